@@ -0,0 +1,100 @@
+#include "Buttons.h"
+#include "ScanningLaserProjector.h"
+
+static const uint8_t kButtonQueueSize = 4;
+static const uint8_t kButtonQueueMask = kButtonQueueSize - 1;
+
+static const uint8_t kButtonPins[kNumButtons] = { RED_BUTTON_PIN, BLUE_BUTTON_PIN, WHITE_BUTTON_PIN };
+static_assert( (RED_BUTTON_PIN < 8) && (BLUE_BUTTON_PIN < 8) && (WHITE_BUTTON_PIN < 8), "The buttons must be on port D" );
+static const uint8_t kButtonPinMask = (1 << RED_BUTTON_PIN) | (1 << BLUE_BUTTON_PIN) | (1 << WHITE_BUTTON_PIN);
+
+static ButtonEvent buttonQueue[kButtonQueueSize];
+static volatile uint8_t buttonHead = 0; // Written by the interrupt
+static volatile uint8_t buttonTail = 0; // Written by the main loop
+static TaskId buttonTaskId = kInvalidTaskId;
+static uint8_t buttonPins;              // PIND as last seen
+static Ticks buttonLastEdge[kNumButtons];
+
+// Statistics, written by the interrupt
+static uint16_t buttonNumPresses = 0;
+static uint16_t buttonNumBounces = 0;
+static uint16_t buttonNumDropped = 0;
+
+void ButtonsStart( TaskId taskId )
+{
+	buttonTaskId = taskId;
+	Ticks now = GetClockMain();
+	cli();
+	buttonPins = PIND;
+	for( uint8_t i = 0; i < kNumButtons; ++i )
+	{
+		buttonLastEdge[i] = now - kButtonDebounceTicks;
+	}
+	PCMSK2 |= kButtonPinMask;
+	PCIFR = (1 << PCIF2); // Clear any stale change
+	PCICR |= (1 << PCIE2);
+	sei();
+}
+
+bool ButtonsPop( ButtonEvent* pEvent )
+{
+	HalCycles( 20 );
+	uint8_t tail = buttonTail;
+	if( tail == buttonHead )
+	{
+		return false;
+	}
+	*pEvent = buttonQueue[tail];
+	buttonTail = (tail + 1) & kButtonQueueMask;
+	return true;
+}
+
+ISR(PCINT2_vect)
+{
+	HalCycles( 20 );
+	Ticks now = GetClockInterrupt();
+	uint8_t pins = PIND;
+	uint8_t changed = (pins ^ buttonPins) & kButtonPinMask;
+	buttonPins = pins;
+	for( uint8_t i = 0; i < kNumButtons; ++i )
+	{
+		HalCycles( 8 );
+		uint8_t mask = 1 << kButtonPins[i];
+		if( !(changed & mask) )
+		{
+			continue;
+		}
+		// Long enough ago that the difference has wrapped counts as quiet.
+		Ticks sinceLastEdge = now - buttonLastEdge[i];
+		buttonLastEdge[i] = now;
+		if( (pins & mask) || ((sinceLastEdge >= 0) && (sinceLastEdge < kButtonDebounceTicks)) )
+		{
+			++buttonNumBounces;
+			continue;
+		}
+		HalCycles( 20 );
+		++buttonNumPresses;
+		uint8_t head = buttonHead;
+		uint8_t nextHead = (head + 1) & kButtonQueueMask;
+		if( nextHead == buttonTail )
+		{
+			++buttonNumDropped;
+			continue;
+		}
+		buttonQueue[head].m_button = i;
+		buttonQueue[head].m_time = now;
+		buttonHead = nextHead;
+		scheduler.Wake( buttonTaskId );
+	}
+}
+
+void ButtonsPrintReport()
+{
+	Serial.print( F( "Buttons: " ) );
+	Serial.print( buttonNumPresses );
+	Serial.print( F( " presses, " ) );
+	Serial.print( buttonNumBounces );
+	Serial.print( F( " other edges ignored, " ) );
+	Serial.print( buttonNumDropped );
+	Serial.println( F( " dropped" ) );
+}
@@ -0,0 +1,46 @@
+#ifndef BUTTONS_H
+#define BUTTONS_H
+
+#include "Config.h"
+#include "Scheduler.h"
+#include "Timer.h"
+
+// Push buttons on the pin change interrupt, debounced and queued, so the
+// main loop never reads the pins.
+//
+// The buttons are on PD4 to PD6 (pins 4 to 6), which share the PCINT2
+// vector, and pull their pin low when pressed. The interrupt reads PIND once
+// and timestamps every edge. A falling edge on a pin that has been quiet for
+// kButtonDebounceTicks is a press, which is queued and the given task woken.
+// Every edge restarts its pin's quiet time, so the contacts bouncing on
+// press and on release are ignored, and a press gets through on its first
+// edge without waiting for them to settle.
+//
+// The interrupt writes the queue's head and the main loop its tail, so no
+// locking is needed. If the queue is full, presses are dropped and counted.
+
+enum Button
+{
+	kButtonRed,
+	kButtonBlue,
+	kButtonWhite,
+	kNumButtons
+};
+
+struct ButtonEvent
+{
+	uint8_t m_button;
+	Ticks   m_time;   // Of the edge
+};
+
+static const Ticks kButtonDebounceTicks = 10000; // 5ms
+
+// Enable the interrupt, waking 'taskId' when there's a press to collect.
+void ButtonsStart( TaskId taskId );
+
+// Take the oldest press off the queue. Returns false if there isn't one.
+bool ButtonsPop( ButtonEvent* pEvent );
+
+void ButtonsPrintReport();
+
+#endif
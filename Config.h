@@ -0,0 +1,211 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <Arduino.h>
+
+// Build options. Each can be overridden from the compiler command line.
+
+// Spend SRAM on the options below that need it. Off by default for parts
+// with no more than the ATmega328P's 2KB, where the canvas alone takes half.
+// The simulator has it on; build it with this 0 to try the 328P's defaults,
+// as make check does. That the 328P's defaults fit is an estimate from host
+// symbol sizes, not yet checked with avr-size.
+#ifndef SLP_LARGE_SRAM
+#if defined(SLP_SIMULATOR) || (RAMEND > 0x8FF)
+#define SLP_LARGE_SRAM 1
+#else
+#define SLP_LARGE_SRAM 0
+#endif
+#endif
+
+// Projector geometry (see Geometry.h). The scan kernels are generated for
+// these at compile time, so a build for a different drum or number of lasers
+// costs nothing at run time.
+// Lasers, 1 to 8, on the low bits of PORTB from pin 8. Only 6 of PORTB's
+// pins are free on an ATmega328P.
+#ifndef SLP_NUM_LASERS
+#define SLP_NUM_LASERS 4
+#endif
+
+// Mirrors on the drum, 8 to 32. Each draws one scan-line per laser.
+#ifndef SLP_NUM_MIRRORS
+#define SLP_NUM_MIRRORS 16
+#endif
+
+// Pixels across a scan-line. A multiple of 8, up to 248.
+#ifndef SLP_WIDTH
+#define SLP_WIDTH 128
+#endif
+
+// The raster line that each mirror in turn draws, as an initialiser list,
+// e.g. -DSLP_MIRROR_TO_RASTER=0,2,4,6,1,3,5,7
+// Defaults to the measured order of the 16 mirror drum, and to mirror n
+// drawing line n for any other drum.
+//#define SLP_MIRROR_TO_RASTER
+
+// Scan out of a pre-transposed buffer of laser nybbles (see ScanBuffer.h)
+// instead of gathering bits from the canvas for every pixel. The buffer is
+// (kNumMirrors + SLP_SPARE_SCAN_LINES) scan-lines of 64 bytes at the default
+// geometry, 2KB with the default spares, on top of the 1KB canvas. So it is
+// only on by default with SLP_LARGE_SRAM.
+//
+// Without it, as on the ATmega328P, there is no tear-free swap: the canvas
+// is scanned out as it is drawn into, and a revolution can show part of a
+// change. The ~200 bytes left there are too few to stage canvas rows in.
+#ifndef SLP_TRANSPOSED_SCAN_BUFFER
+#define SLP_TRANSPOSED_SCAN_BUFFER SLP_LARGE_SRAM
+#endif
+
+// Spare scan-lines in the transposed buffer that changes are staged into,
+// so they can be swapped in between revolutions without tearing (64 bytes
+// each at the default geometry). SLP_NUM_MIRRORS gives full double
+// buffering. Fewer saves SRAM, but a change touching more scan-lines than
+// that is presented over several revolutions. 0 rebuilds lines in place.
+#ifndef SLP_SPARE_SCAN_LINES
+#define SLP_SPARE_SCAN_LINES 16
+#endif
+
+// Pace the pixels of a scan-line with the Timer1 compare B interrupt (see
+// PixelClock.h) rather than busy-waiting in horizontalScan. Needs the
+// transposed scan buffer.
+#ifndef SLP_TIMER_PIXEL_CLOCK
+#define SLP_TIMER_PIXEL_CLOCK 0
+#endif
+
+// Space the pixel clock's pixels for a flat screen rather than evenly in
+// time (see FTheta.h), so they don't spread out towards the ends of the
+// line. 4 bytes a pixel of SRAM, for two tables. Needs SLP_TIMER_PIXEL_CLOCK.
+#ifndef SLP_F_THETA
+#define SLP_F_THETA SLP_TIMER_PIXEL_CLOCK
+#endif
+
+// Scroll text across the display from a ring of scan-lines one scan byte
+// wider than the display (see Marquee.h), rendering one new column a
+// revolution instead of redrawing. 65 bytes a scan-line at the default
+// geometry. Needs the transposed scan buffer, without the pixel clock.
+#ifndef SLP_MARQUEE
+#define SLP_MARQUEE 0
+#endif
+
+// Only scan out the spans of each scan-line that have lasers lit (see
+// ScanBuffer.h), and give the time of the blank ones to background work.
+// Needs the transposed scan buffer, and doesn't apply to the marquee.
+#ifndef SLP_SPARSE_SCAN
+#define SLP_SPARSE_SCAN (SLP_TRANSPOSED_SCAN_BUFFER && !SLP_MARQUEE)
+#endif
+
+// Size of the ring of timing events (see Trace.h), 7 bytes each. A power of
+// 2, up to 128. 0 compiles the trace out, which is the default without
+// SLP_LARGE_SRAM; 8 fits a short trace in about 60 bytes.
+#ifndef SLP_TRACE_EVENTS
+#if SLP_LARGE_SRAM
+#define SLP_TRACE_EVENTS 32
+#else
+#define SLP_TRACE_EVENTS 0
+#endif
+#endif
+
+// Size of the ring of log records waiting to be sent (see Log.h), in bytes,
+// 64 or 128. 0 compiles logging out.
+#ifndef SLP_LOG_BYTES
+#define SLP_LOG_BYTES 64
+#endif
+
+// The most detailed log messages compiled in: 0 errors, 1 warnings, 2 info,
+// 3 debug. SLP_LOG_LEVEL_<subsystem> sets a subsystem's level on its own.
+#ifndef SLP_LOG_LEVEL
+#define SLP_LOG_LEVEL 2
+#endif
+#ifndef SLP_LOG_LEVEL_SYNC
+#define SLP_LOG_LEVEL_SYNC SLP_LOG_LEVEL
+#endif
+#ifndef SLP_LOG_LEVEL_SCAN
+#define SLP_LOG_LEVEL_SCAN SLP_LOG_LEVEL
+#endif
+#ifndef SLP_LOG_LEVEL_INPUT
+#define SLP_LOG_LEVEL_INPUT SLP_LOG_LEVEL
+#endif
+#ifndef SLP_LOG_LEVEL_STORAGE
+#define SLP_LOG_LEVEL_STORAGE SLP_LOG_LEVEL
+#endif
+#ifndef SLP_LOG_LEVEL_TIMER
+#define SLP_LOG_LEVEL_TIMER SLP_LOG_LEVEL
+#endif
+
+// Accept frames streamed over Serial (see Upload.h). Costs about 90 bytes
+// of SRAM, so it is only on by default with SLP_LARGE_SRAM.
+#ifndef SLP_SERIAL_UPLOAD
+#define SLP_SERIAL_UPLOAD SLP_LARGE_SRAM
+#endif
+
+// Send snapshots of the canvas over Serial on request (see Snapshot.h), a
+// row at a time in the gaps between scan-lines. About 10 bytes of SRAM, and
+// only on by default with SLP_LARGE_SRAM.
+#ifndef SLP_SNAPSHOT
+#define SLP_SNAPSHOT SLP_LARGE_SRAM
+#endif
+
+// Slots in EEPROM for each record of settings (see Store.h). Each save goes
+// in the next, so more slots spread the wear further. About 460 bytes of
+// EEPROM at 8.
+#ifndef SLP_STORE_SLOTS
+#define SLP_STORE_SLOTS 8
+#endif
+
+// When scan-lines can't start on time, skip them and drop to a lower
+// quality level (see Quality.h) rather than losing sync.
+#ifndef SLP_ADAPTIVE_QUALITY
+#define SLP_ADAPTIVE_QUALITY 1
+#endif
+
+// Grayscale on the last SLP_GRAY_LASERS lasers, with SLP_GRAY_BITS bits per
+// pixel (see Gray.h). 2 to 4, or 0 for none. Each revolution shows one
+// bit-plane, so the levels flicker at the drum speed / (2^bits - 1).
+// The planes take SLP_GRAY_BITS * SLP_GRAY_LASERS * SLP_NUM_MIRRORS rows of
+// SLP_WIDTH / 8 bytes, halved by SLP_GRAY_HALF_WIDTH: 256 bytes for 2 bits
+// on one laser at half width.
+#ifndef SLP_GRAY_BITS
+#define SLP_GRAY_BITS 0
+#endif
+
+#ifndef SLP_GRAY_LASERS
+#define SLP_GRAY_LASERS 1
+#endif
+
+// Grayscale pixels are 2 laser pixels wide.
+#ifndef SLP_GRAY_HALF_WIDTH
+#define SLP_GRAY_HALF_WIDTH 1
+#endif
+
+// Drum motor PWM duty on pin 3, 0 to 255. The drum runs open loop at this
+// without SLP_DRUM_SPEED_CONTROL, and it's where the speed controller starts
+// from with it.
+#ifndef SLP_DRUM_PWM
+#define SLP_DRUM_PWM 105
+#endif
+
+// Hold the drum at SLP_DRUM_RPM by adjusting the PWM duty (see DrumSpeed.h).
+#ifndef SLP_DRUM_SPEED_CONTROL
+#define SLP_DRUM_SPEED_CONTROL 1
+#endif
+
+#ifndef SLP_DRUM_RPM
+#define SLP_DRUM_RPM 1000
+#endif
+
+// Pool entries in a TileCanvas, 9 bytes each, on top of a byte per 8x8 tile
+// of the canvas: about 720 bytes at the default geometry, against 1KB for a
+// GFXcanvas1. Only tiles that are neither blank nor full take an entry, and
+// identical tiles share one. A screen of dense text needs about 90, and
+// what doesn't fit is dropped (see TileCanvas::GetNumDroppedPixels).
+#ifndef SLP_TILE_POOL
+#define SLP_TILE_POOL 64
+#endif
+
+// SRAM for the rows of a GlyphCache's glyphs, 2 bytes per row: about 20
+// bytes a glyph for FreeMono9pt7b.
+#ifndef SLP_GLYPH_CACHE_BYTES
+#define SLP_GLYPH_CACHE_BYTES 448
+#endif
+
+#endif
@@ -0,0 +1,186 @@
+#include "DelayModel.h"
+#include "Geometry.h"
+#include "Reciprocal.h"
+#include "Store.h"
+
+static_assert( sizeof( DelayCoefficients ) == kStoreRecordBytes[kStoreDelayModel], "The stored delay record is the wrong size" );
+
+static const uint8_t kScanReciprocalShift = 18;
+static const uint8_t kDelayReciprocalShift = 15;
+
+// Scan-lines are checked once there's been at least a revolution's worth
+// of pixels, and corrected if they're out by 1/2^kCorrectionShift.
+static const uint32_t kMinCheckPixels = (uint32_t) kWidth * kNumMirrors;
+static const uint8_t kCorrectionShift = 6;
+
+static const char* const kDelaySourceNames[kNumDelaySources] = { "none", "stored", "measured" };
+
+DelayModel::DelayModel()
+: m_source( kDelaySourceNone ), m_scanRange( 1 ), m_scanReciprocal( 0 ), m_pixelBase( 0 ), m_pixelPerCount( 0 )
+, m_delayRange( 1 ), m_delayReciprocal( 0 ), m_maxDelayUs( 0 ), m_scanCount( 0 ), m_pixelPeriod( 0 )
+, m_numRevolutions( 0 ), m_measuredTicks( 0 ), m_expectedTicks( 0 ), m_numPixels( 0 )
+, m_checkMeasuredTicks( 0 ), m_checkExpectedTicks( 0 ), m_checkNumPixels( 0 ), m_lastError( 0 )
+, m_numChecks( 0 ), m_numCorrections( 0 )
+{
+	m_coefficients.m_minScanUs = 0;
+	m_coefficients.m_maxScanUs = 0;
+	m_coefficients.m_interBitExtra = 0;
+	m_coefficients.m_smallDelayUs = 0;
+	m_coefficients.m_largeDelayUs = 0;
+}
+
+void DelayModel::Set( const DelayCoefficients& coefficients, DelaySource source )
+{
+	HalCycles( 2000 ); // The divisions for the pixel period and the longest delay
+	m_coefficients = coefficients;
+	m_source = source;
+
+	// A measurement with no slope would leave nothing to divide by
+	m_scanRange = (coefficients.m_maxScanUs > coefficients.m_minScanUs) ? coefficients.m_maxScanUs - coefficients.m_minScanUs : 1;
+	m_scanReciprocal = computeReciprocal( m_scanRange, kMaxScanCountLog2, kScanReciprocalShift );
+	// Microseconds to 1/256ths of a tick is 2^9
+	m_pixelBase = ((uint32_t) coefficients.m_minScanUs << 9) / kWidth;
+	m_pixelPerCount = ((uint32_t) m_scanRange << 9) / ((uint32_t) kWidth << kMaxScanCountLog2);
+
+	m_delayRange = (coefficients.m_largeDelayUs > coefficients.m_smallDelayUs) ? coefficients.m_largeDelayUs - coefficients.m_smallDelayUs : 1;
+	m_delayReciprocal = computeReciprocal( m_delayRange, kLargeDelayCountLog2, kDelayReciprocalShift );
+	m_maxDelayUs = coefficients.m_smallDelayUs + (MicroSeconds) ((((uint32_t) 0xffff - kSmallDelayCount) * m_delayRange) >> kLargeDelayCountLog2);
+
+	SetScanCount( m_scanCount );
+}
+
+static bool isWithin( Ticks measured, Ticks expected, uint8_t shift )
+{
+	Ticks difference = measured - expected;
+	return ((difference < 0) ? -difference : difference) <= (expected >> shift);
+}
+
+bool DelayModel::Check( uint16_t count, Ticks scanTicks, Ticks delayTicks ) const
+{
+	return isWithin( scanTicks, MicroSecondsToTicks( GetScanDuration( count ) ), 5 ) &&
+		isWithin( delayTicks, MicroSecondsToTicks( m_coefficients.m_largeDelayUs ), 5 );
+}
+
+uint16_t DelayModel::CountForScan( MicroSeconds duration ) const
+{
+	if( duration <= m_coefficients.m_minScanUs )
+	{
+		return 0;
+	}
+	if( duration >= (MicroSeconds) m_coefficients.m_minScanUs + m_scanRange )
+	{
+		return kMaxScanCount;
+	}
+	return (uint16_t) divideByReciprocal( duration - m_coefficients.m_minScanUs, kMaxScanCountLog2,
+		m_scanRange, m_scanReciprocal, kScanReciprocalShift );
+}
+
+MicroSeconds DelayModel::GetScanDuration( uint16_t count ) const
+{
+	HalCycles( 40 );
+	return m_coefficients.m_minScanUs + (MicroSeconds) (((uint32_t) m_scanRange * count) >> kMaxScanCountLog2);
+}
+
+void DelayModel::SetScanCount( uint16_t count )
+{
+	HalCycles( 40 ); // 16 by 32-bit multiply
+	m_scanCount = count;
+	m_pixelPeriod = m_pixelBase + (count * m_pixelPerCount);
+}
+
+uint16_t DelayModel::CountForDelay( MicroSeconds duration ) const
+{
+	if( duration < m_coefficients.m_smallDelayUs )
+	{
+		duration = m_coefficients.m_smallDelayUs;
+	}
+	else if( duration > m_maxDelayUs )
+	{
+		duration = m_maxDelayUs;
+	}
+	return kSmallDelayCount + (uint16_t) divideByReciprocal( duration - m_coefficients.m_smallDelayUs, kLargeDelayCountLog2,
+		m_delayRange, m_delayReciprocal, kDelayReciprocalShift );
+}
+
+void DelayModel::NoteScan( uint16_t numPixels, Ticks ticks )
+{
+	HalCycles( 60 ); // 16 by 32-bit multiply, and the sums
+	m_measuredTicks += ticks;
+	m_expectedTicks += (numPixels * m_pixelPeriod) >> 8;
+	m_numPixels += numPixels;
+}
+
+bool DelayModel::EndRevolution()
+{
+	HalCycles( 10 );
+	if( ++m_numRevolutions < kCheckRevolutions )
+	{
+		return false;
+	}
+	HalCycles( 40 ); // Copying the sums
+	m_numRevolutions = 0;
+	bool isCheckDue = (m_numPixels >= kMinCheckPixels);
+	if( isCheckDue )
+	{
+		m_checkMeasuredTicks = m_measuredTicks;
+		m_checkExpectedTicks = m_expectedTicks;
+		m_checkNumPixels = m_numPixels;
+	}
+	m_measuredTicks = 0;
+	m_expectedTicks = 0;
+	m_numPixels = 0;
+	return isCheckDue;
+}
+
+bool DelayModel::CheckScans()
+{
+	// Microseconds a scan-line, from ticks over the number of scan-lines'
+	// worth of pixels, in halves.
+	HalCycles( 2 * 650 ); // 32-bit divisions
+	int32_t error = (int32_t) (m_checkMeasuredTicks - m_checkExpectedTicks) / (int32_t) ((m_checkNumPixels << 1) / kWidth);
+	error = (error < -0x7fff) ? -0x7fff : ((error > 0x7fff) ? 0x7fff : error);
+	m_lastError = (int16_t) error;
+	++m_numChecks;
+	int32_t minScanUs = (int32_t) m_coefficients.m_minScanUs + error;
+	int32_t maxScanUs = minScanUs + m_scanRange;
+	if( ((((error < 0) ? -error : error) << kCorrectionShift) <= GetScanDuration( m_scanCount )) ||
+		(minScanUs < 0) || (maxScanUs > 0xffff) )
+	{
+		return false;
+	}
+	DelayCoefficients corrected = m_coefficients;
+	corrected.m_minScanUs = (uint16_t) minScanUs;
+	corrected.m_maxScanUs = (uint16_t) maxScanUs;
+	Set( corrected, (DelaySource) m_source );
+	++m_numCorrections;
+	// What's been noted so far this revolution was predicted by the old
+	// model, so start again from the next.
+	m_numRevolutions = 0;
+	m_measuredTicks = 0;
+	m_expectedTicks = 0;
+	m_numPixels = 0;
+	return true;
+}
+
+void DelayModel::PrintReport() const
+{
+	Serial.print( F( "Delays: " ) );
+	Serial.print( kDelaySourceNames[m_source] );
+	Serial.print( F( ", scan-line " ) );
+	Serial.print( m_coefficients.m_minScanUs );
+	Serial.print( F( " to " ) );
+	Serial.print( m_coefficients.m_maxScanUs );
+	Serial.print( F( "us, inter-bit extra " ) );
+	Serial.print( m_coefficients.m_interBitExtra );
+	Serial.print( F( ", short delay " ) );
+	Serial.print( m_coefficients.m_smallDelayUs );
+	Serial.print( F( " to " ) );
+	Serial.print( m_coefficients.m_largeDelayUs );
+	Serial.print( F( "us, " ) );
+	Serial.print( m_numChecks );
+	Serial.print( F( " checks, " ) );
+	Serial.print( m_numCorrections );
+	Serial.print( F( " corrections, last off by " ) );
+	Serial.print( m_lastError );
+	Serial.println( F( "us" ) );
+}
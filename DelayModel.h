@@ -0,0 +1,138 @@
+#ifndef DELAY_MODEL_H
+#define DELAY_MODEL_H
+
+#include "Config.h"
+#include "Timer.h"
+
+// How long the busy-wait delay loops take, as measured on the projector
+// itself rather than hard coded, so that a change of compiler, clock or scan
+// kernel doesn't leave the scan-lines the wrong length.
+//
+// Both delays are linear in their count. A scan-line takes m_minScanUs with
+// a count of 0 between its pixels, plus an equal share of m_maxScanUs -
+// m_minScanUs for each count up to kMaxScanCount. shortDelay() takes
+// m_smallDelayUs at kSmallDelayCount, and m_largeDelayUs at kLargeDelayCount.
+// Pixels within a byte are given m_interBitExtra more counts than the last
+// pixel of a byte, which waits while the next byte is loaded.
+//
+// The sketch times the kernels at startup, scanning with the lasers held
+// off, and fits these (see measureDelays()). They're stored, and on later
+// startups only checked, at the count that's near what the drum needs.
+//
+// The model is then checked against the scan-lines actually drawn, which
+// take longer than on the bench by the interrupts that land in them. The
+// measured time of every scan-line, or span of one, is summed against what
+// the model predicted for it, and every kCheckRevolutions revolutions,
+// if they differ by more than 1/64 of a scan-line, both scan-line times are
+// moved by the difference. It's only the count around the drum speed that's
+// ever checked like this, so the slope stays as it was measured. The
+// revolution boundary only sets the sums aside, and the comparison, with its
+// divisions, is left to a background task, so the next revolution picks up
+// any correction.
+//
+// The conversions made at each revolution boundary multiply by reciprocals
+// (see Reciprocal.h), which take a division each to work out again whenever
+// the coefficients change. That's rarely.
+struct DelayCoefficients
+{
+	uint16_t m_minScanUs;
+	uint16_t m_maxScanUs;
+	uint16_t m_interBitExtra;
+	uint16_t m_smallDelayUs;
+	uint16_t m_largeDelayUs;
+};
+
+// Where the coefficients in use came from.
+enum DelaySource
+{
+	kDelaySourceNone,       // Not yet Set
+	kDelaySourceStored,     // From the store, and checked at startup
+	kDelaySourceMeasured,   // Measured at startup
+	kNumDelaySources
+};
+
+class DelayModel
+{
+public:
+	static const uint8_t  kMaxScanCountLog2 = 8;
+	static const uint16_t kMaxScanCount = 1 << kMaxScanCountLog2;
+	static const uint16_t kSmallDelayCount = 64;
+	static const uint8_t  kLargeDelayCountLog2 = 12;
+	static const uint16_t kLargeDelayCount = (1 << kLargeDelayCountLog2) + kSmallDelayCount;
+	static const uint8_t  kCheckRevolutions = 64;
+
+	// Approximate AVR cost of CheckScans, with its divisions and a Set().
+	static const Ticks kCheckScansTicks = ((2 * 650) + 10 + 2000 + (2 * 650) + 40 + 40) >> 3;
+
+	// Set() before use.
+	DelayModel();
+
+	void Set( const DelayCoefficients& coefficients, DelaySource source );
+	const DelayCoefficients& Get() const { return m_coefficients; }
+
+	// True if a scan-line at 'count' taking 'scanTicks', and a shortDelay()
+	// of kLargeDelayCount taking 'delayTicks', are within 1/32 of the model.
+	bool Check( uint16_t count, Ticks scanTicks, Ticks delayTicks ) const;
+
+	// Count for scan-lines lasting 'duration', and how long they last at
+	// 'count'.
+	uint16_t CountForScan( MicroSeconds duration ) const;
+	MicroSeconds GetScanDuration( uint16_t count ) const;
+
+	// The count that scan-lines are being drawn at, which the checks
+	// against them are made at.
+	void     SetScanCount( uint16_t count );
+	uint16_t GetScanCount() const { return m_scanCount; }
+
+	// Time per pixel at the current count, in 1/256ths of a tick.
+	uint32_t GetPixelPeriod() const { return m_pixelPeriod; }
+
+	// Count for a shortDelay() lasting 'duration'.
+	uint16_t CountForDelay( MicroSeconds duration ) const;
+
+	// 'numPixels' of a scan-line were scanned out in 'ticks'.
+	void NoteScan( uint16_t numPixels, Ticks ticks );
+
+	// Call at the end of each revolution drawn. Returns true once there's a
+	// check due for CheckScans().
+	bool EndRevolution();
+
+	// Compare the scan-lines set aside by EndRevolution() with the model,
+	// and correct it if they're too far out. Returns true if it has been
+	// corrected, so should be saved.
+	bool CheckScans();
+
+	// The last difference found, in microseconds a scan-line.
+	int16_t GetLastError() const { return m_lastError; }
+
+	void PrintReport() const;
+
+private:
+	DelayCoefficients m_coefficients;
+	uint8_t  m_source;
+	uint16_t m_scanRange;         // m_maxScanUs - m_minScanUs
+	uint32_t m_scanReciprocal;
+	uint32_t m_pixelBase;         // 1/256ths of a tick a pixel, at count 0
+	uint32_t m_pixelPerCount;     // and for each count
+	uint16_t m_delayRange;        // m_largeDelayUs - m_smallDelayUs
+	uint32_t m_delayReciprocal;
+	MicroSeconds m_maxDelayUs;    // The longest with a count in 16 bits
+	uint16_t m_scanCount;
+	uint32_t m_pixelPeriod;
+
+	// Checking
+	uint8_t  m_numRevolutions;    // Towards kCheckRevolutions
+	uint32_t m_measuredTicks;
+	uint32_t m_expectedTicks;
+	uint32_t m_numPixels;
+	uint32_t m_checkMeasuredTicks; // Set aside for CheckScans()
+	uint32_t m_checkExpectedTicks;
+	uint32_t m_checkNumPixels;
+	int16_t  m_lastError;
+
+	// Statistics
+	uint16_t m_numChecks;
+	uint16_t m_numCorrections;
+};
+
+#endif
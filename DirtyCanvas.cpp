@@ -0,0 +1,138 @@
+#include "DirtyCanvas.h"
+#include "Hal.h"
+
+#if SLP_TRANSPOSED_SCAN_BUFFER
+// A clean row has its first dirty byte after its last.
+static const uint8_t kCleanFirstByte = 0xff;
+static const uint8_t kCleanLastByte = 0;
+#endif
+
+DirtyCanvas::DirtyCanvas()
+: GFXcanvas1( kWidth, kHeight ), m_dirtyScanLines( 0 )
+{
+#if SLP_TRANSPOSED_SCAN_BUFFER
+	memset( m_firstByte, kCleanFirstByte, sizeof( m_firstByte ) );
+	memset( m_lastByte, kCleanLastByte, sizeof( m_lastByte ) );
+#endif
+}
+
+void DirtyCanvas::MarkDirtyRect( uint8_t firstByte, uint8_t lastByte, uint8_t y, uint16_t height )
+{
+	uint8_t scanLineIdx = y % kNumMirrors;
+	for( ; height; --height, ++y )
+	{
+#if SLP_TRANSPOSED_SCAN_BUFFER
+		HalCycles( 12 );
+		if( firstByte < m_firstByte[y] )
+		{
+			m_firstByte[y] = firstByte;
+		}
+		if( lastByte > m_lastByte[y] )
+		{
+			m_lastByte[y] = lastByte;
+		}
+#else
+		HalCycles( 6 );
+		(void) firstByte;
+		(void) lastByte;
+#endif
+		m_dirtyScanLines |= (ScanLineMask) 1 << scanLineIdx;
+		if( ++scanLineIdx == kNumMirrors )
+		{
+			scanLineIdx = 0;
+		}
+	}
+}
+
+void DirtyCanvas::MarkDirtyBytes( uint16_t byteOffset, uint16_t numBytes )
+{
+	while( numBytes )
+	{
+		uint8_t y = byteOffset / kWidthBytes;
+		uint8_t firstByte = byteOffset - (y * kWidthBytes);
+		uint8_t rowBytes = ((firstByte + numBytes) > kWidthBytes) ? (kWidthBytes - firstByte) : (uint8_t) numBytes;
+		MarkDirtyRect( firstByte, firstByte + rowBytes - 1, y, 1 );
+		byteOffset += rowBytes;
+		numBytes -= rowBytes;
+	}
+}
+
+void DirtyCanvas::markPixels( int16_t x, int16_t y, int16_t w, int16_t h )
+{
+	int16_t right = x + w;
+	int16_t bottom = y + h;
+	if( x < 0 )
+	{
+		x = 0;
+	}
+	if( y < 0 )
+	{
+		y = 0;
+	}
+	if( right > kWidth )
+	{
+		right = kWidth;
+	}
+	if( bottom > (int16_t) kHeight )
+	{
+		bottom = kHeight;
+	}
+	if( (x < right) && (y < bottom) )
+	{
+		MarkDirtyRect( x >> 3, (right - 1) >> 3, y, bottom - y );
+	}
+}
+
+void DirtyCanvas::drawPixel( int16_t x, int16_t y, uint16_t color )
+{
+	markPixels( x, y, 1, 1 );
+	GFXcanvas1::drawPixel( x, y, color );
+}
+
+void DirtyCanvas::drawFastHLine( int16_t x, int16_t y, int16_t w, uint16_t color )
+{
+	markPixels( x, y, w, 1 );
+	GFXcanvas1::drawFastHLine( x, y, w, color );
+}
+
+void DirtyCanvas::drawFastVLine( int16_t x, int16_t y, int16_t h, uint16_t color )
+{
+	markPixels( x, y, 1, h );
+	GFXcanvas1::drawFastVLine( x, y, h, color );
+}
+
+void DirtyCanvas::fillRect( int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color )
+{
+	// Mark the whole rect once, rather than each line of it.
+	markPixels( x, y, w, h );
+	for( int16_t row = y; row < (y + h); ++row )
+	{
+		GFXcanvas1::drawFastHLine( x, row, w, color );
+	}
+}
+
+void DirtyCanvas::fillScreen( uint16_t color )
+{
+	MarkAllDirty();
+	GFXcanvas1::fillScreen( color );
+}
+
+void DirtyCanvas::ClearDirty()
+{
+#if SLP_TRANSPOSED_SCAN_BUFFER
+	ScanLineMask dirtyScanLines = m_dirtyScanLines;
+	for( uint8_t scanLineIdx = 0; dirtyScanLines; ++scanLineIdx, dirtyScanLines >>= 1 )
+	{
+		if( dirtyScanLines & 1 )
+		{
+			HalCycles( 8 * kNumLasers );
+			for( uint16_t y = scanLineIdx; y < kHeight; y += kNumMirrors )
+			{
+				m_firstByte[y] = kCleanFirstByte;
+				m_lastByte[y] = kCleanLastByte;
+			}
+		}
+	}
+#endif
+	m_dirtyScanLines = 0;
+}
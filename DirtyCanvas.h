@@ -0,0 +1,65 @@
+#ifndef DIRTY_CANVAS_H
+#define DIRTY_CANVAS_H
+
+#include "Config.h"
+#include "Geometry.h"
+#include <Adafruit_GFX.h>
+
+// A GFXcanvas1 that remembers which parts of it have been drawn into, so that
+// anything derived from the canvas only needs to redo what changed.
+//
+// For each scan-line (row % kNumMirrors, whichever laser draws it) it keeps a
+// dirty bit. With the transposed scan buffer it also keeps the span of canvas
+// bytes touched in each row, 2 bytes per row, so ScanBuffer only rebuilds
+// those; without it nothing reads them, so they're left out.
+//
+// Drawing through the Adafruit_GFX calls marks itself; code that writes to
+// getBuffer() directly must call MarkDirtyBytes or MarkDirtyRect.
+//
+// Consumers read the dirty state in CanvasChanged() and then ClearDirty(), so
+// a frame that draws nothing costs almost nothing to present. Only rotation 0
+// is supported.
+class DirtyCanvas : public GFXcanvas1
+{
+public:
+	DirtyCanvas();
+
+	void drawPixel( int16_t x, int16_t y, uint16_t color ) override;
+	void drawFastHLine( int16_t x, int16_t y, int16_t w, uint16_t color ) override;
+	void drawFastVLine( int16_t x, int16_t y, int16_t h, uint16_t color ) override;
+	void fillRect( int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color ) override;
+	void fillScreen( uint16_t color ) override;
+
+	// Mark numBytes of the buffer from byteOffset, which may span rows.
+	void MarkDirtyBytes( uint16_t byteOffset, uint16_t numBytes );
+	// Mark bytes firstByte to lastByte inclusive of rows y to y + height - 1.
+	void MarkDirtyRect( uint8_t firstByte, uint8_t lastByte, uint8_t y, uint16_t height );
+	void MarkAllDirty() { MarkDirtyRect( 0, kWidthBytes - 1, 0, kHeight ); }
+
+	bool         IsDirty() const { return m_dirtyScanLines != 0; }
+	ScanLineMask GetDirtyScanLines() const { return m_dirtyScanLines; }
+#if SLP_TRANSPOSED_SCAN_BUFFER
+	bool         IsRowDirty( uint8_t y ) const { return m_firstByte[y] <= m_lastByte[y]; }
+	// The span of dirty bytes in a row. Only meaningful if IsRowDirty.
+	uint8_t      GetFirstDirtyByte( uint8_t y ) const { return m_firstByte[y]; }
+	uint8_t      GetLastDirtyByte( uint8_t y ) const { return m_lastByte[y]; }
+#endif
+
+	// Forget everything marked so far. Costs nothing for clean scan-lines.
+	void ClearDirty();
+
+	// Approximate AVR cost of ClearDirty with every row dirty, 8 cycles a row.
+	static const uint16_t kClearDirtyTicks = kHeight;
+
+private:
+	// Clip a rectangle of pixels to the canvas, and mark it.
+	void markPixels( int16_t x, int16_t y, int16_t w, int16_t h );
+
+#if SLP_TRANSPOSED_SCAN_BUFFER
+	uint8_t      m_firstByte[kHeight];
+	uint8_t      m_lastByte[kHeight];
+#endif
+	ScanLineMask m_dirtyScanLines;
+};
+
+#endif
@@ -0,0 +1,193 @@
+#include "DrumSpeed.h"
+#include "Trace.h"
+
+// Ticks per revolution at the target speed: 2,000,000 ticks a second.
+static const Ticks kTargetPeriod = 120000000L / SLP_DRUM_RPM;
+
+static const uint8_t kMaxDuty = 255;
+
+// Spin up flat out until the period is within this of the target.
+static const Ticks kSpinUpTolerance = kTargetPeriod >> 3;
+
+// Period errors are clamped to this.
+static const Ticks kMaxError = kTargetPeriod >> 3;
+
+// An interval more than 1/8 away from the last one accepted is ignored,
+// unless it and the two raw intervals before it each differ by less than
+// that from the one before. A missing or spurious edge can't give three like
+// that in a row, so then the drum's speed has really changed. Spinning up,
+// the speed changes too fast for that, and the duty is flat out whatever, so
+// each interval is just compared with the one before.
+static const uint8_t kIntervalChangeShift = 3;
+
+// Gains in duty per unit of fractional speed error, tuned against the
+// simulator's motor model (slpsim --motor) with a 1s time constant. The
+// integral gain is per revolution.
+static const int32_t kProportionalGain = 400;
+static const int32_t kIntegralGain = 48;
+
+// The same, in 16.16 duty per tick of period error.
+static const int32_t kProportionalGainPerTick = (kProportionalGain << 16) / kTargetPeriod;
+static const int32_t kIntegralGainPerTick = (kIntegralGain << 16) / kTargetPeriod;
+static_assert( kIntegralGainPerTick > 0, "SLP_DRUM_RPM is too low for the integral gain's precision" );
+
+// Locked once the period has been this close for this many revolutions.
+static const Ticks kLockTolerance = kTargetPeriod >> 8;
+static const uint8_t kNumRevolutionsToLock = 8;
+
+// The error statistics average over about 2^kStatsShift revolutions, with
+// errors clamped so their squares fit.
+static const uint8_t kStatsShift = 4;
+static const Ticks kMaxStatsError = 2047;
+
+DrumSpeed::DrumSpeed()
+: m_state( kStateSpinUp ), m_duty( kMaxDuty ), m_integral( (int32_t) SLP_DRUM_PWM << 16 ), m_lastInterval( 0 ), m_rawIntervals{ 0, 0 }, m_startTime( 0 )
+, m_numRevolutionsInTolerance( 0 ), m_lockTicks( 0 ), m_meanError( 0 ), m_meanSquareError( 0 ), m_worstError( 0 )
+{
+}
+
+void DrumSpeed::Start( Ticks now, uint8_t primeDuty )
+{
+	m_startTime = now;
+	m_integral = (int32_t) primeDuty << 16;
+	ConfigureTimer2ForPWM( m_duty );
+	TraceEvent( kTracePwm, m_duty, now );
+}
+
+void DrumSpeed::setDuty( uint8_t duty, Ticks now, Ticks error )
+{
+	if( duty != m_duty )
+	{
+		m_duty = duty;
+		OCR2B = duty;
+		TraceEvent( kTracePwm, duty, now, error );
+	}
+}
+
+static bool isClose( Ticks a, Ticks b )
+{
+	Ticks difference = a - b;
+	Ticks tolerance = b >> kIntervalChangeShift;
+	return (difference <= tolerance) && (difference >= -tolerance);
+}
+
+void DrumSpeed::Update( Ticks interval, Ticks now )
+{
+	HalCycles( 280 );
+	bool isAccepted = isClose( interval, m_lastInterval )
+		|| (isClose( interval, m_rawIntervals[0] ) && isClose( m_rawIntervals[0], m_rawIntervals[1] ));
+	m_rawIntervals[1] = m_rawIntervals[0];
+	m_rawIntervals[0] = interval;
+	if( isAccepted || (m_state == kStateSpinUp) )
+	{
+		m_lastInterval = interval;
+	}
+	if( !isAccepted )
+	{
+		return;
+	}
+	// Positive when the drum is too slow
+	Ticks error = interval - kTargetPeriod;
+	if( m_state == kStateSpinUp )
+	{
+		if( error > kSpinUpTolerance )
+		{
+			return;
+		}
+		m_state = kStateRegulating;
+	}
+	if( error > kMaxError )
+	{
+		error = kMaxError;
+	}
+	else if( error < -kMaxError )
+	{
+		error = -kMaxError;
+	}
+
+	m_integral += error * kIntegralGainPerTick;
+	if( m_integral < 0 )
+	{
+		m_integral = 0;
+	}
+	else if( m_integral > ((int32_t) kMaxDuty << 16) )
+	{
+		m_integral = (int32_t) kMaxDuty << 16;
+	}
+	int32_t duty = (m_integral + (error * kProportionalGainPerTick)) >> 16;
+	if( duty < 0 )
+	{
+		duty = 0;
+	}
+	else if( duty > kMaxDuty )
+	{
+		duty = kMaxDuty;
+	}
+	setDuty( (uint8_t) duty, now, error );
+	updateStats( error, now );
+}
+
+void DrumSpeed::updateStats( Ticks error, Ticks now )
+{
+	if( !m_lockTicks )
+	{
+		if( (error > kLockTolerance) || (error < -kLockTolerance) )
+		{
+			m_numRevolutionsInTolerance = 0;
+			return;
+		}
+		if( ++m_numRevolutionsInTolerance < kNumRevolutionsToLock )
+		{
+			return;
+		}
+		m_lockTicks = now - m_startTime;
+	}
+
+	if( error > kMaxStatsError )
+	{
+		error = kMaxStatsError;
+	}
+	else if( error < -kMaxStatsError )
+	{
+		error = -kMaxStatsError;
+	}
+	uint16_t absError = (uint16_t) ((error < 0) ? -error : error);
+	if( absError > m_worstError )
+	{
+		m_worstError = absError;
+	}
+	m_meanError += ((error << kStatsShift) - m_meanError) >> kStatsShift;
+	uint32_t squareError = (uint32_t) (error * error);
+	if( squareError >= m_meanSquareError )
+	{
+		m_meanSquareError += (squareError - m_meanSquareError) >> kStatsShift;
+	}
+	else
+	{
+		m_meanSquareError -= (m_meanSquareError - squareError) >> kStatsShift;
+	}
+}
+
+void DrumSpeed::PrintReport() const
+{
+	Serial.print( F( "Drum speed: duty " ) );
+	Serial.print( m_duty );
+	Serial.print( F( ", target " ) );
+	Serial.print( kTargetPeriod );
+	Serial.print( F( " ticks, " ) );
+	if( !m_lockTicks )
+	{
+		Serial.println( F( "not locked" ) );
+		return;
+	}
+	// Variance of the period error, in ticks squared
+	int32_t meanError = m_meanError >> kStatsShift;
+	int32_t variance = (int32_t) m_meanSquareError - (meanError * meanError);
+	Serial.print( F( "locked in " ) );
+	Serial.print( TicksToMicroSeconds( m_lockTicks ) / 1000 );
+	Serial.print( F( "ms, period variance " ) );
+	Serial.print( (variance > 0) ? variance : 0 );
+	Serial.print( F( ", worst error " ) );
+	Serial.print( m_worstError );
+	Serial.println( F( " ticks" ) );
+}
@@ -0,0 +1,75 @@
+#ifndef DRUM_SPEED_H
+#define DRUM_SPEED_H
+
+#include "Config.h"
+#include "Timer.h"
+
+// Holds the mirror drum at SLP_DRUM_RPM with a PI controller on the motor's
+// PWM duty (OCR2B), so the scan interval doesn't wander with the motor.
+//
+// It's given the time between each pair of sync edges. DrumSync's filtered
+// period is no use here, as it's tuned to average out jitter at a steady
+// speed, so lags well behind a change. An interval too far from the last
+// one accepted is taken to be from a missing or spurious edge, and ignored,
+// unless it and the two before it are a steady change.
+//
+// From power on the motor is driven flat out until the drum is within 1/8
+// of the target speed. The PI loop then takes over with its integral term
+// primed at SLP_DRUM_PWM, or the duty it settled at last time if that was
+// saved, so the drum gets up to speed much sooner than it would open loop,
+// without going far past.
+//
+// The gains are scaled to the target period at compile time, so an update is
+// a few multiplies in 16.16 fixed point, with no division. The integral term
+// is clamped to the PWM range so that it can't wind up while the output is
+// saturated.
+//
+// The speed counts as locked once the period has stayed within 1/256 of the
+// target for kNumRevolutionsToLock revolutions. The time that took from
+// Start, and the variance of the period error from then on, are reported.
+class DrumSpeed
+{
+public:
+	DrumSpeed();
+
+	// Set up the PWM and start spinning the drum up, to regulate from
+	// primeDuty.
+	void Start( Ticks now, uint8_t primeDuty = SLP_DRUM_PWM );
+
+	// A sync edge has come in, interval ticks after the one before.
+	void Update( Ticks interval, Ticks now );
+
+	uint8_t GetDuty() const { return m_duty; }
+	// The integral term: the duty that holds the speed, without the
+	// correction for the current error.
+	uint8_t GetSteadyDuty() const { return (uint8_t) (m_integral >> 16); }
+	bool    IsLocked() const { return m_lockTicks != 0; }
+
+	void PrintReport() const;
+
+private:
+	enum State
+	{
+		kStateSpinUp,
+		kStateRegulating
+	};
+
+	void setDuty( uint8_t duty, Ticks now, Ticks error );
+	void updateStats( Ticks error, Ticks now );
+
+	uint8_t  m_state;
+	uint8_t  m_duty;
+	int32_t  m_integral;              // Duty, with 16 fraction bits
+	Ticks    m_lastInterval;          // The last accepted
+	Ticks    m_rawIntervals[2];       // The last two, most recent first
+	Ticks    m_startTime;
+
+	// Statistics
+	uint8_t  m_numRevolutionsInTolerance;
+	Ticks    m_lockTicks;             // From Start to locking, or 0 until then
+	int32_t  m_meanError;             // Moving averages since locking, with
+	uint32_t m_meanSquareError;       // kStatsShift fraction bits on the mean
+	uint16_t m_worstError;
+};
+
+#endif
@@ -0,0 +1,260 @@
+#include "DrumSync.h"
+#include "Trace.h"
+
+// Shortest gap between sensor edges, to ignore contact bounce.
+static const Ticks kDebounceTicks = 200;
+
+// Plausible revolution periods, 120 to 12000 RPM.
+static const Ticks kMinPeriodTicks = 10000;
+static const Ticks kMaxPeriodTicks = 1000000;
+
+// Good edges needed after acquiring before the estimate is trusted.
+static const uint8_t kNumEdgesToLock = 2;
+
+// Missing or outlying edges in a row before giving up and reacquiring.
+// Anything less is coasted over on the prediction.
+static const uint8_t kMaxConsecutiveBad = 3;
+
+// Filter gains, as right shifts, by the number of good edges since
+// acquiring. They start high so the first few edges pull the estimate in
+// quickly, then settle to alpha = 1/4, beta = 1/32 to average out jitter.
+static const uint8_t kNumGainSteps = 8;
+static const uint8_t kAlphaShifts[kNumGainSteps] = { 0, 1, 1, 1, 1, 2, 2, 2 };
+static const uint8_t kBetaShifts[kNumGainSteps]  = { 1, 2, 2, 3, 3, 4, 4, 5 };
+
+DrumSync::DrumSync()
+: m_edgeHead( 0 ), m_edgeTail( 0 ), m_lastPostedEdge( 0 ), m_numQueueOverflows( 0 )
+, m_lastRawEdge( 0 ), m_rawIntervals{ 0, 0 }, m_edgeInterval( 0 )
+, m_state( kStateSearching ), m_lastEdge( 0 ), m_period( 0 ), m_numGoodEdges( 0 ), m_numConsecutiveBad( 0 )
+, m_numEdges( 0 ), m_numOutliers( 0 ), m_numMissed( 0 ), m_numReacquires( 0 )
+{
+}
+
+void DrumSync::PostEdge( Ticks time )
+{
+	if( (time - m_lastPostedEdge) < kDebounceTicks )
+	{
+		return;
+	}
+	m_lastPostedEdge = time;
+	uint8_t head = m_edgeHead;
+	uint8_t nextHead = (head + 1) & (kEdgeQueueSize - 1);
+	if( nextHead == m_edgeTail )
+	{
+		if( m_numQueueOverflows != 0xff )
+		{
+			++m_numQueueOverflows;
+		}
+		return;
+	}
+	m_edges[head] = time;
+	m_edgeHead = nextHead;
+}
+
+bool DrumSync::Update( Ticks now )
+{
+	bool changed = false;
+	// The interrupt doesn't touch a queued edge again until the tail passes it,
+	// so only the head needs to be read atomically.
+	while( m_edgeTail != m_edgeHead )
+	{
+		Ticks edge = m_edges[m_edgeTail];
+		Ticks interval = edge - m_lastRawEdge;
+		if( isSpeedChange( interval ) )
+		{
+			// Track from the edge before at the new period
+			HalCycles( 40 );
+			m_lastEdge = m_lastRawEdge;
+			m_period = interval << kPeriodFractionBits;
+			m_numGoodEdges = 1;
+			m_numConsecutiveBad = 0;
+			++m_numReacquires;
+		}
+		m_rawIntervals[1] = m_rawIntervals[0];
+		m_rawIntervals[0] = interval;
+		m_edgeInterval = interval;
+		m_lastRawEdge = edge;
+		addEdge( edge );
+		m_edgeTail = (m_edgeTail + 1) & (kEdgeQueueSize - 1);
+		changed = true;
+	}
+	while( (m_state == kStateTracking) && ((now - m_lastEdge) > (GetPeriod() + getGate())) )
+	{
+		coast();
+		changed = true;
+	}
+	return changed;
+}
+
+static bool isClose( Ticks a, Ticks b, Ticks tolerance )
+{
+	Ticks difference = a - b;
+	return (difference <= tolerance) && (difference >= -tolerance);
+}
+
+bool DrumSync::isSpeedChange( Ticks interval ) const
+{
+	HalCycles( 30 );
+	if( (m_state != kStateTracking) || (interval < kMinPeriodTicks) || (interval > kMaxPeriodTicks) )
+	{
+		return false;
+	}
+	Ticks tolerance = interval >> 5;
+	Ticks period = GetPeriod();
+	return isClose( interval, m_rawIntervals[0], tolerance ) && isClose( interval, m_rawIntervals[1], tolerance )
+		&& !isClose( interval, period, period >> 4 );
+}
+
+Ticks DrumSync::TakeEdgeInterval()
+{
+	Ticks interval = m_edgeInterval;
+	m_edgeInterval = 0;
+	return interval;
+}
+
+bool DrumSync::IsLocked() const
+{
+	return (m_state == kStateTracking) && (m_numGoodEdges >= kNumEdgesToLock) && (m_numConsecutiveBad < kMaxConsecutiveBad);
+}
+
+Ticks DrumSync::getGate() const
+{
+	// Wide while the period is still rough, then 1/64 of a revolution
+	return GetPeriod() >> ((m_numGoodEdges < 4) ? 3 : 6);
+}
+
+void DrumSync::coast()
+{
+	// Carry on from the predicted edge as though it had arrived on time
+	m_lastEdge += GetPeriod();
+	TraceEvent( kTraceSyncEdge, kTraceEdgeMissed, m_lastEdge );
+	if( m_numMissed != 0xffff )
+	{
+		++m_numMissed;
+	}
+	if( ++m_numConsecutiveBad == kMaxConsecutiveBad )
+	{
+		if( m_numGoodEdges < kNumEdgesToLock )
+		{
+			// Never got going from the old period, so don't try it again
+			m_period = 0;
+		}
+		m_state = kStateSearching;
+		++m_numReacquires;
+	}
+}
+
+void DrumSync::addEdge( Ticks time )
+{
+	HalCycles( 80 );
+	if( m_numEdges != 0xffff )
+	{
+		++m_numEdges;
+	}
+
+	if( m_state == kStateSearching )
+	{
+		TraceEvent( kTraceSyncEdge, kTraceEdgeAcquire, time );
+		m_lastEdge = time;
+		if( m_period )
+		{
+			// Assume the drum has kept its speed through whatever lost us, so
+			// the next edge can confirm the lock.
+			m_state = kStateTracking;
+			m_numGoodEdges = 1;
+			m_numConsecutiveBad = 0;
+		}
+		else
+		{
+			m_state = kStateAcquiring;
+		}
+		return;
+	}
+
+	if( m_state == kStateAcquiring )
+	{
+		TraceEvent( kTraceSyncEdge, kTraceEdgeAcquire, time );
+		Ticks period = time - m_lastEdge;
+		m_lastEdge = time;
+		if( (period >= kMinPeriodTicks) && (period <= kMaxPeriodTicks) )
+		{
+			m_period = period << kPeriodFractionBits;
+			m_state = kStateTracking;
+			m_numGoodEdges = 1;
+			m_numConsecutiveBad = 0;
+		}
+		return;
+	}
+
+	Ticks period = GetPeriod();
+	Ticks gate = getGate();
+	Ticks error = time - (m_lastEdge + period);
+	if( error < -gate )
+	{
+		// Too early to be the next edge, so a glitch
+		TraceEvent( kTraceSyncEdge, kTraceEdgeGlitch, time, error );
+		if( m_numOutliers != 0xffff )
+		{
+			++m_numOutliers;
+		}
+		return;
+	}
+	while( (error > (period >> 1)) && (m_state == kStateTracking) )
+	{
+		// Closer to the edge after, so one went missing
+		coast();
+		error -= period;
+	}
+	if( m_state != kStateTracking )
+	{
+		// Lost it, so start again from this edge
+		addEdge( time );
+		return;
+	}
+	if( error > gate )
+	{
+		TraceEvent( kTraceSyncEdge, kTraceEdgeOutlier, time, error );
+		if( m_numOutliers != 0xffff )
+		{
+			++m_numOutliers;
+		}
+		if( ++m_numConsecutiveBad == kMaxConsecutiveBad )
+		{
+			m_state = kStateSearching;
+			++m_numReacquires;
+			addEdge( time );
+		}
+		return;
+	}
+
+	TraceEvent( kTraceSyncEdge, kTraceEdgeGood, time, error );
+	uint8_t gainIdx = m_numGoodEdges - 1;
+	if( gainIdx >= kNumGainSteps )
+	{
+		gainIdx = kNumGainSteps - 1;
+	}
+	m_lastEdge += period + (error >> kAlphaShifts[gainIdx]);
+	m_period += (error << kPeriodFractionBits) >> kBetaShifts[gainIdx];
+	if( m_numGoodEdges != 0xff )
+	{
+		++m_numGoodEdges;
+	}
+	m_numConsecutiveBad = 0;
+}
+
+void DrumSync::PrintReport() const
+{
+	Serial.print( F( "Drum: period " ) );
+	Serial.print( GetPeriod() );
+	Serial.print( F( " ticks, " ) );
+	Serial.print( m_numEdges );
+	Serial.print( F( " edges, " ) );
+	Serial.print( m_numOutliers );
+	Serial.print( F( " outliers, " ) );
+	Serial.print( m_numMissed );
+	Serial.print( F( " missed, " ) );
+	Serial.print( m_numReacquires );
+	Serial.print( F( " reacquires, " ) );
+	Serial.print( m_numQueueOverflows );
+	Serial.println( F( " overflows" ) );
+}
@@ -0,0 +1,91 @@
+#ifndef DRUM_SYNC_H
+#define DRUM_SYNC_H
+
+#include "Timer.h"
+
+// Tracks the mirror drum's phase and period from the sync sensor edges.
+//
+// The sync interrupt posts edge times into a small queue, and Update works
+// through them with a fixed point alpha-beta filter (a steady state Kalman
+// filter for a drum turning at constant speed). Each edge is compared with
+// the predicted one:
+// - An edge well before the prediction is a glitch, and is ignored.
+// - An edge about a revolution late means a pulse went missing. The filter
+//   steps over the gap and uses the edge as normal.
+// - An edge outside the gate either way is counted as an outlier.
+// If the predicted edge doesn't turn up at all, Update coasts on the
+// prediction, so a single missing pulse doesn't lose sync.
+//
+// After a reacquire the gains start high and settle over a few edges, so the
+// filter locks within a couple of revolutions, while a locked filter averages
+// out the sensor jitter.
+//
+// That makes it slow to follow a change in speed, such as while the drum
+// spins up, and a change faster than the gate would otherwise be rejected
+// edge after edge. So if three intervals between edges in a row agree with
+// each other, but not with the estimated period, it starts tracking again
+// from the raw interval.
+class DrumSync
+{
+public:
+	DrumSync();
+
+	// Called from the sync interrupt.
+	void PostEdge( Ticks time );
+
+	// Process posted edges, and coast over any that are overdue at 'now'.
+	// Returns true if the estimate moved on.
+	bool Update( Ticks now );
+
+	bool IsLocked() const;
+
+	// Estimated time of the most recent sync edge.
+	Ticks GetLastEdge() const { return m_lastEdge; }
+	Ticks GetPeriod() const { return m_period >> kPeriodFractionBits; }
+
+	// Time between the last two sensor edges, trusted or not, if there's been
+	// an edge since the last call. Otherwise 0. For when there's no lock to
+	// give a period, such as while the drum spins up.
+	Ticks TakeEdgeInterval();
+
+	void PrintReport() const;
+
+private:
+	static const uint8_t kEdgeQueueSize = 4;     // Power of 2
+	static const uint8_t kPeriodFractionBits = 8;
+
+	enum State
+	{
+		kStateSearching,  // Waiting for a first edge
+		kStateAcquiring,  // Have one edge, waiting for a second to give a period
+		kStateTracking
+	};
+
+	void  addEdge( Ticks time );
+	bool  isSpeedChange( Ticks interval ) const;
+	void  coast();
+	Ticks getGate() const;
+
+	// Written by the interrupt
+	volatile Ticks   m_edges[kEdgeQueueSize];
+	volatile uint8_t m_edgeHead;
+	uint8_t          m_edgeTail;
+	Ticks            m_lastPostedEdge;
+	uint8_t          m_numQueueOverflows;
+	Ticks            m_lastRawEdge;
+	Ticks            m_rawIntervals[2];   // The last two, most recent first
+	Ticks            m_edgeInterval;
+
+	uint8_t  m_state;
+	Ticks    m_lastEdge;
+	int32_t  m_period;              // Ticks, with kPeriodFractionBits fraction bits
+	uint8_t  m_numGoodEdges;        // Since acquiring, saturates
+	uint8_t  m_numConsecutiveBad;   // Missing or outlying edges in a row
+
+	uint16_t m_numEdges;
+	uint16_t m_numOutliers;
+	uint16_t m_numMissed;
+	uint16_t m_numReacquires;
+};
+
+#endif
@@ -0,0 +1,142 @@
+#include "FTheta.h"
+#include "Hal.h"
+
+// sin, cos and atan by their Taylor series, at compile time. The angles here
+// are at most pi / 8, and the tangents under 0.42, so they converge quickly.
+static constexpr double kPi = 3.14159265358979;
+
+static constexpr double taylorSinCos( double xSq, double term, int n )
+{
+	return (n > 24) ? 0.0 : term + taylorSinCos( xSq, -term * xSq / ((n + 1) * (n + 2)), n + 2 );
+}
+
+static constexpr double taylorTan( double x )
+{
+	return taylorSinCos( x * x, x, 1 ) / taylorSinCos( x * x, 1.0, 0 );
+}
+
+static constexpr double taylorAtan( double xSq, double power, int n )
+{
+	return (n > 79) ? 0.0 : (power / n) - taylorAtan( xSq, power * xSq, n + 2 );
+}
+
+static constexpr double roundTo16( double x )
+{
+	return (x < 0.0) ? -(double) (int16_t) (0.5 - x) : (double) (int16_t) (x + 0.5);
+}
+
+// Half the angle the beam sweeps in a scan-line. The drum turns through
+// 1/kNumMirrors of a revolution each interval, and reflection doubles it.
+static constexpr double halfSweep( bool isShortScan )
+{
+	return isShortScan ? ((3.0 * kPi) / (4.0 * kNumMirrors)) : (kPi / kNumMirrors);
+}
+
+// How far through the scan-line, from 0 to 1, the beam reaches point u of
+// the line on the screen, where u runs from -1 to 1.
+static constexpr double beamPosition( double u, double halfAngle )
+{
+	return 0.5 + (0.5 * taylorAtan( u * u * taylorTan( halfAngle ) * taylorTan( halfAngle ), u * taylorTan( halfAngle ), 1 ) / halfAngle);
+}
+
+// How far pixel n starts from n periods in, in 1/256ths of a period.
+static constexpr int16_t correction( uint16_t pixel, bool isShortScan )
+{
+	return (int16_t) roundTo16( ((beamPosition( ((2.0 * pixel) / kWidth) - 1.0, halfSweep( isShortScan ) ) * kWidth) - pixel) * 256.0 );
+}
+
+// The corrections for pixels 0 to kWidth, generated into a table in flash.
+template< bool kIsShortScan, uint16_t kNum, int16_t... kCorrections > struct FThetaCorrections
+: FThetaCorrections< kIsShortScan, kNum - 1, correction( kNum - 1, kIsShortScan ), kCorrections... > {};
+
+template< bool kIsShortScan, int16_t... kCorrections > struct FThetaCorrections< kIsShortScan, 0, kCorrections... >
+{
+	static const int16_t kTable[sizeof...(kCorrections)];
+};
+
+template< bool kIsShortScan, int16_t... kCorrections >
+const int16_t FThetaCorrections< kIsShortScan, 0, kCorrections... >::kTable[sizeof...(kCorrections)] PROGMEM = { kCorrections... };
+
+typedef FThetaCorrections< false, kWidth + 1 > FullScanCorrections;
+typedef FThetaCorrections< true, kWidth + 1 > ShortScanCorrections;
+
+FThetaTable::FThetaTable()
+: m_front( 0 ), m_numBuilt( 0 )
+{
+	memset( m_offsets, 0, sizeof( m_offsets ) );
+	m_periods[0] = m_periods[1] = 0;
+	m_isShortScans[0] = m_isShortScans[1] = false;
+}
+
+bool FThetaTable::Request( PixelPeriod period, bool isShortScan )
+{
+	HalCycles( 30 );
+	uint8_t back = m_front ^ 1;
+	if( (period == m_periods[m_front]) && (isShortScan == m_isShortScans[m_front]) )
+	{
+		m_periods[back] = 0;
+		m_numBuilt = 0;
+		return false;
+	}
+	if( (period != m_periods[back]) || (isShortScan != m_isShortScans[back]) )
+	{
+		m_periods[back] = period;
+		m_isShortScans[back] = isShortScan;
+		m_numBuilt = 0;
+	}
+	return m_numBuilt <= kWidth;
+}
+
+bool FThetaTable::BuildSlice()
+{
+	HalCycles( 40 );
+	uint8_t back = m_front ^ 1;
+	PixelPeriod period = m_periods[back];
+	if( period == 0 )
+	{
+		return false;
+	}
+#if SLP_ADAPTIVE_QUALITY
+	const int16_t* pCorrections = m_isShortScans[back] ? ShortScanCorrections::kTable : FullScanCorrections::kTable;
+#else
+	const int16_t* pCorrections = FullScanCorrections::kTable;
+#endif
+	uint16_t* pOffsets = m_offsets[back];
+	uint16_t end = m_numBuilt + kBuildSlicePixels;
+	if( end > kWidth + 1 )
+	{
+		end = kWidth + 1;
+	}
+	for( uint16_t pixel = m_numBuilt; pixel < end; ++pixel )
+	{
+		// A 16x16-bit multiply with MUL
+		HalCycles( 30 );
+		uint16_t position = (uint16_t) ((pixel << 8) + (int16_t) pgm_read_word( &pCorrections[pixel] ));
+		pOffsets[pixel] = (uint16_t) ((((uint32_t) position * period) + 0x8000) >> 16);
+	}
+	m_numBuilt = end;
+	return end <= kWidth;
+}
+
+void FThetaTable::Flip()
+{
+	HalCycles( 10 );
+	if( m_numBuilt == kWidth + 1 )
+	{
+		m_front ^= 1;
+		m_periods[m_front ^ 1] = 0;
+		m_numBuilt = 0;
+	}
+}
+
+const uint16_t* FThetaTable::GetOffsets( PixelPeriod period, bool isShortScan ) const
+{
+	HalCycles( 20 );
+	PixelPeriod built = m_periods[m_front];
+	PixelPeriod error = (period > built) ? (period - built) : (built - period);
+	if( (built == 0) || (isShortScan != m_isShortScans[m_front]) || (error > kMaxPeriodError) )
+	{
+		return nullptr;
+	}
+	return m_offsets[m_front];
+}
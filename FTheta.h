@@ -0,0 +1,78 @@
+#ifndef F_THETA_H
+#define F_THETA_H
+
+#include "Config.h"
+#include "Geometry.h"
+#include "PixelClock.h"
+
+// Pixel timing that corrects for the drum sweeping the beam across a flat
+// screen.
+//
+// The beam turns at a steady rate, so evenly timed pixels are evenly spaced
+// in angle, and on a flat screen they land at the tangent of it: further
+// apart towards the ends of the line than in the middle. To land on an even
+// grid, pixel n is written when the beam points at atan( u * tan( a ) ),
+// where u runs from -1 to 1 across the line and a is half the angle that the
+// beam sweeps during it. That's twice the angle the drum turns through, so
+// a = pi / kNumMirrors scanning for half of each interval, or 3/4 of that
+// for the short scan. With the screen square on to the middle of the sweep,
+// its distance only scales the line, so the timing depends on nothing else.
+//
+// How far each pixel is from its evenly timed position, in 1/256ths of a
+// pixel period, is worked out at compile time into tables in flash, one for
+// each scan length. From those, the start time of each pixel for the current
+// pixel period goes into a table that the pixel clock interrupt looks up
+// instead of stepping on by the period, so it does no more work per pixel.
+//
+// That's a 16x16-bit multiply a pixel, about 4000 cycles at the default
+// width, too long to do between revolutions. So there are two tables: the
+// one in use, and one that a background task builds for a new period a
+// slice at a time. The next revolution boundary switches to it once it's
+// done. Until then the old one is kept if its period is close enough, and
+// otherwise the pixels are evenly timed.
+#if SLP_F_THETA && !SLP_TIMER_PIXEL_CLOCK
+#error "SLP_F_THETA needs SLP_TIMER_PIXEL_CLOCK"
+#endif
+
+class FThetaTable
+{
+public:
+	FThetaTable();
+
+	// Start building a table for the given mean pixel period, unless it's
+	// the one in use or being built already. Returns true if BuildSlice()
+	// has work to do.
+	bool Request( PixelPeriod period, bool isShortScan );
+
+	// Build the next few pixels of the requested table. Returns true if
+	// there are more.
+	bool BuildSlice();
+	static const uint8_t kBuildSlicePixels = 16;
+	// The pixel clock interrupt can land in it a few times.
+	static const Ticks kBuildSliceTicks = (40 + (kBuildSlicePixels * 30) + (4 * kPixelClockPixelCycles)) >> 3;
+
+	// Switch to the requested table if it's done. Only while the pixel clock
+	// is idle.
+	void Flip();
+
+	// Start of pixel n, in ticks from the start of the scan-line, for n up
+	// to kWidth (the blank after the last pixel), from the table in use.
+	// nullptr if that wasn't built for the same scan length and a period
+	// within kMaxPeriodError of 'period'.
+	const uint16_t* GetOffsets( PixelPeriod period, bool isShortScan ) const;
+
+	// The period that the table in use was built for.
+	PixelPeriod GetPeriod() const { return m_periods[m_front]; }
+
+private:
+	// Period error that stretches the line by no more than 2 ticks.
+	static const PixelPeriod kMaxPeriodError = (2 << 8) / kWidth;
+
+	uint16_t    m_offsets[2][kWidth + 1];
+	PixelPeriod m_periods[2]; // 0 for none
+	bool        m_isShortScans[2];
+	uint8_t     m_front;
+	uint16_t    m_numBuilt;   // Pixels of the other table
+};
+
+#endif
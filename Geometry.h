@@ -0,0 +1,58 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include "Config.h"
+
+// Matrix dimensions and derived values, from the SLP_NUM_LASERS,
+// SLP_NUM_MIRRORS and SLP_WIDTH build options.
+static const uint8_t  kWidth = SLP_WIDTH;
+static const uint8_t  kNumLasers = SLP_NUM_LASERS;
+static const uint8_t  kNumMirrors = SLP_NUM_MIRRORS; // The number of mirrors in the drum.
+static const uint16_t kHeight = kNumMirrors * kNumLasers;
+static const uint8_t  kWidthBytes = kWidth >> 3;
+static const uint16_t kLaserByteOffset = kNumMirrors * kWidthBytes;
+
+static_assert( (kNumLasers >= 1) && (kNumLasers <= 8), "SLP_NUM_LASERS must be 1 to 8" );
+static_assert( (kNumMirrors >= 8) && (kNumMirrors <= 32), "SLP_NUM_MIRRORS must be 8 to 32" );
+static_assert( (SLP_WIDTH >= 8) && (SLP_WIDTH <= 248) && ((SLP_WIDTH & 7) == 0), "SLP_WIDTH must be a multiple of 8, up to 248" );
+
+// The lasers' bits of PORTB
+static const uint8_t kLaserPinMask = (uint8_t) ((1 << kNumLasers) - 1);
+
+template< bool kCondition, typename TrueType, typename FalseType > struct SelectType { typedef TrueType Type; };
+template< typename TrueType, typename FalseType > struct SelectType< false, TrueType, FalseType > { typedef FalseType Type; };
+
+// One bit per scan-line
+typedef SelectType< (kNumMirrors <= 8), uint8_t, SelectType< (kNumMirrors <= 16), uint16_t, uint32_t >::Type >::Type ScanLineMask;
+static const ScanLineMask kAllScanLines = (ScanLineMask) (((uint64_t) 1 << kNumMirrors) - 1);
+
+// The raster line that each mirror draws, in the order the mirrors pass the
+// lasers. Checked at compile time to cover every line exactly once.
+constexpr uint64_t rasterLineBits() { return 0; }
+template< typename... Rest > constexpr uint64_t rasterLineBits( uint8_t line, Rest... rest )
+{
+	return ((uint64_t) 1 << line) | rasterLineBits( rest... );
+}
+
+template< uint8_t... kLines > struct RasterOrder
+{
+	static_assert( sizeof...(kLines) == kNumMirrors, "Need a raster line for every mirror" );
+	static_assert( rasterLineBits( kLines... ) == kAllScanLines, "Every raster line must be drawn by exactly one mirror" );
+	static constexpr uint8_t kMirrorToRaster[kNumMirrors] = { kLines... };
+};
+template< uint8_t... kLines > constexpr uint8_t RasterOrder< kLines... >::kMirrorToRaster[kNumMirrors];
+
+// Mirror n draws raster line n.
+template< uint8_t kNum, uint8_t... kLines > struct LinearRasterOrder : LinearRasterOrder< kNum - 1, kNum - 1, kLines... > {};
+template< uint8_t... kLines > struct LinearRasterOrder< 0, kLines... > : RasterOrder< kLines... > {};
+
+#if defined(SLP_MIRROR_TO_RASTER)
+typedef RasterOrder< SLP_MIRROR_TO_RASTER > MirrorRasterOrder;
+#elif SLP_NUM_MIRRORS == 16
+// Measured on the 16 mirror drum
+typedef RasterOrder< 0, 14, 7, 12, 2, 9, 5, 11, 1, 15, 6, 13, 3, 8, 4, 10 > MirrorRasterOrder;
+#else
+typedef LinearRasterOrder< kNumMirrors > MirrorRasterOrder;
+#endif
+
+#endif
@@ -0,0 +1,181 @@
+#include "GlyphCache.h"
+#include "Hal.h"
+
+GlyphCache::GlyphCache()
+: m_pFont( nullptr ), m_numGlyphs( 0 ), m_numRows( 0 ), m_yAdvance( 0 )
+{
+}
+
+void GlyphCache::Clear()
+{
+	m_pFont = nullptr;
+	m_numGlyphs = 0;
+	m_numRows = 0;
+}
+
+const GlyphCache::Glyph* GlyphCache::find( char c ) const
+{
+	for( uint8_t i = 0; i < m_numGlyphs; ++i )
+	{
+		HalCycles( 5 );
+		if( m_glyphs[i].m_char == c )
+		{
+			return &m_glyphs[i];
+		}
+	}
+	return nullptr;
+}
+
+bool GlyphCache::Load( const GFXfont* pFont, const char* pChars )
+{
+	if( pFont != m_pFont )
+	{
+		Clear();
+		m_pFont = pFont;
+		m_yAdvance = pgm_read_byte( &pFont->yAdvance );
+	}
+	uint16_t first = pgm_read_word( &pFont->first );
+	uint16_t last = pgm_read_word( &pFont->last );
+	const GFXglyph* pGlyphs = (const GFXglyph*) pgm_read_pointer( &pFont->glyph );
+	const uint8_t* pBitmap = (const uint8_t*) pgm_read_pointer( &pFont->bitmap );
+	bool isLoaded = true;
+	for( ; *pChars; ++pChars )
+	{
+		uint8_t c = (uint8_t) *pChars;
+		if( (c < first) || (c > last) || find( (char) c ) )
+		{
+			continue;
+		}
+		const GFXglyph* pGlyph = &pGlyphs[c - first];
+		uint8_t width = pgm_read_byte( &pGlyph->width );
+		uint8_t height = pgm_read_byte( &pGlyph->height );
+		if( (width > 16) || (m_numGlyphs == kMaxCachedGlyphs) || (height > kGlyphCacheRows - m_numRows) )
+		{
+			isLoaded = false;
+			continue;
+		}
+
+		Glyph& glyph = m_glyphs[m_numGlyphs++];
+		glyph.m_char = (char) c;
+		glyph.m_width = width;
+		glyph.m_height = height;
+		glyph.m_xAdvance = pgm_read_byte( &pGlyph->xAdvance );
+		glyph.m_xOffset = (int8_t) pgm_read_byte( &pGlyph->xOffset );
+		glyph.m_yOffset = (int8_t) pgm_read_byte( &pGlyph->yOffset );
+		glyph.m_firstRow = m_numRows;
+
+		// The bitmap's rows run on from each other without padding.
+		uint16_t bitmapOffset = pgm_read_word( &pGlyph->bitmapOffset );
+		uint8_t bits = 0;
+		uint8_t bitIdx = 0;
+		for( uint8_t y = 0; y < height; ++y )
+		{
+			uint16_t row = 0;
+			for( uint8_t x = 0; x < width; ++x )
+			{
+				HalCycles( 12 );
+				if( !(bitIdx++ & 7) )
+				{
+					bits = pgm_read_byte( &pBitmap[bitmapOffset++] );
+				}
+				if( bits & 0x80 )
+				{
+					row |= 0x8000 >> x;
+				}
+				bits <<= 1;
+			}
+			m_rows[m_numRows++] = row;
+		}
+	}
+	return isLoaded;
+}
+
+void GlyphCache::drawGlyph( DirtyCanvas& canvas, const Glyph& glyph, int16_t x, int16_t y, uint16_t color ) const
+{
+	HalCycles( 40 );
+	int16_t left = x + glyph.m_xOffset;
+	int16_t top = y + glyph.m_yOffset;
+	if( !glyph.m_height || (left >= kWidth) || (left + glyph.m_width <= 0) || (top >= (int16_t) kHeight) || (top + glyph.m_height <= 0) )
+	{
+		return;
+	}
+	uint8_t firstRow = (top < 0) ? -top : 0;
+	uint8_t endRow = (top + glyph.m_height > (int16_t) kHeight) ? (kHeight - top) : glyph.m_height;
+
+	// A row covers canvas bytes firstByte to firstByte + 2, as bits 23 down to
+	// 0 of the shifted row. Bytes off either side of the canvas are left out.
+	int8_t firstByte = (int8_t) (left >> 3);
+	uint8_t shift = 8 - (left & 7);
+	int8_t lastByte = (int8_t) ((left + glyph.m_width - 1) >> 3);
+	int8_t firstClippedByte = (firstByte < 0) ? 0 : firstByte;
+	int8_t lastClippedByte = (lastByte >= kWidthBytes) ? (kWidthBytes - 1) : lastByte;
+
+	uint8_t* pRowBytes = canvas.getBuffer() + ((top + firstRow) * kWidthBytes);
+	const uint16_t* pRow = m_rows + glyph.m_firstRow + firstRow;
+	for( uint8_t row = firstRow; row < endRow; ++row, pRowBytes += kWidthBytes )
+	{
+		// The shift is a multiply on the AVR.
+		HalCycles( 12 + (8 * (lastClippedByte - firstClippedByte + 1)) );
+		uint32_t bits = (uint32_t) *pRow++ << shift;
+		for( int8_t byteIdx = firstClippedByte; byteIdx <= lastClippedByte; ++byteIdx )
+		{
+			uint8_t mask = (uint8_t) (bits >> ((2 - (byteIdx - firstByte)) << 3));
+			if( color )
+			{
+				pRowBytes[byteIdx] |= mask;
+			}
+			else
+			{
+				pRowBytes[byteIdx] &= ~mask;
+			}
+		}
+	}
+	canvas.MarkDirtyRect( firstClippedByte, lastClippedByte, top + firstRow, endRow - firstRow );
+}
+
+uint8_t GlyphCache::GetColumn( char c, uint8_t column, int16_t baseline, uint8_t* pColumn ) const
+{
+	const Glyph* pGlyph = find( c );
+	if( !pGlyph )
+	{
+		return 0;
+	}
+	HalCycles( 20 );
+	int16_t x = (int16_t) column - pGlyph->m_xOffset;
+	if( (x >= 0) && (x < pGlyph->m_width) )
+	{
+		uint16_t mask = 0x8000 >> x;
+		int16_t y = baseline + pGlyph->m_yOffset;
+		const uint16_t* pRow = m_rows + pGlyph->m_firstRow;
+		for( uint8_t row = 0; row < pGlyph->m_height; ++row, ++y )
+		{
+			HalCycles( 6 );
+			if( (pRow[row] & mask) && (y >= 0) && (y < (int16_t) kHeight) )
+			{
+				pColumn[y >> 3] |= 0x80 >> (y & 7);
+			}
+		}
+	}
+	return pGlyph->m_xAdvance;
+}
+
+int16_t GlyphCache::Print( DirtyCanvas& canvas, int16_t x, int16_t y, const char* pText, uint16_t color ) const
+{
+	int16_t lineX = x;
+	for( ; *pText; ++pText )
+	{
+		if( *pText == '\n' )
+		{
+			x = lineX;
+			y += m_yAdvance;
+			continue;
+		}
+		const Glyph* pGlyph = find( *pText );
+		if( pGlyph )
+		{
+			drawGlyph( canvas, *pGlyph, x, y, color );
+			x += pGlyph->m_xAdvance;
+		}
+	}
+	return x;
+}
@@ -0,0 +1,79 @@
+#ifndef GLYPH_CACHE_H
+#define GLYPH_CACHE_H
+
+#include "Config.h"
+#include "DirtyCanvas.h"
+#include "Timer.h"
+#include <gfxfont.h>
+
+// Text drawn from glyphs rasterised ahead of time, for text that has to be
+// redrawn in the gaps between scan-lines.
+//
+// Adafruit_GFX's print() walks a glyph's PROGMEM bitmap a bit at a time and
+// makes a virtual drawPixel call for every set pixel. Load() does that walk
+// once for each glyph in a set, and keeps each row of the glyph as a 16 bit
+// word, leftmost pixel in the top bit. Print() then draws a glyph row with
+// one shift to the pixel's bit within a canvas byte, and ORs (or clears)
+// the 3 canvas bytes that it covers. Dirty marking is done once per glyph.
+//
+// Rows are stored in SLP_GLYPH_CACHE_BYTES of SRAM, 2 bytes per row of each
+// glyph, and there's room for kMaxCachedGlyphs glyphs. Glyphs wider than 16
+// pixels aren't cached. Print() skips characters that weren't loaded, and
+// doesn't wrap.
+static const uint8_t kMaxCachedGlyphs = 32;
+static const uint8_t kGlyphCacheRows = SLP_GLYPH_CACHE_BYTES / 2;
+
+static_assert( (SLP_GLYPH_CACHE_BYTES >= 2) && (SLP_GLYPH_CACHE_BYTES <= 510), "SLP_GLYPH_CACHE_BYTES must be 2 to 510" );
+
+class GlyphCache
+{
+public:
+	GlyphCache();
+
+	// Forget every glyph.
+	void Clear();
+
+	// Rasterise the glyphs for the characters in pChars from pFont, adding to
+	// the glyphs already loaded from it. Loading from a different font clears
+	// the cache first. Returns false if some didn't fit, or are too wide.
+	bool Load( const GFXfont* pFont, const char* pChars );
+
+	// Draw pText with its baseline starting at x, y, as print() would from
+	// there. '\n' goes back to x on the next line. Returns the x position
+	// after the last character.
+	int16_t Print( DirtyCanvas& canvas, int16_t x, int16_t y, const char* pText, uint16_t color = 1 ) const;
+
+	// OR column 'column' of character c's cell, from its cursor position
+	// onwards, into pColumn: a bit per canvas row, top row in the top bit of
+	// the first byte. Returns the cell's width (its xAdvance), or 0 if c
+	// wasn't loaded.
+	uint8_t GetColumn( char c, uint8_t column, int16_t baseline, uint8_t* pColumn ) const;
+
+	uint8_t GetNumGlyphs() const { return m_numGlyphs; }
+	// Bytes of glyph rows in use.
+	uint16_t GetBytesUsed() const { return (uint16_t) m_numRows * sizeof( m_rows[0] ); }
+
+private:
+	struct Glyph
+	{
+		char    m_char;
+		uint8_t m_width;
+		uint8_t m_height;
+		uint8_t m_xAdvance;
+		int8_t  m_xOffset;
+		int8_t  m_yOffset;
+		uint8_t m_firstRow; // In m_rows
+	};
+
+	const Glyph* find( char c ) const;
+	void         drawGlyph( DirtyCanvas& canvas, const Glyph& glyph, int16_t x, int16_t y, uint16_t color ) const;
+
+	const GFXfont* m_pFont;
+	Glyph          m_glyphs[kMaxCachedGlyphs];
+	uint16_t       m_rows[kGlyphCacheRows];
+	uint8_t        m_numGlyphs;
+	uint8_t        m_numRows;
+	uint8_t        m_yAdvance;
+};
+
+#endif
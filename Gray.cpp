@@ -0,0 +1,200 @@
+#include "Gray.h"
+#include "ScanningLaserProjector.h"
+#include "Scheduler.h"
+
+#if SLP_GRAY_BITS
+
+// Plane b appears 2^b times, as evenly spread as it can be.
+#if SLP_GRAY_BITS == 2
+static const uint8_t kGrayPlaneSequence[] = { 1, 0, 1 };
+#elif SLP_GRAY_BITS == 3
+static const uint8_t kGrayPlaneSequence[] = { 2, 1, 2, 0, 2, 1, 2 };
+#else
+static const uint8_t kGrayPlaneSequence[] = { 3, 2, 3, 1, 3, 2, 3, 0, 3, 2, 3, 1, 3, 2, 3 };
+#endif
+static const uint8_t kGrayPlaneSequenceLength = sizeof( kGrayPlaneSequence );
+static_assert( kGrayPlaneSequenceLength == kGrayMaxLevel, "Need a revolution for each unit of brightness" );
+
+// Each bit of a nybble doubled up, for half width planes.
+static const uint8_t kDoubleBits[16] =
+{
+	0x00, 0x03, 0x0c, 0x0f, 0x30, 0x33, 0x3c, 0x3f,
+	0xc0, 0xc3, 0xcc, 0xcf, 0xf0, 0xf3, 0xfc, 0xff
+};
+
+// Approximate AVR cost of expanding a scan-line's rows, and marking them dirty.
+static const uint8_t kGrayExpandByteCycles = SLP_GRAY_HALF_WIDTH ? 12 : 4;
+static const Ticks kGrayExpandLineTicks = 40 + ((kGrayLasers * (12 + (kGrayWidthBytes * kGrayExpandByteCycles))) >> 3);
+
+GrayCanvas grayGfx;
+
+static TaskId grayTaskId = kInvalidTaskId;
+static uint8_t grayPhase = 0;
+static uint8_t grayPlane = kGrayPlaneSequence[0];
+static ScanLineMask grayPendingLines = 0;
+
+// Statistics
+static uint16_t grayNumRevolutions = 0;
+static uint16_t grayNumHeld = 0;
+static uint16_t grayNumLateLines = 0;
+
+GrayCanvas::GrayCanvas()
+: Adafruit_GFX( kGrayWidth, kGrayHeight )
+{
+	memset( m_planes, 0, sizeof( m_planes ) );
+}
+
+void GrayCanvas::drawPixel( int16_t x, int16_t y, uint16_t color )
+{
+	if( (x < 0) || (y < 0) || (x >= kGrayWidth) || (y >= (int16_t) kGrayHeight) )
+	{
+		return;
+	}
+	if( color > kGrayMaxLevel )
+	{
+		color = kGrayMaxLevel;
+	}
+	uint16_t offset = (y * kGrayWidthBytes) + (x >> 3);
+	uint8_t mask = 0x80 >> (x & 7);
+	for( uint8_t plane = 0; plane < kGrayBits; ++plane, color >>= 1 )
+	{
+		if( color & 1 )
+		{
+			m_planes[plane][offset] |= mask;
+		}
+		else
+		{
+			m_planes[plane][offset] &= ~mask;
+		}
+	}
+}
+
+void GrayCanvas::fillScreen( uint16_t color )
+{
+	for( uint8_t plane = 0; plane < kGrayBits; ++plane )
+	{
+		memset( m_planes[plane], ((color >> plane) & 1) ? 0xff : 0x00, kGrayPlaneBytes );
+	}
+}
+
+// Copy the current plane's rows for a scan-line into gfx.
+static void expandLine( uint8_t scanLineIdx )
+{
+	HalCycles( 10 + (kGrayLasers * kGrayWidthBytes * kGrayExpandByteCycles) );
+	const uint8_t* pPlane = grayGfx.GetPlane( grayPlane );
+	for( uint16_t y = scanLineIdx; y < kGrayHeight; y += kNumMirrors )
+	{
+		const uint8_t* pSrc = pPlane + (y * kGrayWidthBytes);
+		uint8_t* pDst = gfx.getBuffer() + ((kGrayFirstRow + y) * kWidthBytes);
+#if SLP_GRAY_HALF_WIDTH
+		for( uint8_t x = 0; x < kGrayWidthBytes; ++x )
+		{
+			uint8_t byte = *pSrc++;
+			*pDst++ = kDoubleBits[byte >> 4];
+			*pDst++ = kDoubleBits[byte & 0xf];
+		}
+#else
+		memcpy( pDst, pSrc, kWidthBytes );
+#endif
+#if SLP_TRANSPOSED_SCAN_BUFFER
+		gfx.MarkDirtyRect( 0, kWidthBytes - 1, kGrayFirstRow + y, 1 );
+#endif
+	}
+}
+
+// Expand one pending scan-line per call.
+static bool grayTask()
+{
+	if( !grayPendingLines )
+	{
+		return false;
+	}
+	uint8_t scanLineIdx = 0;
+	while( !(grayPendingLines & ((ScanLineMask) 1 << scanLineIdx)) )
+	{
+		++scanLineIdx;
+	}
+	grayPendingLines &= ~((ScanLineMask) 1 << scanLineIdx);
+	expandLine( scanLineIdx );
+#if SLP_TRANSPOSED_SCAN_BUFFER
+	if( !grayPendingLines )
+	{
+		CanvasChanged();
+	}
+#endif
+	return grayPendingLines != 0;
+}
+
+void GrayStart()
+{
+	Ticks worstCaseTicks = kGrayExpandLineTicks;
+#if SLP_TRANSPOSED_SCAN_BUFFER
+	worstCaseTicks += kCanvasChangedTicks;
+#endif
+	grayTaskId = scheduler.AddTask( grayTask, worstCaseTicks );
+}
+
+static void nextPlane()
+{
+	if( ++grayPhase == kGrayPlaneSequenceLength )
+	{
+		grayPhase = 0;
+	}
+	grayPlane = kGrayPlaneSequence[grayPhase];
+}
+
+void GrayRevolutionStart()
+{
+	if( grayNumRevolutions != 0xffff )
+	{
+		++grayNumRevolutions;
+	}
+#if SLP_TRANSPOSED_SCAN_BUFFER
+	// The plane expanded last revolution has only just been swapped in if
+	// nothing is left to present. Otherwise hold it for another revolution.
+	if( grayPendingLines || IsPresentPending() )
+	{
+		if( grayNumHeld != 0xffff )
+		{
+			++grayNumHeld;
+		}
+		return;
+	}
+	nextPlane();
+	grayPendingLines = kAllScanLines;
+	scheduler.Wake( grayTaskId );
+#else
+	// Lines scanned from now on are expanded for the next revolution.
+	nextPlane();
+#endif
+}
+
+void GrayScanLineDone( uint8_t scanLineIdx )
+{
+#if !SLP_TRANSPOSED_SCAN_BUFFER
+	HalCycles( 10 );
+	ScanLineMask lineBit = (ScanLineMask) 1 << scanLineIdx;
+	if( (grayPendingLines & lineBit) && (grayNumLateLines != 0xffff) )
+	{
+		// It was scanned again before the last expansion got done
+		++grayNumLateLines;
+	}
+	grayPendingLines |= lineBit;
+	scheduler.Wake( grayTaskId );
+#else
+	(void) scanLineIdx;
+#endif
+}
+
+void GrayPrintReport()
+{
+	Serial.print( F( "Gray: " ) );
+	Serial.print( grayNumRevolutions );
+	Serial.print( F( " revolutions, " ) );
+	Serial.print( grayNumHeld );
+	Serial.print( F( " planes held, " ) );
+	Serial.print( grayNumLateLines );
+	Serial.println( F( " late lines" ) );
+}
+
+#endif
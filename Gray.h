@@ -0,0 +1,81 @@
+#ifndef GRAY_H
+#define GRAY_H
+
+#include "Config.h"
+#include "Geometry.h"
+#include <Adafruit_GFX.h>
+
+// Grayscale by temporal dithering, for antialiased text and images.
+//
+// grayGfx holds kGrayBits bit-planes covering the rows of the last
+// kGrayLasers lasers, and is drawn into with colours 0 to kGrayMaxLevel.
+// Each revolution, one plane is expanded into those rows of gfx, so the
+// scan path is exactly the same as for 1 bit pixels. Plane b is shown on
+// 2^b revolutions out of every 2^kGrayBits - 1, so a pixel's brightness
+// averages out to its level. The planes are shown in ruler order
+// (kGrayPlaneSequence), which spreads the most significant one out evenly.
+//
+// The expansion for each scan-line is done by a background task:
+// - Scanning from the canvas, a line is expanded as soon as it has been
+//   scanned, ready for the next revolution.
+// - Scanning from the transposed buffer, every line is expanded at the start
+//   of a revolution and presented with CanvasChanged(), so the new plane is
+//   swapped in at the start of the next one.
+// Anything drawn into those rows of gfx, or uploaded to them, is overwritten.
+
+static const uint8_t kGrayBits = SLP_GRAY_BITS;
+static const uint8_t kGrayLasers = SLP_GRAY_LASERS;
+static const uint8_t kGrayMaxLevel = (uint8_t) ((1 << kGrayBits) - 1);
+static const uint8_t kGrayWidthShift = SLP_GRAY_HALF_WIDTH ? 1 : 0;
+static const uint8_t kGrayWidth = kWidth >> kGrayWidthShift;
+static const uint8_t kGrayWidthBytes = kGrayWidth >> 3;
+static const uint16_t kGrayHeight = kGrayLasers * kNumMirrors;
+static const uint16_t kGrayFirstRow = (kNumLasers - kGrayLasers) * kNumMirrors; // In gfx
+static const uint16_t kGrayPlaneBytes = kGrayWidthBytes * kGrayHeight;
+
+#if SLP_GRAY_BITS
+
+static_assert( (kGrayBits >= 2) && (kGrayBits <= 4), "SLP_GRAY_BITS must be 0, or 2 to 4" );
+static_assert( (kGrayLasers >= 1) && (kGrayLasers <= kNumLasers), "SLP_GRAY_LASERS must be 1 to SLP_NUM_LASERS" );
+static_assert( (kGrayWidth & 7) == 0, "SLP_GRAY_HALF_WIDTH needs SLP_WIDTH to be a multiple of 16" );
+
+class GrayCanvas : public Adafruit_GFX
+{
+public:
+	GrayCanvas();
+
+	// colour is a level from 0 (off) to kGrayMaxLevel (always on).
+	void drawPixel( int16_t x, int16_t y, uint16_t color ) override;
+	void fillScreen( uint16_t color ) override;
+
+	const uint8_t* GetPlane( uint8_t plane ) const { return m_planes[plane]; }
+
+private:
+	uint8_t m_planes[kGrayBits][kGrayPlaneBytes];
+};
+
+extern GrayCanvas grayGfx;
+
+// Register the background task that expands the planes into gfx.
+void GrayStart();
+
+// A revolution has started. Moves on to the next plane in the sequence.
+void GrayRevolutionStart();
+
+// The scan-line has been scanned out from the canvas, so its rows can be
+// replaced with the next revolution's plane.
+void GrayScanLineDone( uint8_t scanLineIdx );
+
+// Print grayscale statistics to Serial.
+void GrayPrintReport();
+
+#else
+
+inline void GrayStart() {}
+inline void GrayRevolutionStart() {}
+inline void GrayScanLineDone( uint8_t ) {}
+inline void GrayPrintReport() {}
+
+#endif
+
+#endif
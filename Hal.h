@@ -0,0 +1,80 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <Arduino.h>
+#include "Geometry.h"
+
+// Hardware abstraction for the timing critical parts of the scan engine.
+//
+// On the Arduino these are thin inlines over the registers and compile to
+// exactly what was written before.
+// When built with SLP_SIMULATOR they are implemented by the host simulator
+// in Host/, which emulates Timer1, the drum sync interrupt and PORTB, and
+// keeps a running count of the AVR cycles spent between them.
+
+// Regions of code that the simulator accumulates cycle counts for.
+enum HalProfileZone
+{
+	kProfileZoneUpdate,
+	kProfileZoneHorizontalScan,
+	kProfileZoneRevolutionSettings,
+	kProfileZoneSpinWait,
+	kProfileZonePixelClock,
+	kProfileZoneScheduler,
+	kNumProfileZones
+};
+
+#if defined(SLP_SIMULATOR)
+
+// Read the 16-bit Timer1 counter.
+uint16_t HalReadTimer1();
+
+// True if Timer1 has overflowed and its interrupt hasn't run yet.
+bool HalTimer1Overflowed();
+
+// Write the kNumLasers laser bits to the low bits of PORTB.
+void HalWriteLasers( uint8_t pins );
+
+// The same work as HalWriteLasers, in the same time, with the lasers left
+// off. For timing the scan kernels.
+void HalWriteLasersDark( uint8_t pins );
+
+// Account for the AVR cycles that the surrounding code would take.
+// The simulator advances its clock and services any interrupts that
+// become due.
+void HalCycles( uint32_t numCycles );
+
+void HalProfileBegin( HalProfileZone zone );
+void HalProfileEnd( HalProfileZone zone );
+
+// Bracket the output of a single scan-line so the simulator can measure
+// its start time against the true drum angle. The next laser write is pixel
+// 'firstPixel', as a blank start to the line isn't scanned out, or is
+// before pixel 0 if the scan starts early.
+void HalScanLineBegin( uint8_t scanLineIdx, int16_t firstPixel );
+void HalScanLineEnd();
+
+// The next laser write is 'pixel', after skipping a blank span.
+void HalScanLineSkipTo( uint8_t pixel );
+
+// True once the last EEPROM write has finished, so the EEPROM can be
+// accessed again without stalling.
+bool HalEepromIsReady();
+
+#else
+
+inline uint16_t HalReadTimer1()                  { return TCNT1; }
+inline bool     HalTimer1Overflowed()            { return TIFR1 & (1 << TOV1); }
+inline void     HalWriteLasers( uint8_t pins )   { PORTB = (PORTB & ~kLaserPinMask) | pins; }
+inline void     HalWriteLasersDark( uint8_t pins ) { GPIOR0 = (GPIOR0 & ~kLaserPinMask) | pins; }
+inline void     HalCycles( uint32_t )            {}
+inline void     HalProfileBegin( HalProfileZone ) {}
+inline void     HalProfileEnd( HalProfileZone )   {}
+inline void     HalScanLineBegin( uint8_t, int16_t ) {}
+inline void     HalScanLineEnd()                 {}
+inline void     HalScanLineSkipTo( uint8_t )     {}
+inline bool     HalEepromIsReady()               { return !(EECR & (1 << EEPE)); }
+
+#endif
+
+#endif
@@ -0,0 +1,190 @@
+// Host implementations of the Arduino core functions used by the sketch.
+// Costs are rough AVR cycle counts for the real implementations.
+
+#include <Arduino.h>
+#include <EEPROM.h>
+
+#include "Simulator.h"
+
+volatile uint8_t  SREG;
+volatile uint8_t  PORTB;
+volatile uint8_t  DDRB;
+volatile uint8_t  PINB;
+volatile uint8_t  PORTD;
+volatile uint8_t  DDRD;
+volatile uint8_t  PIND;
+volatile uint8_t  TCCR0A;
+volatile uint8_t  TCCR0B;
+volatile uint8_t  TCNT0;
+volatile uint8_t  OCR0A;
+volatile uint8_t  OCR0B;
+volatile uint8_t  TIMSK0 = (1 << TOIE0); // Enabled by the Arduino core for millis()
+volatile uint8_t  TIFR0;
+volatile uint8_t  TCCR1A;
+volatile uint8_t  TCCR1B;
+volatile uint8_t  TCCR1C;
+volatile uint16_t TCNT1;
+volatile uint16_t OCR1A;
+volatile uint16_t OCR1B;
+volatile uint8_t  TIMSK1;
+volatile uint8_t  TIFR1;
+volatile uint8_t  TCCR2A;
+volatile uint8_t  TCCR2B;
+volatile uint8_t  TCNT2;
+volatile uint8_t  OCR2A;
+volatile uint8_t  OCR2B;
+volatile uint8_t  TIMSK2;
+volatile uint8_t  TIFR2;
+volatile uint8_t  PCICR;
+volatile uint8_t  PCIFR;
+volatile uint8_t  PCMSK0;
+volatile uint8_t  PCMSK1;
+volatile uint8_t  PCMSK2;
+
+HardwareSerial Serial;
+EEPROMClass    EEPROM;
+
+static uint8_t pinModes[20];
+
+void SimCli() { sim.DisableInterrupts(); }
+void SimSei() { sim.EnableInterrupts(); }
+
+void pinMode( uint8_t pin, uint8_t mode )
+{
+	sim.Advance( 50 );
+	if( pin < sizeof( pinModes ) )
+	{
+		pinModes[pin] = mode;
+	}
+	if( (pin >= 8) && (pin < 14) )
+	{
+		uint8_t mask = 1 << (pin - 8);
+		DDRB = (mode == OUTPUT) ? (DDRB | mask) : (DDRB & ~mask);
+	}
+}
+
+void digitalWrite( uint8_t pin, uint8_t value )
+{
+	sim.Advance( 70 );
+	if( (pin >= 8) && (pin < 14) )
+	{
+		uint8_t mask = 1 << (pin - 8);
+		uint8_t portb = value ? (PORTB | mask) : (PORTB & ~mask);
+		if( mask & kLaserPinMask )
+		{
+			sim.WriteLasers( portb & kLaserPinMask );
+		}
+		PORTB = portb;
+	}
+}
+
+int digitalRead( uint8_t pin )
+{
+	sim.Advance( 60 );
+	if( (pin < sizeof( pinModes )) && (pinModes[pin] == INPUT_PULLUP) )
+	{
+		// Port D pins can have a button pulling them low
+		return ((pin >= 8) || (PIND & (1 << pin))) ? HIGH : LOW;
+	}
+	return LOW;
+}
+
+int analogRead( uint8_t )
+{
+	// 13 ADC clocks at 125kHz
+	sim.Advance( 1664 );
+	return (int) (sim.GetCycle() & 0x3ff);
+}
+
+unsigned long micros()
+{
+	sim.Advance( 40 );
+	return (unsigned long) (uint32_t) (sim.GetCycle() / Simulator::kCyclesPerMicroSecond);
+}
+
+unsigned long millis()
+{
+	sim.Advance( 30 );
+	return (unsigned long) (uint32_t) (sim.GetCycle() / (Simulator::kCyclesPerMicroSecond * 1000));
+}
+
+void delay( unsigned long ms )
+{
+	sim.Advance( (uint32_t) (ms * 1000 * Simulator::kCyclesPerMicroSecond) );
+}
+
+void delayMicroseconds( unsigned int us )
+{
+	sim.Advance( us * Simulator::kCyclesPerMicroSecond );
+}
+
+void attachInterrupt( uint8_t interruptNum, void (*handler)(), int )
+{
+	sim.AttachInterrupt( interruptNum, handler );
+}
+
+void detachInterrupt( uint8_t interruptNum )
+{
+	sim.AttachInterrupt( interruptNum, nullptr );
+}
+
+static uint32_t randomState = 1;
+
+void randomSeed( unsigned long seed )
+{
+	if( seed )
+	{
+		randomState = (uint32_t) seed;
+	}
+}
+
+long random( long howBig )
+{
+	if( howBig == 0 )
+	{
+		return 0;
+	}
+	sim.Advance( 400 );
+	randomState = randomState * 1103515245u + 12345u;
+	return (long) ((randomState >> 1) % (uint32_t) howBig);
+}
+
+long random( long howSmall, long howBig )
+{
+	if( howSmall >= howBig )
+	{
+		return howSmall;
+	}
+	return random( howBig - howSmall ) + howSmall;
+}
+
+void HardwareSerial::begin( unsigned long ) {}
+int  HardwareSerial::available()         { return sim.SerialAvailable(); }
+int  HardwareSerial::read()              { return sim.SerialRead(); }
+int  HardwareSerial::peek()              { return -1; }
+int  HardwareSerial::availableForWrite() { return sim.SerialAvailableForWrite(); }
+void HardwareSerial::flush()             { sim.SerialFlush(); }
+
+size_t HardwareSerial::write( uint8_t c )
+{
+	sim.SerialWrite( c );
+	return 1;
+}
+
+uint8_t EEPROMClass::read( int idx )
+{
+	return sim.EepromRead( idx );
+}
+
+void EEPROMClass::write( int idx, uint8_t val )
+{
+	sim.EepromWrite( idx, val );
+}
+
+void EEPROMClass::update( int idx, uint8_t val )
+{
+	if( read( idx ) != val )
+	{
+		write( idx, val );
+	}
+}
@@ -0,0 +1,309 @@
+// Benchmarks of the sketch's building blocks in the simulator, run from
+// slpsim's --measure-* options. Each draws or converts the same thing the
+// old way and the new, checks that the results match, and prints the AVR
+// cycles each took to Serial.
+
+#include "Config.h"
+#include "DelayModel.h"
+#include "DirtyCanvas.h"
+#include "Fonts.h"
+#include "Geometry.h"
+#include "GlyphCache.h"
+#include "PixelClock.h"
+#include "ScanKernel.h"
+#include "TileCanvas.h"
+#include "Timer.h"
+
+// From ScanningLaserProjector.cpp
+extern DelayModel delayModel;
+MicroSeconds scanIntervalForPeriod( Ticks period );
+#if SLP_TIMER_PIXEL_CLOCK
+PixelPeriod pixelPeriodForDuration( MicroSeconds duration );
+#endif
+
+// Time the revolution boundary conversions against the divisions they
+// replaced, over the range of drum periods that DrumSync accepts, and count
+// any results that differ.
+void MeasureRevolutionSettings()
+{
+	static const Ticks kFirstPeriod = 10000;
+	static const Ticks kLastPeriod = 1000000;
+	static const Ticks kPeriodStep = 990;
+	static const bool kIsMirrorDivisionShift = !(kNumMirrors & (kNumMirrors - 1));
+
+	uint16_t numPeriods = 0;
+	uint16_t numIntervalsOff = 0;
+	uint16_t numDelayCountsOff = 0;
+	uint16_t numPixelPeriodsOff = 0;
+	Ticks divisionTicks = 0;
+	Ticks reciprocalTicks = 0;
+	for( Ticks period = kFirstPeriod; period <= kLastPeriod; period += kPeriodStep )
+	{
+		++numPeriods;
+
+		Ticks start = GetClockMain();
+		HalCycles( kIsMirrorDivisionShift ? 8 : 650 );
+		MicroSeconds interval = TicksToMicroSeconds( period ) / kNumMirrors;
+		MicroSeconds duration = interval >> 1;
+		MicroSeconds minScanUs = delayModel.Get().m_minScanUs;
+		MicroSeconds maxScanUs = delayModel.Get().m_maxScanUs;
+		uint16_t delayCount = DelayModel::kMaxScanCount;
+		if( duration < maxScanUs )
+		{
+			HalCycles( 650 );
+			delayCount = (duration <= minScanUs) ? 0 :
+				(uint16_t) ((unsigned long) ((duration - minScanUs) << DelayModel::kMaxScanCountLog2) / (maxScanUs - minScanUs));
+		}
+#if SLP_TIMER_PIXEL_CLOCK
+		HalCycles( (kWidth & (kWidth - 1)) ? 650 : 8 );
+		uint32_t pixelPeriod = ((uint32_t) MicroSecondsToTicks( duration ) << 8) / kWidth;
+		pixelPeriod = (pixelPeriod < kMinPixelPeriod) ? kMinPixelPeriod : ((pixelPeriod > 0xffff) ? 0xffff : pixelPeriod);
+#endif
+		Ticks middle = GetClockMain();
+		MicroSeconds fastInterval = scanIntervalForPeriod( period );
+		uint16_t fastDelayCount = delayModel.CountForScan( fastInterval >> 1 );
+#if SLP_TIMER_PIXEL_CLOCK
+		PixelPeriod fastPixelPeriod = pixelPeriodForDuration( fastInterval >> 1 );
+#endif
+		Ticks end = GetClockMain();
+
+		divisionTicks += middle - start;
+		reciprocalTicks += end - middle;
+		numIntervalsOff += (fastInterval != interval);
+		numDelayCountsOff += (fastDelayCount != delayCount);
+#if SLP_TIMER_PIXEL_CLOCK
+		numPixelPeriodsOff += (fastPixelPeriod != pixelPeriod);
+#endif
+	}
+
+	// Ticks are 8 cycles
+	Serial.print( "Revolution settings over " );
+	Serial.print( numPeriods );
+	Serial.print( " periods: division " );
+	Serial.print( (divisionTicks << 3) / numPeriods );
+	Serial.print( " cycles, reciprocal " );
+	Serial.print( (reciprocalTicks << 3) / numPeriods );
+	Serial.print( " cycles. Differing: " );
+	Serial.print( numIntervalsOff );
+	Serial.print( " intervals, " );
+	Serial.print( numDelayCountsOff );
+	Serial.print( " delay counts, " );
+	Serial.print( numPixelPeriodsOff );
+	Serial.println( " pixel periods" );
+}
+
+// Frames for MeasureTileCanvas: the startup text, a screen of text, line
+// graphics, and a checkerboard.
+static const uint8_t kNumTileCanvasFrames = 4;
+static void drawTileCanvasFrame( Adafruit_GFX& canvas, uint8_t frame )
+{
+	canvas.fillScreen( 0 );
+	canvas.setFont( &FreeMono9pt7b );
+	switch( frame )
+	{
+	case 0:
+		canvas.setCursor( 3, 12 );
+		canvas.drawRect( 0, 0, kWidth, kNumMirrors, 1 );
+		canvas.print( "Hello World" );
+		break;
+	case 1:
+		canvas.setCursor( 0, 12 );
+		for( uint8_t i = 0; i < 33; ++i )
+		{
+			canvas.write( (uint8_t) ('!' + ((i * 7) % 94)) );
+		}
+		break;
+	case 2:
+		canvas.drawCircle( kWidth / 4, kHeight / 2, kHeight / 3, 1 );
+		canvas.drawCircle( kWidth / 4, kHeight / 2, kHeight / 5, 1 );
+		canvas.fillRect( (kWidth * 5) / 8, kHeight / 4, kWidth / 4, kHeight / 2, 1 );
+		canvas.drawLine( 0, 0, kWidth - 1, kHeight - 1, 1 );
+		canvas.drawLine( 0, kHeight - 1, kWidth - 1, 0, 1 );
+		break;
+	default:
+		for( int16_t y = 0; y < (int16_t) kHeight; ++y )
+		{
+			for( int16_t x = y & 1; x < kWidth; x += 2 )
+			{
+				canvas.drawPixel( x, y, 1 );
+			}
+		}
+		break;
+	}
+}
+
+// Draw frames into a GFXcanvas1 and a TileCanvas, check that the pixels and
+// every expanded scan-line match, and report the TileCanvas's size and the
+// time taken to expand its scan-lines against packing them from the canvas.
+void MeasureTileCanvas()
+{
+	static GFXcanvas1 reference( kWidth, kHeight );
+	static TileCanvas tiles;
+
+	Serial.print( "Tile canvas, " );
+	Serial.print( TileCanvas::kSizeBytes );
+	Serial.print( " bytes with a pool of " );
+	Serial.print( kTilePoolSize );
+	Serial.print( " tiles, against a " );
+	Serial.print( kWidthBytes * kHeight );
+	Serial.println( " byte canvas:" );
+	for( uint8_t frame = 0; frame < kNumTileCanvasFrames; ++frame )
+	{
+		drawTileCanvasFrame( reference, frame );
+		drawTileCanvasFrame( tiles, frame );
+		tiles.Compact();
+
+		uint16_t numPixelsOff = 0;
+		for( int16_t y = 0; y < (int16_t) kHeight; ++y )
+		{
+			for( int16_t x = 0; x < kWidth; ++x )
+			{
+				numPixelsOff += (tiles.getPixel( x, y ) != reference.getPixel( x, y ));
+			}
+		}
+
+		uint8_t numLinesOff = 0;
+		uint8_t numLinesIncomplete = 0;
+		Ticks expandTicks = 0;
+		Ticks maxExpandTicks = 0;
+		Ticks rebuildTicks = 0;
+		for( uint8_t scanLineIdx = 0; scanLineIdx < kNumMirrors; ++scanLineIdx )
+		{
+			uint8_t expanded[kWidth / kPixelsPerScanByte];
+			Ticks start = GetClockMain();
+			numLinesIncomplete += !tiles.ExpandScanLine( scanLineIdx, expanded );
+			Ticks ticks = GetClockMain() - start;
+			expandTicks += ticks;
+			maxExpandTicks = (ticks > maxExpandTicks) ? ticks : maxExpandTicks;
+
+			// The same line packed from the canvas, as ScanBuffer rebuilds it
+			uint8_t packed[kWidth / kPixelsPerScanByte];
+			uint8_t* pPixels = packed;
+			start = GetClockMain();
+			const uint8_t* pByte = reference.getBuffer() + (scanLineIdx * kWidthBytes) + kWidthBytes;
+			for( uint8_t x = 0; x < kWidthBytes; ++x )
+			{
+				HalCycles( 10 + (30 * kNumLasers) );
+				LaserBytes bytes;
+				LoadLaserBytes( bytes, --pByte );
+				for( uint8_t bitIdx = 0; bitIdx < 8; bitIdx += kPixelsPerScanByte )
+				{
+					*pPixels++ = PackScanByte( bytes, bitIdx );
+				}
+			}
+			rebuildTicks += GetClockMain() - start;
+			numLinesOff += (memcmp( expanded, packed, sizeof( packed ) ) != 0);
+		}
+
+		// Ticks are 8 cycles
+		Serial.print( "  Frame " );
+		Serial.print( frame );
+		Serial.print( ": " );
+		Serial.print( tiles.GetNumPoolTilesUsed() );
+		Serial.print( " pool tiles, expand " );
+		Serial.print( (expandTicks << 3) / kNumMirrors );
+		Serial.print( " cycles a line, " );
+		Serial.print( maxExpandTicks << 3 );
+		Serial.print( " worst, against " );
+		Serial.print( (rebuildTicks << 3) / kNumMirrors );
+		Serial.print( " from the canvas. Dropped " );
+		Serial.print( tiles.GetNumDroppedPixels() );
+		Serial.print( " pixels, " );
+		Serial.print( numLinesIncomplete );
+		Serial.print( " scan-lines expanded incomplete, differing: " );
+		Serial.print( numPixelsOff );
+		Serial.print( " pixels, " );
+		Serial.print( numLinesOff );
+		Serial.println( " scan-lines" );
+	}
+}
+
+// A DirtyCanvas that charges the AVR cost of Adafruit_GFX's own work, which
+// the host build of the library leaves out: fetching a glyph from PROGMEM,
+// walking its bitmap a bit at a time, and the virtual writePixel and
+// drawPixel calls for each set pixel.
+class PrintCostCanvas : public DirtyCanvas
+{
+public:
+	size_t write( uint8_t c ) override
+	{
+		HalCycles( 100 );
+		if( gfxFont && (c >= gfxFont->first) && (c <= gfxFont->last) )
+		{
+			const GFXglyph& glyph = gfxFont->glyph[c - gfxFont->first];
+			HalCycles( 12 * glyph.width * glyph.height );
+		}
+		return DirtyCanvas::write( c );
+	}
+
+	void drawPixel( int16_t x, int16_t y, uint16_t color ) override
+	{
+		HalCycles( 75 );
+		DirtyCanvas::drawPixel( x, y, color );
+	}
+};
+
+// Draw the same text with gfx.print and from a GlyphCache, check that the
+// canvases match, and report glyphs per millisecond for each.
+void MeasureGlyphCache()
+{
+	static const char kText[] = "Hello World\nquick brown\nfox jumps";
+	static const uint8_t kNumRepeats = 20;
+	static PrintCostCanvas printCanvas;
+	static DirtyCanvas cacheCanvas;
+	static GlyphCache glyphCache;
+
+	uint16_t numGlyphs = 0;
+	for( const char* pChar = kText; *pChar; ++pChar )
+	{
+		numGlyphs += (*pChar != '\n');
+	}
+	numGlyphs *= kNumRepeats;
+
+	Ticks start = GetClockMain();
+	bool isLoaded = glyphCache.Load( &FreeMono9pt7b, kText );
+	Ticks loadTicks = GetClockMain() - start;
+
+	printCanvas.setFont( &FreeMono9pt7b );
+	start = GetClockMain();
+	for( uint8_t i = 0; i < kNumRepeats; ++i )
+	{
+		printCanvas.setCursor( 0, 12 );
+		printCanvas.print( kText );
+	}
+	Ticks printTicks = GetClockMain() - start;
+
+	start = GetClockMain();
+	for( uint8_t i = 0; i < kNumRepeats; ++i )
+	{
+		glyphCache.Print( cacheCanvas, 0, 12, kText );
+	}
+	Ticks cacheTicks = GetClockMain() - start;
+
+	uint16_t numBytesOff = 0;
+	for( uint16_t i = 0; i < kWidthBytes * kHeight; ++i )
+	{
+		numBytesOff += (printCanvas.getBuffer()[i] != cacheCanvas.getBuffer()[i]);
+	}
+
+	// 2000 ticks a millisecond, and 8 cycles a tick
+	Serial.print( "Text, " );
+	Serial.print( numGlyphs );
+	Serial.print( " glyphs: gfx.print " );
+	Serial.print( ((uint32_t) numGlyphs * 2000) / printTicks );
+	Serial.print( " glyphs/ms (" );
+	Serial.print( (printTicks << 3) / numGlyphs );
+	Serial.print( " cycles each), glyph cache " );
+	Serial.print( ((uint32_t) numGlyphs * 2000) / cacheTicks );
+	Serial.print( " glyphs/ms (" );
+	Serial.print( (cacheTicks << 3) / numGlyphs );
+	Serial.print( " cycles each). Cached " );
+	Serial.print( glyphCache.GetNumGlyphs() );
+	Serial.print( isLoaded ? " glyphs in " : " glyphs (some didn't fit) in " );
+	Serial.print( glyphCache.GetBytesUsed() );
+	Serial.print( " bytes, loaded in " );
+	Serial.print( TicksToMicroSeconds( loadTicks ) );
+	Serial.print( "us. Differing: " );
+	Serial.print( numBytesOff );
+	Serial.println( " bytes" );
+}
@@ -0,0 +1,135 @@
+// Stress test for the extended Timer1 clock (Timer.h).
+//
+// Reads the clock with a Timer1 wrap landing at every cycle of the read, and
+// of the overflow interrupt, from the main loop, with interrupts disabled and
+// with the overflow interrupt held off. Then checks long gaps between reads
+// and a long run of random ones. Every read must lie between the true tick
+// counts at the start and end of the call.
+
+#include <stdio.h>
+#include <random>
+
+#include "Simulator.h"
+#include "Timer.h"
+
+// Wide enough to cover a retried GetClockMain and the overflow ISR.
+static const uint32_t kNumPhaseCycles = 160;
+
+class ClockTest
+{
+public:
+	ClockTest() : m_offset( 0 ), m_numReads( 0 ), m_numFailures( 0 ), m_lastRead( 0 ) {}
+
+	int Run()
+	{
+		ConfigureTimer1ForClock();
+		sei();
+		// Settle any overflow left over from before the clock was configured,
+		// then find how the sketch's clock lines up with the simulator's.
+		sim.Advance( 1000 );
+		m_offset = getTrueTicks() - GetClockMain();
+		m_lastRead = GetClockMain();
+
+		// Without millis() interrupts, so the wraps land exactly where asked.
+		uint8_t timerMask0 = TIMSK0;
+		TIMSK0 = 0;
+		for( uint32_t phase = 0; phase < kNumPhaseCycles; ++phase )
+		{
+			advanceToWrap( phase );
+			check( "main", GetClockMain );
+
+			advanceToWrap( phase );
+			cli();
+			check( "interrupts disabled", GetClockInterrupt );
+			sei();
+
+			// The overflow interrupt held off by another handler that reads
+			// the clock after the wrap, then the main loop reading it once
+			// the overflow interrupt can run.
+			advanceToWrap( phase );
+			cli();
+			sim.Advance( phase );
+			check( "overflow pending", GetClockInterrupt );
+			sei();
+			check( "after pending", GetClockMain );
+		}
+		TIMSK0 = timerMask0;
+
+		// Long idle periods, such as while Serial is busy
+		for( uint32_t numWraps = 1; numWraps < 100; numWraps *= 3 )
+		{
+			sim.Advance( numWraps * 0x10000 * Simulator::kCyclesPerTimer1Tick + 12345 );
+			check( "idle", GetClockMain );
+		}
+
+		// Random reads from both contexts
+		std::mt19937 random( 1 );
+		std::uniform_int_distribution<uint32_t> gap( 0, 0x30000 * Simulator::kCyclesPerTimer1Tick );
+		for( int i = 0; i < 100000; ++i )
+		{
+			sim.Advance( gap( random ) );
+			if( i & 1 )
+			{
+				check( "random main", GetClockMain );
+			}
+			else
+			{
+				cli();
+				check( "random interrupt", GetClockInterrupt );
+				sei();
+			}
+		}
+
+		printf( "Clock test: %u reads over %.1fs, %u failures\n", m_numReads, sim.GetMicroSeconds() / 1e6, m_numFailures );
+		return m_numFailures ? 1 : 0;
+	}
+
+private:
+	Ticks getTrueTicks() const { return (Ticks) (sim.GetCycle() / Simulator::kCyclesPerTimer1Tick); }
+
+	// Leave the simulator 'phase' cycles before the next Timer1 wrap.
+	// Interrupt handlers that run on the way add to the cycles advanced.
+	void advanceToWrap( uint32_t phase )
+	{
+		static const uint64_t kWrapCycles = 0x10000 * Simulator::kCyclesPerTimer1Tick;
+		uint64_t target = ((sim.GetCycle() / kWrapCycles) + 1) * kWrapCycles - phase;
+		if( target <= sim.GetCycle() )
+		{
+			target += kWrapCycles;
+		}
+		sim.Advance( (uint32_t) (target - sim.GetCycle()) );
+	}
+
+	void check( const char* pWhat, Ticks (*read)() )
+	{
+		Ticks start = getTrueTicks();
+		Ticks clock = read() + m_offset;
+		Ticks end = getTrueTicks();
+		++m_numReads;
+		bool isGood = ((clock - start) >= 0) && ((end - clock) >= 0);
+		if( (clock - m_lastRead) < 0 )
+		{
+			isGood = false;
+		}
+		if( !isGood )
+		{
+			if( m_numFailures < 20 )
+			{
+				printf( "Clock test %s: read %d, expected %d to %d, previous %d\n", pWhat, clock, start, end, m_lastRead );
+			}
+			++m_numFailures;
+		}
+		m_lastRead = clock;
+	}
+
+	Ticks    m_offset;
+	uint32_t m_numReads;
+	uint32_t m_numFailures;
+	Ticks    m_lastRead;
+};
+
+int RunClockTest()
+{
+	ClockTest test;
+	return test.Run();
+}
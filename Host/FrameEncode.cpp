@@ -0,0 +1,442 @@
+// Encoder for streaming frames to the sketch over Serial (see Upload.h).
+//
+//   slpframe [--demo N] [--key-interval N] [--snapshot-every N] [--tag-frames] [--verbose] [-o FILE] [FRAMES.pbm ...]
+//
+// Frames are kWidth x kHeight PBM images (P1 or P4, several to a file if
+// wanted), or with --demo a generated sequence of scrolling text and a
+// moving box. Each frame is sent as whichever is smallest of
+//   raw     every canvas byte (a key frame)
+//   rle     every canvas byte, run-length encoded (a key frame)
+//   rect    the bytes of the rectangle that changed since the last frame
+//   span    the changed bytes, from the first to the last, run-length encoded
+// with a key frame at least every --key-interval frames so the sketch can
+// recover from a lost packet. The stream is written to FILE, ready to send to
+// the Arduino or to slpsim --serial-in, and the bytes per frame are reported
+// with the frame rate that 115200 baud can sustain. With --snapshot-every,
+// the sketch is asked for a snapshot of its canvas (see Snapshot.h) after
+// every N frames. With --tag-frames, the first byte of every row is set to
+// 0x80 plus the frame number, for slpsim --check-frame-tags.
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <Adafruit_GFX.h>
+#include "Fonts.h"
+#include "Upload.h"
+
+typedef std::vector<uint8_t> Bytes;
+
+static const uint16_t kCanvasBytes = kWidthBytes * kHeight;
+static const uint32_t kBytesPerSecond = 11520; // 10 bits a byte at 115200 baud
+
+enum Encoding
+{
+	kEncodingRaw,
+	kEncodingRle,
+	kEncodingRect,
+	kEncodingSpan,
+	kNumEncodings
+};
+
+static const char* kEncodingNames[kNumEncodings] = { "raw", "rle", "rect", "span" };
+
+static void addPacket( Bytes& out, UploadPacketType type, const Bytes& payload )
+{
+	UploadCheck check;
+	out.push_back( kUploadPacketStart );
+	out.push_back( (uint8_t) type );
+	check.Add( (uint8_t) type );
+	out.push_back( (uint8_t) payload.size() );
+	check.Add( (uint8_t) payload.size() );
+	for( uint8_t byte : payload )
+	{
+		out.push_back( byte );
+		check.Add( byte );
+	}
+	out.push_back( (uint8_t) check.Get() );
+	out.push_back( (uint8_t) (check.Get() >> 8) );
+}
+
+static Bytes offsetPayload( uint16_t offset )
+{
+	Bytes payload;
+	payload.push_back( (uint8_t) offset );
+	payload.push_back( (uint8_t) (offset >> 8) );
+	return payload;
+}
+
+static void encodeRaw( Bytes& out, const uint8_t* pCanvas )
+{
+	static const uint16_t kChunk = kUploadMaxPayload - 2;
+	for( uint16_t offset = 0; offset < kCanvasBytes; offset += kChunk )
+	{
+		Bytes payload = offsetPayload( offset );
+		uint16_t end = (offset + kChunk < kCanvasBytes) ? (offset + kChunk) : kCanvasBytes;
+		payload.insert( payload.end(), pCanvas + offset, pCanvas + end );
+		addPacket( out, kUploadRaw, payload );
+	}
+}
+
+static uint16_t runLength( const uint8_t* pCanvas, uint16_t pos, uint16_t end )
+{
+	uint16_t length = 1;
+	while( (pos + length < end) && (pCanvas[pos + length] == pCanvas[pos]) && (length < 0x7f + kUploadRunBase) )
+	{
+		++length;
+	}
+	return length;
+}
+
+// PackBits, split into packets that fit kUploadMaxPayload and expand to no
+// more than kUploadMaxRleBytes.
+static void encodeRle( Bytes& out, const uint8_t* pCanvas, uint16_t begin, uint16_t end )
+{
+	uint16_t pos = begin;
+	while( pos < end )
+	{
+		Bytes payload = offsetPayload( pos );
+		uint16_t packetEnd = (pos + kUploadMaxRleBytes < end) ? (pos + kUploadMaxRleBytes) : end;
+		while( (pos < packetEnd) && ((kUploadMaxPayload - payload.size()) >= 2) )
+		{
+			uint16_t run = runLength( pCanvas, pos, packetEnd );
+			if( run >= 2 )
+			{
+				payload.push_back( (uint8_t) (run + kUploadRunBase) );
+				payload.push_back( pCanvas[pos] );
+				pos += run;
+				continue;
+			}
+			// Literals, until a run worth breaking off for
+			uint16_t maxLiteral = kUploadMaxPayload - payload.size() - 1;
+			maxLiteral = (maxLiteral < 0x80) ? maxLiteral : 0x80;
+			maxLiteral = (maxLiteral < (packetEnd - pos)) ? maxLiteral : (packetEnd - pos);
+			uint16_t numLiterals = 1;
+			while( (numLiterals < maxLiteral) && (runLength( pCanvas, pos + numLiterals, packetEnd ) < 3) )
+			{
+				++numLiterals;
+			}
+			payload.push_back( (uint8_t) (numLiterals - 1) );
+			payload.insert( payload.end(), pCanvas + pos, pCanvas + pos + numLiterals );
+			pos += numLiterals;
+		}
+		addPacket( out, kUploadRle, payload );
+	}
+}
+
+static void encodeRect( Bytes& out, const uint8_t* pCanvas, const uint8_t* pPrevious )
+{
+	uint8_t left = kWidthBytes;
+	uint8_t right = 0;
+	uint16_t top = kHeight;
+	uint16_t bottom = 0;
+	for( uint16_t y = 0; y < kHeight; ++y )
+	{
+		for( uint8_t x = 0; x < kWidthBytes; ++x )
+		{
+			uint16_t offset = (y * kWidthBytes) + x;
+			if( pCanvas[offset] != pPrevious[offset] )
+			{
+				left = (x < left) ? x : left;
+				right = (x + 1 > right) ? (x + 1) : right;
+				top = (y < top) ? y : top;
+				bottom = y + 1;
+			}
+		}
+	}
+	if( left >= right )
+	{
+		return;
+	}
+	uint8_t width = right - left;
+	uint16_t rowsPerPacket = (kUploadMaxPayload - 4) / width;
+	for( uint16_t y = top; y < bottom; y += rowsPerPacket )
+	{
+		uint16_t height = (y + rowsPerPacket < bottom) ? rowsPerPacket : (bottom - y);
+		Bytes payload;
+		payload.push_back( left );
+		payload.push_back( (uint8_t) y );
+		payload.push_back( width );
+		payload.push_back( (uint8_t) height );
+		for( uint16_t row = 0; row < height; ++row )
+		{
+			const uint8_t* pRow = pCanvas + ((y + row) * kWidthBytes) + left;
+			payload.insert( payload.end(), pRow, pRow + width );
+		}
+		addPacket( out, kUploadRect, payload );
+	}
+}
+
+static void encodeSpan( Bytes& out, const uint8_t* pCanvas, const uint8_t* pPrevious )
+{
+	uint16_t begin = 0;
+	while( (begin < kCanvasBytes) && (pCanvas[begin] == pPrevious[begin]) )
+	{
+		++begin;
+	}
+	uint16_t end = kCanvasBytes;
+	while( (end > begin) && (pCanvas[end - 1] == pPrevious[end - 1]) )
+	{
+		--end;
+	}
+	encodeRle( out, pCanvas, begin, end );
+}
+
+// Read the next image from a PBM file into a canvas sized buffer.
+static bool readPbm( FILE* pFile, uint8_t* pCanvas )
+{
+	char magic[3] = {};
+	if( fscanf( pFile, " %2s", magic ) != 1 )
+	{
+		return false;
+	}
+	bool isBinary = !strcmp( magic, "P4" );
+	if( !isBinary && strcmp( magic, "P1" ) )
+	{
+		fprintf( stderr, "Not a PBM image\n" );
+		return false;
+	}
+	int dims[2];
+	for( int i = 0; i < 2; ++i )
+	{
+		int c;
+		while( ((c = fgetc( pFile )) == '#') || isspace( c ) )
+		{
+			if( c == '#' )
+			{
+				while( ((c = fgetc( pFile )) != '\n') && (c != EOF) ) {}
+			}
+		}
+		ungetc( c, pFile );
+		if( fscanf( pFile, "%d", &dims[i] ) != 1 )
+		{
+			return false;
+		}
+	}
+	if( (dims[0] != kWidth) || (dims[1] != kHeight) )
+	{
+		fprintf( stderr, "Frames must be %dx%d, not %dx%d\n", kWidth, kHeight, dims[0], dims[1] );
+		return false;
+	}
+	if( isBinary )
+	{
+		// One whitespace character, then rows in the same layout as GFXcanvas1
+		fgetc( pFile );
+		return fread( pCanvas, 1, kCanvasBytes, pFile ) == kCanvasBytes;
+	}
+	memset( pCanvas, 0, kCanvasBytes );
+	for( uint32_t i = 0; i < (uint32_t) kWidth * kHeight; ++i )
+	{
+		int c;
+		while( isspace( c = fgetc( pFile ) ) ) {}
+		if( (c != '0') && (c != '1') )
+		{
+			return false;
+		}
+		if( c == '1' )
+		{
+			pCanvas[i >> 3] |= 0x80 >> (i & 7);
+		}
+	}
+	return true;
+}
+
+// Scrolling text over a static border, with a box moving around below it.
+static void drawDemoFrame( GFXcanvas1& canvas, uint32_t frameIdx )
+{
+	static const char* kMessage = "Hello World";
+	static const int16_t kMessageWidth = 11 * 11;
+	canvas.fillScreen( 0 );
+	canvas.drawRect( 0, 0, kWidth, kNumMirrors, 1 );
+	canvas.setCursor( kWidth - (int16_t) (frameIdx % (kWidth + kMessageWidth)), 12 );
+	canvas.print( kMessage );
+	int16_t span = kWidth - 8;
+	int16_t x = (int16_t) ((frameIdx * 3) % (2 * span));
+	x = (x < span) ? x : (2 * span - x);
+	int16_t y = kNumMirrors + 4 + (int16_t) ((frameIdx / 8) % (kHeight - kNumMirrors - 12));
+	canvas.fillRect( x, y, 8, 8, 1 );
+}
+
+static void usage()
+{
+	fprintf( stderr,
+		"Usage: slpframe [options] [FRAMES.pbm ...]\n"
+		"  --demo N            Encode N generated frames\n"
+		"  --key-interval N    Send a key frame at least every N frames (default 30)\n"
+		"  --snapshot-every N  Ask for a snapshot of the canvas after every N frames\n"
+		"  --tag-frames        Mark each frame's number down its left edge\n"
+		"  --verbose           Print the encoding of every frame\n"
+		"  -o FILE             Write the stream to FILE\n" );
+	exit( 1 );
+}
+
+int main( int argc, char** argv )
+{
+	uint32_t numDemoFrames = 0;
+	uint32_t keyInterval = 30;
+	uint32_t snapshotInterval = 0;
+	bool tagFrames = false;
+	bool verbose = false;
+	const char* pOutPath = nullptr;
+	std::vector<const char*> inPaths;
+	for( int i = 1; i < argc; ++i )
+	{
+		const char* pArg = argv[i];
+		bool hasValue = (i + 1) < argc;
+		if( !strcmp( pArg, "--demo" ) && hasValue )
+		{
+			numDemoFrames = (uint32_t) atol( argv[++i] );
+		}
+		else if( !strcmp( pArg, "--key-interval" ) && hasValue )
+		{
+			keyInterval = (uint32_t) atol( argv[++i] );
+		}
+		else if( !strcmp( pArg, "--snapshot-every" ) && hasValue )
+		{
+			snapshotInterval = (uint32_t) atol( argv[++i] );
+		}
+		else if( !strcmp( pArg, "--tag-frames" ) )
+		{
+			tagFrames = true;
+		}
+		else if( !strcmp( pArg, "--verbose" ) )
+		{
+			verbose = true;
+		}
+		else if( !strcmp( pArg, "-o" ) && hasValue )
+		{
+			pOutPath = argv[++i];
+		}
+		else if( pArg[0] != '-' )
+		{
+			inPaths.push_back( pArg );
+		}
+		else
+		{
+			usage();
+		}
+	}
+	if( (numDemoFrames == 0) == inPaths.empty() )
+	{
+		usage();
+	}
+
+	// Collect the frames
+	std::vector<Bytes> frames;
+	if( numDemoFrames )
+	{
+		GFXcanvas1 canvas( kWidth, kHeight );
+		canvas.setFont( &FreeMono9pt7b );
+		canvas.setTextWrap( false );
+		for( uint32_t i = 0; i < numDemoFrames; ++i )
+		{
+			drawDemoFrame( canvas, i );
+			frames.push_back( Bytes( canvas.getBuffer(), canvas.getBuffer() + kCanvasBytes ) );
+		}
+	}
+	for( const char* pPath : inPaths )
+	{
+		FILE* pFile = fopen( pPath, "rb" );
+		if( !pFile )
+		{
+			fprintf( stderr, "Can't open %s\n", pPath );
+			return 1;
+		}
+		Bytes frame( kCanvasBytes );
+		while( readPbm( pFile, frame.data() ) )
+		{
+			frames.push_back( frame );
+		}
+		fclose( pFile );
+	}
+	if( tagFrames )
+	{
+		for( size_t frameIdx = 0; frameIdx < frames.size(); ++frameIdx )
+		{
+			for( uint16_t y = 0; y < kHeight; ++y )
+			{
+				frames[frameIdx][y * kWidthBytes] = (uint8_t) (0x80 | (frameIdx & 0x7f));
+			}
+		}
+	}
+
+	Bytes stream;
+	Bytes previous( kCanvasBytes, 0 );
+	uint32_t encodingCounts[kNumEncodings] = {};
+	uint32_t encodingBytes[kNumEncodings] = {};
+	uint32_t maxFrameBytes = 0;
+	uint32_t sinceKeyFrame = keyInterval;
+	for( size_t frameIdx = 0; frameIdx < frames.size(); ++frameIdx )
+	{
+		const uint8_t* pCanvas = frames[frameIdx].data();
+		bool needKeyFrame = (sinceKeyFrame + 1 >= keyInterval) || (frameIdx == 0);
+		Bytes bodies[kNumEncodings];
+		encodeRaw( bodies[kEncodingRaw], pCanvas );
+		encodeRle( bodies[kEncodingRle], pCanvas, 0, kCanvasBytes );
+		int best = (bodies[kEncodingRle].size() < bodies[kEncodingRaw].size()) ? kEncodingRle : kEncodingRaw;
+		if( !needKeyFrame )
+		{
+			encodeRect( bodies[kEncodingRect], pCanvas, previous.data() );
+			encodeSpan( bodies[kEncodingSpan], pCanvas, previous.data() );
+			for( int encoding = kEncodingRect; encoding < kNumEncodings; ++encoding )
+			{
+				if( bodies[encoding].size() < bodies[best].size() )
+				{
+					best = encoding;
+				}
+			}
+		}
+		bool isKeyFrame = (best == kEncodingRaw) || (best == kEncodingRle);
+		sinceKeyFrame = isKeyFrame ? 0 : (sinceKeyFrame + 1);
+
+		Bytes frame;
+		Bytes begin;
+		begin.push_back( (uint8_t) frameIdx );
+		begin.push_back( isKeyFrame ? kUploadKeyFrame : 0 );
+		addPacket( frame, kUploadBeginFrame, begin );
+		frame.insert( frame.end(), bodies[best].begin(), bodies[best].end() );
+		addPacket( frame, kUploadEndFrame, Bytes( 1, (uint8_t) frameIdx ) );
+		if( snapshotInterval && (((frameIdx + 1) % snapshotInterval) == 0) )
+		{
+			addPacket( frame, kUploadSnapshot, Bytes() );
+		}
+
+		++encodingCounts[best];
+		encodingBytes[best] += (uint32_t) frame.size();
+		maxFrameBytes = (frame.size() > maxFrameBytes) ? (uint32_t) frame.size() : maxFrameBytes;
+		if( verbose )
+		{
+			printf( "Frame %zu: %s, %zu bytes (raw %zu, rle %zu, rect %zu, span %zu)\n", frameIdx, kEncodingNames[best], frame.size(),
+				bodies[kEncodingRaw].size(), bodies[kEncodingRle].size(), bodies[kEncodingRect].size(), bodies[kEncodingSpan].size() );
+		}
+		stream.insert( stream.end(), frame.begin(), frame.end() );
+		previous = frames[frameIdx];
+	}
+
+	if( pOutPath )
+	{
+		FILE* pFile = fopen( pOutPath, "wb" );
+		if( !pFile || (fwrite( stream.data(), 1, stream.size(), pFile ) != stream.size()) )
+		{
+			fprintf( stderr, "Can't write %s\n", pOutPath );
+			return 1;
+		}
+		fclose( pFile );
+	}
+
+	size_t numFrames = frames.size();
+	double averageBytes = numFrames ? (double) stream.size() / numFrames : 0.0;
+	printf( "%zu frames, %zu bytes, %.1f bytes per frame (max %u), raw frame %u bytes\n", numFrames, stream.size(), averageBytes, maxFrameBytes, kCanvasBytes );
+	for( int encoding = 0; encoding < kNumEncodings; ++encoding )
+	{
+		if( encodingCounts[encoding] )
+		{
+			printf( "  %-5s %6u frames, %.1f bytes per frame\n", kEncodingNames[encoding], encodingCounts[encoding], (double) encodingBytes[encoding] / encodingCounts[encoding] );
+		}
+	}
+	printf( "At 115200 baud: %.1f fps sustained, %.1f fps for the largest frame\n",
+		averageBytes > 0.0 ? kBytesPerSecond / averageBytes : 0.0, maxFrameBytes ? (double) kBytesPerSecond / maxFrameBytes : 0.0 );
+	return 0;
+}
@@ -0,0 +1,165 @@
+// Decoder for the sketch's binary log (see Log.h).
+//
+//   slplog [--level N] [FILE]
+//
+// Reads a captured Serial stream (from the Arduino, or slpsim --serial-log)
+// from FILE or stdin, skips anything that isn't a valid log frame, and
+// prints each record as a line of text, expanded from its format in
+// LogMessages.h. --level only prints messages up to that level.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "Log.h"
+
+struct MessageInfo
+{
+	uint8_t     m_subsystem;
+	uint8_t     m_level;
+	const char* m_pFormat;
+};
+
+#define SLP_LOG_INFO( id, subsystem, level, format ) { subsystem, level, format },
+static const MessageInfo kMessageInfo[] = { SLP_LOG_MESSAGES( SLP_LOG_INFO ) };
+#undef SLP_LOG_INFO
+
+static const char* kLevelNames[] = { "error", "warning", "info", "debug" };
+static const char* kSubsystemNames[] = { "log", "sync", "scan", "input", "storage", "timer" };
+
+// Expand a format the way the sketch's printf would have, with each
+// argument as sent, 32 bits whatever the conversion's length modifier.
+static std::string expand( const char* pFormat, const int32_t* pArgs )
+{
+	std::string text;
+	for( const char* p = pFormat; *p; ++p )
+	{
+		if( *p != '%' )
+		{
+			text += *p;
+			continue;
+		}
+		if( p[1] == '%' )
+		{
+			text += '%';
+			++p;
+			continue;
+		}
+		std::string spec = "%";
+		while( p[1] && strchr( "-+ #0123456789", p[1] ) )
+		{
+			spec += *++p;
+		}
+		while( p[1] == 'l' || p[1] == 'h' )
+		{
+			++p;
+		}
+		char conversion = *++p;
+		char buffer[32];
+		if( conversion == 'd' || conversion == 'i' )
+		{
+			snprintf( buffer, sizeof( buffer ), (spec + "lld").c_str(), (long long) *pArgs++ );
+		}
+		else
+		{
+			snprintf( buffer, sizeof( buffer ), (spec + "ll" + conversion).c_str(), (unsigned long long) (uint32_t) *pArgs++ );
+		}
+		text += buffer;
+	}
+	return text;
+}
+
+static void usage()
+{
+	fprintf( stderr,
+		"Usage: slplog [options] [FILE]\n"
+		"  --level N  Only print messages up to level N: 0 errors, 1 warnings,\n"
+		"             2 info, 3 debug (default 3)\n" );
+	exit( 1 );
+}
+
+int main( int argc, char** argv )
+{
+	int maxLevel = kLogLevelDebug;
+	const char* pPath = nullptr;
+	for( int i = 1; i < argc; ++i )
+	{
+		if( !strcmp( argv[i], "--level" ) && (i + 1) < argc )
+		{
+			maxLevel = atoi( argv[++i] );
+		}
+		else if( (argv[i][0] == '-') && argv[i][1] )
+		{
+			usage();
+		}
+		else
+		{
+			pPath = argv[i];
+		}
+	}
+
+	FILE* pFile = (pPath && strcmp( pPath, "-" )) ? fopen( pPath, "rb" ) : stdin;
+	if( !pFile )
+	{
+		fprintf( stderr, "Can't open %s\n", pPath );
+		return 1;
+	}
+	std::vector<uint8_t> data;
+	uint8_t buffer[4096];
+	size_t numRead;
+	while( (numRead = fread( buffer, 1, sizeof( buffer ), pFile )) > 0 )
+	{
+		data.insert( data.end(), buffer, buffer + numRead );
+	}
+	if( pFile != stdin )
+	{
+		fclose( pFile );
+	}
+
+	uint64_t numRecords = 0;
+	uint64_t numSkippedBytes = 0;
+	size_t pos = 0;
+	while( pos + 3 <= data.size() )
+	{
+		const uint8_t* pFrame = &data[pos];
+		uint8_t id = pFrame[1];
+		size_t numArgs = (id < kNumLogMessages) ? LogNumArgs( kMessageInfo[id].m_pFormat ) : 0;
+		size_t frameBytes = 3 + (4 * numArgs);
+		if( (pFrame[0] != kLogFrameStart) || (id >= kNumLogMessages) || (numArgs > kLogMaxArgs) || (pos + frameBytes > data.size()) )
+		{
+			++numSkippedBytes;
+			++pos;
+			continue;
+		}
+		uint8_t check = 0;
+		for( size_t i = 1; i < frameBytes - 1; ++i )
+		{
+			check ^= pFrame[i];
+		}
+		if( check != pFrame[frameBytes - 1] )
+		{
+			++numSkippedBytes;
+			++pos;
+			continue;
+		}
+		pos += frameBytes;
+		++numRecords;
+
+		int32_t args[kLogMaxArgs] = {0};
+		for( size_t i = 0; i < numArgs; ++i )
+		{
+			const uint8_t* pArg = pFrame + 2 + (4 * i);
+			args[i] = (int32_t) (pArg[0] | (pArg[1] << 8) | (pArg[2] << 16) | ((uint32_t) pArg[3] << 24));
+		}
+		const MessageInfo& info = kMessageInfo[id];
+		if( info.m_level <= maxLevel )
+		{
+			printf( "%-7s %-7s %s\n", kLevelNames[info.m_level], kSubsystemNames[info.m_subsystem], expand( info.m_pFormat, args ).c_str() );
+		}
+	}
+	numSkippedBytes += data.size() - pos;
+	fprintf( stderr, "%llu log records, %llu other bytes skipped\n", (unsigned long long) numRecords, (unsigned long long) numSkippedBytes );
+	return 0;
+}
@@ -0,0 +1,251 @@
+// Command line driver for the scanning laser projector simulator.
+//
+//   slpsim [--revs N] [--rpm R] [--jitter US] [--drop P] [--glitch P]
+//          [--outage REV:COUNT] [--seed S] [--motor] [--motor-max-rpm R]
+//          [--motor-tau S] [--motor-load REV:F] [--serial] [--serial-log FILE]
+//          [--serial-in FILE] [--check-frame-tags]
+//          [--portb-log FILE] [--eeprom FILE] [--press PIN:MS[:HOLD]]...
+//          [--bounce MS]
+//   slpsim --clock-test
+//   slpsim --measure-revolution-settings
+//   slpsim --measure-tile-canvas
+//   slpsim --measure-glyph-cache
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ScanningLaserProjector.h"
+#include "Simulator.h"
+#include "Log.h"
+#include "Scheduler.h"
+#include "Trace.h"
+
+// From ScanningLaserProjector.ino
+void setup();
+void loop();
+
+// From Benchmarks.cpp
+void MeasureRevolutionSettings();
+void MeasureTileCanvas();
+void MeasureGlyphCache();
+
+// From ClockTest.cpp
+int RunClockTest();
+
+// Only with full double buffering is every frame meant to be presented whole.
+// With fewer spare scan-lines a big change is presented over several
+// revolutions, so --check-frame-tags only reports.
+static const bool kIsDoubleBuffered = SLP_TRANSPOSED_SCAN_BUFFER && (SLP_SPARE_SCAN_LINES >= SLP_NUM_MIRRORS);
+
+static void usage()
+{
+	fprintf( stderr,
+		"Usage: slpsim [options]\n"
+		"  --revs N         Drum revolutions to simulate (default 500)\n"
+		"  --rpm R          Drum speed (default 1000)\n"
+		"  --jitter US      Sync sensor jitter standard deviation in us (default 10)\n"
+		"  --drop P         Probability of a sync pulse going missing\n"
+		"  --glitch P       Probability per revolution of a spurious sync pulse\n"
+		"  --outage REV:N   No sync pulses for N revolutions from revolution REV\n"
+		"  --seed S         Random seed (default 1)\n"
+		"  --motor          Drive the drum from the PWM duty, from rest, instead of --rpm\n"
+		"  --motor-max-rpm R Motor speed at full duty (default 2400)\n"
+		"  --motor-tau S    Motor time constant in seconds (default 1)\n"
+		"  --motor-load REV:F Scale the motor's speed by F from revolution REV\n"
+		"  --serial         Echo the sketch's Serial output\n"
+		"  --serial-log FILE Write the raw Serial output, for slptrace\n"
+		"  --serial-in FILE Stream a file into Serial at 115200 baud, e.g. from slpframe\n"
+		"  --check-frame-tags Fail if a revolution shows parts of two frames from\n"
+		"                   slpframe --tag-frames, or none shows a whole one,\n"
+		"                   when double buffered\n"
+		"  --portb-log FILE Write timestamped laser changes as CSV\n"
+		"  --eeprom FILE    Load and save EEPROM contents\n"
+		"  --press PIN:MS[:HOLD] Press the button on PIN at MS ms for HOLD ms (default 100)\n"
+		"  --bounce MS      How long button contacts bounce for (default 1)\n"
+		"  --clock-test     Stress test the clock across Timer1 wraps, and exit\n"
+		"  --measure-revolution-settings\n"
+		"                   Time the per-revolution conversions against division, and exit\n"
+		"  --measure-tile-canvas\n"
+		"                   Check and time the tile canvas on some test frames, and exit\n"
+		"  --measure-glyph-cache\n"
+		"                   Time text from the glyph cache against gfx.print, and exit\n" );
+	exit( 1 );
+}
+
+int main( int argc, char** argv )
+{
+	SimConfig config;
+	uint32_t numRevs = 500;
+	for( int i = 1; i < argc; ++i )
+	{
+		const char* pArg = argv[i];
+		bool hasValue = (i + 1) < argc;
+		if( !strcmp( pArg, "--revs" ) && hasValue )
+		{
+			numRevs = (uint32_t) atol( argv[++i] );
+		}
+		else if( !strcmp( pArg, "--rpm" ) && hasValue )
+		{
+			config.m_rpm = atof( argv[++i] );
+		}
+		else if( !strcmp( pArg, "--jitter" ) && hasValue )
+		{
+			config.m_syncJitterUs = atof( argv[++i] );
+		}
+		else if( !strcmp( pArg, "--drop" ) && hasValue )
+		{
+			config.m_syncDropProbability = atof( argv[++i] );
+		}
+		else if( !strcmp( pArg, "--glitch" ) && hasValue )
+		{
+			config.m_syncGlitchProbability = atof( argv[++i] );
+		}
+		else if( !strcmp( pArg, "--outage" ) && hasValue )
+		{
+			const char* pValue = argv[++i];
+			config.m_outageRev = (uint32_t) atol( pValue );
+			const char* pCount = strchr( pValue, ':' );
+			config.m_numOutageRevs = pCount ? (uint32_t) atol( pCount + 1 ) : 1;
+		}
+		else if( !strcmp( pArg, "--seed" ) && hasValue )
+		{
+			config.m_seed = (uint32_t) atol( argv[++i] );
+		}
+		else if( !strcmp( pArg, "--motor" ) )
+		{
+			config.m_motor = true;
+		}
+		else if( !strcmp( pArg, "--motor-max-rpm" ) && hasValue )
+		{
+			config.m_motorMaxRpm = atof( argv[++i] );
+		}
+		else if( !strcmp( pArg, "--motor-tau" ) && hasValue )
+		{
+			config.m_motorTimeConstant = atof( argv[++i] );
+		}
+		else if( !strcmp( pArg, "--motor-load" ) && hasValue )
+		{
+			const char* pValue = argv[++i];
+			config.m_motorLoadRev = (uint32_t) atol( pValue );
+			const char* pLoad = strchr( pValue, ':' );
+			config.m_motorLoad = pLoad ? atof( pLoad + 1 ) : 1.0;
+		}
+		else if( !strcmp( pArg, "--serial" ) )
+		{
+			config.m_echoSerial = true;
+		}
+		else if( !strcmp( pArg, "--serial-log" ) && hasValue )
+		{
+			config.m_pSerialLogPath = argv[++i];
+		}
+		else if( !strcmp( pArg, "--serial-in" ) && hasValue )
+		{
+			config.m_pSerialInPath = argv[++i];
+		}
+		else if( !strcmp( pArg, "--check-frame-tags" ) )
+		{
+			config.m_checkFrameTags = true;
+		}
+		else if( !strcmp( pArg, "--portb-log" ) && hasValue )
+		{
+			config.m_pPortbLogPath = argv[++i];
+		}
+		else if( !strcmp( pArg, "--eeprom" ) && hasValue )
+		{
+			config.m_pEepromPath = argv[++i];
+		}
+		else if( !strcmp( pArg, "--press" ) && hasValue )
+		{
+			const char* pValue = argv[++i];
+			SimButtonPress press;
+			press.m_pin = (uint8_t) atol( pValue );
+			const char* pMs = strchr( pValue, ':' );
+			const char* pHold = pMs ? strchr( pMs + 1, ':' ) : nullptr;
+			if( !pMs || (press.m_pin >= 8) )
+			{
+				usage();
+			}
+			press.m_ms = atof( pMs + 1 );
+			press.m_holdMs = pHold ? atof( pHold + 1 ) : 100.0;
+			config.m_buttonPresses.push_back( press );
+		}
+		else if( !strcmp( pArg, "--bounce" ) && hasValue )
+		{
+			config.m_bounceMs = atof( argv[++i] );
+		}
+		else if( !strcmp( pArg, "--measure-revolution-settings" ) )
+		{
+			config.m_echoSerial = true;
+			sim.Configure( config );
+			setup();
+			MeasureRevolutionSettings();
+			Serial.flush();
+			return 0;
+		}
+		else if( !strcmp( pArg, "--measure-tile-canvas" ) )
+		{
+			config.m_echoSerial = true;
+			sim.Configure( config );
+			setup();
+			MeasureTileCanvas();
+			Serial.flush();
+			return 0;
+		}
+		else if( !strcmp( pArg, "--measure-glyph-cache" ) )
+		{
+			config.m_echoSerial = true;
+			sim.Configure( config );
+			setup();
+			MeasureGlyphCache();
+			Serial.flush();
+			return 0;
+		}
+		else if( !strcmp( pArg, "--clock-test" ) )
+		{
+			sim.Configure( config );
+			return RunClockTest();
+		}
+		else
+		{
+			usage();
+		}
+	}
+	if( (config.m_rpm <= 0.0) || (config.m_motorTimeConstant <= 0.0) )
+	{
+		usage();
+	}
+
+	sim.Configure( config );
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	setup();
+	if( scheduler.GetNumTasks() != Scheduler::kMaxTasks )
+	{
+		fprintf( stderr, "Added %u tasks, but Scheduler::kMaxTasks is %u\n", scheduler.GetNumTasks(), Scheduler::kMaxTasks );
+		return 1;
+	}
+	while( sim.GetNumDrumRevolutions() < numRevs )
+	{
+		loop();
+	}
+	sim.EndRun();
+	double hostSeconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+	// Let the sketch report on itself
+	TraceFlush();
+	LogFlush();
+	Serial.flush();
+	printf( "\n" );
+	sim.SetEchoSerial( true );
+	PrintStats();
+	Serial.flush();
+	sim.Finish();
+
+	printf( "\n" );
+	sim.Report( stdout );
+	printf( "\nHost time %.3fs, %.0f revolutions per second\n", hostSeconds, hostSeconds > 0.0 ? numRevs / hostSeconds : 0.0 );
+	bool isTagCheckFailed = !sim.GetNumTaggedRevolutions() || sim.GetNumMixedRevolutions();
+	return (config.m_checkFrameTags && kIsDoubleBuffered && isTagCheckFailed) ? 1 : 0;
+}
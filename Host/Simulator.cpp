@@ -0,0 +1,954 @@
+#include "Simulator.h"
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include <Arduino.h>
+
+Simulator sim;
+
+// Approximate AVR cycle costs of the interrupt handlers that the sketch does
+// not account for itself.
+static const uint32_t kInt0DispatchCycles = 80;     // attachInterrupt() trampoline, all registers saved
+static const uint32_t kTimer0OverflowCycles = 90;   // Arduino's millis() bookkeeping
+static const uint32_t kUsartUdreCycles = 60;        // HardwareSerial transmit ISR
+static const uint32_t kUsartRxCycles = 50;          // HardwareSerial receive ISR
+static const uint32_t kSerialReadCycles = 40;       // HardwareSerial::read()
+static const uint32_t kIsrOverheadCycles = 30;      // Vector, prologue, epilogue and reti of a small ISR
+static const uint32_t kSerialWriteCycles = 60;      // HardwareSerial::write() when not blocked
+static const uint32_t kTimer0OverflowPeriod = 16384; // Prescaler 64, 256 counts
+static const uint64_t kTimer1OverflowPeriod = 0x10000 * Simulator::kCyclesPerTimer1Tick;
+
+static const uint64_t kNever = ~(uint64_t) 0;
+
+// The motor model's speed is updated every 1ms, and a stopped drum is taken
+// to be turning very slowly so its next edge is just a long way off.
+static const uint32_t kMotorStepCycles = Simulator::kCyclesPerSecond / 1000;
+static const double kMinMotorRpm = 1.0;
+
+// Interrupt vectors that the sketch may or may not define
+extern "C" void PCINT2_vect() __attribute__((weak));
+extern "C" void TIMER1_COMPB_vect() __attribute__((weak));
+extern "C" void TIMER1_OVF_vect() __attribute__((weak));
+
+void Simulator::RunningStats::Add( double value )
+{
+	++m_count;
+	m_sum += value;
+	m_sumSq += value * value;
+	if( value < m_min )
+	{
+		m_min = value;
+	}
+	if( value > m_max )
+	{
+		m_max = value;
+	}
+}
+
+double Simulator::RunningStats::GetStdDev() const
+{
+	if( m_count < 2 )
+	{
+		return 0.0;
+	}
+	double mean = GetMean();
+	double variance = (m_sumSq / m_count) - (mean * mean);
+	return variance > 0.0 ? sqrt( variance ) : 0.0;
+}
+
+Simulator::Simulator()
+: m_cycle( 0 ), m_interruptsEnabled( true ), m_inInterrupt( false ), m_pending( 0 ), m_int0Handler( nullptr )
+, m_drumPeriodCycles( 0.0 ), m_nextDrumEdgeCycle( 0.0 ), m_lastDrumEdgeCycle( 0.0 ), m_numDrumEdges( 0 )
+, m_numRevsWithScanLines( 0 ), m_scanLinesThisRev( 0 ), m_numSyncPulsesDropped( 0 ), m_numSyncGlitches( 0 )
+, m_numLostRevs( 0 ), m_lostRevRun( 0 ), m_maxLostRevRun( 0 ), m_numLostRevRuns( 0 ), m_isRunEnded( false ), m_numRunDrumEdges( 0 )
+, m_motorRpm( 0.0 ), m_nextMotorStep( kNever )
+, m_nextTimer0Overflow( kTimer0OverflowPeriod ), m_nextTimer1Overflow( kTimer1OverflowPeriod ), m_timer1Overflowed( false )
+, m_lastCompareBTick( kNever )
+, m_nextSerialTxComplete( kNever ), m_numSerialBytes( 0 ), m_serialBlockedCycles( 0 ), m_pSerialLog( nullptr )
+, m_serialInPos( 0 ), m_nextSerialRx( kNever ), m_numSerialRxBytes( 0 ), m_numSerialRxDropped( 0 )
+, m_eepromBusyUntil( 0 ), m_numEepromWrites( 0 ), m_eepromStalledCycles( 0 )
+, m_pinsLow( 0 ), m_numPinEdges( 0 )
+, m_pPortbLog( nullptr ), m_lasers( 0 ), m_numLaserWrites( 0 )
+, m_currentScanLine( -1 ), m_scanLineStartCycle( 0 ), m_scanLineEdgeCycle( 0.0 ), m_scanLineFirstPixel( 0 ), m_nextPixel( 0 ), m_numScanLines( 0 )
+, m_tagMirror( -1 ), m_tagRevFrame( -1 ), m_isTagRevMixed( false ), m_numTagRevRows( 0 ), m_isTagChecking( false ), m_numTaggedRevs( 0 ), m_numMixedTagRevs( 0 )
+, m_interruptCycles( 0 )
+{
+	memset( m_eeprom, 0xff, sizeof( m_eeprom ) );
+	memset( m_scanLineTags, 0, sizeof( m_scanLineTags ) );
+}
+
+void Simulator::Configure( const SimConfig& config )
+{
+	m_config = config;
+	m_random.seed( config.m_seed );
+	if( config.m_motor )
+	{
+		// From rest, until the sketch sets up the PWM
+		m_motorRpm = 0.0;
+		m_nextMotorStep = kMotorStepCycles;
+		m_drumPeriodCycles = 60.0 * kCyclesPerSecond / kMinMotorRpm;
+	}
+	else
+	{
+		m_drumPeriodCycles = 60.0 * kCyclesPerSecond / config.m_rpm;
+	}
+	// Start the drum part way round, as it would be at power on
+	m_nextDrumEdgeCycle = m_drumPeriodCycles * 0.3;
+	m_lastDrumEdgeCycle = m_nextDrumEdgeCycle - m_drumPeriodCycles;
+
+	if( config.m_pSerialLogPath )
+	{
+		m_pSerialLog = fopen( config.m_pSerialLogPath, "wb" );
+	}
+	if( config.m_pSerialInPath )
+	{
+		FILE* pFile = fopen( config.m_pSerialInPath, "rb" );
+		if( pFile )
+		{
+			int c;
+			while( (c = fgetc( pFile )) != EOF )
+			{
+				m_serialIn.push_back( (uint8_t) c );
+			}
+			fclose( pFile );
+		}
+		// Start sending once the sketch is up and running
+		if( !m_serialIn.empty() )
+		{
+			m_nextSerialRx = kCyclesPerSecond / 5;
+		}
+	}
+	if( config.m_pPortbLogPath )
+	{
+		m_pPortbLog = fopen( config.m_pPortbLogPath, "w" );
+		if( m_pPortbLog )
+		{
+			fprintf( m_pPortbLog, "cycle,portb\n" );
+		}
+	}
+	// A generator of their own, so that pressing buttons doesn't change the
+	// drum's jitter.
+	std::mt19937 buttonRandom( config.m_seed );
+	for( const SimButtonPress& press : config.m_buttonPresses )
+	{
+		addButtonEdges( press, buttonRandom );
+	}
+	std::sort( m_pinEdges.begin(), m_pinEdges.end() );
+	PIND = 0xff;
+	if( config.m_pEepromPath )
+	{
+		FILE* pFile = fopen( config.m_pEepromPath, "rb" );
+		if( pFile )
+		{
+			size_t numRead = fread( m_eeprom, 1, sizeof( m_eeprom ), pFile );
+			(void) numRead;
+			fclose( pFile );
+		}
+	}
+}
+
+void Simulator::Finish()
+{
+	endTagRevolution();
+	if( m_pSerialLog )
+	{
+		fclose( m_pSerialLog );
+		m_pSerialLog = nullptr;
+	}
+	if( m_pPortbLog )
+	{
+		fclose( m_pPortbLog );
+		m_pPortbLog = nullptr;
+	}
+	if( m_config.m_pEepromPath )
+	{
+		FILE* pFile = fopen( m_config.m_pEepromPath, "wb" );
+		if( pFile )
+		{
+			fwrite( m_eeprom, 1, sizeof( m_eeprom ), pFile );
+			fclose( pFile );
+		}
+	}
+}
+
+double Simulator::gaussian()
+{
+	return m_normal( m_random );
+}
+
+// The cycle at which Timer1 next counts to 'compare'.
+uint64_t Simulator::nextCompareCycle( uint16_t compare, uint64_t lastMatchTick ) const
+{
+	uint64_t tick = m_cycle / kCyclesPerTimer1Tick;
+	uint64_t matchTick = tick + (uint16_t) (compare - (uint16_t) tick);
+	if( matchTick == lastMatchTick )
+	{
+		matchTick += 0x10000;
+	}
+	return matchTick * kCyclesPerTimer1Tick;
+}
+
+void Simulator::addButtonEdges( const SimButtonPress& press, std::mt19937& random )
+{
+	// The contacts make or break, then bounce an even number of times over
+	// the next m_bounceMs.
+	std::uniform_real_distribution<double> uniform( 0.0, 1.0 );
+	double bounceWindowCycles = m_config.m_bounceMs * kCyclesPerSecond / 1000.0;
+	for( int isRelease = 0; isRelease < 2; ++isRelease )
+	{
+		double cycle = (press.m_ms + (isRelease ? press.m_holdMs : 0.0)) * kCyclesPerSecond / 1000.0;
+		PinEdge edge = { (uint64_t) cycle, press.m_pin, !isRelease };
+		m_pinEdges.push_back( edge );
+		int numBounces = 2 * (1 + (int) (uniform( random ) * 3.0));
+		std::vector<uint64_t> bounceEdgeCycles;
+		for( int i = 0; i < numBounces; ++i )
+		{
+			bounceEdgeCycles.push_back( (uint64_t) (cycle + (uniform( random ) * bounceWindowCycles)) + 1 );
+		}
+		std::sort( bounceEdgeCycles.begin(), bounceEdgeCycles.end() );
+		for( int i = 0; i < numBounces; ++i )
+		{
+			edge.m_cycle = bounceEdgeCycles[i];
+			edge.m_isLow = !edge.m_isLow;
+			m_pinEdges.push_back( edge );
+		}
+	}
+}
+
+uint64_t Simulator::nextEventCycle() const
+{
+	uint64_t next = (uint64_t) ceil( m_nextDrumEdgeCycle );
+	if( !m_syncPulses.empty() && (m_syncPulses.front() < next) )
+	{
+		next = m_syncPulses.front();
+	}
+	if( m_nextMotorStep < next )
+	{
+		next = m_nextMotorStep;
+	}
+	if( m_nextTimer0Overflow < next )
+	{
+		next = m_nextTimer0Overflow;
+	}
+	if( m_nextTimer1Overflow < next )
+	{
+		next = m_nextTimer1Overflow;
+	}
+	if( m_nextSerialTxComplete < next )
+	{
+		next = m_nextSerialTxComplete;
+	}
+	if( m_nextSerialRx < next )
+	{
+		next = m_nextSerialRx;
+	}
+	if( !m_pinEdges.empty() && (m_pinEdges.front().m_cycle < next) )
+	{
+		next = m_pinEdges.front().m_cycle;
+	}
+	if( TIMSK1 & (1 << OCIE1B) )
+	{
+		uint64_t compareB = nextCompareCycle( OCR1B, m_lastCompareBTick );
+		if( compareB < next )
+		{
+			next = compareB;
+		}
+	}
+	return next;
+}
+
+void Simulator::stepMotor()
+{
+	// Fast PWM on OCR2B with the counter wrapping at 255
+	double duty = OCR2B / 255.0;
+	double load = (m_numDrumEdges >= m_config.m_motorLoadRev) ? m_config.m_motorLoad : 1.0;
+	double targetRpm = duty * m_config.m_motorMaxRpm * load;
+	double dt = (double) kMotorStepCycles / kCyclesPerSecond;
+	m_motorRpm += (targetRpm - m_motorRpm) * (1.0 - exp( -dt / m_config.m_motorTimeConstant ));
+
+	// The rest of the revolution goes at the new speed
+	double remaining = (m_nextDrumEdgeCycle - (double) m_nextMotorStep) / m_drumPeriodCycles;
+	m_drumPeriodCycles = 60.0 * kCyclesPerSecond / std::max( m_motorRpm, kMinMotorRpm );
+	m_nextDrumEdgeCycle = (double) m_nextMotorStep + (remaining * m_drumPeriodCycles);
+}
+
+void Simulator::processEvents()
+{
+	while( m_nextMotorStep <= m_cycle )
+	{
+		stepMotor();
+		m_nextMotorStep += kMotorStepCycles;
+	}
+	while( m_nextDrumEdgeCycle <= (double) m_cycle )
+	{
+		if( m_config.m_motor )
+		{
+			m_drumPeriodsUs.push_back( (m_nextDrumEdgeCycle - m_lastDrumEdgeCycle) / kCyclesPerMicroSecond );
+		}
+		// The drum has passed its index position. The sensor reports it a
+		// little later, by an amount that varies from revolution to revolution.
+		++m_numDrumEdges;
+		// The report printed after the run doesn't count.
+		if( !m_isRunEnded )
+		{
+			if( m_scanLinesThisRev )
+			{
+				++m_numRevsWithScanLines;
+				m_lostRevRun = 0;
+			}
+			else if( m_numRevsWithScanLines )
+			{
+				// Blank after we'd started drawing
+				++m_numLostRevs;
+				if( m_lostRevRun++ == 0 )
+				{
+					++m_numLostRevRuns;
+				}
+				if( m_lostRevRun > m_maxLostRevRun )
+				{
+					m_maxLostRevRun = m_lostRevRun;
+				}
+			}
+		}
+		m_scanLinesThisRev = 0;
+
+		std::uniform_real_distribution<double> uniform( 0.0, 1.0 );
+		if( uniform( m_random ) < m_config.m_syncGlitchProbability )
+		{
+			// Spurious pulse somewhere in the coming revolution
+			m_syncPulses.push_back( (uint64_t) (m_nextDrumEdgeCycle + m_drumPeriodCycles * (0.05 + 0.9 * uniform( m_random ))) );
+			++m_numSyncGlitches;
+		}
+		bool inOutage = (m_numDrumEdges >= m_config.m_outageRev) && (m_numDrumEdges < m_config.m_outageRev + m_config.m_numOutageRevs);
+		if( inOutage || (uniform( m_random ) < m_config.m_syncDropProbability) )
+		{
+			++m_numSyncPulsesDropped;
+			m_lastDrumEdgeCycle = m_nextDrumEdgeCycle;
+			m_nextDrumEdgeCycle += m_drumPeriodCycles;
+			continue;
+		}
+		double sigma = m_config.m_syncJitterUs * kCyclesPerMicroSecond;
+		double jitter = gaussian() * sigma;
+		if( jitter > 3.0 * sigma )
+		{
+			jitter = 3.0 * sigma;
+		}
+		else if( jitter < -3.0 * sigma )
+		{
+			jitter = -3.0 * sigma;
+		}
+		uint64_t pulseCycle = (uint64_t) (m_nextDrumEdgeCycle + 3.0 * sigma + jitter);
+		m_syncPulses.push_back( pulseCycle );
+		std::sort( m_syncPulses.begin(), m_syncPulses.end() );
+		m_lastDrumEdgeCycle = m_nextDrumEdgeCycle;
+		m_nextDrumEdgeCycle += m_drumPeriodCycles;
+	}
+	while( !m_syncPulses.empty() && (m_syncPulses.front() <= m_cycle) )
+	{
+		m_syncPulses.pop_front();
+		if( m_int0Handler )
+		{
+			m_pending |= 1 << kSimVectorInt0;
+		}
+	}
+	while( !m_pinEdges.empty() && (m_pinEdges.front().m_cycle <= m_cycle) )
+	{
+		const PinEdge& edge = m_pinEdges.front();
+		uint8_t mask = 1 << edge.m_pin;
+		m_pinsLow = edge.m_isLow ? (m_pinsLow | mask) : (m_pinsLow & ~mask);
+		PIND = (uint8_t) ~m_pinsLow;
+		++m_numPinEdges;
+		if( (PCICR & (1 << PCIE2)) && (PCMSK2 & mask) )
+		{
+			m_pending |= 1 << kSimVectorPcint2;
+		}
+		m_pinEdges.pop_front();
+	}
+	while( m_nextTimer0Overflow <= m_cycle )
+	{
+		m_nextTimer0Overflow += kTimer0OverflowPeriod;
+		if( TIMSK0 & (1 << TOIE0) )
+		{
+			m_pending |= 1 << kSimVectorTimer0Ovf;
+		}
+	}
+	while( m_nextTimer1Overflow <= m_cycle )
+	{
+		m_nextTimer1Overflow += kTimer1OverflowPeriod;
+		m_timer1Overflowed = true;
+	}
+	if( m_timer1Overflowed && (TIMSK1 & (1 << TOIE1)) )
+	{
+		m_pending |= 1 << kSimVectorTimer1Ovf;
+	}
+	if( TIMSK1 & (1 << OCIE1B) )
+	{
+		uint64_t compareB = nextCompareCycle( OCR1B, m_lastCompareBTick );
+		if( compareB <= m_cycle )
+		{
+			m_lastCompareBTick = compareB / kCyclesPerTimer1Tick;
+			m_pending |= 1 << kSimVectorTimer1CompB;
+		}
+	}
+	while( m_nextSerialTxComplete <= m_cycle )
+	{
+		uint8_t c = m_serialTx.front();
+		m_serialTx.pop_front();
+		if( m_config.m_echoSerial )
+		{
+			fputc( c, stdout );
+		}
+		if( m_pSerialLog )
+		{
+			fputc( c, m_pSerialLog );
+		}
+		m_nextSerialTxComplete = m_serialTx.empty() ? kNever : m_nextSerialTxComplete + kSerialByteCycles;
+		m_pending |= 1 << kSimVectorUsartUdre;
+	}
+	while( m_nextSerialRx <= m_cycle )
+	{
+		// The receive ISR moves the byte into the buffer. Model it as arriving
+		// there straight away, and dropped if the buffer is full.
+		if( m_serialRx.size() < kSerialBufferSize )
+		{
+			m_serialRx.push_back( m_serialIn[m_serialInPos] );
+		}
+		else
+		{
+			++m_numSerialRxDropped;
+		}
+		++m_numSerialRxBytes;
+		m_nextSerialRx = (++m_serialInPos < m_serialIn.size()) ? m_nextSerialRx + kSerialByteCycles : kNever;
+		m_pending |= 1 << kSimVectorUsartRx;
+	}
+}
+
+void Simulator::Advance( uint32_t numCycles )
+{
+	uint64_t remaining = numCycles;
+	for( ;; )
+	{
+		uint64_t next = nextEventCycle();
+		if( next > m_cycle + remaining )
+		{
+			m_cycle += remaining;
+			break;
+		}
+		if( next > m_cycle )
+		{
+			remaining -= next - m_cycle;
+			m_cycle = next;
+		}
+		processEvents();
+		// Any interrupt handlers run now, and take their own cycles on top
+		// of those that the main code asked for.
+		dispatchInterrupts();
+	}
+}
+
+void Simulator::EnableInterrupts()
+{
+	m_interruptsEnabled = true;
+	dispatchInterrupts();
+}
+
+void Simulator::dispatchInterrupts()
+{
+	while( m_interruptsEnabled && !m_inInterrupt && m_pending )
+	{
+		uint8_t vector = 0;
+		while( !(m_pending & (1 << vector)) )
+		{
+			++vector;
+		}
+		m_pending &= ~(1 << vector);
+		callVector( vector );
+	}
+}
+
+void Simulator::callVector( uint8_t vector )
+{
+	uint64_t start = m_cycle;
+	m_inInterrupt = true;
+	m_interruptsEnabled = false;
+	switch( vector )
+	{
+	case kSimVectorInt0:
+		Advance( kInt0DispatchCycles );
+		m_int0Handler();
+		break;
+	case kSimVectorPcint2:
+		Advance( kIsrOverheadCycles );
+		if( PCINT2_vect )
+		{
+			PCINT2_vect();
+		}
+		break;
+	case kSimVectorTimer1CompB:
+		Advance( kIsrOverheadCycles );
+		if( TIMER1_COMPB_vect )
+		{
+			TIMER1_COMPB_vect();
+		}
+		break;
+	case kSimVectorTimer1Ovf:
+		// The flag is cleared as the vector is taken
+		m_timer1Overflowed = false;
+		Advance( kIsrOverheadCycles );
+		if( TIMER1_OVF_vect )
+		{
+			TIMER1_OVF_vect();
+		}
+		break;
+	case kSimVectorTimer0Ovf:
+		Advance( kTimer0OverflowCycles );
+		break;
+	case kSimVectorUsartRx:
+		Advance( kUsartRxCycles );
+		break;
+	case kSimVectorUsartUdre:
+		Advance( kUsartUdreCycles );
+		break;
+	}
+	// reti
+	m_inInterrupt = false;
+	m_interruptsEnabled = true;
+	m_interruptCycles += m_cycle - start;
+}
+
+void Simulator::AttachInterrupt( uint8_t interruptNum, void (*handler)() )
+{
+	if( interruptNum == 0 )
+	{
+		m_int0Handler = handler;
+	}
+}
+
+void Simulator::WriteLasers( uint8_t pins )
+{
+	PORTB = (PORTB & ~kLaserPinMask) | (pins & kLaserPinMask);
+	// A pin left as an input only switches its pull-up
+	uint8_t lasers = pins & kLaserPinMask & DDRB;
+	++m_numLaserWrites;
+	if( m_currentScanLine >= 0 )
+	{
+		// Pixels are scanned right to left across the canvas, so the last 8
+		// are the first byte of each row, most significant bit last.
+		int16_t column = kWidth - 1 - m_nextPixel;
+		if( m_config.m_checkFrameTags && (column >= 0) && (column < 8) )
+		{
+			for( uint8_t laser = 0; laser < kNumLasers; ++laser )
+			{
+				if( lasers & (1 << laser) )
+				{
+					m_scanLineTags[laser] |= (uint8_t) (0x80 >> column);
+				}
+			}
+		}
+		m_scanLineWrites.push_back( m_cycle );
+		m_scanLinePixels.push_back( m_nextPixel++ );
+	}
+	if( m_pPortbLog && (lasers != m_lasers) )
+	{
+		fprintf( m_pPortbLog, "%llu,%u\n", (unsigned long long) m_cycle, lasers );
+	}
+	m_lasers = lasers;
+}
+
+void Simulator::SerialWrite( uint8_t c )
+{
+	while( m_serialTx.size() >= kSerialBufferSize )
+	{
+		// Buffer full, so HardwareSerial::write() blocks until there's room
+		uint64_t start = m_cycle;
+		Advance( (uint32_t) (m_nextSerialTxComplete - m_cycle) );
+		m_serialBlockedCycles += m_cycle - start;
+	}
+	Advance( kSerialWriteCycles );
+	if( m_serialTx.empty() )
+	{
+		m_nextSerialTxComplete = m_cycle + kSerialByteCycles;
+	}
+	m_serialTx.push_back( c );
+	++m_numSerialBytes;
+}
+
+int Simulator::SerialRead()
+{
+	Advance( kSerialReadCycles );
+	if( m_serialRx.empty() )
+	{
+		return -1;
+	}
+	uint8_t c = m_serialRx.front();
+	m_serialRx.pop_front();
+	return c;
+}
+
+void Simulator::SerialFlush()
+{
+	while( !m_serialTx.empty() )
+	{
+		Advance( (uint32_t) (m_nextSerialTxComplete - m_cycle) );
+	}
+}
+
+uint8_t Simulator::EepromRead( int idx )
+{
+	if( m_eepromBusyUntil > m_cycle )
+	{
+		uint64_t start = m_cycle;
+		Advance( (uint32_t) (m_eepromBusyUntil - m_cycle) );
+		m_eepromStalledCycles += m_cycle - start;
+	}
+	Advance( 8 );
+	return m_eeprom[idx & 1023];
+}
+
+void Simulator::EepromWrite( int idx, uint8_t val )
+{
+	if( m_eepromBusyUntil > m_cycle )
+	{
+		uint64_t start = m_cycle;
+		Advance( (uint32_t) (m_eepromBusyUntil - m_cycle) );
+		m_eepromStalledCycles += m_cycle - start;
+	}
+	Advance( 16 );
+	m_eeprom[idx & 1023] = val;
+	m_eepromBusyUntil = m_cycle + kEepromWriteCycles;
+	++m_numEepromWrites;
+}
+
+void Simulator::ProfileBegin( HalProfileZone zone )
+{
+	ProfileZone& profileZone = m_profileZones[zone];
+	if( profileZone.m_depth++ == 0 )
+	{
+		profileZone.m_startCycle = m_cycle;
+	}
+}
+
+void Simulator::ProfileEnd( HalProfileZone zone )
+{
+	ProfileZone& profileZone = m_profileZones[zone];
+	if( --profileZone.m_depth == 0 )
+	{
+		uint64_t cycles = m_cycle - profileZone.m_startCycle;
+		profileZone.m_totalCycles += cycles;
+		++profileZone.m_numCalls;
+		if( cycles > profileZone.m_maxCycles )
+		{
+			profileZone.m_maxCycles = cycles;
+		}
+	}
+}
+
+void Simulator::ScanLineBegin( uint8_t scanLineIdx, int16_t firstPixel )
+{
+	m_currentScanLine = scanLineIdx;
+	m_scanLineStartCycle = m_cycle;
+	m_scanLineEdgeCycle = m_lastDrumEdgeCycle;
+	m_scanLineFirstPixel = firstPixel;
+	m_nextPixel = firstPixel;
+	m_scanLineWrites.clear();
+	m_scanLinePixels.clear();
+	memset( m_scanLineTags, 0, sizeof( m_scanLineTags ) );
+	++m_numScanLines;
+	++m_scanLinesThisRev;
+}
+
+void Simulator::ScanLineEnd()
+{
+	// Compare each laser write against the evenly spaced pixel grid that
+	// fits them best, by which pixel each was. Blank spans aren't written,
+	// so there can be gaps.
+	size_t numWrites = m_scanLineWrites.size();
+	double period = m_pixelPeriodUs.GetMean() * kCyclesPerMicroSecond;
+	if( (numWrites >= 2) && (m_scanLinePixels.back() > m_scanLinePixels.front()) )
+	{
+		double first = (double) m_scanLineWrites.front();
+		double sumPixel = 0.0, sumTime = 0.0, sumPixelSq = 0.0, sumPixelTime = 0.0;
+		for( size_t i = 0; i < numWrites; ++i )
+		{
+			double pixel = m_scanLinePixels[i];
+			double time = (double) m_scanLineWrites[i] - first;
+			sumPixel += pixel;
+			sumTime += time;
+			sumPixelSq += pixel * pixel;
+			sumPixelTime += pixel * time;
+		}
+		period = ((numWrites * sumPixelTime) - (sumPixel * sumTime)) / ((numWrites * sumPixelSq) - (sumPixel * sumPixel));
+		double offset = (sumTime - (period * sumPixel)) / numWrites;
+		m_pixelPeriodUs.Add( period / kCyclesPerMicroSecond );
+		if( numWrites > 2 )
+		{
+			for( size_t i = 0; i < numWrites; ++i )
+			{
+				double error = fabs( (double) m_scanLineWrites[i] - (first + offset + (m_scanLinePixels[i] * period)) );
+				m_pixelErrorUs.Add( error / kCyclesPerMicroSecond );
+			}
+			addScreenErrors();
+		}
+	}
+
+	if( (m_currentScanLine >= 0) && (m_currentScanLine < kMaxScanLines) )
+	{
+		// Where was the drum really, when the line would have started with
+		// pixel 0?
+		double startCycle = (double) m_scanLineStartCycle - (m_scanLineFirstPixel * period);
+		ScanLineStats& stats = m_scanLineStats[m_currentScanLine];
+		double phase = (startCycle - m_scanLineEdgeCycle) / m_drumPeriodCycles;
+		if( stats.m_referencePhase < 0.0 )
+		{
+			stats.m_referencePhase = phase;
+		}
+		while( (phase - stats.m_referencePhase) > 0.5 )
+		{
+			phase -= 1.0;
+		}
+		while( (phase - stats.m_referencePhase) < -0.5 )
+		{
+			phase += 1.0;
+		}
+		stats.m_startUs.Add( phase * m_drumPeriodCycles / kCyclesPerMicroSecond );
+		stats.m_durationUs.Add( ((double) m_cycle - startCycle) / kCyclesPerMicroSecond );
+	}
+
+	if( m_config.m_checkFrameTags )
+	{
+		// The sketch's revolutions start from mirror 0, which isn't where
+		// the drum's index is, and presents frames between them.
+		int16_t mirror = 0;
+		while( (mirror < kNumMirrors) && (MirrorRasterOrder::kMirrorToRaster[mirror] != m_currentScanLine) )
+		{
+			++mirror;
+		}
+		if( mirror <= m_tagMirror )
+		{
+			endTagRevolution();
+		}
+		m_tagMirror = mirror;
+		for( uint8_t laser = 0; laser < kNumLasers; ++laser )
+		{
+			// Untagged rows, such as the sketch's own picture before the
+			// first frame, have no top bit
+			int16_t frame = m_scanLineTags[laser];
+			if( !(frame & 0x80) )
+			{
+				continue;
+			}
+			++m_numTagRevRows;
+			if( m_tagRevFrame < 0 )
+			{
+				m_tagRevFrame = frame;
+			}
+			else if( frame != m_tagRevFrame )
+			{
+				m_isTagRevMixed = true;
+			}
+		}
+	}
+	m_currentScanLine = -1;
+}
+
+void Simulator::endTagRevolution()
+{
+	// The sketch's own picture can look like a tag in places, so checking
+	// starts from the first revolution that shows a whole tagged frame.
+	if( !m_isTagChecking && !m_isTagRevMixed && (m_numTagRevRows == kHeight) )
+	{
+		m_isTagChecking = true;
+	}
+	if( m_isTagChecking && (m_tagRevFrame >= 0) )
+	{
+		++m_numTaggedRevs;
+		if( m_isTagRevMixed )
+		{
+			++m_numMixedTagRevs;
+		}
+	}
+	m_tagRevFrame = -1;
+	m_isTagRevMixed = false;
+	m_numTagRevRows = 0;
+}
+
+void Simulator::addScreenErrors()
+{
+	// Each facet turns the beam through twice the drum's angle, and a flat
+	// screen puts it at the tangent of the angle from where the screen is
+	// square on. That's somewhere near the middle of the line: angle c from
+	// the middle write. A write at angle a, with t = tan a, lands at
+	// tan( a - c ) = (t - tan c) / (1 + t tan c), so on the grid that fits
+	// best it's pixel
+	//   p = g + h tan( a - c ) = (alpha + beta t) / (1 + gamma t)
+	// and p = alpha + beta t - gamma p t is linear least squares.
+	size_t numWrites = m_scanLineWrites.size();
+	double middle = (double) m_scanLineWrites[numWrites / 2];
+	double radiansPerCycle = (4.0 * M_PI) / m_drumPeriodCycles;
+	double sums[3][4] = {};
+	std::vector<double> tangents( numWrites );
+	for( size_t i = 0; i < numWrites; ++i )
+	{
+		tangents[i] = tan( ((double) m_scanLineWrites[i] - middle) * radiansPerCycle );
+		double pixel = m_scanLinePixels[i];
+		double terms[3] = { 1.0, tangents[i], -pixel * tangents[i] };
+		for( int row = 0; row < 3; ++row )
+		{
+			for( int col = 0; col < 3; ++col )
+			{
+				sums[row][col] += terms[row] * terms[col];
+			}
+			sums[row][3] += terms[row] * pixel;
+		}
+	}
+
+	// Gaussian elimination, pivoting on the largest
+	for( int col = 0; col < 3; ++col )
+	{
+		int pivot = col;
+		for( int row = col + 1; row < 3; ++row )
+		{
+			if( fabs( sums[row][col] ) > fabs( sums[pivot][col] ) )
+			{
+				pivot = row;
+			}
+		}
+		std::swap( sums[col], sums[pivot] );
+		if( sums[col][col] == 0.0 )
+		{
+			return;
+		}
+		for( int row = 0; row < 3; ++row )
+		{
+			if( row != col )
+			{
+				double scale = sums[row][col] / sums[col][col];
+				for( int k = col; k < 4; ++k )
+				{
+					sums[row][k] -= scale * sums[col][k];
+				}
+			}
+		}
+	}
+	double alpha = sums[0][3] / sums[0][0];
+	double beta = sums[1][3] / sums[1][1];
+	double gamma = sums[2][3] / sums[2][2];
+	for( size_t i = 0; i < numWrites; ++i )
+	{
+		double pixel = (alpha + (beta * tangents[i])) / (1.0 + (gamma * tangents[i]));
+		m_screenErrorPixels.Add( fabs( m_scanLinePixels[i] - pixel ) );
+	}
+}
+
+void Simulator::Report( FILE* pFile ) const
+{
+	static const char* kZoneNames[kNumProfileZones] =
+	{
+		"Update",
+		"horizontalScan",
+		"calcNextRevolutionSettings",
+		"spin-wait",
+		"pixel clock ISR",
+		"Scheduler::Run",
+	};
+
+	double seconds = (double) m_cycle / kCyclesPerSecond;
+	fprintf( pFile, "Simulated %.3fs, %u drum revolutions at %.1f RPM\n", seconds, m_numDrumEdges, m_config.m_motor ? m_motorRpm : m_config.m_rpm );
+	if( m_config.m_motor && (m_drumPeriodsUs.size() >= 2) )
+	{
+		// How steady the speed was over the second half of the run
+		RunningStats periodUs;
+		for( size_t i = m_drumPeriodsUs.size() / 2; i < m_drumPeriodsUs.size(); ++i )
+		{
+			periodUs.Add( m_drumPeriodsUs[i] );
+		}
+		fprintf( pFile, "Motor: duty %u/255, period over the last %llu revolutions: mean %.1fus, sd %.2fus, range %.1fus\n",
+			OCR2B, (unsigned long long) periodUs.m_count, periodUs.GetMean(), periodUs.GetStdDev(), periodUs.m_max - periodUs.m_min );
+	}
+	uint32_t numRunRevs = m_isRunEnded ? m_numRunDrumEdges : m_numDrumEdges;
+	fprintf( pFile, "Revolutions with scan-lines: %u (%u without)\n", m_numRevsWithScanLines, numRunRevs - m_numRevsWithScanLines );
+	fprintf( pFile, "Lost revolutions after first drawn: %u in %u runs, longest %u\n", m_numLostRevs, m_numLostRevRuns, m_maxLostRevRun );
+	if( m_numSyncPulsesDropped || m_numSyncGlitches )
+	{
+		fprintf( pFile, "Sync pulses dropped: %u, spurious: %u\n", m_numSyncPulsesDropped, m_numSyncGlitches );
+	}
+	fprintf( pFile, "Scan-lines: %llu, PORTB writes: %llu\n", (unsigned long long) m_numScanLines, (unsigned long long) m_numLaserWrites );
+	fprintf( pFile, "Interrupts: %.2f%% of CPU\n", 100.0 * m_interruptCycles / (double) (m_cycle ? m_cycle : 1) );
+	fprintf( pFile, "Serial: %llu bytes, blocked for %.1fms\n", (unsigned long long) m_numSerialBytes, (double) m_serialBlockedCycles / (kCyclesPerMicroSecond * 1000) );
+	if( m_config.m_pSerialInPath )
+	{
+		fprintf( pFile, "Serial in: %llu of %llu bytes, %llu dropped\n", (unsigned long long) m_numSerialRxBytes,
+			(unsigned long long) m_serialIn.size(), (unsigned long long) m_numSerialRxDropped );
+	}
+	fprintf( pFile, "EEPROM writes: %u, stalled for %.1fms\n", m_numEepromWrites, (double) m_eepromStalledCycles / (kCyclesPerMicroSecond * 1000) );
+	if( m_config.m_checkFrameTags )
+	{
+		fprintf( pFile, "Frame tags: %u revolutions checked, %u showed parts of more than one\n", m_numTaggedRevs, m_numMixedTagRevs );
+	}
+	if( !m_config.m_buttonPresses.empty() )
+	{
+		fprintf( pFile, "Button presses: %u, pin changes with bounce: %u\n", (uint32_t) m_config.m_buttonPresses.size(), m_numPinEdges );
+	}
+
+	fprintf( pFile, "\n%-28s %10s %12s %12s %8s\n", "Zone", "Calls", "Avg cycles", "Max cycles", "CPU %" );
+	for( int i = 0; i < kNumProfileZones; ++i )
+	{
+		const ProfileZone& zone = m_profileZones[i];
+		fprintf( pFile, "%-28s %10llu %12.1f %12llu %8.2f\n", kZoneNames[i],
+			(unsigned long long) zone.m_numCalls,
+			zone.m_numCalls ? (double) zone.m_totalCycles / zone.m_numCalls : 0.0,
+			(unsigned long long) zone.m_maxCycles,
+			100.0 * zone.m_totalCycles / (double) (m_cycle ? m_cycle : 1) );
+	}
+
+	fprintf( pFile, "\n%-9s %8s %14s %12s %12s\n", "Scan-line", "Count", "Start (us)", "Jitter (us)", "Length (us)" );
+	double worstJitter = 0.0;
+	double sumJitter = 0.0;
+	int numLines = 0;
+	for( int i = 0; i < kMaxScanLines; ++i )
+	{
+		const ScanLineStats& stats = m_scanLineStats[i];
+		if( !stats.m_startUs.m_count )
+		{
+			continue;
+		}
+		double jitter = stats.m_startUs.GetStdDev();
+		fprintf( pFile, "%-9d %8llu %14.1f %12.2f %12.1f\n", i, (unsigned long long) stats.m_startUs.m_count,
+			stats.m_startUs.GetMean(), jitter, stats.m_durationUs.GetMean() );
+		if( jitter > worstJitter )
+		{
+			worstJitter = jitter;
+		}
+		sumJitter += jitter;
+		++numLines;
+	}
+	if( numLines )
+	{
+		fprintf( pFile, "Scan-line start jitter: mean %.2fus, worst %.2fus\n", sumJitter / numLines, worstJitter );
+	}
+	if( m_pixelErrorUs.m_count )
+	{
+		fprintf( pFile, "Pixel period %.2fus, error from ideal grid: mean %.3fus, worst %.3fus\n",
+			m_pixelPeriodUs.GetMean(), m_pixelErrorUs.GetMean(), m_pixelErrorUs.m_max );
+	}
+	if( m_screenErrorPixels.m_count )
+	{
+		fprintf( pFile, "On a flat screen, error from ideal grid: mean %.3f pixels, worst %.3f pixels\n",
+			m_screenErrorPixels.GetMean(), m_screenErrorPixels.m_max );
+	}
+}
+
+// HAL
+
+uint16_t HalReadTimer1()                       { return sim.ReadTimer1(); }
+bool     HalTimer1Overflowed()                 { return sim.GetTimer1Overflowed(); }
+void     HalWriteLasers( uint8_t pins )        { sim.WriteLasers( pins ); }
+void     HalWriteLasersDark( uint8_t )         {}
+void     HalCycles( uint32_t numCycles )       { sim.Advance( numCycles ); }
+void     HalProfileBegin( HalProfileZone zone ) { sim.ProfileBegin( zone ); }
+void     HalProfileEnd( HalProfileZone zone )   { sim.ProfileEnd( zone ); }
+void     HalScanLineBegin( uint8_t scanLineIdx, int16_t firstPixel ) { sim.ScanLineBegin( scanLineIdx, firstPixel ); }
+void     HalScanLineEnd()                      { sim.ScanLineEnd(); }
+void     HalScanLineSkipTo( uint8_t pixel )    { sim.ScanLineSkipTo( pixel ); }
+bool     HalEepromIsReady()                    { return sim.EepromIsReady(); }
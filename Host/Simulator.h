@@ -0,0 +1,304 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+// Host simulator for the scanning laser projector.
+//
+// The sketch is compiled unmodified against the stubs in Host/Stubs, and the
+// HAL (Hal.h) and Arduino stubs call in here. Time only advances when the
+// sketch accounts for AVR cycles, so the simulation is deterministic for a
+// given seed and runs as fast as the host can execute the sketch.
+//
+// Modelled:
+// - A 16MHz clock, with Timer1 free running at 1/8 (0.5us ticks).
+// - The Timer0 overflow interrupt that Arduino's millis() uses.
+// - The mirror drum at a given RPM, with Gaussian jitter on the sync sensor,
+//   raising INT0 through attachInterrupt. Sensor pulses can be dropped, or
+//   spurious ones added, at random or for an outage of several revolutions.
+// - Optionally, the drum motor instead of a fixed RPM: a first order lag
+//   from rest towards a speed proportional to the OCR2B PWM duty, with a
+//   step change in its load part way through.
+// - The Timer1 compare B and overflow interrupts, and the overflow flag.
+// - PORTB writes, timestamped, and checked against the evenly spaced pixel
+//   grid that best fits each scan-line: in time, and where the drum would
+//   put them on a flat screen.
+// - Serial transmit at 115200 baud through a 64 byte buffer that blocks when
+//   full, and EEPROM writes that stall for 3.3ms.
+// - Serial receive of a file at 115200 baud, into a 64 byte buffer that
+//   drops bytes when full.
+// - Push buttons on port D pulling their pins low, with contact bounce on
+//   press and release, through PIND and the PCINT2 interrupt.
+//
+// With frames from slpframe --tag-frames, the simulator can also check that
+// no revolution shows parts of two frames. Each frame's number is in the
+// first byte of every row, so it's drawn by the last 8 pixels of every
+// scan-line, for every laser.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "Hal.h"
+
+struct SimButtonPress
+{
+	uint8_t m_pin;      // On port D
+	double  m_ms;       // From power on
+	double  m_holdMs;
+};
+
+struct SimConfig
+{
+	SimConfig()
+	: m_rpm( 1000.0 ), m_syncJitterUs( 10.0 ), m_syncDropProbability( 0.0 ), m_syncGlitchProbability( 0.0 )
+	, m_outageRev( 0 ), m_numOutageRevs( 0 ), m_seed( 1 )
+	, m_motor( false ), m_motorMaxRpm( 2400.0 ), m_motorTimeConstant( 1.0 ), m_motorLoadRev( 0 ), m_motorLoad( 1.0 )
+	, m_echoSerial( false ), m_pSerialLogPath( nullptr ), m_pSerialInPath( nullptr ), m_pPortbLogPath( nullptr ), m_pEepromPath( nullptr )
+	, m_bounceMs( 1.0 ), m_checkFrameTags( false )
+	{}
+
+	double      m_rpm;          // Drum speed
+	double      m_syncJitterUs; // Standard deviation of the sync sensor edge
+	double      m_syncDropProbability;   // Chance of a sensor pulse going missing
+	double      m_syncGlitchProbability; // Chance per revolution of a spurious pulse
+	uint32_t    m_outageRev;     // No sensor pulses for m_numOutageRevs from this revolution
+	uint32_t    m_numOutageRevs;
+	uint32_t    m_seed;
+	bool        m_motor;        // Drive the drum from OCR2B rather than at m_rpm
+	double      m_motorMaxRpm;  // Steady speed at full duty
+	double      m_motorTimeConstant; // Seconds
+	uint32_t    m_motorLoadRev; // From this revolution, the motor's speed is
+	double      m_motorLoad;    // scaled by m_motorLoad
+	bool        m_echoSerial;   // Copy the sketch's Serial output to stdout
+	const char* m_pSerialLogPath; // Write the raw Serial output here
+	const char* m_pSerialInPath;  // Stream this into Serial
+	const char* m_pPortbLogPath;
+	const char* m_pEepromPath;  // Load and save the EEPROM contents here
+	std::vector<SimButtonPress> m_buttonPresses;
+	double      m_bounceMs;     // How long the contacts bounce for
+	bool        m_checkFrameTags; // Check each revolution shows only one tagged frame
+};
+
+// AVR interrupt vectors, in priority order.
+enum SimVector
+{
+	kSimVectorInt0 = 1,
+	kSimVectorPcint2 = 5,
+	kSimVectorTimer1CompB = 12,
+	kSimVectorTimer1Ovf = 13,
+	kSimVectorTimer0Ovf = 16,
+	kSimVectorUsartRx = 18,
+	kSimVectorUsartUdre = 19,
+	kSimNumVectors = 26
+};
+
+class Simulator
+{
+public:
+	static const uint32_t kCyclesPerSecond = 16000000;
+	static const uint32_t kCyclesPerMicroSecond = 16;
+	static const uint32_t kCyclesPerTimer1Tick = 8;
+
+	Simulator();
+
+	void Configure( const SimConfig& config );
+	void Finish();
+	// Stop counting drawn and lost revolutions, once the sketch has stopped
+	// looping to print its report.
+	void EndRun() { m_isRunEnded = true; m_numRunDrumEdges = m_numDrumEdges; }
+	void SetEchoSerial( bool echoSerial ) { m_config.m_echoSerial = echoSerial; }
+
+	uint64_t GetCycle() const { return m_cycle; }
+	double   GetMicroSeconds() const { return (double) m_cycle / kCyclesPerMicroSecond; }
+	uint32_t GetNumDrumRevolutions() const { return m_numDrumEdges; }
+	double   GetDrumPeriodCycles() const { return m_drumPeriodCycles; }
+	uint32_t GetNumTaggedRevolutions() const { return m_numTaggedRevs; }
+	uint32_t GetNumMixedRevolutions() const { return m_numMixedTagRevs; }
+
+	// Consume AVR cycles, servicing any interrupts that become due.
+	void Advance( uint32_t numCycles );
+
+	void DisableInterrupts() { m_interruptsEnabled = false; }
+	void EnableInterrupts();
+	bool GetInterruptsEnabled() const { return m_interruptsEnabled; }
+
+	uint16_t ReadTimer1() const { return (uint16_t) (m_cycle / kCyclesPerTimer1Tick); }
+	bool     GetTimer1Overflowed() const { return m_timer1Overflowed; }
+	void     WriteLasers( uint8_t pins );
+
+	void AttachInterrupt( uint8_t interruptNum, void (*handler)() );
+
+	// Serial and EEPROM backing
+	void    SerialWrite( uint8_t c );
+	int     SerialAvailableForWrite() const { return kSerialBufferSize - (int) m_serialTx.size(); }
+	void    SerialFlush();
+	int     SerialAvailable() const { return (int) m_serialRx.size(); }
+	int     SerialRead();
+	uint8_t EepromRead( int idx );
+	void    EepromWrite( int idx, uint8_t val );
+	bool    EepromIsReady() const { return m_eepromBusyUntil <= m_cycle; }
+
+	// Instrumentation
+	void ProfileBegin( HalProfileZone zone );
+	void ProfileEnd( HalProfileZone zone );
+	void ScanLineBegin( uint8_t scanLineIdx, int16_t firstPixel );
+	void ScanLineEnd();
+	void ScanLineSkipTo( uint8_t pixel ) { m_nextPixel = pixel; }
+
+	void Report( FILE* pFile ) const;
+
+private:
+	static const int kSerialBufferSize = 64;
+	static const uint32_t kSerialByteCycles = kCyclesPerSecond / 11520; // 10 bits at 115200 baud
+	static const uint32_t kEepromWriteCycles = 3300 * kCyclesPerMicroSecond;
+	static const uint8_t  kMaxScanLines = 32;
+
+	struct ProfileZone
+	{
+		ProfileZone() : m_startCycle( 0 ), m_totalCycles( 0 ), m_maxCycles( 0 ), m_numCalls( 0 ), m_depth( 0 ) {}
+		uint64_t m_startCycle;
+		uint64_t m_totalCycles;
+		uint64_t m_maxCycles;
+		uint64_t m_numCalls;
+		uint32_t m_depth;
+	};
+
+	struct RunningStats
+	{
+		RunningStats() : m_count( 0 ), m_sum( 0.0 ), m_sumSq( 0.0 ), m_min( 1e30 ), m_max( -1e30 ) {}
+		void   Add( double value );
+		double GetMean() const { return m_count ? m_sum / m_count : 0.0; }
+		double GetStdDev() const;
+		uint64_t m_count;
+		double   m_sum;
+		double   m_sumSq;
+		double   m_min;
+		double   m_max;
+	};
+
+	struct PinEdge
+	{
+		uint64_t m_cycle;
+		uint8_t  m_pin;
+		bool     m_isLow;
+		bool operator<( const PinEdge& other ) const { return m_cycle < other.m_cycle; }
+	};
+
+	struct ScanLineStats
+	{
+		ScanLineStats() : m_referencePhase( -1.0 ) {}
+		double       m_referencePhase; // First phase seen, to unwrap the others against
+		RunningStats m_startUs;        // Start time relative to the true drum angle
+		RunningStats m_durationUs;
+	};
+
+	uint64_t nextCompareCycle( uint16_t compare, uint64_t lastMatchTick ) const;
+	uint64_t nextEventCycle() const;
+	void     processEvents();
+	void     dispatchInterrupts();
+	void     callVector( uint8_t vector );
+	void     stepMotor();
+	void     addButtonEdges( const SimButtonPress& press, std::mt19937& random );
+	void     addScreenErrors();
+	void     endTagRevolution();
+	double   gaussian();
+
+	SimConfig m_config;
+	uint64_t  m_cycle;
+	bool      m_interruptsEnabled;
+	bool      m_inInterrupt;
+	uint32_t  m_pending;
+	void      (*m_int0Handler)();
+
+	// Drum
+	double               m_drumPeriodCycles;
+	double               m_nextDrumEdgeCycle;
+	double               m_lastDrumEdgeCycle;
+	uint32_t             m_numDrumEdges;
+	std::deque<uint64_t> m_syncPulses; // Sensor edges waiting to be delivered
+	uint32_t             m_numRevsWithScanLines;
+	uint32_t             m_scanLinesThisRev;
+	uint32_t             m_numSyncPulsesDropped;
+	uint32_t             m_numSyncGlitches;
+	uint32_t             m_numLostRevs;      // Blank revolutions after the first one drawn
+	uint32_t             m_lostRevRun;
+	uint32_t             m_maxLostRevRun;
+	uint32_t             m_numLostRevRuns;
+	bool                 m_isRunEnded;
+	uint32_t             m_numRunDrumEdges;  // Up to EndRun
+
+	// Motor
+	double               m_motorRpm;
+	uint64_t             m_nextMotorStep;
+	std::vector<double>  m_drumPeriodsUs; // True period of each revolution
+
+	// Timers
+	uint64_t m_nextTimer0Overflow;
+	uint64_t m_nextTimer1Overflow;
+	bool     m_timer1Overflowed;
+	uint64_t m_lastCompareBTick;
+
+	// Serial
+	std::deque<uint8_t> m_serialTx;
+	uint64_t            m_nextSerialTxComplete;
+	uint64_t            m_numSerialBytes;
+	uint64_t            m_serialBlockedCycles;
+	FILE*               m_pSerialLog;
+	std::vector<uint8_t> m_serialIn;
+	size_t              m_serialInPos;
+	uint64_t            m_nextSerialRx;
+	std::deque<uint8_t> m_serialRx;
+	uint64_t            m_numSerialRxBytes;
+	uint64_t            m_numSerialRxDropped;
+
+	// EEPROM
+	uint8_t  m_eeprom[1024];
+	uint64_t m_eepromBusyUntil;
+	uint32_t m_numEepromWrites;
+	uint64_t m_eepromStalledCycles; // Waiting on a write in flight
+
+	// Buttons
+	std::deque<PinEdge> m_pinEdges; // Waiting to happen, in order
+	uint8_t  m_pinsLow;             // Port D pins that a button is pulling low
+	uint32_t m_numPinEdges;
+
+	// PORTB
+	FILE*    m_pPortbLog;
+	uint8_t  m_lasers;
+	uint64_t m_numLaserWrites;
+
+	// Scan-lines
+	int16_t       m_currentScanLine;
+	uint64_t      m_scanLineStartCycle;
+	double        m_scanLineEdgeCycle; // The drum edge before it
+	int16_t       m_scanLineFirstPixel;
+	int16_t       m_nextPixel;
+	uint64_t      m_numScanLines;
+	ScanLineStats m_scanLineStats[kMaxScanLines];
+	std::vector<uint64_t> m_scanLineWrites;
+	std::vector<int16_t>  m_scanLinePixels; // Which pixel each write was
+	RunningStats  m_pixelErrorUs;  // Distance of each laser write from the ideal grid
+	RunningStats  m_pixelPeriodUs;
+	RunningStats  m_screenErrorPixels; // The same on a flat screen, in pixels
+
+	// Frame tags
+	uint8_t       m_scanLineTags[8]; // Per laser, as drawn so far
+	int16_t       m_tagMirror;       // The last scan-line's mirror
+	int16_t       m_tagRevFrame;     // The tag seen, or -1
+	bool          m_isTagRevMixed;   // More than one seen
+	uint16_t      m_numTagRevRows;   // Rows with a tag
+	bool          m_isTagChecking;   // A whole tagged frame has been shown
+	uint32_t      m_numTaggedRevs;
+	uint32_t      m_numMixedTagRevs;
+
+	ProfileZone   m_profileZones[kNumProfileZones];
+	uint64_t      m_interruptCycles;
+
+	std::mt19937  m_random;
+	std::normal_distribution<double> m_normal;
+};
+
+extern Simulator sim;
+
+#endif
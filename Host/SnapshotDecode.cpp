@@ -0,0 +1,187 @@
+// Decoder for the canvas snapshots that the sketch sends (see Snapshot.h).
+//
+//   slpsnap [-o PREFIX] [FILE]
+//
+// Reads a captured Serial stream (from the Arduino, or slpsim --serial-log)
+// from FILE or stdin, skips anything that isn't a valid snapshot packet, and
+// writes each complete snapshot as a binary PBM image, PREFIX-NNNN.pbm
+// (default snapshot-NNNN.pbm), which slpframe can read back. A snapshot with
+// a row missing or a bad check is reported and not written.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "Snapshot.h"
+
+static const size_t kFramingBytes = 5;
+
+struct Snapshot
+{
+	Snapshot() : m_isOpen( false ), m_number( 0 ), m_width( 0 ), m_height( 0 ), m_widthBytes( 0 ) {}
+
+	bool                 m_isOpen;
+	uint8_t              m_number;
+	uint16_t             m_width;
+	uint16_t             m_height;
+	uint16_t             m_widthBytes;
+	std::vector<uint8_t> m_pixels;
+	std::vector<bool>    m_haveRow;
+};
+
+static bool writePbm( const std::string& path, const Snapshot& snapshot )
+{
+	FILE* pFile = fopen( path.c_str(), "wb" );
+	if( !pFile )
+	{
+		return false;
+	}
+	// Rows are in the same layout as GFXcanvas1, a set bit drawn black
+	fprintf( pFile, "P4\n%u %u\n", snapshot.m_width, snapshot.m_height );
+	bool isWritten = fwrite( snapshot.m_pixels.data(), 1, snapshot.m_pixels.size(), pFile ) == snapshot.m_pixels.size();
+	return (fclose( pFile ) == 0) && isWritten;
+}
+
+static void usage()
+{
+	fprintf( stderr,
+		"Usage: slpsnap [options] [FILE]\n"
+		"  -o PREFIX  Write images to PREFIX-NNNN.pbm (default snapshot)\n" );
+	exit( 1 );
+}
+
+int main( int argc, char** argv )
+{
+	const char* pPrefix = "snapshot";
+	const char* pPath = nullptr;
+	for( int i = 1; i < argc; ++i )
+	{
+		if( !strcmp( argv[i], "-o" ) && (i + 1) < argc )
+		{
+			pPrefix = argv[++i];
+		}
+		else if( (argv[i][0] == '-') && argv[i][1] )
+		{
+			usage();
+		}
+		else
+		{
+			pPath = argv[i];
+		}
+	}
+
+	FILE* pFile = (pPath && strcmp( pPath, "-" )) ? fopen( pPath, "rb" ) : stdin;
+	if( !pFile )
+	{
+		fprintf( stderr, "Can't open %s\n", pPath );
+		return 1;
+	}
+	std::vector<uint8_t> data;
+	uint8_t buffer[4096];
+	size_t numRead;
+	while( (numRead = fread( buffer, 1, sizeof( buffer ), pFile )) > 0 )
+	{
+		data.insert( data.end(), buffer, buffer + numRead );
+	}
+	if( pFile != stdin )
+	{
+		fclose( pFile );
+	}
+
+	uint64_t numPackets = 0;
+	uint32_t numWritten = 0;
+	uint32_t numBad = 0;
+	Snapshot snapshot;
+	size_t pos = 0;
+	while( pos + kFramingBytes <= data.size() )
+	{
+		const uint8_t* pPacket = &data[pos];
+		uint8_t type = pPacket[1];
+		uint8_t length = pPacket[2];
+		if( (pPacket[0] != kSnapshotPacketStart) || (type >= kNumSnapshotPacketTypes) || (pos + kFramingBytes + length > data.size()) )
+		{
+			++pos;
+			continue;
+		}
+		UploadCheck check;
+		for( size_t i = 1; i < 3u + length; ++i )
+		{
+			check.Add( pPacket[i] );
+		}
+		const uint8_t* pPayload = pPacket + 3;
+		if( (pPayload[length] | (pPayload[length + 1] << 8)) != check.Get() )
+		{
+			++pos;
+			continue;
+		}
+		pos += kFramingBytes + length;
+		++numPackets;
+
+		if( (type == kSnapshotBegin) && (length == 4) )
+		{
+			if( snapshot.m_isOpen )
+			{
+				printf( "Snapshot %u: no end\n", snapshot.m_number );
+				++numBad;
+			}
+			snapshot.m_isOpen = true;
+			snapshot.m_number = pPayload[0];
+			snapshot.m_width = pPayload[1];
+			snapshot.m_height = pPayload[2] | (pPayload[3] << 8);
+			snapshot.m_widthBytes = (snapshot.m_width + 7) / 8;
+			snapshot.m_pixels.assign( (size_t) snapshot.m_widthBytes * snapshot.m_height, 0 );
+			snapshot.m_haveRow.assign( snapshot.m_height, false );
+		}
+		else if( (type == kSnapshotRow) && snapshot.m_isOpen && (length == 2 + snapshot.m_widthBytes) )
+		{
+			uint16_t row = pPayload[0] | (pPayload[1] << 8);
+			if( row < snapshot.m_height )
+			{
+				memcpy( &snapshot.m_pixels[(size_t) row * snapshot.m_widthBytes], pPayload + 2, snapshot.m_widthBytes );
+				snapshot.m_haveRow[row] = true;
+			}
+		}
+		else if( (type == kSnapshotEnd) && snapshot.m_isOpen && (length == 4) && (pPayload[0] == snapshot.m_number) )
+		{
+			snapshot.m_isOpen = false;
+			uint16_t numRows = 0;
+			UploadCheck imageCheck;
+			for( uint16_t row = 0; row < snapshot.m_height; ++row )
+			{
+				numRows += snapshot.m_haveRow[row] ? 1 : 0;
+			}
+			for( uint8_t byte : snapshot.m_pixels )
+			{
+				imageCheck.Add( byte );
+			}
+			bool isTorn = (pPayload[1] & kSnapshotTorn) != 0;
+			if( numRows != snapshot.m_height )
+			{
+				printf( "Snapshot %u: %u of %u rows\n", snapshot.m_number, numRows, snapshot.m_height );
+				++numBad;
+			}
+			else if( (pPayload[2] | (pPayload[3] << 8)) != imageCheck.Get() )
+			{
+				printf( "Snapshot %u: bad image check\n", snapshot.m_number );
+				++numBad;
+			}
+			else
+			{
+				char name[16];
+				snprintf( name, sizeof( name ), "-%04u.pbm", numWritten );
+				std::string path = std::string( pPrefix ) + name;
+				if( !writePbm( path, snapshot ) )
+				{
+					fprintf( stderr, "Can't write %s\n", path.c_str() );
+					return 1;
+				}
+				printf( "Snapshot %u: %ux%u%s, %s\n", snapshot.m_number, snapshot.m_width, snapshot.m_height, isTorn ? ", torn" : "", path.c_str() );
+				++numWritten;
+			}
+		}
+	}
+	printf( "%llu packets, %u snapshots written, %u incomplete\n", (unsigned long long) numPackets, numWritten, numBad );
+	return 0;
+}
@@ -0,0 +1,309 @@
+#ifndef ADAFRUIT_GFX_H
+#define ADAFRUIT_GFX_H
+
+// Host build of the parts of Adafruit_GFX that the sketch uses.
+// The class layout, virtual dispatch and GFXcanvas1 buffer format follow the
+// real library so that subclasses and anything reading the raw buffer behave
+// the same on the simulator as on the Arduino.
+
+#include <stdlib.h>
+#include <string.h>
+#include "Print.h"
+#include "gfxfont.h"
+
+class Adafruit_GFX : public Print
+{
+public:
+	Adafruit_GFX( int16_t w, int16_t h )
+	: WIDTH( w ), HEIGHT( h ), _width( w ), _height( h )
+	, cursor_x( 0 ), cursor_y( 0 ), textcolor( 0xffff ), textbgcolor( 0xffff )
+	, textsize_x( 1 ), textsize_y( 1 ), wrap( true ), gfxFont( nullptr )
+	{}
+
+	virtual void drawPixel( int16_t x, int16_t y, uint16_t color ) = 0;
+
+	virtual void startWrite() {}
+	virtual void writePixel( int16_t x, int16_t y, uint16_t color ) { drawPixel( x, y, color ); }
+	virtual void writeFillRect( int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color ) { fillRect( x, y, w, h, color ); }
+	virtual void writeFastVLine( int16_t x, int16_t y, int16_t h, uint16_t color ) { drawFastVLine( x, y, h, color ); }
+	virtual void writeFastHLine( int16_t x, int16_t y, int16_t w, uint16_t color ) { drawFastHLine( x, y, w, color ); }
+	virtual void endWrite() {}
+
+	virtual void drawFastVLine( int16_t x, int16_t y, int16_t h, uint16_t color )
+	{
+		startWrite();
+		for( int16_t i = 0; i < h; ++i )
+		{
+			writePixel( x, y + i, color );
+		}
+		endWrite();
+	}
+
+	virtual void drawFastHLine( int16_t x, int16_t y, int16_t w, uint16_t color )
+	{
+		startWrite();
+		for( int16_t i = 0; i < w; ++i )
+		{
+			writePixel( x + i, y, color );
+		}
+		endWrite();
+	}
+
+	virtual void fillRect( int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color )
+	{
+		startWrite();
+		for( int16_t i = x; i < x + w; ++i )
+		{
+			writeFastVLine( i, y, h, color );
+		}
+		endWrite();
+	}
+
+	virtual void fillScreen( uint16_t color ) { fillRect( 0, 0, _width, _height, color ); }
+
+	void drawRect( int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color )
+	{
+		startWrite();
+		writeFastHLine( x, y, w, color );
+		writeFastHLine( x, y + h - 1, w, color );
+		writeFastVLine( x, y, h, color );
+		writeFastVLine( x + w - 1, y, h, color );
+		endWrite();
+	}
+
+	// Bresenham's algorithm, as the library does it.
+	void drawLine( int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color )
+	{
+		bool steep = abs( y1 - y0 ) > abs( x1 - x0 );
+		if( steep )
+		{
+			swap( x0, y0 );
+			swap( x1, y1 );
+		}
+		if( x0 > x1 )
+		{
+			swap( x0, x1 );
+			swap( y0, y1 );
+		}
+		int16_t dx = x1 - x0;
+		int16_t dy = abs( y1 - y0 );
+		int16_t err = dx / 2;
+		int16_t ystep = (y0 < y1) ? 1 : -1;
+		startWrite();
+		for( ; x0 <= x1; ++x0 )
+		{
+			if( steep )
+			{
+				writePixel( y0, x0, color );
+			}
+			else
+			{
+				writePixel( x0, y0, color );
+			}
+			err -= dy;
+			if( err < 0 )
+			{
+				y0 += ystep;
+				err += dx;
+			}
+		}
+		endWrite();
+	}
+
+	void drawCircle( int16_t x0, int16_t y0, int16_t r, uint16_t color )
+	{
+		int16_t f = 1 - r;
+		int16_t ddF_x = 1;
+		int16_t ddF_y = -2 * r;
+		int16_t x = 0;
+		int16_t y = r;
+		startWrite();
+		writePixel( x0, y0 + r, color );
+		writePixel( x0, y0 - r, color );
+		writePixel( x0 + r, y0, color );
+		writePixel( x0 - r, y0, color );
+		while( x < y )
+		{
+			if( f >= 0 )
+			{
+				--y;
+				ddF_y += 2;
+				f += ddF_y;
+			}
+			++x;
+			ddF_x += 2;
+			f += ddF_x;
+			writePixel( x0 + x, y0 + y, color );
+			writePixel( x0 - x, y0 + y, color );
+			writePixel( x0 + x, y0 - y, color );
+			writePixel( x0 - x, y0 - y, color );
+			writePixel( x0 + y, y0 + x, color );
+			writePixel( x0 - y, y0 + x, color );
+			writePixel( x0 + y, y0 - x, color );
+			writePixel( x0 - y, y0 - x, color );
+		}
+		endWrite();
+	}
+
+	void drawChar( int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg, uint8_t size )
+	{
+		(void) bg;
+		(void) size;
+		if( !gfxFont )
+		{
+			return;
+		}
+		c -= (uint8_t) gfxFont->first;
+		const GFXglyph* pGlyph = &gfxFont->glyph[c];
+		const uint8_t* pBitmap = gfxFont->bitmap;
+		uint16_t bo = pGlyph->bitmapOffset;
+		uint8_t bits = 0;
+		uint8_t bitIdx = 0;
+		startWrite();
+		for( uint8_t yy = 0; yy < pGlyph->height; ++yy )
+		{
+			for( uint8_t xx = 0; xx < pGlyph->width; ++xx )
+			{
+				if( !(bitIdx++ & 7) )
+				{
+					bits = pBitmap[bo++];
+				}
+				if( bits & 0x80 )
+				{
+					writePixel( x + pGlyph->xOffset + xx, y + pGlyph->yOffset + yy, color );
+				}
+				bits <<= 1;
+			}
+		}
+		endWrite();
+	}
+
+	size_t write( uint8_t c ) override
+	{
+		if( !gfxFont )
+		{
+			return 1;
+		}
+		if( c == '\n' )
+		{
+			cursor_x = 0;
+			cursor_y += gfxFont->yAdvance;
+		}
+		else if( c != '\r' )
+		{
+			if( (c >= gfxFont->first) && (c <= gfxFont->last) )
+			{
+				const GFXglyph* pGlyph = &gfxFont->glyph[c - gfxFont->first];
+				if( (pGlyph->width > 0) && (pGlyph->height > 0) )
+				{
+					if( wrap && ((cursor_x + pGlyph->xOffset + pGlyph->width) > _width) )
+					{
+						cursor_x = 0;
+						cursor_y += gfxFont->yAdvance;
+					}
+					drawChar( cursor_x, cursor_y, c, textcolor, textbgcolor, 1 );
+				}
+				cursor_x += pGlyph->xAdvance;
+			}
+		}
+		return 1;
+	}
+	using Print::write;
+
+	void setCursor( int16_t x, int16_t y )   { cursor_x = x; cursor_y = y; }
+	void setTextColor( uint16_t c )          { textcolor = textbgcolor = c; }
+	void setTextColor( uint16_t c, uint16_t bg ) { textcolor = c; textbgcolor = bg; }
+	void setTextSize( uint8_t s )            { textsize_x = textsize_y = s; }
+	void setTextWrap( bool w )               { wrap = w; }
+	void setFont( const GFXfont* f )         { gfxFont = (GFXfont*) f; }
+
+	int16_t width() const      { return _width; }
+	int16_t height() const     { return _height; }
+	int16_t getCursorX() const { return cursor_x; }
+	int16_t getCursorY() const { return cursor_y; }
+
+protected:
+	int16_t  WIDTH;
+	int16_t  HEIGHT;
+	int16_t  _width;
+	int16_t  _height;
+	int16_t  cursor_x;
+	int16_t  cursor_y;
+	uint16_t textcolor;
+	uint16_t textbgcolor;
+	uint8_t  textsize_x;
+	uint8_t  textsize_y;
+	bool     wrap;
+	GFXfont* gfxFont;
+
+private:
+	static void swap( int16_t& a, int16_t& b ) { int16_t t = a; a = b; b = t; }
+};
+
+// 1 bit per pixel, rows of (w + 7) / 8 bytes, most significant bit leftmost.
+class GFXcanvas1 : public Adafruit_GFX
+{
+public:
+	GFXcanvas1( uint16_t w, uint16_t h )
+	: Adafruit_GFX( w, h )
+	{
+		uint16_t bytes = ((w + 7) / 8) * h;
+		buffer = (uint8_t*) malloc( bytes );
+		memset( buffer, 0, bytes );
+	}
+	~GFXcanvas1() { free( buffer ); }
+
+	void drawPixel( int16_t x, int16_t y, uint16_t color ) override
+	{
+		if( (x < 0) || (y < 0) || (x >= _width) || (y >= _height) )
+		{
+			return;
+		}
+		uint8_t* pByte = &buffer[(x / 8) + y * ((WIDTH + 7) / 8)];
+		if( color )
+		{
+			*pByte |= 0x80 >> (x & 7);
+		}
+		else
+		{
+			*pByte &= ~(0x80 >> (x & 7));
+		}
+	}
+
+	void drawFastHLine( int16_t x, int16_t y, int16_t w, uint16_t color ) override
+	{
+		for( int16_t i = 0; i < w; ++i )
+		{
+			drawPixel( x + i, y, color );
+		}
+	}
+
+	void drawFastVLine( int16_t x, int16_t y, int16_t h, uint16_t color ) override
+	{
+		for( int16_t i = 0; i < h; ++i )
+		{
+			drawPixel( x, y + i, color );
+		}
+	}
+
+	void fillScreen( uint16_t color ) override
+	{
+		memset( buffer, color ? 0xff : 0x00, ((WIDTH + 7) / 8) * HEIGHT );
+	}
+
+	bool getPixel( int16_t x, int16_t y ) const
+	{
+		if( (x < 0) || (y < 0) || (x >= _width) || (y >= _height) )
+		{
+			return false;
+		}
+		return buffer[(x / 8) + y * ((WIDTH + 7) / 8)] & (0x80 >> (x & 7));
+	}
+
+	uint8_t* getBuffer() const { return buffer; }
+
+private:
+	uint8_t* buffer;
+};
+
+#endif
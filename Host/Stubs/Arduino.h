@@ -0,0 +1,95 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+// Minimal stand-in for the Arduino core, just enough to compile the sketch
+// for the host simulator. Anything with a timing cost charges the
+// simulator clock, see Host/Simulator.cpp.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "Print.h"
+#include "Registers.h"
+
+typedef uint8_t byte;
+typedef bool    boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x0
+#define OUTPUT       0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE  1
+#define FALLING 2
+#define RISING  3
+
+#define DEC 10
+#define HEX 16
+#define BIN 2
+
+#define LED_BUILTIN 13
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (s)
+#define pgm_read_byte(addr)    (*(const uint8_t*)(addr))
+#define pgm_read_word(addr)    (*(const uint16_t*)(addr))
+#define pgm_read_dword(addr)   (*(const uint32_t*)(addr))
+#define pgm_read_pointer(addr) ((void*)*(void* const*)(addr))
+#define memcpy_P memcpy
+
+#define bit(b)                 (1UL << (b))
+#define bitRead(value, b)      (((value) >> (b)) & 0x01)
+#define bitSet(value, b)       ((value) |= (1UL << (b)))
+#define bitClear(value, b)     ((value) &= ~(1UL << (b)))
+#define lowByte(w)             ((uint8_t) ((w) & 0xff))
+#define highByte(w)            ((uint8_t) ((w) >> 8))
+
+#define digitalPinToInterrupt(p) ((p) == 2 ? 0 : ((p) == 3 ? 1 : -1))
+
+// Interrupt control
+void SimCli();
+void SimSei();
+#define cli() SimCli()
+#define sei() SimSei()
+#define noInterrupts() SimCli()
+#define interrupts() SimSei()
+
+// Interrupt vectors are plain functions that the simulator calls.
+#define ISR(vect) extern "C" void vect()
+
+void          pinMode( uint8_t pin, uint8_t mode );
+void          digitalWrite( uint8_t pin, uint8_t value );
+int           digitalRead( uint8_t pin );
+int           analogRead( uint8_t pin );
+unsigned long micros();
+unsigned long millis();
+void          delay( unsigned long ms );
+void          delayMicroseconds( unsigned int us );
+void          attachInterrupt( uint8_t interruptNum, void (*handler)(), int mode );
+void          detachInterrupt( uint8_t interruptNum );
+void          randomSeed( unsigned long seed );
+long          random( long howBig );
+long          random( long howSmall, long howBig );
+
+class HardwareSerial : public Print
+{
+public:
+	void   begin( unsigned long baud );
+	int    available();
+	int    read();
+	int    peek();
+	int    availableForWrite();
+	void   flush();
+	size_t write( uint8_t c ) override;
+	using Print::write;
+	operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef EEPROM_H
+#define EEPROM_H
+
+#include <stdint.h>
+
+// The 1KB EEPROM of the ATmega328P. Writes cost the simulator the 3.3ms
+// that the hardware would stall for if a previous write is still in flight.
+class EEPROMClass
+{
+public:
+	uint8_t  read( int idx );
+	void     write( int idx, uint8_t val );
+	void     update( int idx, uint8_t val );
+	uint16_t length() { return kSize; }
+
+	static const uint16_t kSize = 1024;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef FREEMONO9PT7B_H
+#define FREEMONO9PT7B_H
+
+// Stand-in for the Adafruit FreeMono9pt7b font.
+// It has the real font's metrics (11 pixel advance, 18 pixel line height)
+// but the glyph shapes are generated, so rendering costs and memory use are
+// representative without shipping the Adafruit bitmap data.
+
+#include <gfxfont.h>
+
+static const uint8_t kFreeMono9pt7bGlyphWidth = 7;
+static const uint8_t kFreeMono9pt7bGlyphHeight = 10;
+static const uint8_t kFreeMono9pt7bGlyphBytes = (kFreeMono9pt7bGlyphWidth * kFreeMono9pt7bGlyphHeight + 7) / 8;
+static const uint8_t kFreeMono9pt7bNumGlyphs = 0x7E - 0x20 + 1;
+
+static uint8_t  FreeMono9pt7bBitmaps[kFreeMono9pt7bNumGlyphs * kFreeMono9pt7bGlyphBytes];
+static GFXglyph FreeMono9pt7bGlyphs[kFreeMono9pt7bNumGlyphs];
+
+static struct FreeMono9pt7bGenerator
+{
+	FreeMono9pt7bGenerator()
+	{
+		for( uint8_t i = 0; i < kFreeMono9pt7bNumGlyphs; ++i )
+		{
+			GFXglyph& glyph = FreeMono9pt7bGlyphs[i];
+			glyph.bitmapOffset = i * kFreeMono9pt7bGlyphBytes;
+			glyph.xAdvance = 11;
+			glyph.xOffset = 2;
+			glyph.yOffset = -10;
+			if( i == 0 )
+			{
+				// Space
+				glyph.width = 0;
+				glyph.height = 0;
+				continue;
+			}
+			glyph.width = kFreeMono9pt7bGlyphWidth;
+			glyph.height = kFreeMono9pt7bGlyphHeight;
+
+			// A vertical stem plus a character dependent pattern of strokes
+			uint32_t hash = (i + 0x20) * 2654435761u;
+			uint8_t* pBitmap = &FreeMono9pt7bBitmaps[glyph.bitmapOffset];
+			uint16_t bitIdx = 0;
+			for( uint8_t y = 0; y < kFreeMono9pt7bGlyphHeight; ++y )
+			{
+				uint8_t row = 0x40 | ((hash >> ((y * 3) & 31)) & 0x3f);
+				if( (y == 0) || (y == kFreeMono9pt7bGlyphHeight - 1) )
+				{
+					row |= (hash & 1) ? 0x7f : 0;
+				}
+				for( uint8_t x = 0; x < kFreeMono9pt7bGlyphWidth; ++x, ++bitIdx )
+				{
+					if( row & (0x40 >> x) )
+					{
+						pBitmap[bitIdx >> 3] |= 0x80 >> (bitIdx & 7);
+					}
+				}
+			}
+		}
+	}
+} sFreeMono9pt7bGenerator;
+
+const GFXfont FreeMono9pt7b PROGMEM = { FreeMono9pt7bBitmaps, FreeMono9pt7bGlyphs, 0x20, 0x7E, 18 };
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef PRINT_H
+#define PRINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Subset of the Arduino Print class used by Serial and Adafruit_GFX.
+class Print
+{
+public:
+	virtual ~Print() {}
+
+	virtual size_t write( uint8_t c ) = 0;
+	virtual size_t write( const uint8_t* pBuffer, size_t size )
+	{
+		size_t n = 0;
+		while( size-- )
+		{
+			n += write( *pBuffer++ );
+		}
+		return n;
+	}
+	size_t write( const char* pStr ) { return pStr ? write( (const uint8_t*) pStr, strlen( pStr ) ) : 0; }
+
+	size_t print( const char* pStr )                { return write( pStr ); }
+	size_t print( char c )                          { return write( (uint8_t) c ); }
+	size_t print( unsigned char n, int base = 10 )  { return printNumber( n, base ); }
+	size_t print( int n, int base = 10 )            { return printSigned( n, base ); }
+	size_t print( unsigned int n, int base = 10 )   { return printNumber( n, base ); }
+	size_t print( long n, int base = 10 )           { return printSigned( n, base ); }
+	size_t print( unsigned long n, int base = 10 )  { return printNumber( n, base ); }
+	size_t print( double n, int digits = 2 );
+
+	size_t println()                                { return write( "\r\n" ); }
+	template< typename T > size_t println( T value ) { size_t n = print( value ); return n + println(); }
+	template< typename T > size_t println( T value, int base ) { size_t n = print( value, base ); return n + println(); }
+
+private:
+	size_t printSigned( long n, int base )
+	{
+		if( (base == 10) && (n < 0) )
+		{
+			return write( '-' ) + printNumber( (unsigned long) -n, base );
+		}
+		return printNumber( (unsigned long) n, base );
+	}
+
+	size_t printNumber( unsigned long n, int base )
+	{
+		char buf[8 * sizeof( long ) + 1];
+		char* pStr = &buf[sizeof( buf ) - 1];
+		*pStr = '\0';
+		if( base < 2 )
+		{
+			base = 10;
+		}
+		do
+		{
+			char c = (char) (n % base);
+			n /= base;
+			*--pStr = c < 10 ? c + '0' : c + 'A' - 10;
+		} while( n );
+		return write( pStr );
+	}
+};
+
+inline size_t Print::print( double n, int digits )
+{
+	size_t count = 0;
+	if( n < 0.0 )
+	{
+		count += write( '-' );
+		n = -n;
+	}
+	double rounding = 0.5;
+	for( int i = 0; i < digits; ++i )
+	{
+		rounding /= 10.0;
+	}
+	n += rounding;
+	unsigned long intPart = (unsigned long) n;
+	count += print( intPart );
+	if( digits > 0 )
+	{
+		count += write( '.' );
+	}
+	double remainder = n - (double) intPart;
+	while( digits-- > 0 )
+	{
+		remainder *= 10.0;
+		unsigned int digit = (unsigned int) remainder;
+		count += print( digit );
+		remainder -= digit;
+	}
+	return count;
+}
+
+#endif
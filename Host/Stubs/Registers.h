@@ -0,0 +1,105 @@
+#ifndef REGISTERS_H
+#define REGISTERS_H
+
+#include <stdint.h>
+
+// ATmega328P I/O registers used by the sketch, as plain variables.
+// The simulator reads the timer configuration back out of these to decide
+// which timer interrupts are enabled and when they fire.
+
+#define RAMEND 0x8FF
+#define E2END  0x3FF
+
+extern volatile uint8_t  SREG;
+
+extern volatile uint8_t  PORTB;
+extern volatile uint8_t  DDRB;
+extern volatile uint8_t  PINB;
+extern volatile uint8_t  PORTD;
+extern volatile uint8_t  DDRD;
+extern volatile uint8_t  PIND;
+
+extern volatile uint8_t  TCCR0A;
+extern volatile uint8_t  TCCR0B;
+extern volatile uint8_t  TCNT0;
+extern volatile uint8_t  OCR0A;
+extern volatile uint8_t  OCR0B;
+extern volatile uint8_t  TIMSK0;
+extern volatile uint8_t  TIFR0;
+
+extern volatile uint8_t  TCCR1A;
+extern volatile uint8_t  TCCR1B;
+extern volatile uint8_t  TCCR1C;
+extern volatile uint16_t TCNT1;
+extern volatile uint16_t OCR1A;
+extern volatile uint16_t OCR1B;
+extern volatile uint8_t  TIMSK1;
+extern volatile uint8_t  TIFR1;
+
+extern volatile uint8_t  TCCR2A;
+extern volatile uint8_t  TCCR2B;
+extern volatile uint8_t  TCNT2;
+extern volatile uint8_t  OCR2A;
+extern volatile uint8_t  OCR2B;
+extern volatile uint8_t  TIMSK2;
+extern volatile uint8_t  TIFR2;
+
+extern volatile uint8_t  PCICR;
+extern volatile uint8_t  PCIFR;
+extern volatile uint8_t  PCMSK0;
+extern volatile uint8_t  PCMSK1;
+extern volatile uint8_t  PCMSK2;
+
+// Timer 0
+#define CS00   0
+#define CS01   1
+#define CS02   2
+#define WGM00  0
+#define WGM01  1
+#define WGM02  3
+#define OCIE0A 1
+#define OCIE0B 2
+#define TOIE0  0
+
+// Timer 1
+#define CS10   0
+#define CS11   1
+#define CS12   2
+#define WGM10  0
+#define WGM11  1
+#define WGM12  3
+#define WGM13  4
+#define OCIE1A 1
+#define OCIE1B 2
+#define TOIE1  0
+#define OCF1A  1
+#define OCF1B  2
+#define TOV1   0
+
+// Timer 2
+#define CS20   0
+#define CS21   1
+#define CS22   2
+#define WGM20  0
+#define WGM21  1
+#define WGM22  3
+#define COM2B0 4
+#define COM2B1 5
+#define COM2A0 6
+#define COM2A1 7
+#define OCIE2A 1
+#define OCIE2B 2
+#define TOIE2  0
+
+// Pin change interrupts
+#define PCIE0  0
+#define PCIE1  1
+#define PCIE2  2
+#define PCIF2  2
+#define PCINT20 4
+#define PCINT21 5
+#define PCINT22 6
+
+#define _BV(b) (1 << (b))
+
+#endif
@@ -0,0 +1,303 @@
+// Decoder for the sketch's binary timing trace (see Trace.h).
+//
+//   slptrace [--bin US] [FILE]
+//
+// Reads a captured Serial stream (from the Arduino, or slpsim --serial-log)
+// from FILE or stdin, skips anything that isn't a valid trace frame, and
+// prints histograms of the scan-line start error and sync edge error, with
+// per-mirror timing statistics and a timeline of state changes.
+
+#include <map>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "Trace.h"
+
+static const double kUsPerTick = 0.5;
+
+struct Stats
+{
+	Stats() : m_count( 0 ), m_sum( 0.0 ), m_sumSq( 0.0 ), m_min( 1e30 ), m_max( -1e30 ) {}
+	void Add( double value )
+	{
+		++m_count;
+		m_sum += value;
+		m_sumSq += value * value;
+		m_min = (value < m_min) ? value : m_min;
+		m_max = (value > m_max) ? value : m_max;
+	}
+	double GetMean() const { return m_count ? m_sum / m_count : 0.0; }
+	double GetStdDev() const
+	{
+		if( m_count < 2 )
+		{
+			return 0.0;
+		}
+		double mean = GetMean();
+		double variance = m_sumSq / m_count - mean * mean;
+		return (variance > 0.0) ? sqrt( variance ) : 0.0;
+	}
+	void Print( const char* pName ) const
+	{
+		if( m_count )
+		{
+			printf( "%s: %llu, mean %.2fus, sd %.2fus, min %.2fus, max %.2fus\n", pName, (unsigned long long) m_count, GetMean(), GetStdDev(), m_min, m_max );
+		}
+		else
+		{
+			printf( "%s: none\n", pName );
+		}
+	}
+
+	uint64_t m_count;
+	double   m_sum;
+	double   m_sumSq;
+	double   m_min;
+	double   m_max;
+};
+
+// Counts of values in fixed width bins.
+class Histogram
+{
+public:
+	explicit Histogram( double binWidth ) : m_binWidth( binWidth ) {}
+
+	void Add( double value ) { ++m_bins[(long) floor( value / m_binWidth )]; }
+
+	void Print( const char* pTitle ) const
+	{
+		if( m_bins.empty() )
+		{
+			return;
+		}
+		printf( "\n%s\n", pTitle );
+		uint64_t maxCount = 0;
+		for( const auto& bin : m_bins )
+		{
+			maxCount = (bin.second > maxCount) ? bin.second : maxCount;
+		}
+		long first = m_bins.begin()->first;
+		long last = m_bins.rbegin()->first;
+		for( long binIdx = first; binIdx <= last; ++binIdx )
+		{
+			auto it = m_bins.find( binIdx );
+			uint64_t count = (it == m_bins.end()) ? 0 : it->second;
+			int barLength = (int) ((count * 50 + maxCount - 1) / maxCount);
+			printf( "%8.1f %8llu ", binIdx * m_binWidth, (unsigned long long) count );
+			for( int i = 0; i < barLength; ++i )
+			{
+				putchar( '#' );
+			}
+			putchar( '\n' );
+		}
+	}
+
+private:
+	double                  m_binWidth;
+	std::map<long, uint64_t> m_bins;
+};
+
+static void usage()
+{
+	fprintf( stderr,
+		"Usage: slptrace [options] [FILE]\n"
+		"  --bin US   Histogram bin width in us (default 1)\n" );
+	exit( 1 );
+}
+
+int main( int argc, char** argv )
+{
+	double binWidthUs = 1.0;
+	const char* pPath = nullptr;
+	for( int i = 1; i < argc; ++i )
+	{
+		if( !strcmp( argv[i], "--bin" ) && (i + 1) < argc )
+		{
+			binWidthUs = atof( argv[++i] );
+		}
+		else if( (argv[i][0] == '-') && argv[i][1] )
+		{
+			usage();
+		}
+		else
+		{
+			pPath = argv[i];
+		}
+	}
+	if( binWidthUs <= 0.0 )
+	{
+		usage();
+	}
+
+	FILE* pFile = (pPath && strcmp( pPath, "-" )) ? fopen( pPath, "rb" ) : stdin;
+	if( !pFile )
+	{
+		fprintf( stderr, "Can't open %s\n", pPath );
+		return 1;
+	}
+	std::vector<uint8_t> data;
+	uint8_t buffer[4096];
+	size_t numRead;
+	while( (numRead = fread( buffer, 1, sizeof( buffer ), pFile )) > 0 )
+	{
+		data.insert( data.end(), buffer, buffer + numRead );
+	}
+	if( pFile != stdin )
+	{
+		fclose( pFile );
+	}
+
+	static const char* kEdgeKindNames[] = { "good", "acquire", "glitch", "outlier", "missed" };
+	static const uint8_t kNumEdgeKinds = sizeof( kEdgeKindNames ) / sizeof( kEdgeKindNames[0] );
+	static const uint8_t kMaxMirrors = 32;
+
+	uint64_t numFrames = 0;
+	uint64_t numSkippedBytes = 0;
+	uint64_t numDropped = 0;
+	uint64_t typeCounts[kNumTraceEventTypes] = {0};
+	uint64_t edgeKindCounts[kNumEdgeKinds] = {0};
+	uint64_t numRevolutionsLate = 0;
+	Stats scanStartUs;
+	Stats mirrorStartUs[kMaxMirrors];
+	uint64_t mirrorLate[kMaxMirrors] = {0};
+	Stats edgeErrorUs;
+	Stats buttonLatencyUs;
+	Histogram scanStartHistogram( binWidthUs );
+	Histogram edgeErrorHistogram( binWidthUs );
+	std::vector<std::string> timeline;
+
+	// Unwrap the 24-bit timestamps, assuming events are less than half a
+	// wrap (4s) apart.
+	bool haveTime = false;
+	uint32_t lastRawTime = 0;
+	int64_t time = 0;
+
+	size_t pos = 0;
+	while( pos + kTraceFrameBytes <= data.size() )
+	{
+		const uint8_t* pFrame = &data[pos];
+		uint8_t check = 0;
+		for( uint8_t i = 1; i < kTraceFrameBytes - 1; ++i )
+		{
+			check ^= pFrame[i];
+		}
+		if( (pFrame[0] != kTraceFrameStart) || (check != pFrame[kTraceFrameBytes - 1]) || (pFrame[1] >= kNumTraceEventTypes) )
+		{
+			++numSkippedBytes;
+			++pos;
+			continue;
+		}
+		pos += kTraceFrameBytes;
+		++numFrames;
+
+		uint8_t type = pFrame[1];
+		uint8_t arg = pFrame[2];
+		uint32_t rawTime = pFrame[3] | (pFrame[4] << 8) | ((uint32_t) pFrame[5] << 16);
+		int16_t value = (int16_t) (pFrame[6] | (pFrame[7] << 8));
+		int32_t delta = (int32_t) ((rawTime - lastRawTime) << 8) >> 8; // Sign extend from 24 bits
+		time = haveTime ? time + delta : rawTime;
+		haveTime = true;
+		lastRawTime = rawTime;
+		double timeMs = time * kUsPerTick / 1000.0;
+		double valueUs = value * kUsPerTick;
+		++typeCounts[type];
+
+		char line[128];
+		switch( type )
+		{
+		case kTraceSyncEdge:
+			if( arg < kNumEdgeKinds )
+			{
+				++edgeKindCounts[arg];
+			}
+			if( arg == kTraceEdgeGood )
+			{
+				edgeErrorUs.Add( valueUs );
+				edgeErrorHistogram.Add( valueUs );
+			}
+			break;
+		case kTraceScanStart:
+			scanStartUs.Add( valueUs );
+			scanStartHistogram.Add( valueUs );
+			if( arg < kMaxMirrors )
+			{
+				mirrorStartUs[arg].Add( valueUs );
+			}
+			break;
+		case kTraceScanLate:
+			if( arg < kMaxMirrors )
+			{
+				++mirrorLate[arg];
+			}
+			break;
+		case kTraceSyncState:
+			snprintf( line, sizeof( line ), "%12.3fms  %s", timeMs, arg ? "synchronised" : "lost sync" );
+			timeline.push_back( line );
+			break;
+		case kTracePwm:
+			snprintf( line, sizeof( line ), "%12.3fms  PWM %u", timeMs, arg );
+			timeline.push_back( line );
+			break;
+		case kTraceRevolutionLate:
+			++numRevolutionsLate;
+			break;
+		case kTraceQuality:
+			snprintf( line, sizeof( line ), "%12.3fms  quality level %u", timeMs, arg );
+			timeline.push_back( line );
+			break;
+		case kTraceButton:
+			buttonLatencyUs.Add( valueUs );
+			snprintf( line, sizeof( line ), "%12.3fms  button %u, handled %.1fus later", timeMs, arg, valueUs );
+			timeline.push_back( line );
+			break;
+		case kTraceOverflow:
+			numDropped += (uint16_t) value;
+			snprintf( line, sizeof( line ), "%12.3fms  %u events dropped", timeMs, (uint16_t) value );
+			timeline.push_back( line );
+			break;
+		}
+	}
+	numSkippedBytes += data.size() - pos;
+
+	printf( "%llu frames, %llu other bytes skipped, %llu events dropped by the sketch\n",
+		(unsigned long long) numFrames, (unsigned long long) numSkippedBytes, (unsigned long long) numDropped );
+	printf( "Sync edges: %llu", (unsigned long long) typeCounts[kTraceSyncEdge] );
+	for( uint8_t i = 0; i < kNumEdgeKinds; ++i )
+	{
+		printf( ", %llu %s", (unsigned long long) edgeKindCounts[i], kEdgeKindNames[i] );
+	}
+	printf( "\nLate scan-lines: %llu, late revolution starts: %llu\n",
+		(unsigned long long) typeCounts[kTraceScanLate], (unsigned long long) numRevolutionsLate );
+	scanStartUs.Print( "Scan-line start error" );
+	edgeErrorUs.Print( "Sync edge error from prediction" );
+	buttonLatencyUs.Print( "Button press to handling" );
+
+	printf( "\nMirror    starts   mean us     sd us    min us    max us   late\n" );
+	for( uint8_t i = 0; i < kMaxMirrors; ++i )
+	{
+		const Stats& stats = mirrorStartUs[i];
+		if( stats.m_count || mirrorLate[i] )
+		{
+			printf( "%6u %9llu %9.2f %9.2f %9.2f %9.2f %6llu\n", i, (unsigned long long) stats.m_count,
+				stats.GetMean(), stats.GetStdDev(), stats.m_count ? stats.m_min : 0.0, stats.m_count ? stats.m_max : 0.0,
+				(unsigned long long) mirrorLate[i] );
+		}
+	}
+
+	scanStartHistogram.Print( "Scan-line start error (us)" );
+	edgeErrorHistogram.Print( "Sync edge error from prediction (us)" );
+
+	if( !timeline.empty() )
+	{
+		printf( "\nTimeline\n" );
+		for( const std::string& line : timeline )
+		{
+			printf( "%s\n", line.c_str() );
+		}
+	}
+	return 0;
+}
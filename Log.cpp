@@ -0,0 +1,176 @@
+#include "Log.h"
+#include "Scheduler.h"
+
+#if SLP_LOG_BYTES
+
+#if SLP_LOG_BYTES & (SLP_LOG_BYTES - 1)
+#error SLP_LOG_BYTES must be a power of 2
+#endif
+
+static_assert( (SLP_LOG_BYTES >= 2 * kLogMaxFrameBytes) && (SLP_LOG_BYTES <= 128), "SLP_LOG_BYTES must be 64 or 128" );
+
+static const uint8_t kLogMask = SLP_LOG_BYTES - 1;
+
+// Serial writes are about 60 cycles a byte while there's room in its buffer,
+// and the drain task sends up to a whole frame.
+static const uint16_t kLogDrainTicks = (kLogMaxFrameBytes * 60) / 8 + 20;
+
+// Frames as they'll be sent, except that each starts with its length in
+// place of kLogFrameStart, so the drain task can send whole frames without
+// interleaving them with anything else written to Serial.
+static uint8_t logBytes[SLP_LOG_BYTES];
+static volatile uint8_t logHead = 0; // Written by the producer
+static volatile uint8_t logTail = 0; // Written by the consumer
+static uint8_t logTokens = kLogBurst;
+static Ticks logRefillTime = 0;
+static uint16_t logPendingDropped = 0; // Since the last kLogDropped record
+static uint16_t logPendingRateLimited = 0;
+static TaskId logDrainTaskId = kInvalidTaskId;
+
+// Statistics
+static uint32_t logNumRecords = 0;
+static uint32_t logNumDropped = 0;
+static uint32_t logNumRateLimited = 0;
+
+static uint8_t logFreeBytes()
+{
+	return (logTail - logHead - 1) & kLogMask;
+}
+
+// Copy a frame into the ring, which must have room for it.
+static void logAdd( uint8_t id, uint8_t numArgs, const int32_t* pArgs )
+{
+	HalCycles( 20 + (16 * numArgs) );
+	uint8_t head = logHead;
+	uint8_t check = id;
+	logBytes[head] = 3 + (4 * numArgs);
+	head = (head + 1) & kLogMask;
+	logBytes[head] = id;
+	head = (head + 1) & kLogMask;
+	for( uint8_t i = 0; i < numArgs; ++i )
+	{
+		uint32_t arg = (uint32_t) pArgs[i];
+		for( uint8_t j = 0; j < 4; ++j )
+		{
+			uint8_t byte = (uint8_t) arg;
+			check ^= byte;
+			logBytes[head] = byte;
+			head = (head + 1) & kLogMask;
+			arg >>= 8;
+		}
+	}
+	logBytes[head] = check;
+	logHead = (head + 1) & kLogMask;
+	++logNumRecords;
+}
+
+static uint16_t logCount( uint16_t count )
+{
+	return (count == 0xffff) ? count : count + 1;
+}
+
+void LogRecord( uint8_t id, uint8_t numArgs, const int32_t* pArgs )
+{
+	HalCycles( 40 );
+	Ticks now = GetClockMain();
+	while( (logTokens < kLogBurst) && ((Ticks) (now - logRefillTime) >= kLogRefillTicks) )
+	{
+		++logTokens;
+		logRefillTime += kLogRefillTicks;
+	}
+	if( logTokens == kLogBurst )
+	{
+		logRefillTime = now;
+	}
+	if( logTokens == 0 )
+	{
+		logPendingRateLimited = logCount( logPendingRateLimited );
+		++logNumRateLimited;
+		return;
+	}
+	uint8_t frameBytes = 3 + (4 * numArgs);
+	if( logPendingDropped || logPendingRateLimited )
+	{
+		frameBytes += 3 + (4 * 2);
+	}
+	if( logFreeBytes() < frameBytes )
+	{
+		logPendingDropped = logCount( logPendingDropped );
+		++logNumDropped;
+		return;
+	}
+	--logTokens;
+	if( logPendingDropped || logPendingRateLimited )
+	{
+		const int32_t counts[2] = { logPendingDropped, logPendingRateLimited };
+		logAdd( kLogDropped, 2, counts );
+		logPendingDropped = 0;
+		logPendingRateLimited = 0;
+	}
+	logAdd( id, numArgs, pArgs );
+	if( logDrainTaskId != kInvalidTaskId )
+	{
+		scheduler.Wake( logDrainTaskId );
+	}
+}
+
+// Send the oldest frame, if Serial can take all of it without blocking.
+static bool logSendNext( bool block )
+{
+	uint8_t tail = logTail;
+	if( tail == logHead )
+	{
+		return false;
+	}
+	uint8_t frameBytes = logBytes[tail];
+	if( !block && (Serial.availableForWrite() < frameBytes) )
+	{
+		return true;
+	}
+	Serial.write( kLogFrameStart );
+	uint8_t begin = (tail + 1) & kLogMask;
+	uint8_t numBytes = frameBytes - 1;
+	if( begin + numBytes > SLP_LOG_BYTES )
+	{
+		// Wraps around the end of the ring
+		uint8_t numFirstBytes = SLP_LOG_BYTES - begin;
+		Serial.write( logBytes + begin, numFirstBytes );
+		Serial.write( logBytes, numBytes - numFirstBytes );
+	}
+	else
+	{
+		Serial.write( logBytes + begin, numBytes );
+	}
+	logTail = (tail + frameBytes) & kLogMask;
+	return true;
+}
+
+// Stream a frame at a time, until the ring is empty.
+static bool logDrainTask()
+{
+	return logSendNext( false ) && (logTail != logHead);
+}
+
+void LogStart()
+{
+	logRefillTime = GetClockMain();
+	logDrainTaskId = scheduler.AddTask( logDrainTask, kLogDrainTicks, logTail != logHead );
+}
+
+void LogFlush()
+{
+	while( logSendNext( true ) ) {}
+}
+
+void LogPrintReport()
+{
+	Serial.print( F( "Log: " ) );
+	Serial.print( logNumRecords );
+	Serial.print( F( " records, " ) );
+	Serial.print( logNumDropped );
+	Serial.print( F( " dropped, " ) );
+	Serial.print( logNumRateLimited );
+	Serial.println( F( " rate limited" ) );
+}
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include "Config.h"
+#include "LogMessages.h"
+#include "Timer.h"
+
+// Buffered binary log of status and diagnostic messages.
+//
+// A message is logged as its id and its arguments, not as text: the formats
+// live in LogMessages.h and are only expanded by the host, in
+// Host/LogDecode.cpp. Logging copies a record of a few bytes into a ring in
+// SRAM and never blocks. A background task streams the ring out over Serial
+// in idle time, only as much as Serial can take without blocking, or
+// LogFlush empties it on request.
+//
+// If the ring is full, records are dropped and counted. Records over the
+// rate limit, kLogBurst at once and then one every kLogRefillTicks, are
+// counted too, so a message logged every scan-line can't flood the link.
+// Either way, the next record that gets through is preceded by a kLogDropped
+// record with the counts.
+//
+// Each message has a subsystem and a level, and is compiled out entirely,
+// arguments and all, when its level is above SLP_LOG_LEVEL, or the
+// subsystem's own SLP_LOG_LEVEL_<subsystem>.
+//
+// Only the main loop logs. The ring's head is only written by the producer
+// and its tail only by the consumer, so no locking is needed.
+//
+// Each record goes out as a frame of
+//   kLogFrameStart, id, arguments (4 bytes each), check
+// Arguments are 32-bit little endian, as many as the format takes, and check
+// is the XOR of the bytes from the id on. Anything else on the Serial stream
+// is skipped by the decoder.
+
+static const uint8_t kLogFrameStart = 0x5c;
+static const uint8_t kLogMaxArgs = 4;
+static const uint8_t kLogMaxFrameBytes = 3 + (4 * kLogMaxArgs);
+
+// The rate limit, in records.
+static const uint8_t kLogBurst = 8;
+static const Ticks kLogRefillTicks = 20000;
+
+enum LogLevel
+{
+	kLogLevelError,
+	kLogLevelWarning,
+	kLogLevelInfo,
+	kLogLevelDebug
+};
+
+enum LogSubsystem
+{
+	kLogSubsystemLog,
+	kLogSubsystemSync,
+	kLogSubsystemScan,
+	kLogSubsystemInput,
+	kLogSubsystemStorage,
+	kLogSubsystemTimer
+};
+
+#define SLP_LOG_ID( id, subsystem, level, format ) id,
+enum LogMessage
+{
+	SLP_LOG_MESSAGES( SLP_LOG_ID )
+	kNumLogMessages
+};
+#undef SLP_LOG_ID
+
+constexpr uint8_t LogSubsystemLevel( uint8_t subsystem )
+{
+	return (subsystem == kLogSubsystemSync) ? SLP_LOG_LEVEL_SYNC
+		: (subsystem == kLogSubsystemScan) ? SLP_LOG_LEVEL_SCAN
+		: (subsystem == kLogSubsystemInput) ? SLP_LOG_LEVEL_INPUT
+		: (subsystem == kLogSubsystemStorage) ? SLP_LOG_LEVEL_STORAGE
+		: (subsystem == kLogSubsystemTimer) ? SLP_LOG_LEVEL_TIMER
+		: SLP_LOG_LEVEL;
+}
+
+// Conversions in a format, skipping "%%".
+constexpr uint8_t LogNumArgs( const char* pFormat )
+{
+	return (*pFormat == 0) ? 0
+		: (*pFormat != '%') ? LogNumArgs( pFormat + 1 )
+		: (pFormat[1] == '%') ? LogNumArgs( pFormat + 2 )
+		: 1 + LogNumArgs( pFormat + 1 );
+}
+
+// Only ever used in constant expressions, so the formats don't reach flash.
+#define SLP_LOG_ENABLED( id, subsystem, level, format ) ((SLP_LOG_BYTES != 0) && ((level) <= LogSubsystemLevel( subsystem ))),
+#define SLP_LOG_NUM_ARGS( id, subsystem, level, format ) LogNumArgs( format ),
+static constexpr bool kLogMessageEnabled[] = { SLP_LOG_MESSAGES( SLP_LOG_ENABLED ) };
+static constexpr uint8_t kLogMessageNumArgs[] = { SLP_LOG_MESSAGES( SLP_LOG_NUM_ARGS ) };
+#undef SLP_LOG_ENABLED
+#undef SLP_LOG_NUM_ARGS
+
+// Log a message from LogMessages.h, with an argument for each conversion in
+// its format. When the message is compiled out, the arguments aren't
+// evaluated.
+#define LOG( id, ... ) do { if( kLogMessageEnabled[id] ) { LogWrite< id >( __VA_ARGS__ ); } } while( 0 )
+
+#if SLP_LOG_BYTES
+
+// Register the background task that streams records out.
+void LogStart();
+
+void LogRecord( uint8_t id, uint8_t numArgs, const int32_t* pArgs );
+
+// Send everything in the ring, blocking on Serial.
+void LogFlush();
+
+void LogPrintReport();
+
+#else
+
+inline void LogStart() {}
+inline void LogRecord( uint8_t, uint8_t, const int32_t* ) {}
+inline void LogFlush() {}
+inline void LogPrintReport() {}
+
+#endif
+
+template< LogMessage kId, typename... Args >
+inline void LogWrite( Args... args )
+{
+	static_assert( sizeof...(Args) == kLogMessageNumArgs[kId], "Wrong number of arguments for the log message's format" );
+	static_assert( sizeof...(Args) <= kLogMaxArgs, "Too many arguments for a log message" );
+	const int32_t argValues[sizeof...(Args) + 1] = { (int32_t) args..., 0 };
+	LogRecord( kId, sizeof...(Args), argValues );
+}
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef LOG_MESSAGES_H
+#define LOG_MESSAGES_H
+
+// Every log message, as X( id, subsystem, level, format ). Included by the
+// sketch for the ids, subsystems and levels, and by Host/LogDecode.cpp for
+// the formats, which never go into the sketch's flash.
+//
+// A format takes one argument for each of its %d, %u, %ld or %lu, up to
+// kLogMaxArgs. Add new messages at the end, so that logs from older builds
+// still decode.
+#define SLP_LOG_MESSAGES( X ) \
+	X( kLogDropped,          kLogSubsystemLog,     kLogLevelWarning, "%u log records dropped, %u rate limited" ) \
+	X( kLogReadingOffsets,   kLogSubsystemStorage, kLogLevelInfo,    "Reading rasterHorizontalOffsets" ) \
+	X( kLogCalibrationScan,  kLogSubsystemInput,   kLogLevelInfo,    "Scan: %u" ) \
+	X( kLogFirstMirrorOffset, kLogSubsystemInput,  kLogLevelInfo,    "First mirror offset %u" ) \
+	X( kLogFillScan,         kLogSubsystemInput,   kLogLevelInfo,    "Filled scan-line %u" ) \
+	X( kLogScanDuration,     kLogSubsystemScan,    kLogLevelDebug,   "H: %ld, %ld" ) \
+	X( kLogResync,           kLogSubsystemSync,    kLogLevelDebug,   "Now: %ld, M0: %ld, T: %ld, D: %ld" ) \
+	X( kLogTimerOutOfRange,  kLogSubsystemTimer,   kLogLevelError,   "Timer %u interval out of range" ) \
+	X( kLogTimerShared,      kLogSubsystemTimer,   kLogLevelWarning, "Timer %u is shared with millis() or the drum PWM" ) \
+	X( kLogStoreLoaded,      kLogSubsystemStorage, kLogLevelInfo,    "Loaded %u of %u stored records" ) \
+	X( kLogStoreSaved,       kLogSubsystemStorage, kLogLevelDebug,   "Saved record %u in slot %u" ) \
+	X( kLogDelaysStored,     kLogSubsystemScan,    kLogLevelInfo,    "Stored delays hold, scan-line %u to %uus" ) \
+	X( kLogDelaysMeasured,   kLogSubsystemScan,    kLogLevelInfo,    "Measured delays, scan-line %u to %uus, inter-bit extra %u" ) \
+	X( kLogDelaysCorrected,  kLogSubsystemScan,    kLogLevelInfo,    "Scan-lines %dus off the delay model, corrected" )
+
+#endif
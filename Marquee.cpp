@@ -0,0 +1,87 @@
+#include "Marquee.h"
+#include "Hal.h"
+
+Marquee::Marquee()
+: m_start( 0 ), m_isColumnReady( false ), m_pGlyphs( nullptr ), m_pText( nullptr ), m_pChar( nullptr )
+, m_charColumn( 0 ), m_baseline( 0 ), m_numSteps( 0 ), m_numHeld( 0 )
+{
+	memset( m_lines, 0, sizeof( m_lines ) );
+}
+
+void Marquee::SetText( const GlyphCache* pGlyphs, const char* pText, int16_t baseline )
+{
+	m_pGlyphs = pGlyphs;
+	m_pText = *pText ? pText : nullptr;
+	m_pChar = m_pText;
+	m_charColumn = 0;
+	m_baseline = baseline;
+}
+
+void Marquee::RenderNextColumn()
+{
+	if( m_isColumnReady )
+	{
+		return;
+	}
+	HalCycles( 60 );
+	uint8_t column[kMarqueeColumnBytes];
+	memset( column, 0, sizeof( column ) );
+	if( m_pText )
+	{
+		uint8_t advance = m_pGlyphs->GetColumn( *m_pChar, m_charColumn, m_baseline, column );
+		if( ++m_charColumn >= advance )
+		{
+			m_charColumn = 0;
+			if( !*++m_pChar )
+			{
+				m_pChar = m_pText;
+			}
+		}
+	}
+
+	// Into the field for ring pixel m_start - 1 of each scan-line's byte,
+	// with laser n's bit from row (n * kNumMirrors) + scanLineIdx.
+	uint16_t pixel = (m_start ? m_start : kMarqueePixels) - 1;
+	uint8_t byteIdx = (uint8_t) (pixel / kPixelsPerScanByte);
+	uint8_t shift = (uint8_t) ((pixel % kPixelsPerScanByte) * kLaserBitsPerPixel);
+	uint8_t keepMask = (uint8_t) ~(kLaserBitsMask << shift);
+	for( uint8_t scanLineIdx = 0; scanLineIdx < kNumMirrors; ++scanLineIdx )
+	{
+		HalCycles( 12 + (8 * kNumLasers) );
+		uint8_t pins = 0;
+		for( uint8_t laser = 0; laser < kNumLasers; ++laser )
+		{
+			uint16_t y = (laser * kNumMirrors) + scanLineIdx;
+			if( column[y >> 3] & (0x80 >> (y & 7)) )
+			{
+				pins |= 1 << laser;
+			}
+		}
+		uint8_t* pByte = &m_lines[scanLineIdx][byteIdx];
+		*pByte = (*pByte & keepMask) | (pins << shift);
+	}
+	m_isColumnReady = true;
+}
+
+bool Marquee::Step()
+{
+	HalCycles( 20 );
+	if( !m_isColumnReady )
+	{
+		++m_numHeld;
+		return false;
+	}
+	m_start = (m_start ? m_start : kMarqueePixels) - 1;
+	m_isColumnReady = false;
+	++m_numSteps;
+	return true;
+}
+
+void Marquee::PrintReport() const
+{
+	Serial.print( F( "Marquee: scrolled " ) );
+	Serial.print( m_numSteps );
+	Serial.print( F( " pixels, held " ) );
+	Serial.print( m_numHeld );
+	Serial.println( F( " revolutions for want of a column" ) );
+}
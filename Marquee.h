@@ -0,0 +1,86 @@
+#ifndef MARQUEE_H
+#define MARQUEE_H
+
+#include "Config.h"
+#include "Geometry.h"
+#include "GlyphCache.h"
+#include "ScanKernel.h"
+#include "Timer.h"
+
+// Text scrolling right to left across the whole display, one pixel a
+// revolution, without redrawing anything.
+//
+// Each scan-line is a ring of kMarqueeLineBytes bytes in the transposed scan
+// buffer's format (see ScanBuffer.h), one byte wider than the display. The
+// display is a window onto the rings that starts at ring pixel GetStart(),
+// and scrolling moves the window back a pixel. The only new pixels are the
+// column that comes into view at the right hand edge (pixel 0 of the scan),
+// so that's all that has to be rendered. It goes into the ring pixel before
+// the window, which isn't scanned, so it can be rendered by a background
+// task at any time during the revolution before Step() scrolls onto it.
+// Step() is called between revolutions. If the column isn't ready in time,
+// the window holds where it is for another revolution.
+//
+// The window usually starts part way into a byte, GetPhase() pixels in. The
+// scan starts that many pixel periods early to keep the pixels where they
+// belong, with the pixels before the window blanked with GetPhaseMask(),
+// and finishes with the first GetPhase() pixels of one more byte. Those are
+// the pixels at the end of the window, as the ring has wrapped.
+//
+// The text comes from a GlyphCache, a column at a time, and starts again
+// once it has all gone past. Characters that weren't loaded into the cache
+// come out as a single blank column.
+#if SLP_MARQUEE && (!SLP_TRANSPOSED_SCAN_BUFFER || SLP_TIMER_PIXEL_CLOCK || SLP_SPARSE_SCAN)
+#error "SLP_MARQUEE needs SLP_TRANSPOSED_SCAN_BUFFER, without SLP_TIMER_PIXEL_CLOCK or SLP_SPARSE_SCAN"
+#endif
+
+static const uint8_t  kMarqueeLineBytes = (kWidth / kPixelsPerScanByte) + 1;
+static const uint16_t kMarqueePixels = (uint16_t) kMarqueeLineBytes * kPixelsPerScanByte;
+static const uint8_t  kMarqueeColumnBytes = (uint8_t) ((kHeight + 7) >> 3);
+
+class Marquee
+{
+public:
+	Marquee();
+
+	// Scroll pText, drawn from pGlyphs with its baseline on canvas row
+	// 'baseline'. pText must stay valid.
+	void SetText( const GlyphCache* pGlyphs, const char* pText, int16_t baseline );
+
+	// Render the column that comes into view on the next Step, if it hasn't
+	// been already.
+	void RenderNextColumn();
+	bool IsColumnReady() const { return m_isColumnReady; }
+
+	// Between revolutions: scroll a pixel if the next column is ready.
+	// Returns true if it scrolled.
+	bool Step();
+
+	const uint8_t* GetLine( uint8_t scanLineIdx ) const { return m_lines[scanLineIdx]; }
+	uint16_t       GetStart() const { return m_start; }
+	uint8_t        GetFirstByte() const { return (uint8_t) (m_start / kPixelsPerScanByte); }
+	uint8_t        GetPhase() const { return (uint8_t) (m_start % kPixelsPerScanByte); }
+	// The bits of the first byte's pixels that are before the window.
+	uint8_t        GetPhaseMask() const { return (uint8_t) ((1 << (GetPhase() * kLaserBitsPerPixel)) - 1); }
+
+	// Approximate AVR cost of RenderNextColumn, with glyphs up to kHeight rows.
+	static const Ticks kRenderColumnTicks = (100 + (6 * kHeight) + (kNumMirrors * (12 + (8 * kNumLasers)))) >> 3;
+
+	void PrintReport() const;
+
+private:
+	uint8_t           m_lines[kNumMirrors][kMarqueeLineBytes];
+	uint16_t          m_start;          // Ring pixel at the right hand edge of the display
+	bool              m_isColumnReady;
+	const GlyphCache* m_pGlyphs;
+	const char*       m_pText;
+	const char*       m_pChar;          // The character coming into view
+	uint8_t           m_charColumn;     // and its next column
+	int16_t           m_baseline;
+
+	// Statistics
+	uint32_t          m_numSteps;
+	uint32_t          m_numHeld;        // Revolutions without a column ready
+};
+
+#endif
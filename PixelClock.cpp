@@ -0,0 +1,139 @@
+#include "PixelClock.h"
+#include "Config.h"
+#include "Geometry.h"
+#include "ScanKernel.h"
+
+#if SLP_TIMER_PIXEL_CLOCK
+
+#if !SLP_TRANSPOSED_SCAN_BUFFER
+#error The timer driven pixel clock needs SLP_TRANSPOSED_SCAN_BUFFER
+#endif
+
+static const uint8_t* pPixelClockLine;
+static const uint8_t* pPixelClockData;
+static const ScanSpan* pPixelClockSpan;
+static uint8_t pixelClockNumSpans; // Including the current one
+static uint8_t pixelClockPixel; // The next one to write
+static uint8_t pixelClockSpanEnd; // The pixel after the current span, which is written blank
+static volatile bool pixelClockBusy = false;
+static bool pixelClockStarted;
+static uint8_t pixelClockByte; // What's left of the current scan buffer byte
+static PixelPeriod pixelClockPeriod;
+static const uint16_t* pPixelClockOffsets;
+static Ticks pixelClockStartTime;
+static uint8_t pixelClockFraction;
+static uint8_t pixelClockScanLineIdx;
+static uint8_t pixelClockStartError;
+
+void PixelClockStart( const uint8_t* pPixels, const ScanSpan* pSpans, uint8_t numSpans, uint8_t scanLineIdx, Ticks startTime, PixelPeriod period,
+	const uint16_t* pOffsets )
+{
+	HalCycles( 50 );
+	uint8_t firstByte = numSpans ? pSpans->m_begin : 0;
+	uint8_t firstPixel = firstByte * kPixelsPerScanByte;
+	uint32_t offset = pOffsets ? ((uint32_t) pOffsets[firstPixel] << 8) : ((uint32_t) firstPixel * period);
+	cli();
+	pPixelClockLine = pPixels;
+	pPixelClockData = pPixels + firstByte;
+	pPixelClockSpan = pSpans;
+	pixelClockNumSpans = numSpans;
+	pixelClockPixel = firstPixel;
+	pixelClockSpanEnd = numSpans ? pSpans->m_end * kPixelsPerScanByte : 0;
+	pixelClockStarted = false;
+	pixelClockBusy = true;
+	pixelClockScanLineIdx = scanLineIdx;
+	pixelClockPeriod = period;
+	pPixelClockOffsets = pOffsets;
+	pixelClockStartTime = startTime;
+	pixelClockFraction = (uint8_t) offset;
+	OCR1B = (uint16_t) (startTime + (offset >> 8));
+	TIFR1 = (1 << OCF1B); // Clear any stale match
+	TIMSK1 |= (1 << OCIE1B);
+	sei();
+}
+
+bool PixelClockIsBusy()
+{
+	return pixelClockBusy;
+}
+
+Ticks PixelClockGetStartError()
+{
+	return pixelClockStartError;
+}
+
+ISR(TIMER1_COMPB_vect)
+{
+	// Write the pixel first, so it's as close to the compare as possible.
+	// Spans are whole scan buffer bytes, so the low bits of the pixel
+	// say where in a byte we are.
+	HalProfileBegin( kProfileZonePixelClock );
+	uint8_t pixel = pixelClockPixel;
+	uint32_t step = 0;
+	if( pixel == pixelClockSpanEnd )
+	{
+		HalWriteLasers( 0 );
+		HalCycles( 30 );
+		if( pixelClockNumSpans <= 1 )
+		{
+			TIMSK1 &= ~(1 << OCIE1B);
+			if( pixelClockNumSpans )
+			{
+				HalScanLineEnd();
+			}
+			pixelClockBusy = false;
+		}
+		else
+		{
+			// Step over the gap to the next span
+			HalCycles( 30 );
+			--pixelClockNumSpans;
+			const ScanSpan& span = *++pPixelClockSpan;
+			pPixelClockData = pPixelClockLine + span.m_begin;
+			pixelClockSpanEnd = span.m_end * kPixelsPerScanByte;
+			uint8_t begin = span.m_begin * kPixelsPerScanByte;
+			step = ((uint32_t) (uint8_t) (begin - pixel) * pixelClockPeriod) + pixelClockFraction;
+			pixel = begin;
+			HalScanLineSkipTo( begin );
+		}
+	}
+	else
+	{
+		if( (pixel & (kPixelsPerScanByte - 1)) == 0 )
+		{
+			pixelClockByte = *pPixelClockData++;
+		}
+		if( !pixelClockStarted )
+		{
+			HalScanLineBegin( pixelClockScanLineIdx, pixel );
+		}
+		HalWriteLasers( pixelClockByte & kLaserBitsMask );
+		pixelClockByte >>= kLaserBitsPerPixel;
+		HalCycles( 30 );
+		++pixel;
+		step = (uint32_t) pixelClockPeriod + pixelClockFraction;
+	}
+	if( !pixelClockStarted )
+	{
+		pixelClockStarted = true;
+		pixelClockStartError = (uint8_t) (HalReadTimer1() - OCR1B);
+	}
+	if( pixelClockBusy )
+	{
+		pixelClockPixel = pixel;
+		if( pPixelClockOffsets )
+		{
+			// Straight from the table, over a gap or not
+			OCR1B = (uint16_t) (pixelClockStartTime + pPixelClockOffsets[pixel]);
+		}
+		else
+		{
+			// Step on to the next pixel, carrying the fractional part
+			pixelClockFraction = (uint8_t) step;
+			OCR1B += (uint16_t) (step >> 8);
+		}
+	}
+	HalProfileEnd( kProfileZonePixelClock );
+}
+
+#endif
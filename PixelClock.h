@@ -0,0 +1,51 @@
+#ifndef PIXEL_CLOCK_H
+#define PIXEL_CLOCK_H
+
+#include "ScanKernel.h"
+#include "Timer.h"
+
+// Scans a line out of the transposed scan buffer from the Timer1 compare B
+// interrupt, one pixel per compare, instead of pacing the pixels with nop
+// loops. Timer1 keeps free running as the 0.5us clock; OCR1B is stepped on
+// by a fixed point period so the pixels land on an exact grid, and the main
+// loop is free for other work for the duration of the scan-line.
+//
+// Only the given spans of the line are scanned out. The compare is stepped
+// straight over the gaps between them, so blank pixels don't cost an
+// interrupt each.
+//
+// Given a table of pixel start times (see FTheta.h), the compare is set from
+// that instead of being stepped on by the period, so the pixels needn't be
+// evenly spaced.
+
+// Pixel period in 1/256ths of a tick.
+typedef uint16_t PixelPeriod;
+
+// AVR cycles spent in the ISR per pixel.
+static const uint8_t kPixelClockPixelCycles = 60;
+
+// Shortest period the interrupt can keep up with, leaving some time for the
+// main loop.
+static const PixelPeriod kMinPixelPeriod = 12 << 8;
+
+// A scan-line must be started at least this far ahead of its start time, and
+// no further ahead than half the Timer1 wrap.
+static const Ticks kPixelClockMinLeadTicks = 16;
+static const Ticks kPixelClockMaxLeadTicks = 0x7000;
+
+// Start scanning out the spans of a line that starts at 'startTime'. With no
+// spans, just the blank is written then. With pOffsets, pixel n starts
+// pOffsets[n] ticks after startTime, for n up to kWidth, rather than n
+// periods after it.
+void PixelClockStart( const uint8_t* pPixels, const ScanSpan* pSpans, uint8_t numSpans, uint8_t scanLineIdx, Ticks startTime, PixelPeriod period,
+	const uint16_t* pOffsets = nullptr );
+
+// True from PixelClockStart until the last pixel of the last span, and the
+// blank that follows it, have been written.
+bool PixelClockIsBusy();
+
+// How many ticks after its start time the last scan-line's first pixel was
+// written, from interrupt latency.
+Ticks PixelClockGetStartError();
+
+#endif
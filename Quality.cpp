@@ -0,0 +1,122 @@
+#include "Quality.h"
+#include "Hal.h"
+
+// Revolutions without lateness before trying the next level up, doubled
+// each time a step up turns out to be premature.
+static const uint16_t kMinRevolutionsToStepUp = 32;
+static const uint16_t kMaxRevolutionsToStepUp = 1024;
+
+// Spare time that each level needs before every scan-line to step up, in
+// 1/8ths of the scan interval. Stepping up to kQualityFull lengthens the scan
+// by 1/8. Leaving interlacing loses the skipped mirror's interval.
+static const uint8_t kStepUpSlackEighths[kNumQualityLevels] = { 0, 2, 9, 2 };
+
+static const Ticks kNoSlack = 0x7fffffff;
+
+QualityGovernor::QualityGovernor()
+: m_level( kQualityFull )
+, m_numLateThisRevolution( 0 )
+, m_wasLateLastRevolution( false )
+, m_minSlack( kNoSlack )
+, m_numGoodRevolutions( 0 )
+, m_numRevolutionsToStepUp( kMinRevolutionsToStepUp )
+, m_numRevolutionsAtLevel( 0 )
+, m_lastStepWasUp( false )
+, m_numLateScanLines( 0 )
+, m_numStepsDown( 0 )
+, m_numStepsUp( 0 )
+{
+	memset( m_numRevolutionsAtLevels, 0, sizeof( m_numRevolutionsAtLevels ) );
+}
+
+void QualityGovernor::NoteLateScanLine()
+{
+	if( m_numLateThisRevolution != 0xff )
+	{
+		++m_numLateThisRevolution;
+	}
+	if( m_numLateScanLines != 0xffff )
+	{
+		++m_numLateScanLines;
+	}
+}
+
+bool QualityGovernor::EndRevolution( Ticks scanInterval )
+{
+	HalCycles( 60 );
+	if( m_numRevolutionsAtLevels[m_level] != 0xffff )
+	{
+		++m_numRevolutionsAtLevels[m_level];
+	}
+	if( m_numRevolutionsAtLevel != 0xffff )
+	{
+		++m_numRevolutionsAtLevel;
+	}
+	uint8_t oldLevel = m_level;
+	bool isLate = (m_numLateThisRevolution != 0);
+	if( (m_numLateThisRevolution >= 2) || (isLate && m_wasLateLastRevolution) )
+	{
+		if( m_level + 1 < kNumQualityLevels )
+		{
+			if( m_lastStepWasUp && (m_numRevolutionsAtLevel < m_numRevolutionsToStepUp) )
+			{
+				// Didn't last, so wait longer before trying again
+				if( m_numRevolutionsToStepUp < kMaxRevolutionsToStepUp )
+				{
+					m_numRevolutionsToStepUp <<= 1;
+				}
+			}
+			else
+			{
+				m_numRevolutionsToStepUp = kMinRevolutionsToStepUp;
+			}
+			++m_level;
+			m_lastStepWasUp = false;
+			++m_numStepsDown;
+		}
+	}
+	else if( isLate || (m_minSlack < ((scanInterval * kStepUpSlackEighths[m_level]) >> 3)) )
+	{
+		m_numGoodRevolutions = 0;
+	}
+	else if( (m_level > kQualityFull) && (++m_numGoodRevolutions >= m_numRevolutionsToStepUp) )
+	{
+		--m_level;
+		m_lastStepWasUp = true;
+		++m_numStepsUp;
+	}
+
+	if( m_level != oldLevel )
+	{
+		m_numGoodRevolutions = 0;
+		m_numRevolutionsAtLevel = 0;
+		m_wasLateLastRevolution = false;
+	}
+	else
+	{
+		m_wasLateLastRevolution = isLate;
+	}
+	m_numLateThisRevolution = 0;
+	m_minSlack = kNoSlack;
+	return m_level != oldLevel;
+}
+
+void QualityGovernor::PrintReport() const
+{
+	// Level, late scan-lines, steps, then revolutions spent at each level
+	Serial.print( F( "Quality: level " ) );
+	Serial.print( m_level );
+	Serial.print( F( ", " ) );
+	Serial.print( m_numLateScanLines );
+	Serial.print( F( " late scan-lines, " ) );
+	Serial.print( m_numStepsDown );
+	Serial.print( F( " down, " ) );
+	Serial.print( m_numStepsUp );
+	Serial.print( F( " up, revolutions at each level" ) );
+	for( uint8_t i = 0; i < kNumQualityLevels; ++i )
+	{
+		Serial.print( i ? "/" : " " );
+		Serial.print( m_numRevolutionsAtLevels[i] );
+	}
+	Serial.println();
+}
@@ -0,0 +1,66 @@
+#ifndef QUALITY_H
+#define QUALITY_H
+
+#include "Config.h"
+#include "Timer.h"
+
+// Steps the output quality down when scan-lines can't start on time, and
+// back up once there's headroom, so that an overloaded CPU or a fast drum
+// shows a degraded picture rather than none.
+//
+// A late scan-line is skipped. Two in a revolution, or one in each of two
+// revolutions running, step the quality down a level at the end of the
+// revolution. Stepping back up needs a run of revolutions with no late
+// scan-lines and enough spare time before every scan-line for the next level
+// up. If that run ends in lateness soon after a step up, the run needed is
+// doubled, so a marginal level isn't retried every few revolutions.
+enum QualityLevel
+{
+	kQualityFull,                  // Every mirror, scanning for 1/2 of each interval
+	kQualityShortScan,             // Scanning for 3/8 of each interval
+	kQualityInterlaced,            // Odd and even mirrors on alternate revolutions
+	kQualityInterlacedShortScan,
+	kNumQualityLevels
+};
+
+class QualityGovernor
+{
+public:
+	QualityGovernor();
+
+	// A scan-line couldn't start on time.
+	void NoteLateScanLine();
+
+	// Ticks to spare between scheduling a scan-line and its start.
+	void NoteSlack( Ticks slack ) { if( slack < m_minSlack ) m_minSlack = slack; }
+
+	// Call at the end of each revolution that was scanned, with the time
+	// between scan-lines. Returns true if the level changed.
+	bool EndRevolution( Ticks scanInterval );
+
+	QualityLevel GetLevel() const { return (QualityLevel) m_level; }
+	bool IsInterlaced() const { return m_level >= kQualityInterlaced; }
+	bool IsShortScan() const { return (m_level == kQualityShortScan) || (m_level == kQualityInterlacedShortScan); }
+
+	uint16_t GetNumLateScanLines() const { return m_numLateScanLines; }
+
+	void PrintReport() const;
+
+private:
+	uint8_t  m_level;
+	uint8_t  m_numLateThisRevolution;
+	bool     m_wasLateLastRevolution;
+	Ticks    m_minSlack;
+	uint16_t m_numGoodRevolutions;       // Since the last late scan-line
+	uint16_t m_numRevolutionsToStepUp;
+	uint16_t m_numRevolutionsAtLevel;
+	bool     m_lastStepWasUp;
+
+	// Statistics
+	uint16_t m_numLateScanLines;
+	uint16_t m_numStepsDown;
+	uint16_t m_numStepsUp;
+	uint16_t m_numRevolutionsAtLevels[kNumQualityLevels];
+};
+
+#endif
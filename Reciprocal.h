@@ -0,0 +1,42 @@
+#ifndef RECIPROCAL_H
+#define RECIPROCAL_H
+
+#include "Hal.h"
+
+// The conversions made at each revolution boundary divide by constants, so
+// they multiply by a reciprocal worked out ahead of time instead of doing a
+// 32-bit division (about 650 cycles on the AVR, in libgcc's __udivmodsi4).
+//
+// The reciprocal is rounded down, so the quotient can only come out low, and
+// is brought up from the remainder. That takes at most x / 2^shift steps,
+// and none or one at the drum speeds that the projector runs at.
+// measureRevolutionSettings() checks the results against the divisions.
+//
+// floor( (x << scale) / divisor ), where reciprocal is
+// floor( 2^(shift + scale) / divisor ) and x * reciprocal fits in 32 bits.
+inline uint32_t divideByReciprocal( uint32_t x, uint8_t scale, uint16_t divisor, uint32_t reciprocal, uint8_t shift )
+{
+	HalCycles( 40 ); // 32 by 16-bit multiply with MUL, and the shift
+	uint32_t quotient = (x * reciprocal) >> shift;
+	uint32_t remainder = (x << scale) - (quotient * divisor);
+	while( remainder >= divisor )
+	{
+		HalCycles( 12 );
+		++quotient;
+		remainder -= divisor;
+	}
+	return quotient;
+}
+
+// At compile time, for a constant divisor.
+#define RECIPROCAL( divisor, scale, shift ) ((uint32_t) ((1ULL << ((shift) + (scale))) / (divisor)))
+
+// At run time, for a divisor that's only known then, such as a measured one.
+// shift + scale must be under 32.
+inline uint32_t computeReciprocal( uint16_t divisor, uint8_t scale, uint8_t shift )
+{
+	HalCycles( 650 );
+	return (1UL << (shift + scale)) / divisor;
+}
+
+#endif
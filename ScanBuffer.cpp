@@ -0,0 +1,185 @@
+#include "ScanBuffer.h"
+#include "Hal.h"
+#include "Timer.h"
+
+#if SLP_TRANSPOSED_SCAN_BUFFER
+
+ScanBuffer::ScanBuffer()
+: m_numFreeSlots( kNumSpareScanLines ), m_dirtyLines( kAllScanLines ), m_stagedLines( 0 ), m_numRebuiltLines( 0 ), m_numRebuiltBytes( 0 )
+{
+	memset( m_slots, 0, sizeof( m_slots ) );
+	memset( m_firstDirtyByte, 0, sizeof( m_firstDirtyByte ) );
+	memset( m_lastDirtyByte, kWidthBytes - 1, sizeof( m_lastDirtyByte ) );
+#if SLP_SPARSE_SCAN
+	memset( m_numSpans, 0, sizeof( m_numSpans ) );
+#endif
+	for( uint8_t i = 0; i < kNumMirrors; ++i )
+	{
+		m_front[i] = i;
+	}
+	for( uint8_t i = 0; i < kNumSpareScanLines; ++i )
+	{
+		m_freeSlots[i] = kNumMirrors + i;
+	}
+}
+
+void ScanBuffer::MarkDirty( const DirtyCanvas& canvas )
+{
+	ScanLineMask dirtyLines = canvas.GetDirtyScanLines();
+	for( uint8_t scanLineIdx = 0; dirtyLines; ++scanLineIdx, dirtyLines >>= 1 )
+	{
+		if( !(dirtyLines & 1) )
+		{
+			continue;
+		}
+		// Merge the spans of every laser's row into the scan-line's. A line
+		// that was already dirty keeps what it had.
+		HalCycles( 10 + (12 * kNumLasers) );
+		ScanLineMask lineBit = (ScanLineMask) 1 << scanLineIdx;
+		uint8_t firstByte = (m_dirtyLines & lineBit) ? m_firstDirtyByte[scanLineIdx] : 0xff;
+		uint8_t lastByte = (m_dirtyLines & lineBit) ? m_lastDirtyByte[scanLineIdx] : 0;
+		for( uint16_t y = scanLineIdx; y < kHeight; y += kNumMirrors )
+		{
+			if( canvas.IsRowDirty( y ) )
+			{
+				if( canvas.GetFirstDirtyByte( y ) < firstByte )
+				{
+					firstByte = canvas.GetFirstDirtyByte( y );
+				}
+				if( canvas.GetLastDirtyByte( y ) > lastByte )
+				{
+					lastByte = canvas.GetLastDirtyByte( y );
+				}
+			}
+		}
+		m_firstDirtyByte[scanLineIdx] = firstByte;
+		m_lastDirtyByte[scanLineIdx] = lastByte;
+		m_dirtyLines |= lineBit;
+	}
+}
+
+void ScanBuffer::rebuildBytes( const uint8_t* pCanvas, uint8_t* pPixels, uint8_t scanLineIdx, uint8_t firstByte, uint8_t lastByte )
+{
+	const uint8_t* pByte = pCanvas + (scanLineIdx * kWidthBytes) + lastByte + 1;
+	pPixels += (kWidthBytes - 1 - lastByte) * kScanBytesPerCanvasByte;
+	++m_numRebuiltLines;
+	m_numRebuiltBytes += lastByte - firstByte + 1;
+	// Same traversal as the bit-gathering scan: bytes right to left, and
+	// within a byte least significant (rightmost) pixel first.
+	for( int8_t x = lastByte; x >= (int8_t) firstByte; --x )
+	{
+		HalCycles( 10 + (30 * kNumLasers) );
+		--pByte;
+		LaserBytes bytes;
+		LoadLaserBytes( bytes, pByte );
+		for( uint8_t bitIdx = 0; bitIdx < 8; bitIdx += kPixelsPerScanByte )
+		{
+			*pPixels++ = PackScanByte( bytes, bitIdx );
+		}
+	}
+}
+
+void ScanBuffer::findSpans( uint8_t slot )
+{
+#if SLP_SPARSE_SCAN
+	HalCycles( 20 + (6 * kScanLineBytes) );
+	const uint8_t* pPixels = m_slots[slot];
+	ScanSpan* pSpans = m_spans[slot];
+	uint8_t numSpans = 0;
+	uint8_t gapBytes = kMinScanGapBytes; // So the first lit byte starts a span
+	for( uint8_t x = 0; x < kScanLineBytes; ++x )
+	{
+		if( !pPixels[x] )
+		{
+			++gapBytes;
+			continue;
+		}
+		if( (gapBytes >= kMinScanGapBytes) && (numSpans < kMaxScanSpans) )
+		{
+			pSpans[numSpans++].m_begin = x;
+		}
+		pSpans[numSpans - 1].m_end = x + 1;
+		gapBytes = 0;
+	}
+	m_numSpans[slot] = numSpans;
+#else
+	(void) slot;
+#endif
+}
+
+bool ScanBuffer::RebuildNextDirtyLine( const DirtyCanvas& canvas )
+{
+	if( !m_dirtyLines )
+	{
+		return false;
+	}
+	uint8_t scanLineIdx = 0;
+	while( !(m_dirtyLines & ((ScanLineMask) 1 << scanLineIdx)) )
+	{
+		++scanLineIdx;
+	}
+	ScanLineMask lineBit = (ScanLineMask) 1 << scanLineIdx;
+
+	uint8_t firstByte = m_firstDirtyByte[scanLineIdx];
+	uint8_t lastByte = m_lastDirtyByte[scanLineIdx];
+	uint8_t slot;
+	if( kNumSpareScanLines == 0 )
+	{
+		slot = m_front[scanLineIdx];
+	}
+	else if( m_stagedLines & lineBit )
+	{
+		// Changed again before it was swapped in
+		slot = m_back[scanLineIdx];
+	}
+	else if( m_numFreeSlots )
+	{
+		slot = m_freeSlots[--m_numFreeSlots];
+		m_back[scanLineIdx] = slot;
+		m_stagedLines |= lineBit;
+		if( (firstByte != 0) || (lastByte != (kWidthBytes - 1)) )
+		{
+			// Keep the bytes that aren't being rebuilt
+			HalCycles( 20 + (4 * kScanLineBytes) );
+			memcpy( m_slots[slot], m_slots[m_front[scanLineIdx]], kScanLineBytes );
+		}
+	}
+	else
+	{
+		// Wait for the next swap to free some slots up
+		return false;
+	}
+	m_dirtyLines &= ~lineBit;
+	rebuildBytes( canvas.getBuffer(), m_slots[slot], scanLineIdx, firstByte, lastByte );
+	findSpans( slot );
+	return true;
+}
+
+void ScanBuffer::Swap()
+{
+	if( !m_stagedLines || (m_dirtyLines && m_numFreeSlots) )
+	{
+		return;
+	}
+	HalCycles( 10 * kNumMirrors );
+	for( uint8_t i = 0; i < kNumMirrors; ++i )
+	{
+		if( m_stagedLines & ((ScanLineMask) 1 << i) )
+		{
+			m_freeSlots[m_numFreeSlots++] = m_front[i];
+			m_front[i] = m_back[i];
+		}
+	}
+	m_stagedLines = 0;
+}
+
+void ScanBuffer::PrintReport() const
+{
+	Serial.print( F( "Scan buffer: " ) );
+	Serial.print( m_numRebuiltLines );
+	Serial.print( F( " lines, " ) );
+	Serial.print( m_numRebuiltBytes );
+	Serial.println( F( " canvas bytes rebuilt" ) );
+}
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef SCAN_BUFFER_H
+#define SCAN_BUFFER_H
+
+#include "Config.h"
+#include "DirtyCanvas.h"
+#include "Geometry.h"
+#include "ScanKernel.h"
+#include "Timer.h"
+
+// The canvas rearranged into the order that horizontalScan outputs it, so the
+// scan kernel does one load per two pixels and no bit manipulation.
+//
+// Each scan-line holds kWidth pixels in scan order, which is right to left
+// across the canvas, packed kPixelsPerScanByte to a byte with the first pixel
+// in the low bits (see ScanKernel.h). With 4 lasers that's two nybbles per
+// byte. Bit n of a pixel drives laser n, and comes from canvas row
+// (n * kNumMirrors) + scanLineIdx.
+//
+// Scan-lines live in a pool of slots, with a table mapping each scan-line to
+// the slot that is currently being scanned out. Rebuilt lines are staged into
+// spare slots and only swapped into the table between revolutions, so a
+// revolution never shows a mixture of old and new content.
+// With SLP_SPARE_SCAN_LINES == kNumMirrors this is full double buffering.
+// With fewer spares, a change to more lines than that is presented over
+// several revolutions. With none, lines are rebuilt in place.
+//
+// Only the bytes of a scan-line that the canvas marked dirty are rebuilt. A
+// line staged into a fresh slot first takes a copy of the line it replaces.
+//
+// With SLP_SPARSE_SCAN, rebuilding a line also finds the spans of it with
+// any laser lit, up to kMaxScanSpans of them. Blank runs shorter than
+// kMinScanGapBytes are left inside a span, as they'd be too short to do
+// anything with, and the last span takes in everything after it. A blank
+// line has no spans.
+static const uint8_t kScanLineBytes = kWidth / kPixelsPerScanByte;
+static const uint8_t kNumSpareScanLines = (SLP_SPARE_SCAN_LINES < kNumMirrors) ? SLP_SPARE_SCAN_LINES : kNumMirrors;
+static const uint8_t kMaxScanSpans = 4;
+static const uint8_t kMinScanGapBytes = 4;
+
+#if SLP_SPARSE_SCAN && !SLP_TRANSPOSED_SCAN_BUFFER
+#error SLP_SPARSE_SCAN needs SLP_TRANSPOSED_SCAN_BUFFER
+#endif
+
+class ScanBuffer
+{
+public:
+	ScanBuffer();
+
+	const uint8_t* GetLine( uint8_t scanLineIdx ) const { return m_slots[m_front[scanLineIdx]]; }
+
+#if SLP_SPARSE_SCAN
+	// The spans of a scan-line with lasers lit, in order.
+	uint8_t         GetNumSpans( uint8_t scanLineIdx ) const { return m_numSpans[m_front[scanLineIdx]]; }
+	const ScanSpan* GetSpans( uint8_t scanLineIdx ) const { return m_spans[m_front[scanLineIdx]]; }
+#endif
+
+	// Take the canvas's dirty scan-lines and spans as out of date.
+	void MarkDirty( const DirtyCanvas& canvas );
+	bool IsDirty() const { return m_dirtyLines != 0; }
+
+	// True until every change has been rebuilt and swapped in.
+	bool IsPresentPending() const { return (m_dirtyLines | m_stagedLines) != 0; }
+
+	// Rebuild the lowest numbered dirty scan-line from the canvas.
+	// Returns false if there was nothing to do, or no spare slot to do it in.
+	bool RebuildNextDirtyLine( const DirtyCanvas& canvas );
+
+	// Make the staged scan-lines visible. Only call between revolutions.
+	// Waits for all dirty lines to be staged unless the spares have run out.
+	void Swap();
+
+	// Approximate AVR cost of MarkDirty with every scan-line dirty.
+	static const Ticks kMarkDirtyTicks = (kNumMirrors * (10 + (12 * kNumLasers))) >> 3;
+
+	// Approximate AVR cost of finding a scan-line's spans.
+	static const Ticks kFindSpansTicks = SLP_SPARSE_SCAN ? ((20 + (6 * kScanLineBytes)) >> 3) : 0;
+
+	// Approximate AVR cost of RebuildNextDirtyLine, for fitting it between scan-lines.
+	static const Ticks kRebuildLineTicks = 40 + ((kWidthBytes * (10 + (30 * kNumLasers))) >> 3) + (kScanLineBytes >> 2) + kFindSpansTicks;
+
+	// Print the number of scan-lines and canvas bytes rebuilt to Serial.
+	void PrintReport() const;
+
+private:
+	void rebuildBytes( const uint8_t* pCanvas, uint8_t* pPixels, uint8_t scanLineIdx, uint8_t firstByte, uint8_t lastByte );
+	void findSpans( uint8_t slot );
+
+	uint8_t      m_slots[kNumMirrors + kNumSpareScanLines][kScanLineBytes];
+	uint8_t      m_front[kNumMirrors];
+	uint8_t      m_back[kNumMirrors];
+	uint8_t      m_freeSlots[kNumSpareScanLines + 1];
+	uint8_t      m_numFreeSlots;
+	ScanLineMask m_dirtyLines;
+	ScanLineMask m_stagedLines;
+	uint8_t      m_firstDirtyByte[kNumMirrors]; // Canvas bytes, as DirtyCanvas
+	uint8_t      m_lastDirtyByte[kNumMirrors];
+#if SLP_SPARSE_SCAN
+	ScanSpan     m_spans[kNumMirrors + kNumSpareScanLines][kMaxScanSpans];
+	uint8_t      m_numSpans[kNumMirrors + kNumSpareScanLines];
+#endif
+	uint16_t     m_numRebuiltLines;
+	uint32_t     m_numRebuiltBytes;
+};
+
+#endif
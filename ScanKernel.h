@@ -0,0 +1,133 @@
+#ifndef SCAN_KERNEL_H
+#define SCAN_KERNEL_H
+
+#include "Geometry.h"
+#include "Hal.h"
+
+// Scan kernels, generated at compile time for the projector geometry.
+//
+// These templates unroll themselves over the lasers and the pixels of a
+// byte, so each build gets straight line code for its own number of lasers
+// and packing, with the laser byte offsets folded into constants.
+//
+// The kernels that output pixels take an Output class with static inline
+// functions, which supply the pixel writes and the delays between them:
+//   Pixel( pins )      Write one pixel's laser bits, in pin order
+//   InterBitDelay()    Between pixels within a byte
+//   InterByteDelay()   After the last pixel of a byte
+
+// The transposed scan buffer packs each pixel's laser bits into the smallest
+// power of 2 sized field that holds them, with the first pixel in the low bits.
+static const uint8_t kLaserBitsPerPixel = (kNumLasers <= 1) ? 1 : (kNumLasers <= 2) ? 2 : (kNumLasers <= 4) ? 4 : 8;
+static const uint8_t kPixelsPerScanByte = 8 / kLaserBitsPerPixel;
+static const uint8_t kLaserBitsMask = (uint8_t) ((1 << kLaserBitsPerPixel) - 1);
+// Scan buffer bytes per canvas byte
+static const uint8_t kScanBytesPerCanvasByte = 8 / kPixelsPerScanByte;
+
+// Scan buffer bytes m_begin to m_end - 1 of a scan-line.
+struct ScanSpan
+{
+	uint8_t m_begin;
+	uint8_t m_end;
+};
+
+// The canvas bytes that a pixel's lasers come from. Laser n's byte is
+// kLaserByteOffset * n on from laser 0's, which is row (n * kNumMirrors) + scanLineIdx.
+struct LaserBytes
+{
+	uint8_t m_bytes[kNumLasers];
+};
+
+template< uint8_t kLaser > struct LaserUnroll
+{
+	static inline void Load( LaserBytes& bytes, const uint8_t* pByte )
+	{
+		LaserUnroll< kLaser - 1 >::Load( bytes, pByte );
+		bytes.m_bytes[kLaser] = pByte[kLaser * kLaserByteOffset];
+	}
+
+	// Gather bit 'bitIdx' of each laser's byte into pin order.
+	static inline uint8_t Gather( const LaserBytes& bytes, uint8_t bitIdx )
+	{
+		return LaserUnroll< kLaser - 1 >::Gather( bytes, bitIdx ) | (((bytes.m_bytes[kLaser] >> bitIdx) & 1) << kLaser);
+	}
+};
+
+template<> struct LaserUnroll< 0 >
+{
+	static inline void Load( LaserBytes& bytes, const uint8_t* pByte ) { bytes.m_bytes[0] = *pByte; }
+	static inline uint8_t Gather( const LaserBytes& bytes, uint8_t bitIdx ) { return (bytes.m_bytes[0] >> bitIdx) & 1; }
+};
+
+inline void LoadLaserBytes( LaserBytes& bytes, const uint8_t* pByte ) { LaserUnroll< kNumLasers - 1 >::Load( bytes, pByte ); }
+inline uint8_t GatherLasers( const LaserBytes& bytes, uint8_t bitIdx ) { return LaserUnroll< kNumLasers - 1 >::Gather( bytes, bitIdx ); }
+
+// Pixels kPixel to kEnd - 1 of a byte.
+template< uint8_t kPixel, uint8_t kEnd > struct PixelUnroll
+{
+	// Scan out canvas bits, least significant (rightmost) pixel first.
+	template< typename Output > static inline void ScanCanvas( const LaserBytes& bytes )
+	{
+		Output::Pixel( GatherLasers( bytes, kPixel ) );
+		if( kPixel + 1 < kEnd )
+		{
+			Output::InterBitDelay();
+		}
+		else
+		{
+			Output::InterByteDelay();
+		}
+		PixelUnroll< kPixel + 1, kEnd >::template ScanCanvas< Output >( bytes );
+	}
+
+	// Scan out a byte of the transposed scan buffer.
+	template< typename Output > static inline void ScanPacked( uint8_t pixels )
+	{
+		Output::Pixel( pixels & kLaserBitsMask );
+		if( kPixel + 1 < kEnd )
+		{
+			Output::InterBitDelay();
+		}
+		else
+		{
+			Output::InterByteDelay();
+		}
+		PixelUnroll< kPixel + 1, kEnd >::template ScanPacked< Output >( pixels >> kLaserBitsPerPixel );
+	}
+
+	// Pack canvas bits firstBit + kPixel onwards into scan buffer order.
+	static inline uint8_t Pack( const LaserBytes& bytes, uint8_t firstBit )
+	{
+		return (GatherLasers( bytes, firstBit + kPixel ) << (kPixel * kLaserBitsPerPixel)) | PixelUnroll< kPixel + 1, kEnd >::Pack( bytes, firstBit );
+	}
+};
+
+template< uint8_t kEnd > struct PixelUnroll< kEnd, kEnd >
+{
+	template< typename Output > static inline void ScanCanvas( const LaserBytes& ) {}
+	template< typename Output > static inline void ScanPacked( uint8_t ) {}
+	static inline uint8_t Pack( const LaserBytes&, uint8_t ) { return 0; }
+};
+
+// Scan out the 8 pixels of a canvas byte for every laser.
+template< typename Output > inline void ScanCanvasByte( const uint8_t* pByte )
+{
+	LaserBytes bytes;
+	LoadLaserBytes( bytes, pByte );
+	PixelUnroll< 0, 8 >::ScanCanvas< Output >( bytes );
+}
+
+// Scan out the kPixelsPerScanByte pixels of a transposed scan buffer byte.
+template< typename Output > inline void ScanPackedByte( uint8_t pixels )
+{
+	PixelUnroll< 0, kPixelsPerScanByte >::ScanPacked< Output >( pixels );
+}
+
+// Pack kPixelsPerScanByte pixels from bit 'firstBit' of each laser's canvas
+// byte into a transposed scan buffer byte.
+inline uint8_t PackScanByte( const LaserBytes& bytes, uint8_t firstBit )
+{
+	return PixelUnroll< 0, kPixelsPerScanByte >::Pack( bytes, firstBit );
+}
+
+#endif
@@ -1,65 +1,190 @@
 #include "ScanningLaserProjector.h"
+#include "Config.h"
+#include "Buttons.h"
+#include "DelayModel.h"
+#include "DrumSpeed.h"
+#include "DrumSync.h"
+#include "FTheta.h"
 #include "Fonts.h"
+#include "Geometry.h"
+#include "GlyphCache.h"
+#include "Gray.h"
+#include "Log.h"
+#include "Marquee.h"
+#include "PixelClock.h"
+#include "Quality.h"
+#include "Reciprocal.h"
+#include "ScanBuffer.h"
+#include "ScanKernel.h"
+#include "Scheduler.h"
+#include "Snapshot.h"
+#include "Store.h"
+#include "Trace.h"
+#include "Upload.h"
 #include <EEPROM.h>
 
-static InputState previousInputState;
-
-// Matrix dimensions and derived values
-static const uint8_t  kWidth = 128;
-static const uint8_t  kNumLasers = 4; // Don't change without changing all the code.
-static const uint8_t  kNumMirrors = 16; // The number of mirrors in the drum.
-static const uint8_t  kHeight = kNumMirrors * kNumLasers;
-static const uint8_t  kWidthBytes = 128 >> 3;
-static const uint16_t kLaserByteOffset = kNumMirrors * kWidthBytes;
 static const Ticks kDrift = 4;
 
 // Mirror drum
-static Ticks previousDrumSyncTime = 0;
-volatile static Ticks actualSyncTime = 0;
-volatile static uint8_t drumSyncTimePosted = 0;
-static Ticks previousDrumRevolutionDurationTicks = 0;
-static uint8_t revsPerSecond = 0;
+static DrumSync drumSync;
+#if SLP_DRUM_SPEED_CONTROL
+static DrumSpeed drumSpeed;
+static bool drumDutySaved = false;
+#endif
 static uint16_t firstMirrorOffset = 1936; // Fraction of drum revolution * 4096
 
-static uint8_t mirrorToRaster[] = {0, 14, 7, 12, 2, 9, 5, 11, 1, 15, 6, 13, 3, 8, 4, 10 };
+static const uint8_t* const mirrorToRaster = MirrorRasterOrder::kMirrorToRaster;
+
+#if SLP_ADAPTIVE_QUALITY
+static QualityGovernor quality;
+static uint8_t revolutionCount = 0;
+#endif
 
 uint8_t currentMirrorIdx = 0;
-uint8_t pwmCompare = 105;
 
+// Calibration from before the record store was a version at the start of the
+// EEPROM, then the offsets. It's read once if the store has none.
 #define CURRENT_HORIZONTAL_RASTER_VERSION 0x0102
-static uint16_t rasterHorizontalOffsetVersion;
 static uint16_t rasterHorizontalOffsets[kNumMirrors] = {0};
 
-GFXcanvas1 gfx( kWidth, kHeight );
+DirtyCanvas gfx;
 //GFXcanvas1 gfx2( kWidth, kHeight );
 
-static void readEepromData( void* pDst, int eepromAddress, uint16_t numBytes )
+#if SLP_TRANSPOSED_SCAN_BUFFER
+static ScanBuffer scanBuffer;
+static TaskId rebuildScanBufferTaskId = kInvalidTaskId;
+
+// Background task to bring the scan buffer up to date with the canvas,
+// a line at a time.
+static bool rebuildScanBufferTask()
 {
-	uint8_t* pByte = (uint8_t*) pDst;
-	for( uint16_t i = 0; i < numBytes; ++i )
+	// If there are no spare lines to stage into, sleep until the next swap.
+	return scanBuffer.RebuildNextDirtyLine( gfx ) && scanBuffer.IsDirty();
+}
+#endif
+
+#if SLP_MARQUEE
+static const char kMarqueeText[] = "Hello World   ";
+static GlyphCache marqueeGlyphs;
+static Marquee marquee;
+static TaskId renderMarqueeTaskId = kInvalidTaskId;
+
+// How much earlier than the calibrated time to start scanning, for the
+// pixels of the marquee's first byte that are before its window.
+static Ticks marqueeLeadTicks = 0;
+
+// Background task to render the column that the marquee scrolls onto next.
+static bool renderMarqueeTask()
+{
+	marquee.RenderNextColumn();
+	return false;
+}
+#endif
+
+// Background task to act on button presses, one a call. A press only queues
+// a log record, and saving the calibration at the end of a pass is left to
+// the store's own task.
+static bool buttonTask();
+static const uint16_t kButtonTaskTicks = 200;
+
+// Time the delay loops at startup (see DelayModel.h).
+static void calibrateDelays();
+
+#if !SLP_TIMER_PIXEL_CLOCK
+// Background task to check the delay model against the scan-lines drawn,
+// once a revolution boundary has set them aside, and save any correction.
+static bool checkDelaysTask();
+// StorePut and the LOG take about 150 cycles, and an interrupt can land in
+// a call this long.
+static const Ticks kCheckDelaysTaskTicks = DelayModel::kCheckScansTicks + 40;
+static TaskId checkDelaysTaskId = kInvalidTaskId;
+#endif
+
+#if SLP_F_THETA
+// Background task to build the f-theta table for a new pixel period, a slice
+// at a time, for a revolution boundary to switch to (see FTheta.h).
+static bool buildFThetaTask();
+static TaskId buildFThetaTaskId = kInvalidTaskId;
+#endif
+
+// Time to leave between the end of background work and the start of a
+// scan-line, to cover the scheduler's own overhead.
+static const Ticks kSchedulerMarginTicks = 20;
+
+// How long to spend on background work per Update when not synchronised.
+static const Ticks kUnsynchronisedWorkTicks = 2000;
+
+const Ticks kCanvasChangedTicks = 10 + DirtyCanvas::kClearDirtyTicks
+#if SLP_TRANSPOSED_SCAN_BUFFER
+	+ ScanBuffer::kMarkDirtyTicks
+#endif
+	;
+
+void CanvasChanged()
+{
+	if( !gfx.IsDirty() )
 	{
-		pByte[i] = EEPROM.read( eepromAddress + i );
+		return;
 	}
+#if SLP_TRANSPOSED_SCAN_BUFFER
+	scanBuffer.MarkDirty( gfx );
+	scheduler.Wake( rebuildScanBufferTaskId );
+#endif
+	SnapshotCanvasChanged( gfx.GetDirtyScanLines() );
+	gfx.ClearDirty();
+}
+
+bool IsCanvasBusy()
+{
+#if SLP_TRANSPOSED_SCAN_BUFFER
+	return scanBuffer.IsDirty();
+#else
+	return false;
+#endif
+}
+
+bool IsPresentPending()
+{
+#if SLP_TRANSPOSED_SCAN_BUFFER
+	return scanBuffer.IsPresentPending();
+#else
+	return false;
+#endif
 }
 
-static void writeEepromData( const void* pSrc, int eepromAddress, uint16_t numBytes )
+static void readEepromData( void* pDst, int eepromAddress, uint16_t numBytes )
 {
-	const uint8_t* pByte = (uint8_t*) pSrc;
+	uint8_t* pByte = (uint8_t*) pDst;
 	for( uint16_t i = 0; i < numBytes; ++i )
 	{
-		EEPROM.update( eepromAddress + i, pByte[i] );
+		pByte[i] = EEPROM.read( eepromAddress + i );
 	}
 }
 
 void Startup()
 {
-	memset( &previousInputState, 0, sizeof( previousInputState ) );
+#if SLP_TRANSPOSED_SCAN_BUFFER
+	rebuildScanBufferTaskId = scheduler.AddTask( rebuildScanBufferTask, ScanBuffer::kRebuildLineTicks );
+#endif
 
 	// Draw some initial data into the bitmap
 	gfx.setFont( &FreeMono9pt7b );
 	gfx.setCursor( 3, 12 );
 	gfx.drawRect( 0, 0, kWidth, kNumMirrors, 1 );
 	gfx.print( "Hello World" );
+#if SLP_MARQUEE
+	marqueeGlyphs.Load( &FreeMono9pt7b, kMarqueeText );
+	marquee.SetText( &marqueeGlyphs, kMarqueeText, 12 );
+	renderMarqueeTaskId = scheduler.AddTask( renderMarqueeTask, Marquee::kRenderColumnTicks, true );
+#endif
+#if SLP_GRAY_BITS
+	// A ramp through every level
+	for( int16_t x = 0; x < kGrayWidth; ++x )
+	{
+		grayGfx.drawFastVLine( x, 0, kGrayHeight, (x * (kGrayMaxLevel + 1)) / kGrayWidth );
+	}
+#endif
+	CanvasChanged();
 	//gfx.fillRect( 0, 0, 128, 16, 1 );
 	//gfx.fillRect( 64-4, 0, 8, 16, 1 );
 	// gfx.fillRect( 64, 0, 16, 16, 1 );
@@ -67,41 +192,93 @@ void Startup()
 	//gfx.fillRect( 0, 0, 32, 16, 1 );
 	//gfx.fillRect( 96, 0, 32, 1, 1 );
 
-	DisableAllTimerInterrupts();
-	ConfigureTimer1ForClock();
-	ConfigureTimer2ForPWM(pwmCompare);
-
-	// Read horizontal offsets from EEPROM
-	readEepromData( &rasterHorizontalOffsetVersion, 0, 2 );
-	if( rasterHorizontalOffsetVersion == CURRENT_HORIZONTAL_RASTER_VERSION )
+	// Load the settings
+	StoreLoad();
+	if( StoreGet( kStoreRasterOffsets, rasterHorizontalOffsets ) )
 	{
-		Serial.println( "Reading rasterHorizontalOffsets" );
-		readEepromData( &rasterHorizontalOffsets, 2, sizeof(rasterHorizontalOffsets) );
+		LOG( kLogReadingOffsets );
 	}
 	else
 	{
-		for( uint8_t i = 0; i < kNumMirrors; ++i )
+		uint16_t version;
+		readEepromData( &version, 0, 2 );
+		if( version == CURRENT_HORIZONTAL_RASTER_VERSION )
 		{
-			rasterHorizontalOffsets[i] = 32;
+			LOG( kLogReadingOffsets );
+			readEepromData( &rasterHorizontalOffsets, 2, sizeof(rasterHorizontalOffsets) );
+			StorePut( kStoreRasterOffsets, rasterHorizontalOffsets );
+		}
+		else
+		{
+			for( uint8_t i = 0; i < kNumMirrors; ++i )
+			{
+				rasterHorizontalOffsets[i] = 32;
+			}
 		}
 	}
-	rasterHorizontalOffsetVersion = CURRENT_HORIZONTAL_RASTER_VERSION;
+	StoreGet( kStoreFirstMirrorOffset, &firstMirrorOffset );
+
+	DisableAllTimerInterrupts();
+	ConfigureTimer1ForClock();
+#if SLP_DRUM_SPEED_CONTROL
+	uint8_t drumDuty = SLP_DRUM_PWM;
+	StoreGet( kStoreDrumDuty, &drumDuty );
+	drumSpeed.Start( GetClockMain(), drumDuty );
+#else
+	ConfigureTimer2ForPWM( SLP_DRUM_PWM );
+	TraceEvent( kTracePwm, SLP_DRUM_PWM, GetClockMain() );
+#endif
+	// While the drum spins up
+	calibrateDelays();
+#if !SLP_TIMER_PIXEL_CLOCK
+	checkDelaysTaskId = scheduler.AddTask( checkDelaysTask, kCheckDelaysTaskTicks );
+#endif
+#if SLP_F_THETA
+	buildFThetaTaskId = scheduler.AddTask( buildFThetaTask, FThetaTable::kBuildSliceTicks );
+#endif
+	TraceStart();
+	LogStart();
+	ButtonsStart( scheduler.AddTask( buttonTask, kButtonTaskTicks ) );
+	UploadStart();
+	SnapshotStart();
+	StoreStart();
+	GrayStart();
+	if( scheduler.GetNumTasks() != Scheduler::kMaxTasks )
+	{
+		Serial.println( F( "Scheduler::kMaxTasks doesn't match the tasks added." ) );
+	}
 }
 
-static const uint8_t kNumFramesToEstablishSync = 8;
+// DrumSync already insists on consistent edges before it reports a lock, so
+// one revolution is enough here.
+static const uint8_t kNumFramesToEstablishSync = 1;
 static const uint8_t kNumFramesToEstablishLostSync = 4;
 static uint8_t numFramesInSync = 0;
 static uint8_t numFramesNotInSync = 0;
 
+static void loseSync()
+{
+	if( numFramesInSync == kNumFramesToEstablishSync )
+	{
+		TraceEvent( kTraceSyncState, 0, GetClockMain() );
+	}
+	numFramesInSync = 0;
+}
+
 static void setIsSynchronised()
 {
 	if( numFramesInSync < kNumFramesToEstablishSync)
 	{
-		++numFramesInSync;
+		if( ++numFramesInSync == kNumFramesToEstablishSync )
+		{
+			TraceEvent( kTraceSyncState, 1, GetClockMain() );
+		}
 	}
 	numFramesNotInSync = 0;
 }
 
+// Without adaptive quality a late scan-line counts against sync.
+#if !SLP_ADAPTIVE_QUALITY
 static void setIsNotSynchronised()
 {
 	if( numFramesInSync == kNumFramesToEstablishSync)
@@ -112,7 +289,7 @@ static void setIsNotSynchronised()
 		}
 		if( numFramesNotInSync == kNumFramesToEstablishLostSync)
 		{
-			numFramesInSync = 0;
+			loseSync();
 		}
 	}
 	else
@@ -120,6 +297,7 @@ static void setIsNotSynchronised()
 		numFramesInSync = 0;
 	}
 }
+#endif
 
 static bool getIsSynchronised()
 {
@@ -130,33 +308,34 @@ static void turnLedOn()
 {
 	digitalWrite( LED_PIN, HIGH );
 }
-static void turnLedOff()
-{
-	digitalWrite( LED_PIN, LOW );
-}
 
 static void turnLaserOn()
 {
 	digitalWrite( LASER_PIN, HIGH );
 }
-static void turnLaserOff()
+
+// Gathering a pixel's bits from the canvas bytes, which matched the scan-line
+// times measured by hand at 128 pixels with 4 lasers.
+static const uint16_t kGatherPixelCycles = 96 + (16 * kNumLasers);
+
+// Write a pixel gathered from the canvas bytes.
+inline void writePixel( uint8_t pins )
 {
-	digitalWrite( LASER_PIN, LOW );
+	HalCycles( kGatherPixelCycles );
+	HalWriteLasers( pins );
+	//digitalWrite( LASER_PIN, (byte >> bitIdx) & 1 );
 }
 
-inline void writePixel( uint8_t byte0, uint8_t byte1, uint8_t byte2, uint8_t byte3, uint8_t bitIdx )
+// Write laser bits that are already in pin order.
+inline void writeLasers( uint8_t pins )
 {
-	uint8_t pins;
-	pins  = (byte0 >> bitIdx) & 1;
-	pins |= ((byte1 >> bitIdx) & 1) << 1;
-	pins |= ((byte2 >> bitIdx) & 1) << 2;
-	pins |= ((byte3 >> bitIdx) & 1) << 3;
-	PORTB = (PORTB & 0xf0) | pins;
-	//digitalWrite( LASER_PIN, (byte >> bitIdx) & 1 );
+	HalCycles( 8 );
+	HalWriteLasers( pins );
 }
 
 inline void shortDelay( uint16_t count )
 {
+	HalCycles( 12 + (uint32_t) count * 9 );
 	for( uint16_t i = 0; i < count; ++i )
 	{
 		__asm__("nop\n\t" "nop\n\t");
@@ -165,199 +344,514 @@ inline void shortDelay( uint16_t count )
 
 uint16_t interByteDelayCount = 15;
 
-// Empirically determined difference between inter-byte and inter-bit delay counts
-// to make the time between the last bit of one byte and the first bit of the next
-// byte equal.
-static const uint16_t kInterByteDelayCountDifference = 5;
-
-static const uint16_t kMinInterByteDelayCount = 0;
-static const uint16_t kMaxInterByteDelayCountLog2 = 8;
-static const uint16_t kMaxInterByteDelayCount = 1 << kMaxInterByteDelayCountLog2;
+// Added to the count between pixels within a byte, so the time between the
+// last pixel of one byte and the first of the next, which takes in loading
+// the byte, comes out the same.
+static uint16_t interBitDelayExtra = 0;
 
-// Empirically measured in microseconds using measureDelayCounts()
-static const uint16_t kMinDelayCountHScanDuration = 1690;
-static const uint16_t kMaxDelayCountHScanDuration = 20257;
+// Fitted to timings of the delay loops at startup. Not static, as
+// Host/Benchmarks.cpp times conversions against it.
+DelayModel delayModel;
 
 MicroSeconds hScanInterval = 3000;
 MicroSeconds hScanDuration = 2000;
 
-static bool enableHScanTiming = true;
+#if SLP_TIMER_PIXEL_CLOCK
+static PixelPeriod pixelClockPeriod = kMinPixelPeriod;
+#if SLP_F_THETA
+static FThetaTable fTheta;
+static const uint16_t* pPixelClockOffsets = nullptr;
+
+static bool buildFThetaTask()
+{
+	return fTheta.BuildSlice();
+}
+#else
+static const uint16_t* const pPixelClockOffsets = nullptr;
+#endif
+static bool scanLineInProgress = false;
+#if !SLP_SPARSE_SCAN
+static const ScanSpan kWholeScanLine = { 0, kScanLineBytes };
+#endif
+#endif
+
 static Ticks nextScanTime = 0;
 static Ticks nextScanTimeAdjusted = 0;
 static Ticks nextRevolutionStartTime = 0;
 
-void calcHorizontalScanDelays()
+// When the next pixels are due to be scanned out. That's the start of the
+// current scan-line, or with SLP_SPARSE_SCAN, of its next span.
+static Ticks nextSpanTime = 0;
+
+#if SLP_SPARSE_SCAN || SLP_MARQUEE
+// Time to scan out a byte of the scan buffer, in 1/256ths of a tick. With
+// the pixel clock, it's the time in the ISR that a skipped byte saves.
+#if SLP_TIMER_PIXEL_CLOCK
+static const uint32_t scanBytePeriod = ((uint32_t) kPixelsPerScanByte * kPixelClockPixelCycles) << 5;
+#else
+static uint32_t scanBytePeriod = 0;
+#endif
+#endif
+
+#if SLP_SPARSE_SCAN
+#if !SLP_TIMER_PIXEL_CLOCK
+static uint8_t currentSpanIdx = 0;
+static uint8_t numScannedBytes = 0; // Of the current scan-line
+#endif
+
+// A gap between spans shorter than this is scanned straight through, as
+// there'd be no time to do anything else in it.
+static const Ticks kMinSpanGapTicks = 200;
+
+// Statistics
+static uint32_t sparseNumScanLines = 0;
+static uint32_t sparseNumBlankScanLines = 0;
+static uint32_t sparseNumSkippedBytes = 0;
+static uint32_t sparseReclaimedTicks = 0;
+#endif
+
+// Microseconds per revolution, up to 2^19, to per mirror.
+static const uint8_t kMirrorReciprocalShift = 16;
+static const uint32_t kMirrorReciprocal = RECIPROCAL( kNumMirrors, 0, kMirrorReciprocalShift );
+
+// The time between scan-lines for a drum revolution period.
+MicroSeconds scanIntervalForPeriod( Ticks period )
 {
-	// Calculate inter-byte delay count values for a desired scan duration
-	if( hScanDuration <= kMinDelayCountHScanDuration )
+	return (MicroSeconds) divideByReciprocal( TicksToMicroSeconds( period ), 0, kNumMirrors, kMirrorReciprocal, kMirrorReciprocalShift );
+}
+
+#if SLP_TIMER_PIXEL_CLOCK
+// Scan-line ticks to 1/256ths of a tick per pixel. The period saturates
+// from kMaxPixelPeriodTicks, and below that the multiply fits in 32 bits.
+static const uint32_t kMaxPixelPeriodTicks = (uint32_t) kWidth << 8;
+static const uint8_t kPixelPeriodReciprocalShift = 16;
+static const uint32_t kPixelPeriodReciprocal = RECIPROCAL( kWidth, 8, kPixelPeriodReciprocalShift );
+
+// Pixel clock period for a scan-line lasting 'duration'.
+PixelPeriod pixelPeriodForDuration( MicroSeconds duration )
+{
+	uint32_t ticks = (uint32_t) MicroSecondsToTicks( duration );
+	if( ticks >= kMaxPixelPeriodTicks )
 	{
-		interByteDelayCount = kMinInterByteDelayCount;
+		return 0xffff;
 	}
-	else if( hScanDuration >= kMaxDelayCountHScanDuration )
+	uint32_t period = divideByReciprocal( ticks, 8, kWidth, kPixelPeriodReciprocal, kPixelPeriodReciprocalShift );
+	return (period < kMinPixelPeriod) ? kMinPixelPeriod : (PixelPeriod) period;
+}
+#endif
+
+void calcHorizontalScanDelays()
+{
+	// Calculate inter-byte delay count values for a desired scan duration
+	interByteDelayCount = delayModel.CountForScan( hScanDuration );
+	delayModel.SetScanCount( interByteDelayCount );
+#if SLP_TIMER_PIXEL_CLOCK
+	pixelClockPeriod = pixelPeriodForDuration( hScanDuration );
+#if SLP_F_THETA
+#if SLP_ADAPTIVE_QUALITY
+	bool isShortScan = quality.IsShortScan();
+#else
+	bool isShortScan = false;
+#endif
+	// The table for this period is built in the background. Until it's done,
+	// use the last one if it's close enough, and otherwise time the pixels
+	// evenly.
+	fTheta.Flip();
+	if( fTheta.Request( pixelClockPeriod, isShortScan ) )
 	{
-		interByteDelayCount = kMaxInterByteDelayCount;
+		scheduler.Wake( buildFThetaTaskId );
 	}
-	else
+	pPixelClockOffsets = fTheta.GetOffsets( pixelClockPeriod, isShortScan );
+	if( pPixelClockOffsets )
 	{
-		interByteDelayCount = (uint16_t) ((unsigned long) ((hScanDuration - kMinDelayCountHScanDuration) << kMaxInterByteDelayCountLog2) / (kMaxDelayCountHScanDuration - kMinDelayCountHScanDuration));
+		pixelClockPeriod = fTheta.GetPeriod();
 	}
+#endif
+#elif SLP_SPARSE_SCAN || SLP_MARQUEE
+	scanBytePeriod = kPixelsPerScanByte * delayModel.GetPixelPeriod();
+#endif
 }
 
-inline void interBitDelay() { shortDelay( interByteDelayCount + kInterByteDelayCountDifference ); }
+inline void interBitDelay() { shortDelay( interByteDelayCount + interBitDelayExtra ); }
 inline void interByteDelay() { shortDelay( interByteDelayCount ); }
 
+// Outputs for the scan kernels (see ScanKernel.h)
+struct CanvasScanOutput
+{
+	static inline void Pixel( uint8_t pins ) { writePixel( pins ); }
+	static inline void InterBitDelay()       { interBitDelay(); }
+	static inline void InterByteDelay()      { interByteDelay(); }
+};
+
+struct PackedScanOutput
+{
+	static inline void Pixel( uint8_t pins ) { writeLasers( pins ); }
+	static inline void InterBitDelay()       { interBitDelay(); }
+	static inline void InterByteDelay()      { interByteDelay(); }
+};
+
+// The same, in the same time, with the lasers left off. For measureDelays().
+struct DarkCanvasOutput : CanvasScanOutput
+{
+	static inline void Pixel( uint8_t pins ) { HalCycles( kGatherPixelCycles ); HalWriteLasersDark( pins ); }
+};
+
+struct DarkPackedOutput : PackedScanOutput
+{
+	static inline void Pixel( uint8_t pins ) { HalCycles( 8 ); HalWriteLasersDark( pins ); }
+};
+
+#if !SLP_SPARSE_SCAN && !SLP_TIMER_PIXEL_CLOCK
+// A whole scan-line further than this from hScanDuration is logged, at
+// debug level.
+static const MicroSeconds kScanDurationLogUs = 200;
+
 // Do a single horizontal scan.
 static void horizontalScan( uint8_t scanLineIdx )
 {
-	//MicroSeconds startTime = micros();
+	Ticks startTime = GetClockMain();
+	uint16_t numPixels = kWidth;
+	HalProfileBegin( kProfileZoneHorizontalScan );
+#if SLP_MARQUEE
+	// A byte more than the display when the window starts part way into a
+	// byte, with the pixels outside it blanked (see Marquee.h).
+	const uint8_t* pLine = marquee.GetLine( scanLineIdx );
+	const uint8_t* pLineEnd = pLine + kMarqueeLineBytes;
+	const uint8_t* pPixels = pLine + marquee.GetFirstByte();
+	uint8_t phaseMask = marquee.GetPhaseMask();
+	HalScanLineBegin( scanLineIdx, -(int16_t) marquee.GetPhase() );
+	ScanPackedByte< PackedScanOutput >( *pPixels & ~phaseMask );
+	for( uint8_t x = 1; x < kScanLineBytes; ++x )
+	{
+		if( ++pPixels == pLineEnd )
+		{
+			pPixels = pLine;
+		}
+		ScanPackedByte< PackedScanOutput >( *pPixels );
+	}
+	if( phaseMask )
+	{
+		if( ++pPixels == pLineEnd )
+		{
+			pPixels = pLine;
+		}
+		ScanPackedByte< PackedScanOutput >( *pPixels & phaseMask );
+		numPixels += kPixelsPerScanByte;
+	}
+	writeLasers( 0 );
+#elif SLP_TRANSPOSED_SCAN_BUFFER
+	HalScanLineBegin( scanLineIdx, 0 );
+	const uint8_t* pPixels = scanBuffer.GetLine( scanLineIdx );
+	for( uint8_t x = 0; x < kScanLineBytes; ++x )
+	{
+		ScanPackedByte< PackedScanOutput >( *pPixels++ );
+	}
+	writeLasers( 0 );
+#else
+	HalScanLineBegin( scanLineIdx, 0 );
 	uint8_t* pByte = gfx.getBuffer() + ((scanLineIdx+1) * kWidthBytes);
 	for( int8_t x = kWidthBytes-1; x >= 0; --x )
 	{
 		--pByte;
-		uint8_t byte0 = *pByte;
-		uint8_t byte1 = *(pByte + kLaserByteOffset);
-		uint8_t byte2 = *(pByte + (kLaserByteOffset*2));
-		uint8_t byte3 = *(pByte + (kLaserByteOffset*3));
-		writePixel( byte0, byte1, byte2, byte3, 0 );
-		interBitDelay();
-		writePixel( byte0, byte1, byte2, byte3, 1 );
-		interBitDelay();
-		writePixel( byte0, byte1, byte2, byte3, 2 );
-		interBitDelay();
-		writePixel( byte0, byte1, byte2, byte3, 3 );
-		interBitDelay();
-		writePixel( byte0, byte1, byte2, byte3, 4 );
-		interBitDelay();
-		writePixel( byte0, byte1, byte2, byte3, 5 );
-		interBitDelay();
-		writePixel( byte0, byte1, byte2, byte3, 6 );
-		interBitDelay();
-		writePixel( byte0, byte1, byte2, byte3, 7 );
-		interByteDelay();
-	}
-	writePixel( 0,0,0,0, 0 );
-#if 0
-	MicroSeconds duration = micros() - startTime;
+		ScanCanvasByte< CanvasScanOutput >( pByte );
+	}
+	writePixel( 0 );
+#endif
+	HalScanLineEnd();
+	HalProfileEnd( kProfileZoneHorizontalScan );
+	Ticks ticks = GetClockMain() - startTime;
+	delayModel.NoteScan( numPixels, ticks );
+	MicroSeconds duration = TicksToMicroSeconds( ticks );
 	MicroSeconds durationError = duration - hScanDuration;
-	if( enableHScanTiming && (abs(durationError) > 200) )
+	if( (durationError > kScanDurationLogUs) || (durationError < -kScanDurationLogUs) )
 	{
-		Serial.print( "H: " );
-		Serial.print( duration );
-		Serial.print( ", " );
-		Serial.println( hScanDuration );
+		LOG( kLogScanDuration, duration, hScanDuration );
 	}
-#endif
 }
+#endif
 
-// Use this to establish 
-void measureDelayCounts()
+#if SLP_SPARSE_SCAN && !SLP_TIMER_PIXEL_CLOCK
+// Scan out the current span of a scan-line, and any after it that are too
+// close to leave. The blank written after it is where the first blank pixel
+// would have been.
+static void horizontalScanSpan( uint8_t scanLineIdx )
 {
-	// Measure minumum delay
-	enableHScanTiming = false;
-	interByteDelayCount = kMinInterByteDelayCount;
-	uint16_t start = micros();
-	for( uint8_t i = 0; i < kNumMirrors; ++i )
+	HalProfileBegin( kProfileZoneHorizontalScan );
+	const ScanSpan* pSpans = scanBuffer.GetSpans( scanLineIdx );
+	uint8_t numSpans = scanBuffer.GetNumSpans( scanLineIdx );
+	uint8_t begin = pSpans[currentSpanIdx].m_begin;
+	if( currentSpanIdx == 0 )
+	{
+		HalScanLineBegin( scanLineIdx, begin * kPixelsPerScanByte );
+	}
+	else
+	{
+		HalScanLineSkipTo( begin * kPixelsPerScanByte );
+	}
+	while( (currentSpanIdx + 1 < numSpans) &&
+		(((pSpans[currentSpanIdx + 1].m_begin - pSpans[currentSpanIdx].m_end) * scanBytePeriod) < ((uint32_t) kMinSpanGapTicks << 8)) )
 	{
-		horizontalScan( i );
+		HalCycles( 30 );
+		++currentSpanIdx;
 	}
-	unsigned long duration = micros() - start;
-	Serial.print( "kMinDelayCountHScanDuration = ");
-	Serial.println( duration / kNumMirrors );
-	// Measure maximum delay
-	interByteDelayCount = kMaxInterByteDelayCount;
-	start = micros();
-	for( uint8_t i = 0; i < kNumMirrors; ++i )
+	uint8_t end = pSpans[currentSpanIdx].m_end;
+	const uint8_t* pPixels = scanBuffer.GetLine( scanLineIdx ) + begin;
+	Ticks startTime = GetClockMain();
+	for( uint8_t x = begin; x < end; ++x )
 	{
-		horizontalScan( i );
+		ScanPackedByte< PackedScanOutput >( *pPixels++ );
 	}
-	duration = micros() - start;
-	Serial.print( "kMaxDelayCountHScanDuration = ");
-	Serial.println( duration / kNumMirrors );
-	// Try for a scan 3000us
-	hScanDuration = 3000;
-	calcHorizontalScanDelays();
-	start = micros();
-	for( uint8_t i = 0; i < kNumMirrors; ++i )
+	writeLasers( 0 );
+	delayModel.NoteScan( (end - begin) * kPixelsPerScanByte, GetClockMain() - startTime );
+	numScannedBytes += end - begin;
+	if( currentSpanIdx + 1 == numSpans )
 	{
-		horizontalScan( i );
+		HalScanLineEnd();
 	}
-	duration = micros() - start;
-	enableHScanTiming = true;
-	Serial.print( "calcHorizontalScanDelays(3000) = ");
-	Serial.println( duration / kNumMirrors );
-	Serial.print( "interByteDelayCount = ");
-	Serial.println( interByteDelayCount );
+	HalProfileEnd( kProfileZoneHorizontalScan );
 }
 
-void delayMicroSeconds( MicroSeconds duration )
+// Ticks from the start of a scan-line to a byte of it.
+static Ticks spanOffset( uint8_t byteIdx )
 {
-	static const MicroSeconds kLargeCountTime = 2426;
-	static const MicroSeconds kSmallCountTime = 38;
-	static const uint16_t kSmallCount = 64;
-	static const uint16_t kLargeCount = 4096 + kSmallCount;
-	long count = 64 + ((duration - kSmallCountTime) << 12) / (kLargeCountTime - kSmallCountTime);
-	shortDelay( count );
-}
-
-void measureShortDelay()
-{
-	Ticks start = GetClockMain();
-	shortDelay(64);
-	shortDelay(64);
-	shortDelay(64);
-	shortDelay(64);
-	shortDelay(64);
-	shortDelay(64);
-	shortDelay(64);
-	shortDelay(64);
-	Ticks duration = (GetClockMain() - start) >> (3 + 1);  // +1 to convert to us
-	Serial.print( "shortDelay(64) = " );
-	Serial.println( duration );
-	start = micros();
-	shortDelay(4096 + 64);
-	shortDelay(4096 + 64);
-	shortDelay(4096 + 64);
-	shortDelay(4096 + 64);
-	shortDelay(4096 + 64);
-	shortDelay(4096 + 64);
-	shortDelay(4096 + 64);
-	shortDelay(4096 + 64);
-	duration = (GetClockMain() - start) >> (3 + 1);  // +1 to convert to us
-	Serial.print( "shortDelay(4096) = " );
-	Serial.println( duration );
-	
-	// Test
-	start = micros();
-	delayMicroSeconds( 50 );
-	delayMicroSeconds( 50 );
-	delayMicroSeconds( 50 );
-	delayMicroSeconds( 50 );
-	delayMicroSeconds( 50 );
-	delayMicroSeconds( 50 );
-	delayMicroSeconds( 50 );
-	delayMicroSeconds( 50 );
-	duration = (GetClockMain() - start) >> (3 + 1);  // +1 to convert to us
-	Serial.print( "delayMicroSeconds(50) = " );
-	Serial.println( duration );
-}
-
-void dumpDisplayToTTY()
+	HalCycles( 20 ); // 8 by 32-bit multiply
+	return (Ticks) ((byteIdx * scanBytePeriod) >> 8);
+}
+#endif
+
+#if SLP_SPARSE_SCAN
+// A scan-line is done. Count the time that its blank spans gave back.
+static void noteSparseScanLine( uint8_t numBytes, bool isBlank )
 {
-	cli();
-	uint8_t* pByte = gfx.getBuffer();
-	for( uint8_t y = 0; y < kHeight; ++y )
+	HalCycles( 40 );
+	uint8_t numSkippedBytes = kScanLineBytes - numBytes;
+	++sparseNumScanLines;
+	if( isBlank )
+	{
+		++sparseNumBlankScanLines;
+	}
+	sparseNumSkippedBytes += numSkippedBytes;
+	sparseReclaimedTicks += (numSkippedBytes * scanBytePeriod) >> 8;
+}
+
+static void printSparseScanReport()
+{
+	Serial.print( F( "Sparse scan: " ) );
+	Serial.print( sparseNumBlankScanLines );
+	Serial.print( F( " of " ) );
+	Serial.print( sparseNumScanLines );
+	Serial.print( F( " scan-lines blank, " ) );
+	uint32_t numBytes = sparseNumScanLines * kScanLineBytes;
+	Serial.print( (numBytes >= 100) ? sparseNumSkippedBytes / (numBytes / 100) : 0 );
+	Serial.print( F( "% of bytes skipped, " ) );
+	uint32_t numRevolutions = sparseNumScanLines / kNumMirrors;
+	Serial.print( numRevolutions ? TicksToMicroSeconds( sparseReclaimedTicks ) / numRevolutions : 0 );
+#if SLP_TIMER_PIXEL_CLOCK
+	Serial.println( F( "us of pixel clock interrupts saved a revolution" ) );
+#else
+	Serial.println( F( "us reclaimed a revolution" ) );
+#endif
+}
+#endif
+
+// Start on the first span of the current scan-line.
+static void startScanLineSpans()
+{
+	nextSpanTime = nextScanTimeAdjusted;
+#if SLP_SPARSE_SCAN && !SLP_TIMER_PIXEL_CLOCK
+	currentSpanIdx = 0;
+	numScannedBytes = 0;
+	uint8_t scanLineIdx = mirrorToRaster[currentMirrorIdx];
+	if( scanBuffer.GetNumSpans( scanLineIdx ) )
+	{
+		nextSpanTime += spanOffset( scanBuffer.GetSpans( scanLineIdx )->m_begin );
+	}
+#endif
+}
+
+#if SLP_SPARSE_SCAN && !SLP_TIMER_PIXEL_CLOCK
+// Move on to the next span of the current scan-line. Returns false if the
+// scan-line is done.
+static bool advanceToNextSpan()
+{
+	uint8_t scanLineIdx = mirrorToRaster[currentMirrorIdx];
+	if( ++currentSpanIdx < scanBuffer.GetNumSpans( scanLineIdx ) )
 	{
-		for( uint8_t x = 0; x < kWidthBytes; ++x )
+		nextSpanTime = nextScanTimeAdjusted + spanOffset( scanBuffer.GetSpans( scanLineIdx )[currentSpanIdx].m_begin );
+		return true;
+	}
+	noteSparseScanLine( numScannedBytes, scanBuffer.GetNumSpans( scanLineIdx ) == 0 );
+	return false;
+}
+#endif
+
+// Timing the delay loops (see DelayModel.h). Each time is the shortest of a
+// few, to leave out any that an interrupt landed in.
+static const uint8_t kDelayTimingRepeats = 4;
+
+// The scan-line count that the slope of the scan-line time is measured up
+// to, and stored timings are checked at. It's about what the drum needs.
+static const uint16_t kDelayCheckCount = 32;
+
+// Bytes a scan-line in the kernel, and pixels in each.
+#if SLP_TRANSPOSED_SCAN_BUFFER
+static const uint8_t kKernelBytes = kScanLineBytes;
+static const uint8_t kKernelPixelsPerByte = kPixelsPerScanByte;
+#else
+static const uint8_t kKernelBytes = kWidthBytes;
+static const uint8_t kKernelPixelsPerByte = 8;
+#endif
+
+// Scan out a scan-line's worth of pixels with the lasers off, from bytes of
+// kPixels pixels each: the first kPixels of each byte of the line, as many
+// times over as that takes.
+template< uint8_t kPixels > static void darkScanLine()
+{
+	for( uint8_t pass = 0; pass < kKernelPixelsPerByte / kPixels; ++pass )
+	{
+#if SLP_TRANSPOSED_SCAN_BUFFER
+		const uint8_t* pPixels = scanBuffer.GetLine( 0 );
+		for( uint8_t x = 0; x < kScanLineBytes; ++x )
 		{
-			for( int a=7; a >= 0; a-- )
-			{ 
-				Serial.print( bitRead (*pByte, a) );
-			}
-			++pByte;
+			PixelUnroll< 0, kPixels >::template ScanPacked< DarkPackedOutput >( *pPixels++ );
 		}
-		Serial.println("");
+#else
+		const uint8_t* pByte = gfx.getBuffer() + kWidthBytes;
+		for( int8_t x = kWidthBytes-1; x >= 0; --x )
+		{
+			--pByte;
+			LaserBytes bytes;
+			LoadLaserBytes( bytes, pByte );
+			PixelUnroll< 0, kPixels >::template ScanCanvas< DarkCanvasOutput >( bytes );
+		}
+#endif
 	}
-	sei();
+#if SLP_TRANSPOSED_SCAN_BUFFER
+	DarkPackedOutput::Pixel( 0 );
+#else
+	DarkCanvasOutput::Pixel( 0 );
+#endif
+}
+
+template< uint8_t kPixels > static Ticks timeDarkScanLine( uint16_t count )
+{
+	interByteDelayCount = count;
+	Ticks best = 0x7fffffff;
+	for( uint8_t i = 0; i < kDelayTimingRepeats; ++i )
+	{
+		Ticks start = GetClockMain();
+		darkScanLine< kPixels >();
+		Ticks ticks = GetClockMain() - start;
+		best = (ticks < best) ? ticks : best;
+	}
+	return best;
+}
+
+static Ticks timeShortDelay( uint16_t count )
+{
+	Ticks best = 0x7fffffff;
+	for( uint8_t i = 0; i < kDelayTimingRepeats; ++i )
+	{
+		Ticks start = GetClockMain();
+		shortDelay( count );
+		Ticks ticks = GetClockMain() - start;
+		best = (ticks < best) ? ticks : best;
+	}
+	return best;
+}
+
+// How many more delay counts the pixels within a byte need than they have,
+// to take as long as the last pixel of the byte with the next byte's load.
+// A byte of half as many pixels takes as long to load, so the same pixels
+// from twice as many half bytes take longer than from whole ones by a load
+// and the difference between the delays, for each byte. 'countTicks' is how
+// long 2^kLargeDelayCountLog2 counts take.
+static int16_t measureByteImbalance( Ticks countTicks )
+{
+	if( kKernelPixelsPerByte < 2 )
+	{
+		return 0;
+	}
+	Ticks wholeTicks = timeDarkScanLine< kKernelPixelsPerByte >( 0 );
+	Ticks halfTicks = timeDarkScanLine< kKernelPixelsPerByte / 2 >( 0 );
+	int32_t imbalance = (halfTicks - wholeTicks) << DelayModel::kLargeDelayCountLog2;
+	int32_t byteCountTicks = countTicks * kKernelBytes;
+	int32_t rounding = (imbalance < 0) ? -(byteCountTicks >> 1) : (byteCountTicks >> 1);
+	return (int16_t) ((imbalance + rounding) / byteCountTicks);
+}
+
+// Time the delay loops with the lasers off, and fit the delay model to them.
+static void measureDelays( DelayCoefficients* pDelays )
+{
+	Ticks smallDelayTicks = timeShortDelay( DelayModel::kSmallDelayCount );
+	Ticks largeDelayTicks = timeShortDelay( DelayModel::kLargeDelayCount );
+	pDelays->m_smallDelayUs = (uint16_t) TicksToMicroSeconds( smallDelayTicks );
+	pDelays->m_largeDelayUs = (uint16_t) TicksToMicroSeconds( largeDelayTicks );
+
+	interBitDelayExtra = 0;
+	int16_t extra = measureByteImbalance( largeDelayTicks - smallDelayTicks );
+	interBitDelayExtra = (extra > 0) ? extra : 0;
+	pDelays->m_interBitExtra = interBitDelayExtra;
+
+	// The scan-line time is linear in the count, so two points will do
+	Ticks minTicks = timeDarkScanLine< kKernelPixelsPerByte >( 0 );
+	Ticks checkTicks = timeDarkScanLine< kKernelPixelsPerByte >( kDelayCheckCount );
+	pDelays->m_minScanUs = (uint16_t) TicksToMicroSeconds( minTicks );
+	pDelays->m_maxScanUs = (uint16_t) TicksToMicroSeconds( minTicks + ((checkTicks - minTicks) * (DelayModel::kMaxScanCount / kDelayCheckCount)) );
+}
+
+// True if stored timings still hold, as they won't after a change to the
+// build or the clock.
+static bool checkDelays( const DelayCoefficients& delays )
+{
+	Ticks countTicks = MicroSecondsToTicks( delays.m_largeDelayUs - delays.m_smallDelayUs );
+	if( countTicks <= 0 )
+	{
+		return false;
+	}
+	delayModel.Set( delays, kDelaySourceStored );
+	interBitDelayExtra = delays.m_interBitExtra;
+	if( measureByteImbalance( countTicks ) != 0 )
+	{
+		return false;
+	}
+	Ticks largeDelayTicks = timeShortDelay( DelayModel::kLargeDelayCount );
+	return delayModel.Check( kDelayCheckCount, timeDarkScanLine< kKernelPixelsPerByte >( kDelayCheckCount ), largeDelayTicks );
+}
+
+// Use the stored delay timings if they still hold, or measure them again.
+static void calibrateDelays()
+{
+	DelayCoefficients delays;
+	if( StoreGet( kStoreDelayModel, &delays ) && checkDelays( delays ) )
+	{
+		LOG( kLogDelaysStored, delays.m_minScanUs, delays.m_maxScanUs );
+	}
+	else
+	{
+		measureDelays( &delays );
+		delayModel.Set( delays, kDelaySourceMeasured );
+		StorePut( kStoreDelayModel, &delays );
+		LOG( kLogDelaysMeasured, delays.m_minScanUs, delays.m_maxScanUs, delays.m_interBitExtra );
+	}
+	interBitDelayExtra = delays.m_interBitExtra;
+}
+
+#if !SLP_TIMER_PIXEL_CLOCK
+static bool checkDelaysTask()
+{
+	if( delayModel.CheckScans() )
+	{
+		StorePut( kStoreDelayModel, &delayModel.Get() );
+		LOG( kLogDelaysCorrected, delayModel.GetLastError() );
+	}
+	return false;
+}
+#endif
+
+void delayMicroSeconds( MicroSeconds duration )
+{
+	shortDelay( delayModel.CountForDelay( duration ) );
 }
 
 static uint8_t fillScanIdx = kNumMirrors-1;
@@ -369,146 +863,236 @@ void fillNextScan()
 		fillScanIdx = 0;
 	}
 	gfx.fillRect( 0, fillScanIdx, kWidth, 1, 1 );
-	Serial.println( fillScanIdx );
+	CanvasChanged();
+	LOG( kLogFillScan, fillScanIdx );
 }
 
 static uint8_t calibrationScanIdx = 0;
 
-#define PUSH_BUTTON( field ) input.field = inputState.field && !previousInputState.field
-void checkButtons()
+static void handleButton( uint8_t button )
 {
-	// Read the buttons
-	InputState inputState;
-	inputState.m_redButton = (digitalRead( RED_BUTTON_PIN ) == LOW);
-	inputState.m_blueButton = (digitalRead( BLUE_BUTTON_PIN ) == LOW);
-	inputState.m_whiteButton = (digitalRead( WHITE_BUTTON_PIN ) == LOW);
-
-	// Modify the push-button inputs so they only appear as set the first frame
-	// they're pressed
-	InputState input = inputState;
-	PUSH_BUTTON( m_redButton );
-	PUSH_BUTTON( m_blueButton );
-	PUSH_BUTTON( m_whiteButton );
-	previousInputState = inputState;
-
 #if 1
-	if( input.m_redButton )
+	if( button == kButtonRed )
 	{
 		rasterHorizontalOffsets[calibrationScanIdx]+=4;
 	}
-	if( input.m_blueButton )
+	if( button == kButtonBlue )
 	{
 		rasterHorizontalOffsets[calibrationScanIdx]-=4;
 	}
-	if( input.m_whiteButton )
+	if( button == kButtonWhite )
 	{
 		if( ++calibrationScanIdx == kNumMirrors )
 		{
 			calibrationScanIdx = 0;
-			writeEepromData( &rasterHorizontalOffsetVersion, 0, 2 );
-			writeEepromData( &rasterHorizontalOffsets, 2, sizeof(rasterHorizontalOffsets) );
+			StorePut( kStoreRasterOffsets, rasterHorizontalOffsets );
 		}
-		Serial.print( "Scan: " );
-		Serial.println( calibrationScanIdx );
+		LOG( kLogCalibrationScan, calibrationScanIdx );
 	}
 #else
 	// Button tests
-	if( input.m_redButton )
+	if( button == kButtonRed )
 	{
 		//turnLaserOn();
-		// pwmCompare += 1;
-		// Serial.println( pwmCompare );
-		// OCR2B = pwmCompare;
+		// OCR2B += 1;
+		// Serial.println( OCR2B );
 		
 		firstMirrorOffset += 5;
-		Serial.println( firstMirrorOffset );
+		StorePut( kStoreFirstMirrorOffset, &firstMirrorOffset );
+		LOG( kLogFirstMirrorOffset, firstMirrorOffset );
 	}
-	if( input.m_blueButton )
+	if( button == kButtonBlue )
 	{
-		// pwmCompare -= 1;
-		// Serial.println( pwmCompare );
-		// OCR2B = pwmCompare;
+		// OCR2B -= 1;
+		// Serial.println( OCR2B );
 		firstMirrorOffset -= 5;
-		Serial.println( firstMirrorOffset );
+		StorePut( kStoreFirstMirrorOffset, &firstMirrorOffset );
+		LOG( kLogFirstMirrorOffset, firstMirrorOffset );
 	}
-	if( input.m_whiteButton )
+	if( button == kButtonWhite )
 	{
-		//measureShortDelay();
 		turnLaserOn();
 		fillNextScan();
-		//dumpDisplayToTTY();
-		//measureDelayCounts();
+		//SnapshotRequest();
 	}
 #endif
 }
 
-void doSomeWork()
+static bool buttonTask()
 {
-	// Do some reading of the serial port, and updating of the bitmap etc.
-	//fillNextScan();
+	ButtonEvent event;
+	if( !ButtonsPop( &event ) )
+	{
+		return false;
+	}
+	// The value is how long the press waited for a gap in the scan.
+	TraceEvent( kTraceButton, event.m_button, event.m_time, GetClockMain() - event.m_time );
+	handleButton( event.m_button );
+	return true;
 }
 
 void calcNextRevolutionSettings( bool expectData )
 {
-	if( drumSyncTimePosted )
+	HalProfileBegin( kProfileZoneRevolutionSettings );
+#if SLP_TRANSPOSED_SCAN_BUFFER
+	// All the scan-lines for this revolution are done, so this is the one
+	// place that staged changes can be made visible without tearing.
+	scanBuffer.Swap();
+	if( scanBuffer.IsDirty() )
 	{
-		cli();
-		if( drumSyncTimePosted > 1 )
-		{
-			//Serial.println( drumSyncTimePosted );
-			// Correct for syncing up to a multiple of the actual frequency
-			previousDrumSyncTime -= (actualSyncTime - previousDrumSyncTime) * (drumSyncTimePosted - 1);
-		}
-		drumSyncTimePosted = 0;
-		Ticks drumRevolutionDurationTicks = actualSyncTime - previousDrumSyncTime;
-		previousDrumSyncTime = actualSyncTime;
-		if( abs( drumRevolutionDurationTicks - previousDrumRevolutionDurationTicks ) < 1000 )
-		{
-			setIsSynchronised();
-		}
-		else
+		scheduler.Wake( rebuildScanBufferTaskId );
+	}
+#endif
+	// At the end of a revolution the sync edge is always due, so the estimate
+	// moves on even if the edge itself went missing.
+	bool estimateChanged = drumSync.Update( GetClockMain() );
+#if SLP_DRUM_SPEED_CONTROL
+	Ticks edgeInterval = drumSync.TakeEdgeInterval();
+	if( edgeInterval )
+	{
+		drumSpeed.Update( edgeInterval, GetClockMain() );
+		if( !drumDutySaved && drumSpeed.IsLocked() )
 		{
-			setIsNotSynchronised();
+			// Start from here next time
+			uint8_t duty = drumSpeed.GetSteadyDuty();
+			StorePut( kStoreDrumDuty, &duty );
+			drumDutySaved = true;
 		}
-		previousDrumRevolutionDurationTicks = drumRevolutionDurationTicks;
+	}
+#endif
+	if( !drumSync.IsLocked() )
+	{
+		// Stop scanning straight away rather than on pulses we can't trust
+		loseSync();
+	}
+	else if( estimateChanged || expectData )
+	{
+		setIsSynchronised();
+		Ticks drumRevolutionDurationTicks = drumSync.GetPeriod();
 
+		HalCycles( 120 ); // 32-bit multiply
 		Ticks delayToFirstMirror = (drumRevolutionDurationTicks * (unsigned long) firstMirrorOffset) >> 12;
-		nextRevolutionStartTime = actualSyncTime + delayToFirstMirror;
-		if( nextRevolutionStartTime < GetClockMain() )
+		nextRevolutionStartTime = drumSync.GetLastEdge() + delayToFirstMirror;
+		Ticks timeToRevolutionStart = nextRevolutionStartTime - GetClockMain();
+		if( timeToRevolutionStart < 0 )
 		{
-			Serial.println("V");
+			TraceEvent( kTraceRevolutionLate, 0, nextRevolutionStartTime, timeToRevolutionStart );
 		}
 
 		// Calculate desired horizontal scan time, and from that
 		// the inter-bit and inter-byte delays
-		hScanInterval = TicksToMicroSeconds(drumRevolutionDurationTicks) / kNumMirrors;
+		hScanInterval = scanIntervalForPeriod( drumRevolutionDurationTicks );
 		hScanDuration = (hScanInterval * 2) >> 2; // We'll draw for 1/2 of the hScanDuration
+#if SLP_ADAPTIVE_QUALITY
+		if( quality.IsShortScan() )
+		{
+			hScanDuration = (hScanInterval * 3) >> 3;
+		}
+#endif
 		calcHorizontalScanDelays();
 
 		//turnLedOn();
-		sei();
 
-#if 0
-		if( !expectData )
+		if( kLogMessageEnabled[kLogResync] && !expectData )
 		{
-			// We're not currently doing any scanning, we're just trying to get back in sync
-			// so we should have plenty of time for some spam....
+			// We're not currently doing any scanning, we're just trying to get
+			// back in sync, so there's time to log where we are.
 			Ticks now = GetClockMain();
-			Serial.print( "Now: " );
-			Serial.println( now );
-			Serial.print( "M0: " );
-			Serial.println( nextRevolutionStartTime - now );
-			Serial.print( "T: " );
-			Serial.println( actualSyncTime );
-			Serial.print( "D: " );
-			Serial.println( drumRevolutionDurationTicks );
+			LOG( kLogResync, now, nextRevolutionStartTime - now, drumSync.GetLastEdge(), drumRevolutionDurationTicks );
 		}
-#endif
 	}
-	else if( expectData )
+	HalProfileEnd( kProfileZoneRevolutionSettings );
+}
+
+static bool isMirrorShown( uint8_t mirrorIdx )
+{
+#if SLP_ADAPTIVE_QUALITY
+	// Interlaced, odd mirrors are shown on odd revolutions, and even on even.
+	if( !quality.IsInterlaced() || ((mirrorIdx ^ revolutionCount) & 1) )
+	{
+		return !quality.IsInterlaced();
+	}
+	// With an even number of mirrors, the last mirror of an odd revolution
+	// is followed by the first of the next. Leave out each of them in turn.
+	if( !(kNumMirrors & 1) )
 	{
-		Serial.println( "X" );
+		if( (mirrorIdx == (kNumMirrors - 1)) && ((revolutionCount & 3) == 1) )
+		{
+			return false;
+		}
+		if( (mirrorIdx == 0) && ((revolutionCount & 3) == 0) )
+		{
+			return false;
+		}
 	}
+	return true;
+#else
+	(void) mirrorIdx;
+	return true;
+#endif
+}
+
+// Move on to the next mirror once a scan-line is done.
+static void advanceToNextScanLine()
+{
+	do
+	{
+		// Establish the start time for the next scan
+		nextScanTime += MicroSecondsToTicks(hScanInterval);
+		if( ++currentMirrorIdx == kNumMirrors )
+		{
+			// We've finished all the scanlines.
+			// Update all our timings and set things up so we start
+			// the first scanline of the next rotation at the right time.
+#if SLP_ADAPTIVE_QUALITY
+			if( quality.EndRevolution( MicroSecondsToTicks( hScanInterval ) ) )
+			{
+				TraceEvent( kTraceQuality, quality.GetLevel(), GetClockMain() );
+			}
+			++revolutionCount;
+#endif
+#if !SLP_TIMER_PIXEL_CLOCK
+			if( delayModel.EndRevolution() )
+			{
+				scheduler.Wake( checkDelaysTaskId );
+			}
+#endif
+			calcNextRevolutionSettings( true );
+			GrayRevolutionStart();
+#if SLP_MARQUEE
+			if( marquee.Step() )
+			{
+				scheduler.Wake( renderMarqueeTaskId );
+			}
+			marqueeLeadTicks = (Ticks) ((marquee.GetPhase() * (scanBytePeriod / kPixelsPerScanByte)) >> 8);
+#endif
+			currentMirrorIdx = 0;
+			nextScanTime = nextRevolutionStartTime;
+		}
+	} while( !isMirrorShown( currentMirrorIdx ) );
+	// Adjust the scan-line horizontally according to the calibration data.
+	nextScanTimeAdjusted = nextScanTime + rasterHorizontalOffsets[ mirrorToRaster[currentMirrorIdx] ];
+#if SLP_MARQUEE
+	nextScanTimeAdjusted -= marqueeLeadTicks;
+#endif
+	startScanLineSpans();
+#if SLP_ADAPTIVE_QUALITY
+	quality.NoteSlack( nextScanTimeAdjusted - GetClockMain() );
+#endif
+	scheduler.NewSlackWindow();
+}
+
+static void scanLineLate( Ticks timeToNextScan )
+{
+	scheduler.NoteLateScanLine();
+	TraceEvent( kTraceScanLate, currentMirrorIdx, nextScanTimeAdjusted, timeToNextScan );
+#if SLP_ADAPTIVE_QUALITY
+	// Skip it, and leave the quality governor to make more time
+	quality.NoteLateScanLine();
+	advanceToNextScanLine();
+#else
+	setIsNotSynchronised();
+#endif
 }
 
 #if 0
@@ -519,94 +1103,162 @@ void Update()
 #else
 void Update()
 {
+	HalProfileBegin( kProfileZoneUpdate );
+	HalCycles( 20 );
 	sei();
 	if( getIsSynchronised() )
 	{
-		Ticks timeToNextScan = nextScanTimeAdjusted - GetClockMain();
-		//if( timeToNextScan > 300 )
-		{
-			checkButtons();
-		}
-#if 0
-		if( timeToNextScan > 1400 )
-		{
-			doSomeWork();
-		}
-		else if( timeToNextScan > 300 )
+		Ticks timeToNextScan = nextSpanTime - GetClockMain();
+		UploadPoll();
+		StorePoll();
+#if SLP_TIMER_PIXEL_CLOCK
+		if( scanLineInProgress )
 		{
-			//checkButtons();
-			Ticks timeToNextScan = nextScanTimeAdjusted - GetClockMain();
-			if( timeToNextScan < 50 )
+			// The pixel clock interrupt is busy with the current scan-line,
+			// so there's until the end of it for background work.
+			scheduler.Run( nextScanTimeAdjusted + MicroSecondsToTicks( hScanDuration ) );
+			if( !PixelClockIsBusy() )
 			{
-				Serial.println("Y");
+				TraceEvent( kTraceScanStart, currentMirrorIdx, nextScanTimeAdjusted, PixelClockGetStartError() );
+#if SLP_SPARSE_SCAN
+				uint8_t scanLineIdx = mirrorToRaster[currentMirrorIdx];
+				uint8_t numSpans = scanBuffer.GetNumSpans( scanLineIdx );
+				const ScanSpan* pSpans = scanBuffer.GetSpans( scanLineIdx );
+				uint8_t numBytes = 0;
+				for( uint8_t i = 0; i < numSpans; ++i )
+				{
+					numBytes += pSpans[i].m_end - pSpans[i].m_begin;
+				}
+				noteSparseScanLine( numBytes, numSpans == 0 );
+#endif
+				scanLineInProgress = false;
+				advanceToNextScanLine();
 			}
 		}
-		else if( timeToNextScan > 0 )
+		else
 		{
-
-			if( timeToNextScan < 50 )
+			// Hand the next scan-line to the pixel clock once it's close
+			// enough for the 16-bit compare.
+			scheduler.Run( nextScanTimeAdjusted - (kPixelClockMinLeadTicks + kSchedulerMarginTicks) );
+			timeToNextScan = nextScanTimeAdjusted - GetClockMain();
+			if( timeToNextScan <= kPixelClockMinLeadTicks )
 			{
-				Serial.println("Y");
+				scanLineLate( timeToNextScan );
 			}
+			else if( timeToNextScan < kPixelClockMaxLeadTicks )
+			{
+				uint8_t scanLineIdx = mirrorToRaster[currentMirrorIdx];
+#if SLP_SPARSE_SCAN
+				PixelClockStart( scanBuffer.GetLine( scanLineIdx ), scanBuffer.GetSpans( scanLineIdx ), scanBuffer.GetNumSpans( scanLineIdx ),
+					scanLineIdx, nextScanTimeAdjusted, pixelClockPeriod, pPixelClockOffsets );
+#else
+				PixelClockStart( scanBuffer.GetLine( scanLineIdx ), &kWholeScanLine, 1, scanLineIdx, nextScanTimeAdjusted, pixelClockPeriod, pPixelClockOffsets );
 #endif
+				scanLineInProgress = true;
+			}
+		}
+#else
+		scheduler.Run( nextSpanTime - kSchedulerMarginTicks );
 		if( timeToNextScan > 0 )
 		{
 			// Spin until the time is right to draw the next scan-line
-			while( (nextScanTimeAdjusted - GetClockMain()) > 0 ){}
+			HalProfileBegin( kProfileZoneSpinWait );
+			Ticks now;
+			while( (nextSpanTime - (now = GetClockMain())) > 0 ){}
+			HalProfileEnd( kProfileZoneSpinWait );
+#if SLP_SPARSE_SCAN
+			// Spit out the next span of the scan-line, if it isn't blank
+			bool isFirstSpan = (currentSpanIdx == 0);
+			if( currentSpanIdx < scanBuffer.GetNumSpans( mirrorToRaster[currentMirrorIdx] ) )
+			{
+				horizontalScanSpan( mirrorToRaster[currentMirrorIdx] );
+			}
+			if( isFirstSpan )
+			{
+				TraceEvent( kTraceScanStart, currentMirrorIdx, nextSpanTime, now - nextSpanTime );
+			}
+			if( !advanceToNextSpan() )
+			{
+				advanceToNextScanLine();
+			}
+#else
 			// Spit out a single scan-line
 			if( currentMirrorIdx < kNumMirrors )
 			{
 				horizontalScan( mirrorToRaster[currentMirrorIdx] );
+				GrayScanLineDone( mirrorToRaster[currentMirrorIdx] );
 			}
-			// Establish the start time for the next scan
-			nextScanTime += MicroSecondsToTicks(hScanInterval);
-			if( ++currentMirrorIdx == kNumMirrors )
-			{
-				// We've finished all the scanlines.
-				// Update all our timings and set things up so we start
-				// the first scanline of the next rotation at the right time.
-				calcNextRevolutionSettings( true );
-				currentMirrorIdx = 0;
-				nextScanTime = nextRevolutionStartTime;
-			}
-			// Adjust the scan-line horizontally according to the calibration data.
-			nextScanTimeAdjusted = nextScanTime + rasterHorizontalOffsets[ mirrorToRaster[currentMirrorIdx] ];
+			TraceEvent( kTraceScanStart, currentMirrorIdx, nextScanTimeAdjusted, now - nextScanTimeAdjusted );
+			advanceToNextScanLine();
+#endif
 		}
 		else
 		{
-			Serial.println("Z");
-			Serial.print( "Now: " );
-			Serial.println( GetClockMain() );
-			Serial.print( "TTNS: " );
-			Serial.println( timeToNextScan );
-			setIsNotSynchronised();
+			scanLineLate( timeToNextScan );
 		}
+#endif
 	}
 	else
 	{
 		// Not synchronised
 		//Serial.println("Z");
 		GetClockMain();
-		checkButtons();
+		UploadPoll();
+		StorePoll();
+		scheduler.Run( GetClockMain() + kUnsynchronisedWorkTicks );
 		calcNextRevolutionSettings( getIsSynchronised() );
 		nextScanTime = nextRevolutionStartTime;
 		nextScanTimeAdjusted = nextScanTime;
 		currentMirrorIdx = 0;
+		startScanLineSpans();
 		turnLedOn();
 		turnLaserOn();
 	}
+	HalProfileEnd( kProfileZoneUpdate );
+}
+#endif
+
+void PrintStats()
+{
+	scheduler.PrintReport();
+	drumSync.PrintReport();
+#if SLP_DRUM_SPEED_CONTROL
+	drumSpeed.PrintReport();
+#endif
+#if SLP_TRANSPOSED_SCAN_BUFFER
+	scanBuffer.PrintReport();
+#endif
+#if SLP_SPARSE_SCAN
+	printSparseScanReport();
+#endif
+#if SLP_MARQUEE
+	marquee.PrintReport();
+#endif
+	UploadPrintReport();
+	SnapshotPrintReport();
+	StorePrintReport();
+	delayModel.PrintReport();
+	GrayPrintReport();
+	ButtonsPrintReport();
+	LogPrintReport();
+#if SLP_ADAPTIVE_QUALITY
+	quality.PrintReport();
+#endif
 }
+
+QualityLevel GetQualityLevel()
+{
+#if SLP_ADAPTIVE_QUALITY
+	return quality.GetLevel();
+#else
+	return kQualityFull;
 #endif
+}
 
 void MirrorDrumInterrupt()
 {
 	cli();
-	Ticks now = GetClockInterrupt();
-	if( (now - actualSyncTime) > 10000 )
-	{
-		actualSyncTime = now;
-		++drumSyncTimePosted;
-	}
+	drumSync.PostEdge( GetClockInterrupt() );
 	sei();
 }
 
@@ -1,13 +1,14 @@
 #ifndef SCANNING_LASER_PROJECTOR_H
 #define SCANNING_LASER_PROJECTOR_H
 
+#include "DirtyCanvas.h"
+#include "Quality.h"
 #include "Timer.h"
-#include <Adafruit_GFX.h>
 
 #define LED_PIN LED_BUILTIN
 
-// 4 Lasers attached to the pins controlled by the lower nybble of PORTB
-// Pins 8 - 11
+// kNumLasers lasers attached to the pins controlled by the low bits of PORTB
+// Pins 8 - 11 for the default 4
 #define LASER_PIN 8
 
 #define RED_BUTTON_PIN 4
@@ -18,17 +19,30 @@
 
 void Startup();
 
-extern GFXcanvas1 gfx;
+extern DirtyCanvas gfx;
 
-struct InputState
-{
-	bool         m_redButton;
-	bool         m_blueButton;
-	bool         m_whiteButton;
-};
+// Call after drawing into gfx so that the change gets scanned out. Only the
+// scan-lines that gfx has marked dirty are rebuilt.
+// gfx is the back buffer; the change becomes visible all at once at the start
+// of a revolution. Avoid drawing again while IsCanvasBusy(), when scan-lines
+// are still being rebuilt from gfx, or calling CanvasChanged() again while
+// IsPresentPending(), or a revolution can show parts of both changes.
+void CanvasChanged();
+bool IsPresentPending();
+bool IsCanvasBusy();
+
+// Worst case ticks for CanvasChanged, for tasks that call it.
+extern const Ticks kCanvasChangedTicks;
 
 void Update();
 
 void MirrorDrumInterrupt();
 
+// Print the scheduler, drum sync and speed, scan buffer, upload, snapshot,
+// store, delay model, grayscale and quality statistics to Serial.
+void PrintStats();
+
+// The output quality that the scan can currently keep up with.
+QualityLevel GetQualityLevel();
+
 #endif
\ No newline at end of file
@@ -17,8 +17,8 @@ void setup()
 	pinMode( DRUM_ROTATION_SIGNAL_PIN, INPUT_PULLUP);
 
 	pinMode( LED_PIN, OUTPUT );
-	pinMode( LASER_PIN, OUTPUT );
-	pinMode( LASER_PIN, OUTPUT );
+	// Every laser's pin, from LASER_PIN up
+	DDRB |= kLaserPinMask;
 
 	pinMode( DRUM_PWM_PIN, OUTPUT );
 
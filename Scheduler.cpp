@@ -0,0 +1,118 @@
+#include "Scheduler.h"
+
+Scheduler scheduler;
+
+Scheduler::Scheduler()
+: m_numTasks( 0 ), m_nextTaskId( 0 ), m_lastTaskId( kInvalidTaskId )
+{
+}
+
+TaskId Scheduler::AddTask( TaskFunction function, uint16_t worstCaseTicks, bool isReady )
+{
+	if( m_numTasks == kMaxTasks )
+	{
+		Serial.println( F( "Too many tasks." ) );
+		return kInvalidTaskId;
+	}
+	Task& task = m_tasks[m_numTasks];
+	task.m_function = function;
+	task.m_worstCaseTicks = worstCaseTicks;
+	task.m_maxTicks = 0;
+	task.m_numRuns = 0;
+	task.m_numOverruns = 0;
+	task.m_numSkips = 0;
+	task.m_numLateScanLines = 0;
+	task.m_isReady = isReady;
+	return m_numTasks++;
+}
+
+void Scheduler::Run( Ticks deadline )
+{
+	HalProfileBegin( kProfileZoneScheduler );
+	// Keep going until we've been all the way round without running anything
+	uint8_t numSkipped = 0;
+	while( numSkipped < m_numTasks )
+	{
+		TaskId taskId = m_nextTaskId;
+		if( ++m_nextTaskId == m_numTasks )
+		{
+			m_nextTaskId = 0;
+		}
+		Task& task = m_tasks[taskId];
+		if( !task.m_isReady )
+		{
+			++numSkipped;
+			continue;
+		}
+		Ticks start = GetClockMain();
+		if( (deadline - start) < (Ticks) task.m_worstCaseTicks )
+		{
+			// Doesn't fit. Something smaller might.
+			if( task.m_numSkips != 0xffff )
+			{
+				++task.m_numSkips;
+			}
+			++numSkipped;
+			continue;
+		}
+		numSkipped = 0;
+		m_lastTaskId = taskId;
+		task.m_isReady = false;
+		if( task.m_function() )
+		{
+			task.m_isReady = true;
+		}
+		Ticks duration = GetClockMain() - start;
+
+		if( task.m_numRuns != 0xffff )
+		{
+			++task.m_numRuns;
+		}
+		if( duration > (Ticks) task.m_maxTicks )
+		{
+			task.m_maxTicks = (duration > 0xffff) ? 0xffff : (uint16_t) duration;
+		}
+		if( (duration > (Ticks) task.m_worstCaseTicks) && (task.m_numOverruns != 0xffff) )
+		{
+			++task.m_numOverruns;
+		}
+	}
+	HalProfileEnd( kProfileZoneScheduler );
+}
+
+void Scheduler::NoteLateScanLine()
+{
+	if( m_lastTaskId != kInvalidTaskId )
+	{
+		Task& task = m_tasks[m_lastTaskId];
+		if( task.m_numLateScanLines != 0xff )
+		{
+			++task.m_numLateScanLines;
+		}
+		m_lastTaskId = kInvalidTaskId;
+	}
+}
+
+void Scheduler::PrintReport() const
+{
+	// Task, runs, worst case, longest, overruns, skips, late scan-lines
+	for( uint8_t i = 0; i < m_numTasks; ++i )
+	{
+		const Task& task = m_tasks[i];
+		Serial.print( F( "Task " ) );
+		Serial.print( i );
+		Serial.print( F( ": " ) );
+		Serial.print( task.m_numRuns );
+		Serial.print( F( " runs, " ) );
+		Serial.print( task.m_maxTicks );
+		Serial.print( F( "/" ) );
+		Serial.print( task.m_worstCaseTicks );
+		Serial.print( F( " ticks, " ) );
+		Serial.print( task.m_numOverruns );
+		Serial.print( F( " overruns, " ) );
+		Serial.print( task.m_numSkips );
+		Serial.print( F( " skipped, " ) );
+		Serial.print( task.m_numLateScanLines );
+		Serial.println( F( " late" ) );
+	}
+}
@@ -0,0 +1,92 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "Config.h"
+#include "Timer.h"
+
+// Cooperative scheduler for background work (rendering, serial decoding,
+// rebuilding the scan buffer) in the gaps between scan-lines.
+//
+// Each task declares the worst case number of ticks that one call can take.
+// A task is only run if that fits before the deadline it's given, so a
+// well behaved task can never make a scan-line late. Long jobs are split into
+// resumable slices: the task function does one slice and returns true if it
+// has more to do, or false to sleep until it is woken again.
+//
+// Ready tasks are run round robin. Every call is timed, and calls that take
+// longer than declared are counted as overruns. Times a ready task didn't fit
+// are counted as skips; one that only ever skips has a worst case bigger
+// than any gap, and will never run.
+
+typedef bool (*TaskFunction)();
+typedef uint8_t TaskId;
+
+static const TaskId kInvalidTaskId = 0xff;
+
+class Scheduler
+{
+public:
+	// A slot for each task the build adds: the store's and the buttons', and
+	// one for each option that has one. Keep it in step with the callers of
+	// AddTask; Startup() checks that it is.
+	static const uint8_t kMaxTasks = 2
+		+ (SLP_TRANSPOSED_SCAN_BUFFER ? 1 : 0)  // Rebuilding the scan buffer
+		+ (SLP_MARQUEE ? 1 : 0)
+		+ (SLP_GRAY_BITS ? 1 : 0)
+		+ (SLP_TIMER_PIXEL_CLOCK ? 0 : 1)       // Checking the delay model
+		+ (SLP_F_THETA ? 1 : 0)
+		+ (SLP_TRACE_EVENTS ? 1 : 0)
+		+ (SLP_LOG_BYTES ? 1 : 0)
+		+ (SLP_SERIAL_UPLOAD ? 1 : 0)
+		+ (SLP_SNAPSHOT ? 1 : 0);
+
+	Scheduler();
+
+	TaskId AddTask( TaskFunction function, uint16_t worstCaseTicks, bool isReady = false );
+
+	// Make a sleeping task ready to run. Safe to call from an interrupt.
+	// Ignores kInvalidTaskId, from an AddTask that found no room.
+	void Wake( TaskId taskId )
+	{
+		if( taskId < m_numTasks )
+		{
+			m_tasks[taskId].m_isReady = true;
+		}
+	}
+	bool IsReady( TaskId taskId ) const { return (taskId < m_numTasks) && m_tasks[taskId].m_isReady; }
+
+	uint8_t GetNumTasks() const { return m_numTasks; }
+
+	// Run ready tasks for as long as they fit before 'deadline'.
+	void Run( Ticks deadline );
+
+	// A new gap between scan-lines has started.
+	void NewSlackWindow() { m_lastTaskId = kInvalidTaskId; }
+
+	// A scan-line was late. Blame whichever task ran last in this gap.
+	void NoteLateScanLine();
+
+	void PrintReport() const;
+
+private:
+	struct Task
+	{
+		TaskFunction m_function;
+		uint16_t     m_worstCaseTicks;
+		uint16_t     m_maxTicks;
+		uint16_t     m_numRuns;
+		uint16_t     m_numOverruns;
+		uint16_t     m_numSkips;
+		uint8_t      m_numLateScanLines;
+		volatile bool m_isReady;
+	};
+
+	Task    m_tasks[kMaxTasks];
+	uint8_t m_numTasks;
+	TaskId  m_nextTaskId;
+	TaskId  m_lastTaskId;
+};
+
+extern Scheduler scheduler;
+
+#endif
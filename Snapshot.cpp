@@ -0,0 +1,159 @@
+#include "Snapshot.h"
+#include "ScanningLaserProjector.h"
+#include "Scheduler.h"
+
+#if SLP_SNAPSHOT
+
+// Start byte, type, length and check around the payload.
+static const uint8_t kSnapshotFramingBytes = 5;
+static const uint8_t kSnapshotRowHeaderBytes = 2;
+static const uint8_t kSnapshotRowPacketBytes = kSnapshotFramingBytes + kSnapshotRowHeaderBytes + kWidthBytes;
+
+// Serial writes are about 60 cycles a byte while there's room in its buffer,
+// and each row byte goes through both checks. Allow for the interrupts that
+// land in a call that long, the transmit one included.
+static const Ticks kSnapshotTaskTicks = ((kSnapshotRowPacketBytes * 60) + (kWidthBytes * 16) + 500) / 8;
+
+static const uint16_t kSnapshotIdle = 0xffff;
+static const uint16_t kSnapshotBeginRow = 0xfffe;
+
+static TaskId snapshotTaskId = kInvalidTaskId;
+static uint16_t snapshotRow = kSnapshotIdle; // The next to send, from kSnapshotBeginRow up to kHeight for the end packet
+static uint8_t snapshotNumber = 0;
+static uint8_t snapshotFlags = 0;
+static UploadCheck snapshotImageCheck;
+
+// Statistics
+static uint16_t snapshotNumSent = 0;
+static uint16_t snapshotNumTorn = 0;
+static uint16_t snapshotNumIgnored = 0;
+
+// Send a packet of a header then data, if Serial can take all of it without
+// blocking. The data also goes into pImageCheck, if given.
+static bool sendPacket( uint8_t type, const uint8_t* pHeader, uint8_t headerBytes, const uint8_t* pData, uint8_t dataBytes, UploadCheck* pImageCheck )
+{
+	uint8_t length = headerBytes + dataBytes;
+	if( Serial.availableForWrite() < kSnapshotFramingBytes + length )
+	{
+		return false;
+	}
+	HalCycles( 40 + (8 * headerBytes) + ((pImageCheck ? 16 : 8) * dataBytes) );
+	UploadCheck check;
+	check.Add( type );
+	check.Add( length );
+	for( uint8_t i = 0; i < headerBytes; ++i )
+	{
+		check.Add( pHeader[i] );
+	}
+	for( uint8_t i = 0; i < dataBytes; ++i )
+	{
+		check.Add( pData[i] );
+		if( pImageCheck )
+		{
+			pImageCheck->Add( pData[i] );
+		}
+	}
+	uint16_t checkValue = check.Get();
+	Serial.write( kSnapshotPacketStart );
+	Serial.write( type );
+	Serial.write( length );
+	Serial.write( pHeader, headerBytes );
+	Serial.write( pData, dataBytes );
+	Serial.write( (uint8_t) checkValue );
+	Serial.write( (uint8_t) (checkValue >> 8) );
+	return true;
+}
+
+// Send the next packet of the snapshot, a row at a time.
+static bool snapshotTask()
+{
+	uint16_t row = snapshotRow;
+	if( row == kSnapshotIdle )
+	{
+		return false;
+	}
+	if( row == kSnapshotBeginRow )
+	{
+		const uint8_t header[4] = { snapshotNumber, (uint8_t) kWidth, (uint8_t) kHeight, (uint8_t) (kHeight >> 8) };
+		if( sendPacket( kSnapshotBegin, header, sizeof( header ), nullptr, 0, nullptr ) )
+		{
+			snapshotRow = 0;
+		}
+	}
+	else if( row < kHeight )
+	{
+		const uint8_t header[kSnapshotRowHeaderBytes] = { (uint8_t) row, (uint8_t) (row >> 8) };
+		if( sendPacket( kSnapshotRow, header, sizeof( header ), gfx.getBuffer() + (row * kWidthBytes), kWidthBytes, &snapshotImageCheck ) )
+		{
+			snapshotRow = row + 1;
+		}
+	}
+	else
+	{
+		uint16_t imageCheck = snapshotImageCheck.Get();
+		const uint8_t header[4] = { snapshotNumber, snapshotFlags, (uint8_t) imageCheck, (uint8_t) (imageCheck >> 8) };
+		if( sendPacket( kSnapshotEnd, header, sizeof( header ), nullptr, 0, nullptr ) )
+		{
+			snapshotRow = kSnapshotIdle;
+			++snapshotNumSent;
+			if( snapshotFlags & kSnapshotTorn )
+			{
+				++snapshotNumTorn;
+			}
+			++snapshotNumber;
+			return false;
+		}
+	}
+	// Stay ready, to try again if Serial had no room
+	return true;
+}
+
+void SnapshotStart()
+{
+	snapshotTaskId = scheduler.AddTask( snapshotTask, kSnapshotTaskTicks );
+}
+
+void SnapshotRequest()
+{
+	if( snapshotRow != kSnapshotIdle )
+	{
+		++snapshotNumIgnored;
+		return;
+	}
+	snapshotRow = kSnapshotBeginRow;
+	snapshotFlags = 0;
+	snapshotImageCheck = UploadCheck();
+	if( snapshotTaskId != kInvalidTaskId )
+	{
+		scheduler.Wake( snapshotTaskId );
+	}
+}
+
+void SnapshotCanvasChanged( ScanLineMask dirtyScanLines )
+{
+	HalCycles( 10 );
+	uint16_t row = snapshotRow;
+	if( (row == kSnapshotIdle) || (row == kSnapshotBeginRow) || (row == 0) )
+	{
+		return;
+	}
+	// Row y is drawn by scan-line y % kNumMirrors
+	ScanLineMask sentScanLines = (row >= kNumMirrors) ? kAllScanLines : (ScanLineMask) (((ScanLineMask) 1 << row) - 1);
+	if( dirtyScanLines & sentScanLines )
+	{
+		snapshotFlags |= kSnapshotTorn;
+	}
+}
+
+void SnapshotPrintReport()
+{
+	Serial.print( F( "Snapshot: " ) );
+	Serial.print( snapshotNumSent );
+	Serial.print( F( " sent, " ) );
+	Serial.print( snapshotNumTorn );
+	Serial.print( F( " torn, " ) );
+	Serial.print( snapshotNumIgnored );
+	Serial.println( F( " requests ignored while busy" ) );
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "Config.h"
+#include "Geometry.h"
+#include "Upload.h"
+
+// Snapshots of the canvas streamed out over Serial, so a host can see what's
+// being projected without blanking the display.
+//
+// A background task sends the canvas a row at a time, with interrupts
+// enabled, and only when Serial has room for the row's whole packet, so a
+// snapshot never blocks and never holds up a scan-line. At the default
+// geometry it's 64 packets of 23 bytes, about 130ms at 115200 baud.
+//
+// Packets are framed the same way as uploads (see Upload.h):
+//   kSnapshotPacketStart, type, length, payload (length bytes), check (2 bytes)
+// where check is the Fletcher-16 of type, length and payload, low byte first.
+// The end packet also has the Fletcher-16 of every row's bytes in order, so
+// the host knows it has the whole image.
+//
+// Rows are read from the canvas as they're sent. If the canvas is presented
+// with changes to scan-lines that have already been sent, the snapshot mixes
+// two frames, and the end packet flags it as torn.
+//
+// A snapshot is requested by a kUploadSnapshot packet, or SnapshotRequest().
+// Host/SnapshotDecode.cpp writes them out as PBM images.
+
+static const uint8_t kSnapshotPacketStart = 0xc3;
+
+enum SnapshotPacketType
+{
+	kSnapshotBegin,  // snapshot number, width in pixels, height in rows (2 bytes)
+	kSnapshotRow,    // row (2 bytes), the row's kWidthBytes canvas bytes
+	kSnapshotEnd,    // snapshot number, SnapshotFlags, check of the rows (2 bytes)
+	kNumSnapshotPacketTypes
+};
+
+enum SnapshotFlags
+{
+	kSnapshotTorn = 1 // The canvas was presented with changes to rows already sent
+};
+
+#if SLP_SNAPSHOT
+
+// Register the background task that sends snapshots.
+void SnapshotStart();
+
+// Start a snapshot, unless one is already being sent.
+void SnapshotRequest();
+
+// Call from CanvasChanged() with the scan-lines about to be presented, before
+// the canvas forgets them.
+void SnapshotCanvasChanged( ScanLineMask dirtyScanLines );
+
+// Print snapshot statistics to Serial.
+void SnapshotPrintReport();
+
+#else
+
+inline void SnapshotStart() {}
+inline void SnapshotRequest() {}
+inline void SnapshotCanvasChanged( ScanLineMask ) {}
+inline void SnapshotPrintReport() {}
+
+#endif
+
+#endif
@@ -0,0 +1,296 @@
+#include "Store.h"
+#include "Log.h"
+#include "Scheduler.h"
+#include <EEPROM.h>
+#if !defined(SLP_SIMULATOR)
+#include <util/crc16.h>
+#endif
+
+// Sequence byte and check around the payload.
+static const uint8_t kStoreSlotOverhead = 3;
+
+static constexpr uint16_t storeDataBytes( uint8_t record )
+{
+	return record ? kStoreRecordBytes[record - 1] + storeDataBytes( record - 1 ) : 0;
+}
+
+static constexpr uint8_t storeMaxRecordBytes( uint8_t record )
+{
+	return record ? ((kStoreRecordBytes[record - 1] > storeMaxRecordBytes( record - 1 )) ? kStoreRecordBytes[record - 1] : storeMaxRecordBytes( record - 1 )) : 0;
+}
+
+// Each record's payload in SRAM, one after the other.
+static const uint16_t kStoreDataBytes = storeDataBytes( kNumStoreRecords );
+static const uint8_t kStoreMaxSlotBytes = storeMaxRecordBytes( kNumStoreRecords ) + kStoreSlotOverhead;
+static const uint16_t kStoreEepromBytes = (kStoreDataBytes + (kNumStoreRecords * kStoreSlotOverhead)) * SLP_STORE_SLOTS;
+
+static_assert( kNumStoreRecords <= 8, "Store records are tracked in a byte of flags" );
+static_assert( kStoreEepromBytes <= E2END + 1, "The store doesn't fit in the EEPROM" );
+
+// CRC-16 of a byte with avr-libc's _crc_xmodem_update, about 25 single
+// cycle instructions, and loading the byte and looping around it.
+static const uint8_t kStoreCheckCycles = 32;
+
+// The worst case is starting a save, which checks the largest slot.
+static const uint16_t kStoreTaskTicks = ((kStoreMaxSlotBytes + 3) * kStoreCheckCycles + 100) / 8;
+
+static const uint8_t kStoreNone = 0xff;
+
+static uint8_t storeData[kStoreDataBytes];
+static uint8_t storeLoaded = 0;     // Records with a value, a bit each
+static uint8_t storeDirty = 0;      // Records put and not yet written
+static uint8_t storeNewestSlot[kNumStoreRecords];
+static uint8_t storeSequence[kNumStoreRecords];
+static TaskId storeTaskId = kInvalidTaskId;
+
+// The save being written
+static uint8_t storeWriteRecord = kStoreNone;
+static uint8_t storeWriteSlot;
+static uint16_t storeWriteAddress;
+static uint8_t storeWriteBytes;
+static uint8_t storeWritePos;
+static uint8_t storeWriteSequence;
+static uint16_t storeWriteCheck;
+
+// Statistics
+static uint16_t storeNumSaves = 0;
+static uint16_t storeNumBytesWritten = 0;
+static uint16_t storeNumBytesUnchanged = 0;
+
+// CRC-16/XMODEM, polynomial 0x1021 most significant bit first. The host
+// works it out a bit at a time, as avr-libc documents the routine.
+static uint16_t storeCheckAdd( uint16_t crc, uint8_t byte )
+{
+#if defined(SLP_SIMULATOR)
+	crc ^= (uint16_t) byte << 8;
+	for( uint8_t i = 0; i < 8; ++i )
+	{
+		crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+	}
+	return crc;
+#else
+	return _crc_xmodem_update( crc, byte );
+#endif
+}
+
+// The check of a slot's sequence and payload.
+static uint16_t storeCheck( uint8_t record, uint8_t sequence, const uint8_t* pPayload )
+{
+	uint8_t numBytes = kStoreRecordBytes[record];
+	HalCycles( (4 + numBytes) * kStoreCheckCycles );
+	uint16_t crc = 0xffff;
+	crc = storeCheckAdd( crc, kStoreVersion );
+	crc = storeCheckAdd( crc, record );
+	crc = storeCheckAdd( crc, numBytes );
+	crc = storeCheckAdd( crc, sequence );
+	for( uint8_t i = 0; i < numBytes; ++i )
+	{
+		crc = storeCheckAdd( crc, pPayload[i] );
+	}
+	return crc;
+}
+
+static uint8_t* storeGetData( uint8_t record )
+{
+	uint8_t* pData = storeData;
+	for( uint8_t i = 0; i < record; ++i )
+	{
+		pData += kStoreRecordBytes[i];
+	}
+	return pData;
+}
+
+static uint16_t storeGetSlotAddress( uint8_t record, uint8_t slot )
+{
+	uint16_t address = 0;
+	for( uint8_t i = 0; i < record; ++i )
+	{
+		address += (kStoreRecordBytes[i] + kStoreSlotOverhead) * SLP_STORE_SLOTS;
+	}
+	return address + (kStoreRecordBytes[record] + kStoreSlotOverhead) * slot;
+}
+
+uint8_t StoreLoad()
+{
+	// The regions are one after the other, so this reads straight through
+	uint8_t numLoaded = 0;
+	uint16_t address = 0;
+	uint8_t slotBytes[kStoreMaxSlotBytes];
+	for( uint8_t record = 0; record < kNumStoreRecords; ++record )
+	{
+		uint8_t numBytes = kStoreRecordBytes[record] + kStoreSlotOverhead;
+		uint8_t recordBit = 1 << record;
+		// With no valid slot, the first save goes in slot 0
+		storeNewestSlot[record] = SLP_STORE_SLOTS - 1;
+		for( uint8_t slot = 0; slot < SLP_STORE_SLOTS; ++slot )
+		{
+			for( uint8_t i = 0; i < numBytes; ++i )
+			{
+				slotBytes[i] = EEPROM.read( address++ );
+			}
+			uint16_t check = slotBytes[numBytes - 2] | ((uint16_t) slotBytes[numBytes - 1] << 8);
+			if( check != storeCheck( record, slotBytes[0], slotBytes + 1 ) )
+			{
+				continue;
+			}
+			// Newest by sequence, allowing for it wrapping around
+			if( !(storeLoaded & recordBit) || ((int8_t) (slotBytes[0] - storeSequence[record]) > 0) )
+			{
+				storeLoaded |= recordBit;
+				storeNewestSlot[record] = slot;
+				storeSequence[record] = slotBytes[0];
+				memcpy( storeGetData( record ), slotBytes + 1, kStoreRecordBytes[record] );
+			}
+		}
+		if( storeLoaded & recordBit )
+		{
+			++numLoaded;
+		}
+	}
+	LOG( kLogStoreLoaded, numLoaded, kNumStoreRecords );
+	return numLoaded;
+}
+
+bool StoreGet( StoreRecord record, void* pDst )
+{
+	if( !(storeLoaded & (1 << record)) )
+	{
+		return false;
+	}
+	memcpy( pDst, storeGetData( record ), kStoreRecordBytes[record] );
+	return true;
+}
+
+void StorePut( StoreRecord record, const void* pSrc )
+{
+	HalCycles( 20 + (4 * kStoreRecordBytes[record]) );
+	uint8_t recordBit = 1 << record;
+	uint8_t* pData = storeGetData( record );
+	if( (storeLoaded & recordBit) && !memcmp( pData, pSrc, kStoreRecordBytes[record] ) )
+	{
+		return;
+	}
+	memcpy( pData, pSrc, kStoreRecordBytes[record] );
+	storeLoaded |= recordBit;
+	storeDirty |= recordBit;
+	if( storeTaskId != kInvalidTaskId )
+	{
+		scheduler.Wake( storeTaskId );
+	}
+}
+
+bool StoreIsBusy()
+{
+	return storeDirty || (storeWriteRecord != kStoreNone);
+}
+
+// Start the next slot of the lowest numbered record waiting to be saved.
+// The payload is written straight from the record's SRAM copy. A put while
+// it's being written can leave the slot failing its check, but then the
+// record is dirty again and is saved to the slot after, and until then the
+// one before is still good.
+static void storeBeginSave()
+{
+	uint8_t record = 0;
+	while( !(storeDirty & (1 << record)) )
+	{
+		++record;
+	}
+	storeDirty &= ~(1 << record);
+	uint8_t slot = storeNewestSlot[record] + 1;
+	storeWriteSlot = (slot == SLP_STORE_SLOTS) ? 0 : slot;
+	uint8_t numBytes = kStoreRecordBytes[record];
+	storeWriteSequence = storeSequence[record] + 1;
+	storeWriteCheck = storeCheck( record, storeWriteSequence, storeGetData( record ) );
+	storeWriteRecord = record;
+	storeWriteAddress = storeGetSlotAddress( record, storeWriteSlot );
+	storeWriteBytes = numBytes + kStoreSlotOverhead;
+	storeWritePos = 0;
+}
+
+// Byte pos of the slot being written.
+static uint8_t storeGetSlotByte( uint8_t pos )
+{
+	if( pos == 0 )
+	{
+		return storeWriteSequence;
+	}
+	if( pos == storeWriteBytes - 2 )
+	{
+		return (uint8_t) storeWriteCheck;
+	}
+	if( pos == storeWriteBytes - 1 )
+	{
+		return (uint8_t) (storeWriteCheck >> 8);
+	}
+	return storeGetData( storeWriteRecord )[pos - 1];
+}
+
+// Start the next save, or write the next byte of this one that differs.
+// Sleeps while the EEPROM is busy, for StorePoll to wake it.
+static bool storeTask()
+{
+	if( storeWriteRecord == kStoreNone )
+	{
+		if( !storeDirty )
+		{
+			return false;
+		}
+		storeBeginSave();
+		return HalEepromIsReady();
+	}
+	if( !HalEepromIsReady() )
+	{
+		return false;
+	}
+	while( storeWritePos < storeWriteBytes )
+	{
+		uint16_t address = storeWriteAddress + storeWritePos;
+		uint8_t byte = storeGetSlotByte( storeWritePos++ );
+		if( EEPROM.read( address ) != byte )
+		{
+			// Returns as soon as the write has started
+			EEPROM.write( address, byte );
+			++storeNumBytesWritten;
+			break;
+		}
+		++storeNumBytesUnchanged;
+	}
+	if( storeWritePos == storeWriteBytes )
+	{
+		uint8_t record = storeWriteRecord;
+		storeNewestSlot[record] = storeWriteSlot;
+		storeSequence[record] = storeWriteSequence;
+		storeWriteRecord = kStoreNone;
+		++storeNumSaves;
+		LOG( kLogStoreSaved, record, storeWriteSlot );
+		return storeDirty != 0;
+	}
+	return HalEepromIsReady();
+}
+
+void StoreStart()
+{
+	storeTaskId = scheduler.AddTask( storeTask, kStoreTaskTicks, storeDirty != 0 );
+}
+
+void StorePoll()
+{
+	HalCycles( 10 );
+	if( (storeWriteRecord != kStoreNone) && HalEepromIsReady() )
+	{
+		scheduler.Wake( storeTaskId );
+	}
+}
+
+void StorePrintReport()
+{
+	Serial.print( F( "Store: " ) );
+	Serial.print( storeNumSaves );
+	Serial.print( F( " saves, " ) );
+	Serial.print( storeNumBytesWritten );
+	Serial.print( F( " bytes written, " ) );
+	Serial.print( storeNumBytesUnchanged );
+	Serial.print( F( " unchanged, " ) );
+	Serial.println( StoreIsBusy() ? "busy" : "idle" );
+}
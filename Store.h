@@ -0,0 +1,62 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include "Config.h"
+#include "Geometry.h"
+
+// Settings kept in EEPROM across power cycles, as fixed size records.
+//
+// Each record has its own region of SLP_STORE_SLOTS slots, and each save
+// goes into the slot after the newest, so the wear is spread across them and
+// a save that's cut short leaves the one before intact. A slot is
+//   sequence, payload, check (2 bytes)
+// where sequence counts up by one each save, and check is the CRC-16 (CCITT)
+// of kStoreVersion, the record's id and size, the sequence and the payload.
+// Changing a record's size or kStoreVersion makes the old slots fail their
+// check, so they're ignored rather than misread.
+//
+// StoreLoad reads the whole store once at startup, and keeps the newest
+// valid slot of each record in SRAM. StorePut only copies into that, and a
+// background task writes a byte at a time. The EEPROM takes 3.3ms over each
+// byte, and the task sleeps until StorePoll finds it has finished, so the CPU
+// never waits on the EEPROM and a save doesn't hold up a scan-line. Bytes
+// that already match aren't rewritten.
+
+static const uint8_t kStoreVersion = 1;
+
+enum StoreRecord
+{
+	kStoreRasterOffsets,     // uint16_t per mirror, the horizontal offset of each scan-line
+	kStoreFirstMirrorOffset, // uint16_t, the first mirror's fraction of a revolution * 4096
+	kStoreDrumDuty,          // uint8_t, the PWM duty that the drum speed locked at
+	kStoreDelayModel,        // DelayCoefficients, the measured delay loop timings (see DelayModel.h)
+	kNumStoreRecords
+};
+
+// Payload bytes of each record.
+static constexpr uint8_t kStoreRecordBytes[kNumStoreRecords] = { 2 * kNumMirrors, 2, 1, 10 };
+
+// Read every record's newest valid slot. Returns how many were found.
+uint8_t StoreLoad();
+
+// Copy a record's loaded or last put value to pDst. False if there's none.
+bool StoreGet( StoreRecord record, void* pDst );
+
+// Save a new value for a record, in the background. Does nothing if it's
+// the same as the last.
+void StorePut( StoreRecord record, const void* pSrc );
+
+// True while anything put is yet to be written.
+bool StoreIsBusy();
+
+// Register the background task that writes records.
+void StoreStart();
+
+// Wake the writer if it's waiting for the EEPROM and the EEPROM is ready.
+// Cheap enough to call every Update.
+void StorePoll();
+
+// Print store statistics to Serial.
+void StorePrintReport();
+
+#endif
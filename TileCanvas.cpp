@@ -0,0 +1,316 @@
+#include "TileCanvas.h"
+#include "ScanKernel.h"
+
+TileCanvas::TileCanvas()
+: Adafruit_GFX( kWidth, kHeight ), m_numUsed( 0 ), m_numDroppedPixels( 0 )
+{
+	memset( m_map, kTileBlank, sizeof( m_map ) );
+	memset( m_tiles[kTileBlank], 0x00, sizeof( m_tiles[0] ) );
+	memset( m_tiles[kTileFull], 0xff, sizeof( m_tiles[0] ) );
+	memset( m_refCounts, 0, sizeof( m_refCounts ) );
+}
+
+TileId TileCanvas::allocate()
+{
+	for( TileId id = kFirstPoolTile; id < kFirstPoolTile + kTilePoolSize; ++id )
+	{
+		HalCycles( 6 );
+		if( !m_refCounts[id] )
+		{
+			return id;
+		}
+	}
+	return kTileBlank;
+}
+
+void TileCanvas::release( TileId id )
+{
+	if( (id >= kFirstPoolTile) && !--m_refCounts[id] )
+	{
+		--m_numUsed;
+	}
+}
+
+void TileCanvas::setTile( uint16_t tileIdx, TileId id )
+{
+	TileId oldId = m_map[tileIdx];
+	if( oldId == id )
+	{
+		return;
+	}
+	if( (id >= kFirstPoolTile) && !m_refCounts[id]++ )
+	{
+		++m_numUsed;
+	}
+	release( oldId );
+	m_map[tileIdx] = id;
+}
+
+uint8_t* TileCanvas::writableTile( uint16_t tileIdx )
+{
+	TileId id = m_map[tileIdx];
+	if( (id >= kFirstPoolTile) && (m_refCounts[id] == 1) )
+	{
+		return m_tiles[id];
+	}
+	TileId newId = allocate();
+	if( newId == kTileBlank )
+	{
+		Compact();
+		id = m_map[tileIdx];
+		newId = allocate();
+		if( newId == kTileBlank )
+		{
+			return nullptr;
+		}
+	}
+	HalCycles( 40 );
+	memcpy( m_tiles[newId], m_tiles[id], sizeof( m_tiles[0] ) );
+	setTile( tileIdx, newId );
+	return m_tiles[newId];
+}
+
+void TileCanvas::normaliseTile( uint16_t tileIdx )
+{
+	HalCycles( 30 );
+	const uint8_t* pRows = m_tiles[m_map[tileIdx]];
+	uint8_t anySet = 0;
+	uint8_t allSet = 0xff;
+	for( uint8_t row = 0; row < 8; ++row )
+	{
+		anySet |= pRows[row];
+		allSet &= pRows[row];
+	}
+	if( !anySet )
+	{
+		setTile( tileIdx, kTileBlank );
+	}
+	else if( allSet == 0xff )
+	{
+		setTile( tileIdx, kTileFull );
+	}
+}
+
+void TileCanvas::drawPixel( int16_t x, int16_t y, uint16_t color )
+{
+	if( (x < 0) || (y < 0) || (x >= kWidth) || (y >= (int16_t) kHeight) )
+	{
+		return;
+	}
+	HalCycles( 40 );
+	uint16_t tileIdx = ((y >> 3) * kTileColumns) + (x >> 3);
+	uint8_t row = y & 7;
+	uint8_t mask = 0x80 >> (x & 7);
+	uint8_t oldByte = m_tiles[m_map[tileIdx]][row];
+	uint8_t newByte = (color == 2) ? (oldByte ^ mask) : color ? (oldByte | mask) : (oldByte & ~mask);
+	if( newByte == oldByte )
+	{
+		return;
+	}
+	uint8_t* pRows = writableTile( tileIdx );
+	if( !pRows )
+	{
+		if( m_numDroppedPixels != 0xffff )
+		{
+			++m_numDroppedPixels;
+		}
+		return;
+	}
+	pRows[row] = newByte;
+	if( (newByte == 0x00) || (newByte == 0xff) )
+	{
+		normaliseTile( tileIdx );
+	}
+}
+
+void TileCanvas::drawFastHLine( int16_t x, int16_t y, int16_t w, uint16_t color )
+{
+	fillRect( x, y, w, 1, color );
+}
+
+void TileCanvas::drawFastVLine( int16_t x, int16_t y, int16_t h, uint16_t color )
+{
+	fillRect( x, y, 1, h, color );
+}
+
+void TileCanvas::fillRect( int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color )
+{
+	if( w < 0 )
+	{
+		x += w + 1;
+		w = -w;
+	}
+	if( h < 0 )
+	{
+		y += h + 1;
+		h = -h;
+	}
+	int16_t right = x + w;
+	int16_t bottom = y + h;
+	if( x < 0 ) x = 0;
+	if( y < 0 ) y = 0;
+	if( right > kWidth ) right = kWidth;
+	if( bottom > (int16_t) kHeight ) bottom = kHeight;
+	if( (x >= right) || (y >= bottom) )
+	{
+		return;
+	}
+
+	for( int16_t tileY = y & ~7; tileY < bottom; tileY += 8 )
+	{
+		uint8_t firstRow = (y > tileY) ? (y - tileY) : 0;
+		uint8_t endRow = (bottom < tileY + 8) ? (bottom - tileY) : 8;
+		for( int16_t tileX = x & ~7; tileX < right; tileX += 8 )
+		{
+			HalCycles( 30 );
+			uint16_t tileIdx = ((tileY >> 3) * kTileColumns) + (tileX >> 3);
+			uint8_t mask = 0xff;
+			if( x > tileX )
+			{
+				mask >>= x - tileX;
+			}
+			if( right < tileX + 8 )
+			{
+				mask &= (uint8_t) (0xff << (tileX + 8 - right));
+			}
+
+			// A whole tile of 0 or 1 just points at the blank or full tile.
+			if( (mask == 0xff) && (firstRow == 0) && (endRow == 8) && (color != 2) )
+			{
+				setTile( tileIdx, color ? kTileFull : kTileBlank );
+				continue;
+			}
+
+			const uint8_t* pOldRows = m_tiles[m_map[tileIdx]];
+			bool isChanged = (color == 2);
+			for( uint8_t row = firstRow; !isChanged && (row < endRow); ++row )
+			{
+				isChanged = (color ? (pOldRows[row] | mask) : (pOldRows[row] & ~mask)) != pOldRows[row];
+			}
+			if( !isChanged )
+			{
+				continue;
+			}
+			uint8_t* pRows = writableTile( tileIdx );
+			if( !pRows )
+			{
+				uint8_t numPixels = 0;
+				for( uint8_t bits = mask; bits; bits &= bits - 1 )
+				{
+					++numPixels;
+				}
+				uint16_t numDropped = m_numDroppedPixels + (numPixels * (endRow - firstRow));
+				m_numDroppedPixels = (numDropped < m_numDroppedPixels) ? 0xffff : numDropped;
+				continue;
+			}
+			HalCycles( 4 * (endRow - firstRow) );
+			for( uint8_t row = firstRow; row < endRow; ++row )
+			{
+				pRows[row] = (color == 2) ? (pRows[row] ^ mask) : color ? (pRows[row] | mask) : (pRows[row] & ~mask);
+			}
+			normaliseTile( tileIdx );
+		}
+	}
+}
+
+void TileCanvas::fillScreen( uint16_t color )
+{
+	HalCycles( 20 + (kNumTiles >> 1) );
+	memset( m_map, color ? kTileFull : kTileBlank, sizeof( m_map ) );
+	memset( m_refCounts, 0, sizeof( m_refCounts ) );
+	m_numUsed = 0;
+	m_numDroppedPixels = 0;
+}
+
+bool TileCanvas::getPixel( int16_t x, int16_t y ) const
+{
+	if( (x < 0) || (y < 0) || (x >= kWidth) || (y >= (int16_t) kHeight) )
+	{
+		return false;
+	}
+	return (m_tiles[m_map[((y >> 3) * kTileColumns) + (x >> 3)]][y & 7] & (0x80 >> (x & 7))) != 0;
+}
+
+void TileCanvas::Compact()
+{
+	// Point each pool entry at the first earlier one with the same pixels,
+	// unless the merged reference count wouldn't fit, then remap the tiles.
+	TileId remap[kFirstPoolTile + kTilePoolSize];
+	bool isMerged = false;
+	for( TileId id = 0; id < kFirstPoolTile + kTilePoolSize; ++id )
+	{
+		remap[id] = id;
+		if( (id < kFirstPoolTile) || !m_refCounts[id] )
+		{
+			continue;
+		}
+		for( TileId otherId = kFirstPoolTile; otherId < id; ++otherId )
+		{
+			HalCycles( 20 );
+			if( !m_refCounts[otherId] || (m_refCounts[otherId] + m_refCounts[id] > 255) )
+			{
+				continue;
+			}
+			if( !memcmp( m_tiles[otherId], m_tiles[id], sizeof( m_tiles[0] ) ) )
+			{
+				remap[id] = otherId;
+				m_refCounts[otherId] += m_refCounts[id];
+				m_refCounts[id] = 0;
+				--m_numUsed;
+				isMerged = true;
+				break;
+			}
+		}
+	}
+	if( !isMerged )
+	{
+		return;
+	}
+	HalCycles( 6 * kNumTiles );
+	for( uint16_t tileIdx = 0; tileIdx < kNumTiles; ++tileIdx )
+	{
+		m_map[tileIdx] = remap[m_map[tileIdx]];
+	}
+}
+
+bool TileCanvas::ExpandScanLine( uint8_t scanLineIdx, uint8_t* pPixels ) const
+{
+	HalCycles( 20 + (10 * kNumLasers) );
+	// Each laser's row of the tile map, and its row within those tiles.
+	const TileId* pMapRows[kNumLasers];
+	uint8_t tileRows[kNumLasers];
+	for( uint8_t laser = 0; laser < kNumLasers; ++laser )
+	{
+		uint16_t y = (laser * kNumMirrors) + scanLineIdx;
+		pMapRows[laser] = m_map + ((y >> 3) * kTileColumns);
+		tileRows[laser] = y & 7;
+	}
+
+	// Same traversal as ScanBuffer: canvas bytes right to left, and within a
+	// byte least significant (rightmost) pixel first.
+	for( int8_t x = kTileColumns - 1; x >= 0; --x )
+	{
+		HalCycles( 6 + (10 * kNumLasers) );
+		TileId ids = 0;
+		LaserBytes bytes;
+		for( uint8_t laser = 0; laser < kNumLasers; ++laser )
+		{
+			TileId id = pMapRows[laser][x];
+			ids |= id;
+			bytes.m_bytes[laser] = m_tiles[id][tileRows[laser]];
+		}
+		if( !ids )
+		{
+			HalCycles( 2 * kScanBytesPerCanvasByte );
+			memset( pPixels, 0, kScanBytesPerCanvasByte );
+			pPixels += kScanBytesPerCanvasByte;
+			continue;
+		}
+		HalCycles( 26 * kNumLasers );
+		for( uint8_t bitIdx = 0; bitIdx < 8; bitIdx += kPixelsPerScanByte )
+		{
+			*pPixels++ = PackScanByte( bytes, bitIdx );
+		}
+	}
+	return !m_numDroppedPixels;
+}
@@ -0,0 +1,95 @@
+#ifndef TILE_CANVAS_H
+#define TILE_CANVAS_H
+
+#include "Config.h"
+#include "Geometry.h"
+#include "Timer.h"
+#include <Adafruit_GFX.h>
+
+// A 1 bit canvas stored as 8x8 pixel tiles through a dictionary, for frames
+// that would otherwise need a whole GFXcanvas1 (1KB at the default geometry).
+//
+// The tile map holds a byte per tile: 0 for blank, 1 for full, or an entry in
+// a pool of SLP_TILE_POOL tiles of 8 row bytes each. Blank and full tiles
+// take no pool entry. Pool entries are reference counted, and shared by every
+// tile with the same pixels, so repeated glyphs and patterns are only stored
+// once. Drawing into a shared tile gives it its own copy first, and a tile
+// that becomes blank or full again goes back to costing nothing. Compact()
+// merges tiles that drawing has made identical. It runs by itself when the
+// pool runs out, and pixels that still don't fit are dropped and counted.
+//
+// Each tile row is a canvas byte, in the same bit order as GFXcanvas1, so
+// ExpandScanLine() can pack a scan-line straight into the transposed scan
+// buffer's order (see ScanBuffer.h) for horizontalScan. Blank tiles are
+// skipped without packing. Only rotation 0 is supported.
+//
+// This trades time for SRAM. Going through the tile map makes expanding a
+// line slower than packing it from a GFXcanvas1, about 2400 to 2560 cycles
+// against 2100 to 2160 (slpsim --measure-tile-canvas). And it only saves
+// SRAM on frames that are mostly blank, full or repeated: a screen of dense
+// text needs about 90 pool entries, and overflows the default pool. Nothing
+// in the sketch uses it yet; the scan buffer is still built from the canvas.
+static const uint8_t  kTileColumns = kWidthBytes;
+static const uint8_t  kTileRows = (uint8_t) ((kHeight + 7) >> 3);
+static const uint16_t kNumTiles = (uint16_t) kTileColumns * kTileRows;
+static const uint8_t  kTilePoolSize = SLP_TILE_POOL;
+
+typedef uint8_t TileId;
+static const TileId kTileBlank = 0;
+static const TileId kTileFull = 1;
+static const TileId kFirstPoolTile = 2;
+
+static_assert( (kTilePoolSize >= 1) && (kTilePoolSize <= 254), "SLP_TILE_POOL must be 1 to 254" );
+
+class TileCanvas : public Adafruit_GFX
+{
+public:
+	TileCanvas();
+
+	void drawPixel( int16_t x, int16_t y, uint16_t color ) override;
+	void drawFastHLine( int16_t x, int16_t y, int16_t w, uint16_t color ) override;
+	void drawFastVLine( int16_t x, int16_t y, int16_t h, uint16_t color ) override;
+	void fillRect( int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color ) override;
+	void fillScreen( uint16_t color ) override;
+
+	bool getPixel( int16_t x, int16_t y ) const;
+
+	// Merge pool entries that hold the same pixels.
+	void Compact();
+
+	// Pack scan-line scanLineIdx into kWidth / kPixelsPerScanByte bytes of
+	// scan buffer order at pPixels. Returns false if pixels have been dropped
+	// since the last fillScreen, as the line may then be missing some.
+	bool ExpandScanLine( uint8_t scanLineIdx, uint8_t* pPixels ) const;
+
+	// Approximate AVR cost of ExpandScanLine with no blank tiles.
+	static const Ticks kExpandLineTicks = (20 + (10 * kNumLasers) + (kTileColumns * (6 + (36 * kNumLasers)))) >> 3;
+
+	// SRAM taken whatever is drawn: the tile map, the blank, full and pool
+	// tiles with their reference counts, and the counters. Leaves out the
+	// Adafruit_GFX state, which a GFXcanvas1 has too.
+	static const uint16_t kSizeBytes = kNumTiles + ((uint16_t) (kFirstPoolTile + kTilePoolSize) * 9) + 3;
+
+	uint8_t  GetNumPoolTilesUsed() const { return m_numUsed; }
+	// Pixels drawn since the last fillScreen that didn't fit in the pool.
+	uint16_t GetNumDroppedPixels() const { return m_numDroppedPixels; }
+
+private:
+	// The rows of a tile, with its own pool entry to draw into, or null if
+	// the pool is full.
+	uint8_t* writableTile( uint16_t tileIdx );
+	// Set a tile that has just been drawn into back to blank or full if it
+	// is either.
+	void     normaliseTile( uint16_t tileIdx );
+	void     setTile( uint16_t tileIdx, TileId id );
+	void     release( TileId id );
+	TileId   allocate();
+
+	TileId   m_map[kNumTiles];
+	uint8_t  m_tiles[kFirstPoolTile + kTilePoolSize][8]; // Blank, full, then the pool
+	uint8_t  m_refCounts[kFirstPoolTile + kTilePoolSize]; // 0 for a free entry
+	uint8_t  m_numUsed;
+	uint16_t m_numDroppedPixels;
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "Timer.h"
+#include "Log.h"
 
 struct Prescaler
 {
@@ -9,8 +10,7 @@ typedef volatile uint8_t  Reg8;
 typedef volatile uint16_t Reg16;
 typedef volatile void     RegVoid;
 
-ClockState clockStates[2];
-uint8_t clockStateBufferIdx = 0;
+volatile uint16_t clockHigh = 0;
 
 // Contains const information about a hardware timer, like available prescalers.
 class TimerInfo
@@ -99,6 +99,12 @@ static TimerState timerStates[3];
 
 //ISR(TIMER0_COMPA_vect) { timerStates[0].Interrupt(); }
 ISR(TIMER1_COMPA_vect) { timerStates[1].Interrupt(); }
+
+ISR(TIMER1_OVF_vect)
+{
+	HalCycles( 20 );
+	++clockHigh;
+}
 //ISR(TIMER2_COMPA_vect) { timerStates[2].Interrupt(); }
 
 void SetTimerInterrupt( uint8_t timerIdx, MicroSeconds interval, InterruptHandler handler, uint16_t numInterrupts )
@@ -126,13 +132,12 @@ void SetTimerInterrupt( uint8_t timerIdx, MicroSeconds interval, InterruptHandle
 	}
 	if( prescalerIdx == timerInfo.GetNumPrescalers() )
 	{
-		Serial.println( "Timer interval out of range." );
+		LOG( kLogTimerOutOfRange, timerIdx );
 		// Set the maximum interval that we can for this timerIdx
 		prescalerIdx = timerInfo.GetNumPrescalers() - 1;
 		countTarget = timerInfo.GetMaxCount();
 	}
 	const Prescaler& prescaler = timerInfo.GetPrescaler( prescalerIdx );
-	uint8_t clockSelect = prescaler.m_clockSelectBits;
 
 	//Serial.println( 1 << prescaler.m_bitShift );
 	//Serial.println( prescaler.m_clockSelectBits );
@@ -143,7 +148,7 @@ void SetTimerInterrupt( uint8_t timerIdx, MicroSeconds interval, InterruptHandle
 	// Poke the registers
 	if( timerIdx == 0 )
 	{
-		Serial.println( "AAAAAGGHGGHHHH");
+		LOG( kLogTimerShared, timerIdx );
 		TCCR0A = 0;
 		TCCR0B = 0;
 		TCNT0 = 0;
@@ -164,7 +169,7 @@ void SetTimerInterrupt( uint8_t timerIdx, MicroSeconds interval, InterruptHandle
 	}
 	else
 	{
-		Serial.println( "AAAAAGGHGGHHHH");
+		LOG( kLogTimerShared, timerIdx );
 		TCCR2A = 0;
 		TCCR2B = 0;
 		TCNT2 = 0;
@@ -180,13 +185,16 @@ void ConfigureTimer1ForClock()
 {
 	// 16-bit with prescaler of 8
 	// Counter resolution is 0.5us
-	TIMSK1 &= ~(1 << OCIE1A);
+	TIMSK1 &= ~((1 << OCIE1A) | (1 << TOIE1));
 	TCCR1A = 0;
 	//TCCR1B = 0;
 	TCNT1 = 0;
 	OCR1A = 0xffff;
 	TCCR1B = (1 << CS11);// | (1 << WGM12);
 	//TIMSK1 |= (1 << OCIE1A);
+	clockHigh = 0;
+	TIFR1 = (1 << TOV1); // Clear any stale overflow
+	TIMSK1 |= (1 << TOIE1);
 }
 
 void ConfigureTimer2ForPWM( uint8_t dutyCycle )
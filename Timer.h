@@ -2,9 +2,10 @@
 #define TIMER_H
 
 #include <Arduino.h>
+#include "Hal.h"
 
-typedef long MicroSeconds;
-typedef long Ticks;
+typedef int32_t MicroSeconds;
+typedef int32_t Ticks;
 typedef void (*InterruptHandler)();
 
 // Set up a timer to call an interrupt handler at a set interval.
@@ -22,52 +23,64 @@ typedef void (*InterruptHandler)();
 // Also, timer2 is used by the standard function 'tone'.
 void SetTimerInterrupt( uint8_t timerIdx, MicroSeconds interval, InterruptHandler handler, uint16_t numInterrupts = 0 );
 
-// Configures timer1 to operate as a 16-bit clock with resolution 0.5us
+// Configures timer1 to operate as a 16-bit clock with resolution 0.5us,
+// extended to 32 bits by its overflow interrupt.
 void ConfigureTimer1ForClock();
 
 void ConfigureTimer2ForPWM( uint8_t dutyCycle );
 
 // Get the current 0.5us clock value.
-struct ClockState
-{
-	uint16_t prevClock;
-	uint16_t clockHigh;
-	ClockState() : prevClock(0), clockHigh(0) {}
-};
-extern ClockState clockStates[2];
-extern uint8_t clockStateBufferIdx;
-inline Ticks GetClockMain()
-{
-	// Copy the previous ClockState
-	ClockState& clockState = clockStates[ 1 - clockStateBufferIdx ];
-	clockState = clockStates[ clockStateBufferIdx ];
+//
+// The Timer1 overflow interrupt counts the high 16 bits, so the clock stays
+// right however long it goes between reads, as long as interrupts aren't
+// disabled for more than one 32ms wrap.
+// If the counter has wrapped but the interrupt hasn't run yet, because
+// another interrupt is in progress or interrupts are disabled, the pending
+// overflow flag makes up for it. That's only taken to apply if the counter
+// was read in the first half of its range, after the wrap.
+extern volatile uint16_t clockHigh;
 
-	uint16_t clock = TCNT1;
-	if( clockState.prevClock > clock )
+inline Ticks extendClock( uint16_t high, uint16_t clock, bool overflowed )
+{
+	if( overflowed && !(clock & 0x8000) )
 	{
-		// Wrap
-		++clockState.clockHigh;
+		++high;
 	}
-	clockState.prevClock = clock;
-
-	// Flip the buffers so the interrupt handler sees what's
-	// just happened as an atomic operation.
-	clockStateBufferIdx =1 - clockStateBufferIdx;
+	return (((Ticks) high) << 16) | clock;
+}
 
-	return (((Ticks) clockState.clockHigh) << 16) | clock;
+// For the main loop. The high word is read either side of the counter and
+// the overflow flag, seqlock style, and the read is retried if the overflow
+// interrupt ran in between. That also catches a torn read of the high word.
+inline Ticks GetClockMain()
+{
+	uint16_t high;
+	uint16_t clock;
+	bool overflowed;
+	do
+	{
+		HalCycles( 4 );
+		high = clockHigh;
+		HalCycles( 4 );
+		clock = HalReadTimer1();
+		HalCycles( 2 );
+		overflowed = HalTimer1Overflowed();
+		HalCycles( 6 );
+	} while( high != clockHigh );
+	return extendClock( high, clock, overflowed );
 }
 
+// For interrupt handlers, or with interrupts disabled, when the overflow
+// interrupt can't run.
 inline Ticks GetClockInterrupt()
 {
-	const ClockState& clockState = clockStates[ clockStateBufferIdx ];
-	uint16_t clock = TCNT1;
-	uint16_t high = clockState.clockHigh;
-	if( clockState.prevClock > clock )
-	{
-		// Wrap
-		++high;
-	}
-	return (((Ticks) high) << 16) | clock;
+	HalCycles( 8 );
+	uint16_t high = clockHigh;
+	uint16_t clock = HalReadTimer1();
+	HalCycles( 2 );
+	bool overflowed = HalTimer1Overflowed();
+	HalCycles( 2 );
+	return extendClock( high, clock, overflowed );
 }
 
 inline MicroSeconds TicksToMicroSeconds( Ticks ticks ) { return ticks >> 1; }
@@ -0,0 +1,125 @@
+#include "Trace.h"
+#include "Scheduler.h"
+
+#if SLP_TRACE_EVENTS
+
+#if SLP_TRACE_EVENTS & (SLP_TRACE_EVENTS - 1)
+#error SLP_TRACE_EVENTS must be a power of 2
+#endif
+
+struct TraceRecord
+{
+	uint8_t  m_type;
+	uint8_t  m_arg;
+	uint16_t m_time;       // Low 24 bits of the clock
+	uint8_t  m_timeHigh;
+	int16_t  m_value;
+};
+
+static const uint8_t kTraceMask = SLP_TRACE_EVENTS - 1;
+
+// Serial writes are about 60 cycles a byte while there's room in its buffer.
+static const uint16_t kTraceDrainTicks = 100;
+
+static TraceRecord traceRecords[SLP_TRACE_EVENTS];
+static volatile uint8_t traceHead = 0; // Written by the producer
+static volatile uint8_t traceTail = 0; // Written by the consumer
+static uint16_t traceNumDropped = 0;
+static TaskId traceDrainTaskId = kInvalidTaskId;
+
+static bool traceAdd( uint8_t type, uint8_t arg, Ticks time, int32_t value )
+{
+	uint8_t head = traceHead;
+	uint8_t nextHead = (head + 1) & kTraceMask;
+	if( nextHead == traceTail )
+	{
+		return false;
+	}
+	TraceRecord& record = traceRecords[head];
+	record.m_type = type;
+	record.m_arg = arg;
+	record.m_time = (uint16_t) time;
+	record.m_timeHigh = (uint8_t) (time >> 16);
+	record.m_value = (value > 0x7fff) ? 0x7fff : ((value < -0x8000) ? -0x8000 : (int16_t) value);
+	traceHead = nextHead;
+	return true;
+}
+
+void TraceEvent( TraceEventType type, uint8_t arg, Ticks time, int32_t value )
+{
+	HalCycles( 40 );
+	if( traceNumDropped )
+	{
+		// Needs room for the overflow record and this one
+		if( ((traceTail - traceHead - 1) & kTraceMask) < 2 )
+		{
+			if( traceNumDropped != 0xffff )
+			{
+				++traceNumDropped;
+			}
+			return;
+		}
+		traceAdd( kTraceOverflow, 0, time, traceNumDropped );
+		traceNumDropped = 0;
+	}
+	if( !traceAdd( type, arg, time, value ) )
+	{
+		traceNumDropped = 1;
+		return;
+	}
+	if( traceDrainTaskId != kInvalidTaskId )
+	{
+		scheduler.Wake( traceDrainTaskId );
+	}
+}
+
+// Send the oldest record, if Serial can take all of it without blocking.
+static bool traceSendNext( bool block )
+{
+	uint8_t tail = traceTail;
+	if( tail == traceHead )
+	{
+		return false;
+	}
+	if( !block && (Serial.availableForWrite() < kTraceFrameBytes) )
+	{
+		return true;
+	}
+	const TraceRecord& record = traceRecords[tail];
+	uint8_t frame[kTraceFrameBytes];
+	frame[0] = kTraceFrameStart;
+	frame[1] = record.m_type;
+	frame[2] = record.m_arg;
+	frame[3] = (uint8_t) record.m_time;
+	frame[4] = (uint8_t) (record.m_time >> 8);
+	frame[5] = record.m_timeHigh;
+	frame[6] = (uint8_t) record.m_value;
+	frame[7] = (uint8_t) ((uint16_t) record.m_value >> 8);
+	uint8_t check = 0;
+	for( uint8_t i = 1; i < kTraceFrameBytes - 1; ++i )
+	{
+		check ^= frame[i];
+	}
+	frame[kTraceFrameBytes - 1] = check;
+	traceTail = (tail + 1) & kTraceMask;
+	Serial.write( frame, kTraceFrameBytes );
+	return true;
+}
+
+// Stream a frame at a time, until the ring is empty.
+static bool traceDrainTask()
+{
+	return traceSendNext( false ) && (traceTail != traceHead);
+}
+
+void TraceStart()
+{
+	traceDrainTaskId = scheduler.AddTask( traceDrainTask, kTraceDrainTicks, traceTail != traceHead );
+}
+
+void TraceFlush()
+{
+	while( traceSendNext( true ) ) {}
+}
+
+#endif
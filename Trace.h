@@ -0,0 +1,69 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "Config.h"
+#include "Timer.h"
+
+// Binary trace of scan timing events.
+//
+// Recording an event copies a few bytes into a ring in SRAM, so it's cheap
+// enough for the scan path and never blocks. A background task streams the
+// ring out over Serial when there's time between scan-lines, or TraceFlush
+// empties it on request. If the ring fills, events are dropped and counted,
+// and a kTraceOverflow event is recorded once there's room again.
+//
+// The main loop is the only producer. The ring's head is only written by the
+// producer and its tail only by the consumer, so no locking is needed.
+//
+// Each event goes out as a 9 byte frame:
+//   kTraceFrameStart, type, arg, time (3 bytes), value (2 bytes), check
+// Multi-byte fields are little endian, time is the low 24 bits of the Ticks
+// clock (an 8 second wrap), and check is the XOR of the 7 bytes before it.
+// Anything else on the Serial stream is skipped by the decoder,
+// Host/TraceDecode.cpp.
+
+static const uint8_t kTraceFrameStart = 0xa5;
+static const uint8_t kTraceFrameBytes = 9;
+
+enum TraceEventType
+{
+	kTraceSyncEdge,        // arg: TraceEdgeKind, time: edge, value: ticks from the predicted edge
+	kTraceScanStart,       // arg: mirror, time: scheduled start, value: ticks late starting
+	kTraceScanLate,        // arg: mirror, time: scheduled start, value: ticks to the start when skipped
+	kTraceSyncState,       // arg: 1 when synchronised, 0 when not
+	kTracePwm,             // arg: drum PWM compare value
+	kTraceRevolutionLate,  // time: revolution start, value: ticks to it when calculated
+	kTraceOverflow,        // value: number of events dropped before this one
+	kTraceQuality,         // arg: new QualityLevel
+	kTraceButton,          // arg: Button, time: pressed, value: ticks until handled
+	kNumTraceEventTypes
+};
+
+enum TraceEdgeKind
+{
+	kTraceEdgeGood,
+	kTraceEdgeAcquire,     // Starting to track from this edge
+	kTraceEdgeGlitch,      // Early, so ignored
+	kTraceEdgeOutlier,     // Late, outside the gate
+	kTraceEdgeMissed       // Coasted over on the prediction
+};
+
+#if SLP_TRACE_EVENTS
+
+// Register the background task that streams events out.
+void TraceStart();
+
+void TraceEvent( TraceEventType type, uint8_t arg, Ticks time, int32_t value = 0 );
+
+// Send everything in the ring, blocking on Serial.
+void TraceFlush();
+
+#else
+
+inline void TraceStart() {}
+inline void TraceEvent( TraceEventType, uint8_t, Ticks, int32_t = 0 ) {}
+inline void TraceFlush() {}
+
+#endif
+
+#endif
@@ -0,0 +1,411 @@
+#include "Upload.h"
+#include "ScanningLaserProjector.h"
+#include "Scheduler.h"
+#include "Snapshot.h"
+
+#if SLP_SERIAL_UPLOAD
+
+enum UploadState
+{
+	kUploadWaitStart,
+	kUploadWaitType,
+	kUploadWaitLength,
+	kUploadWaitPayload,
+	kUploadWaitCheckLow,
+	kUploadWaitCheckHigh,
+	kUploadWaitApply
+};
+
+static const uint16_t kCanvasBytes = kWidthBytes * kHeight;
+
+// Bytes taken from Serial per call, about 70 cycles each.
+static const uint8_t kUploadBytesPerCall = 8;
+
+// The worst case is applying a kUploadRle packet that expands to
+// kUploadMaxRleBytes, or presenting a frame with CanvasChanged().
+static const Ticks kUploadApplyTicks = 130;
+static const Ticks kUploadEndFrameTicks = 70 + kCanvasChangedTicks;
+
+static TaskId uploadTaskId = kInvalidTaskId;
+static uint8_t uploadState = kUploadWaitStart;
+static uint8_t uploadType;
+static uint8_t uploadLength;
+static uint8_t uploadNumReceived;
+static uint16_t uploadReceivedCheck;
+static UploadCheck uploadCheck;
+static uint8_t uploadPayload[kUploadMaxPayload];
+
+static bool uploadNeedKeyFrame = true;
+static bool uploadSkippingFrame = true;
+static bool uploadPresentDeferred = false;
+
+// Statistics
+static uint16_t uploadNumFrames = 0;
+static uint16_t uploadNumSkippedFrames = 0;
+static uint16_t uploadNumBadPackets = 0;
+static uint16_t uploadNumHeldPackets = 0;
+static uint16_t uploadNumReplacedFrames = 0;
+static uint16_t uploadFrameBytes = 0;
+static uint16_t uploadFrameTicks = 0;
+static uint32_t uploadTotalBytes = 0;
+static uint32_t uploadTotalTicks = 0;
+static uint16_t uploadMaxFrameBytes = 0;
+static uint16_t uploadMaxFrameTicks = 0;
+
+static uint16_t readOffset( const uint8_t* pPayload )
+{
+	return pPayload[0] | ((uint16_t) pPayload[1] << 8);
+}
+
+static bool applyRaw()
+{
+	if( uploadLength < 2 )
+	{
+		return false;
+	}
+	uint16_t offset = readOffset( uploadPayload );
+	uint8_t numBytes = uploadLength - 2;
+	if( (offset + numBytes) > kCanvasBytes )
+	{
+		return false;
+	}
+	HalCycles( 20 + (4 * numBytes) );
+	memcpy( gfx.getBuffer() + offset, uploadPayload + 2, numBytes );
+	gfx.MarkDirtyBytes( offset, numBytes );
+	return true;
+}
+
+static bool applyRect()
+{
+	if( uploadLength < 4 )
+	{
+		return false;
+	}
+	uint8_t x = uploadPayload[0];
+	uint8_t y = uploadPayload[1];
+	uint8_t width = uploadPayload[2];
+	uint8_t height = uploadPayload[3];
+	if( ((x + width) > kWidthBytes) || ((y + height) > kHeight) || ((width * height) != (uploadLength - 4)) )
+	{
+		return false;
+	}
+	HalCycles( 20 + (10 * height) + (4 * width * height) );
+	uint8_t* pDst = gfx.getBuffer() + (y * kWidthBytes) + x;
+	const uint8_t* pSrc = uploadPayload + 4;
+	for( uint8_t row = 0; row < height; ++row )
+	{
+		memcpy( pDst, pSrc, width );
+		pDst += kWidthBytes;
+		pSrc += width;
+	}
+	if( width )
+	{
+		gfx.MarkDirtyRect( x, x + width - 1, y, height );
+	}
+	return true;
+}
+
+static bool applyRle()
+{
+	if( uploadLength < 2 )
+	{
+		return false;
+	}
+	uint16_t start = readOffset( uploadPayload );
+	uint16_t offset = start;
+	uint16_t end = offset + kUploadMaxRleBytes;
+	if( end > kCanvasBytes )
+	{
+		end = kCanvasBytes;
+	}
+	uint8_t* pCanvas = gfx.getBuffer();
+	const uint8_t* pSrc = uploadPayload + 2;
+	const uint8_t* pSrcEnd = uploadPayload + uploadLength;
+	while( pSrc < pSrcEnd )
+	{
+		uint8_t control = *pSrc++;
+		if( control < 0x80 )
+		{
+			uint8_t numBytes = control + 1;
+			if( ((pSrcEnd - pSrc) < numBytes) || ((offset + numBytes) > end) )
+			{
+				return false;
+			}
+			HalCycles( 10 + (4 * numBytes) );
+			memcpy( pCanvas + offset, pSrc, numBytes );
+			pSrc += numBytes;
+			offset += numBytes;
+		}
+		else
+		{
+			uint8_t numBytes = control - kUploadRunBase;
+			if( (pSrc == pSrcEnd) || ((offset + numBytes) > end) )
+			{
+				return false;
+			}
+			HalCycles( 10 + (3 * numBytes) );
+			memset( pCanvas + offset, *pSrc++, numBytes );
+			offset += numBytes;
+		}
+	}
+	gfx.MarkDirtyBytes( start, offset - start );
+	return true;
+}
+
+static void endFrame()
+{
+	uploadTotalBytes += uploadFrameBytes;
+	uploadTotalTicks += uploadFrameTicks;
+	if( uploadFrameBytes > uploadMaxFrameBytes )
+	{
+		uploadMaxFrameBytes = uploadFrameBytes;
+	}
+	if( uploadFrameTicks > uploadMaxFrameTicks )
+	{
+		uploadMaxFrameTicks = uploadFrameTicks;
+	}
+	++uploadNumFrames;
+	// Presenting again before the last frame has been swapped in could show
+	// parts of both, so until it has, the frame is left for uploadTask. If
+	// the next one ends first, it replaces this one, as the canvas already
+	// holds both.
+	if( uploadPresentDeferred && (uploadNumReplacedFrames != 0xffff) )
+	{
+		++uploadNumReplacedFrames;
+	}
+	uploadPresentDeferred = IsPresentPending();
+	if( !uploadPresentDeferred )
+	{
+		CanvasChanged();
+	}
+}
+
+// Apply a packet that has passed its check.
+static bool applyPacket()
+{
+	HalCycles( 20 );
+	switch( uploadType )
+	{
+	case kUploadBeginFrame:
+		if( uploadLength != 2 )
+		{
+			return false;
+		}
+		if( uploadPayload[1] & kUploadKeyFrame )
+		{
+			uploadNeedKeyFrame = false;
+		}
+		uploadSkippingFrame = uploadNeedKeyFrame;
+		return true;
+	case kUploadRaw:
+		return uploadSkippingFrame || applyRaw();
+	case kUploadRect:
+		return uploadSkippingFrame || applyRect();
+	case kUploadRle:
+		return uploadSkippingFrame || applyRle();
+	case kUploadEndFrame:
+		if( uploadSkippingFrame )
+		{
+			++uploadNumSkippedFrames;
+		}
+		else
+		{
+			endFrame();
+		}
+		// Wait for the next kUploadBeginFrame
+		uploadSkippingFrame = true;
+		uploadFrameBytes = 0;
+		uploadFrameTicks = 0;
+		return true;
+	case kUploadSnapshot:
+		SnapshotRequest();
+		return true;
+	}
+	return false;
+}
+
+// Packets that change the canvas wait while the scan buffer is still
+// rebuilding scan-lines from it for the last frame, or those lines would show
+// parts of both. That's a few scan-lines at most, which Serial's buffer
+// covers.
+static bool isApplyHeld()
+{
+	HalCycles( 10 );
+	switch( uploadType )
+	{
+	case kUploadRaw:
+	case kUploadRect:
+	case kUploadRle:
+		return !uploadSkippingFrame && IsCanvasBusy();
+	}
+	return false;
+}
+
+// A deferred frame can be presented once the one before has been swapped
+// in, as long as the next hasn't started changing the canvas.
+static bool isDeferredPresentDue()
+{
+	return uploadPresentDeferred && uploadSkippingFrame && !IsPresentPending();
+}
+
+static void badPacket()
+{
+	if( uploadNumBadPackets != 0xffff )
+	{
+		++uploadNumBadPackets;
+	}
+	// Whatever it was meant to change is now out of date, and the canvas may
+	// hold part of it, so there's nothing to present until the key frame.
+	uploadNeedKeyFrame = true;
+	uploadSkippingFrame = true;
+	uploadPresentDeferred = false;
+}
+
+// Take a byte from Serial. Returns true once a whole packet has arrived.
+static bool receiveByte( uint8_t byte )
+{
+	HalCycles( 15 );
+	++uploadFrameBytes;
+	switch( uploadState )
+	{
+	case kUploadWaitStart:
+		if( byte == kUploadPacketStart )
+		{
+			uploadCheck = UploadCheck();
+			uploadState = kUploadWaitType;
+		}
+		break;
+	case kUploadWaitType:
+		uploadType = byte;
+		uploadCheck.Add( byte );
+		uploadState = kUploadWaitLength;
+		break;
+	case kUploadWaitLength:
+		uploadLength = byte;
+		uploadNumReceived = 0;
+		uploadCheck.Add( byte );
+		if( (uploadType >= kNumUploadPacketTypes) || (byte > kUploadMaxPayload) )
+		{
+			badPacket();
+			uploadState = kUploadWaitStart;
+		}
+		else
+		{
+			uploadState = byte ? kUploadWaitPayload : kUploadWaitCheckLow;
+		}
+		break;
+	case kUploadWaitPayload:
+		uploadPayload[uploadNumReceived] = byte;
+		uploadCheck.Add( byte );
+		if( ++uploadNumReceived == uploadLength )
+		{
+			uploadState = kUploadWaitCheckLow;
+		}
+		break;
+	case kUploadWaitCheckLow:
+		uploadReceivedCheck = byte;
+		uploadState = kUploadWaitCheckHigh;
+		break;
+	case kUploadWaitCheckHigh:
+		uploadReceivedCheck |= (uint16_t) byte << 8;
+		if( uploadReceivedCheck == uploadCheck.Get() )
+		{
+			uploadState = kUploadWaitApply;
+			return true;
+		}
+		badPacket();
+		uploadState = kUploadWaitStart;
+		break;
+	}
+	return false;
+}
+
+// Receive a few bytes, apply the packet they complete, or present a deferred
+// frame. Each is left to its own call so that any fits in the task's worst
+// case. A held packet leaves the task asleep until UploadPoll finds the
+// scan buffer done with the canvas.
+static bool uploadTask()
+{
+	Ticks start = GetClockMain();
+	if( isDeferredPresentDue() )
+	{
+		uploadPresentDeferred = false;
+		CanvasChanged();
+	}
+	else if( uploadState == kUploadWaitApply )
+	{
+		if( isApplyHeld() )
+		{
+			if( uploadNumHeldPackets != 0xffff )
+			{
+				++uploadNumHeldPackets;
+			}
+			return false;
+		}
+		if( !applyPacket() )
+		{
+			badPacket();
+		}
+		uploadState = kUploadWaitStart;
+	}
+	else
+	{
+		for( uint8_t i = 0; (i < kUploadBytesPerCall) && Serial.available(); ++i )
+		{
+			if( receiveByte( (uint8_t) Serial.read() ) )
+			{
+				break;
+			}
+		}
+	}
+	Ticks duration = GetClockMain() - start;
+	uploadFrameTicks = ((uploadFrameTicks + duration) > 0xffff) ? 0xffff : (uint16_t) (uploadFrameTicks + duration);
+	return isDeferredPresentDue() || (uploadState == kUploadWaitApply) || Serial.available();
+}
+
+void UploadStart()
+{
+	Ticks worstCaseTicks = (kUploadEndFrameTicks > kUploadApplyTicks) ? kUploadEndFrameTicks : kUploadApplyTicks;
+	uploadTaskId = scheduler.AddTask( uploadTask, worstCaseTicks );
+}
+
+void UploadPoll()
+{
+	HalCycles( 10 );
+	if( isDeferredPresentDue() || ((uploadState == kUploadWaitApply) ? !isApplyHeld() : Serial.available()) )
+	{
+		scheduler.Wake( uploadTaskId );
+	}
+}
+
+void UploadPrintReport()
+{
+	// Frames, skipped, replaced before they were shown, bad and held
+	// packets, then bytes and decode ticks per frame,
+	// and the frame rate that 115200 baud could carry at the average size.
+	uint16_t numFrames = uploadNumFrames ? uploadNumFrames : 1;
+	uint16_t averageBytes = (uint16_t) (uploadTotalBytes / numFrames);
+	Serial.print( F( "Upload: " ) );
+	Serial.print( uploadNumFrames );
+	Serial.print( F( " frames, " ) );
+	Serial.print( uploadNumSkippedFrames );
+	Serial.print( F( " skipped, " ) );
+	Serial.print( uploadNumReplacedFrames );
+	Serial.print( F( " replaced, " ) );
+	Serial.print( uploadNumBadPackets );
+	Serial.print( F( " bad packets, " ) );
+	Serial.print( uploadNumHeldPackets );
+	Serial.print( F( " held, " ) );
+	Serial.print( averageBytes );
+	Serial.print( F( "/" ) );
+	Serial.print( uploadMaxFrameBytes );
+	Serial.print( F( " bytes, " ) );
+	Serial.print( (uint16_t) (uploadTotalTicks / numFrames) );
+	Serial.print( F( "/" ) );
+	Serial.print( uploadMaxFrameTicks );
+	Serial.print( F( " decode ticks, " ) );
+	Serial.print( averageBytes ? (11520 / averageBytes) : 0 );
+	Serial.println( F( " fps at 115200" ) );
+}
+
+#endif
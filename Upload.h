@@ -0,0 +1,91 @@
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include "Config.h"
+#include "Geometry.h"
+
+// Framebuffer upload over Serial, so a host can stream frames to the canvas.
+//
+// The host sends each frame as a kUploadBeginFrame packet, packets that
+// change the canvas, then kUploadEndFrame, which makes the frame visible with
+// CanvasChanged(). If the frame before is still waiting to be swapped in,
+// that's put off until it has been, and should the next frame end first, it
+// replaces this one. The encoder, Host/FrameEncode.cpp, picks whichever
+// encoding is smallest for each frame.
+//
+// Each packet is
+//   kUploadPacketStart, type, length, payload (length bytes), check (2 bytes)
+// where check is the Fletcher-16 of type, length and payload, low byte first.
+// Canvas offsets are in bytes of the GFXcanvas1 buffer, kWidthBytes per row,
+// little endian.
+//
+// Packets are decoded a few bytes at a time by a background task, and only
+// applied to the canvas once their check has passed. If a packet is lost or
+// corrupt, delta frames are ignored until the next key frame.
+
+static const uint8_t kUploadPacketStart = 0x5a;
+static const uint8_t kUploadMaxPayload = 64;
+
+// Most canvas bytes that a single kUploadRle packet may expand to, which
+// bounds the time taken to apply it.
+static const uint8_t kUploadMaxRleBytes = 128;
+
+enum UploadPacketType
+{
+	kUploadBeginFrame,  // frame number, UploadFrameFlags
+	kUploadRaw,         // offset (2 bytes), canvas bytes
+	kUploadRect,        // x in bytes, y, width in bytes, height, then the rect's bytes row by row
+	kUploadRle,         // offset (2 bytes), PackBits runs (see below)
+	kUploadEndFrame,    // frame number
+	kUploadSnapshot,    // no payload; send a snapshot of the canvas back (see Snapshot.h)
+	kNumUploadPacketTypes
+};
+
+enum UploadFrameFlags
+{
+	kUploadKeyFrame = 1 // Sets every byte of the canvas, so needs no previous frame
+};
+
+// PackBits: a control byte n < 0x80 is followed by n + 1 literal bytes;
+// n >= 0x80 is followed by one byte to repeat n - 0x7e times (2 to 129).
+static const uint8_t kUploadRunBase = 0x7e;
+
+// Fletcher-16, as used for the packet check.
+struct UploadCheck
+{
+	UploadCheck() : m_sum1( 0 ), m_sum2( 0 ) {}
+	void Add( uint8_t byte )
+	{
+		m_sum1 = mod255( m_sum1 + byte );
+		m_sum2 = mod255( m_sum2 + m_sum1 );
+	}
+	uint16_t Get() const { return (uint16_t) ((m_sum2 << 8) | m_sum1); }
+
+	// No division on the AVR
+	static uint8_t mod255( uint16_t sum ) { return (uint8_t) ((sum >= 255) ? (sum - 255) : sum); }
+
+	uint8_t m_sum1;
+	uint8_t m_sum2;
+};
+
+#if SLP_SERIAL_UPLOAD
+
+// Register the background task that decodes uploads.
+void UploadStart();
+
+// Wake the decoder if Serial has received anything. Cheap enough to call
+// every Update.
+void UploadPoll();
+
+// Print upload statistics to Serial.
+void UploadPrintReport();
+
+#else
+
+inline void UploadStart() {}
+inline void UploadPoll() {}
+inline void UploadPrintReport() {}
+
+#endif
+
+#endif